@@ -5,6 +5,9 @@
 
 #< envPaths
 
+## PREVIEW_IMAGE is up to 512x512 32-bit counts
+epicsEnvSet("EPICS_CA_MAX_ARRAY_BYTES", "1100000")
+
 ## Register all support components
 dbLoadDatabase "../../dbd/tpx3serval.dbd"
 tpx3serval_registerRecordDeviceDriver(pdbbase) 
@@ -15,7 +18,16 @@ dbLoadRecords("../../db/tpx3serval.db","P=TPX3-TEST:,R=Serval:,PORT=TPX3_PORT,AD
 ## Configure the TPX3 serval driver
 tpx3servalConfigure("TPX3_PORT", 1)
 
+## A second detector: its own port, PV prefix and Serval
+#dbLoadRecords("../../db/tpx3serval.db","P=TPX3-TEST2:,R=Serval:,PORT=TPX3_PORT2,ADDR=0,TIMEOUT=1.0")
+#tpx3servalConfigure("TPX3_PORT2", 1)
+
 iocInit()
 
+## Ports and placement of the second detector must not clash with the first
+#dbpf("TPX3-TEST2:Serval:HTTP_PORT", "8083")
+#dbpf("TPX3-TEST2:Serval:STANDBY_HTTP_PORT", "8084")
+#dbpf("TPX3-TEST2:Serval:STREAM_PORT", "8093")
+
 ## Start any sequence programs
 #seq snctpx3serval,"user=kg1"
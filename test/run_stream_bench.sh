@@ -0,0 +1,103 @@
+#!/bin/bash
+
+# Benchmark of the raw stream ingest paths (STREAM_* PVs) on synthetic data.
+# Runs tpx3StreamBench and writes its JSON report. It fails when an analysis
+# consumer's output does not match the generated data, and, with a baseline
+# report from an earlier release, when a stage got slower.
+#
+#   ./run_stream_bench.sh                      # writes stream_bench.json
+#   ./run_stream_bench.sh baseline.json        # ... and compares against it
+#
+# OUT names the report, TOLERANCE the allowed slowdown in percent (default 20)
+# and BENCH_ARGS is passed on to tpx3StreamBench (e.g. "--rate 40e6 --workers 4").
+# If the IOC is running, the generator is also pointed at its STREAM_PORT.
+
+P=${P:-TPX3-TEST:Serval:}
+OUT=${OUT:-stream_bench.json}
+TOLERANCE=${TOLERANCE:-20}
+BASELINE=$1
+DIR="$(cd "$(dirname "$0")" && pwd)"
+BIN="$DIR/../bin/${EPICS_HOST_ARCH:-linux-x86_64}"
+FAILED=0
+
+echo "=== Stream Ingest Benchmark ==="
+echo ""
+
+if [ ! -x "$BIN/tpx3StreamBench" ]; then
+    echo "❌ $BIN/tpx3StreamBench not found - build the IOC first"
+    exit 1
+fi
+
+echo "1. Running tpx3StreamBench $BENCH_ARGS..."
+if ! "$BIN/tpx3StreamBench" $BENCH_ARGS --output "$OUT"; then
+    echo "   ✗ benchmark failed"
+    FAILED=1
+fi
+python3 - "$OUT" <<'EOF' || FAILED=1
+import json, sys
+report = json.load(open(sys.argv[1]))
+failed = False
+for c in report.get("checks", []):
+    failed |= not c["ok"]
+    print("   %s %-22s expected %d, got %d" % ("✓" if c["ok"] else "✗", c["name"], c["expected"], c["actual"]))
+for r in report["results"]:
+    line = "   %-20s %8.1f MB/s %8.2f Mpkt/s" % (r["name"], r["bytes_per_s"] / 1e6, r["packets_per_s"] / 1e6)
+    if "latency_us" in r:
+        line += "  latency p50 %.0f us p99 %.0f us" % (r["latency_us"]["p50"], r["latency_us"]["p99"])
+    print(line)
+sys.exit(1 if failed else 0)
+EOF
+echo "   Report written to $OUT"
+
+if [ -n "$BASELINE" ]; then
+    echo ""
+    echo "2. Comparing against $BASELINE (tolerance $TOLERANCE%)..."
+    python3 - "$BASELINE" "$OUT" "$TOLERANCE" <<'EOF' || FAILED=1
+import json, sys
+base = {r["name"]: r for r in json.load(open(sys.argv[1]))["results"]}
+new = {r["name"]: r for r in json.load(open(sys.argv[2]))["results"]}
+tolerance = float(sys.argv[3]) / 100.0
+failed = False
+for name, r in new.items():
+    if name not in base:
+        continue
+    old = base[name]["packets_per_s"]
+    change = (r["packets_per_s"] - old) / old if old else 0.0
+    ok = change >= -tolerance
+    failed |= not ok
+    print("   %s %-20s %+6.1f%% packets/s" % ("✓" if ok else "✗", name, change * 100.0))
+    if "latency_us" in r and "latency_us" in base[name]:
+        old = base[name]["latency_us"]["p99"]
+        change = (r["latency_us"]["p99"] - old) / old if old else 0.0
+        ok = change <= tolerance
+        failed |= not ok
+        print("   %s %-20s %+6.1f%% p99 latency" % ("✓" if ok else "✗", name, change * 100.0))
+sys.exit(1 if failed else 0)
+EOF
+fi
+
+echo ""
+echo "3. Checking if IOC is running..."
+if caget -t ${P}STREAM_PORT > /dev/null 2>&1; then
+    STREAM_PORT=$(caget -t ${P}STREAM_PORT)
+    caput -t ${P}STREAM_SOURCE 0 > /dev/null
+    caput -t ${P}STREAM_ENABLE 1 > /dev/null
+    sleep 1
+    "$BIN/tpx3StreamGen" --connect localhost:$STREAM_PORT --rate 10e6 --duration 3 --realtime &
+    GEN_PID=$!
+    sleep 2
+    echo "   IOC STREAM_HIT_RATE: $(caget -t ${P}STREAM_HIT_RATE) (expected ~10e6)"
+    echo "   IOC STREAM_MIN_FREE_BLOCKS: $(caget -t ${P}STREAM_MIN_FREE_BLOCKS)"
+    wait $GEN_PID
+    caput -t ${P}STREAM_ENABLE 0 > /dev/null
+else
+    echo "   IOC not running - skipping IOC stream test"
+fi
+
+echo ""
+if [ $FAILED -eq 0 ]; then
+    echo "🎉 Stream benchmark completed successfully!"
+else
+    echo "❌ Stream benchmark found regressions or failures"
+fi
+exit $FAILED
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Stub of Serval's REST API for testing the IOC without Serval or a detector.
+
+Accepts the same command line as Serval (unknown options such as -jar or
+--spidrNet are ignored), so it can be run directly:
+
+    ./serval_stub.py --httpPort=18081
+
+or launched by the IOC through the java shim in test/stub_java/.
+
+Endpoints:
+    /dashboard         Server, Detector and Measurement status (FrameCount grows)
+    /detector/health   Temperatures and humidity
+    /stub/stats        Connections and requests seen by the stub
+    /stub/close        Like /stub/stats, then closes the connection without
+                       announcing it, as a server dropping an idle keep-alive
+
+Stub options (environment variables, since the IOC builds the command line):
+    SERVAL_STUB_STARTUP_DELAY  seconds to wait before listening (default 0)
+    SERVAL_STUB_NO_DETECTOR    set to report no connected detector
+    SERVAL_STUB_NOTIFICATION   message to report in Server.Notifications
+"""
+
+import http.server
+import json
+import os
+import socketserver
+import sys
+import threading
+import time
+
+stats = {"connections": 0, "requests": 0}
+stats_lock = threading.Lock()
+start_time = time.time()
+
+
+def dashboard():
+    elapsed = time.time() - start_time
+    notification = os.environ.get("SERVAL_STUB_NOTIFICATION")
+    detector = None
+    if not os.environ.get("SERVAL_STUB_NO_DETECTOR"):
+        detector = {"DetectorType": "Tpx3", "NumberOfChips": 4, "DetectorOrientation": "UP"}
+    return {
+        "Server": {
+            "SoftwareVersion": "3.3.2-stub",
+            "SoftwareTimestamp": "2024/01/01 00:00",
+            "Notifications": [{"Message": notification, "Type": "ERROR"}] if notification else [],
+        },
+        "Detector": detector,
+        "Measurement": {
+            "Status": "DA_RECORDING" if detector else "DA_IDLE",
+            "FrameCount": int(elapsed * 10),
+            "DroppedFrames": 0,
+            "PixelEventRate": 1250000,
+            "Tdc1EventRate": 1000,
+            "ElapsedTime": round(elapsed, 3),
+            "TimeLeft": 0.0,
+        },
+    }
+
+
+def health():
+    return {"LocalTemperature": 35.5, "FPGATemperature": 52.25, "Humidity": 12.0,
+            "ChipTemperatures": [40, 41, 42, 43]}
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # keep-alive
+
+    def setup(self):
+        super().setup()
+        with stats_lock:
+            stats["connections"] += 1
+
+    def do_GET(self):
+        with stats_lock:
+            stats["requests"] += 1
+            snapshot = dict(stats)
+        routes = {"/dashboard": dashboard, "/detector/health": health, "/stub/stats": lambda: snapshot,
+                  "/stub/close": lambda: snapshot}
+        if self.path not in routes:
+            self.send_error(404)
+            return
+        body = json.dumps(routes[self.path]()).encode()
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+        if self.path == "/stub/close":
+            self.close_connection = True
+
+    def log_message(self, fmt, *args):
+        pass
+
+
+class Server(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+
+def main():
+    port = 8080
+    for arg in sys.argv[1:]:
+        if arg.startswith("--httpPort="):
+            port = int(arg.split("=", 1)[1])
+    time.sleep(float(os.environ.get("SERVAL_STUB_STARTUP_DELAY", "0")))
+    server = Server(("localhost", port), Handler)
+    print("serval_stub listening on port %d" % port, flush=True)
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
@@ -69,6 +69,14 @@ echo "Set CORRECTION_HANDLERS_ENABLE=1, CORRECTION_HANDLERS=4"
 echo "Command should include: --ringBufferSize=65536 --correctionHandlers=4"
 echo ""
 
+# Test 11: Test JVM performance options
+echo "Test 11: Test JVM performance options"
+echo "Set JVM_XMS_ENABLE=1, JVM_XMS=8192, JVM_XMX_ENABLE=1, JVM_XMX=8192"
+echo "Set JVM_GC_ENABLE=1, JVM_GC=G1, JVM_PRETOUCH=1"
+echo "Command should include before -jar: -Xms8192m -Xmx8192m -XX:+UseG1GC -XX:+AlwaysPreTouch"
+echo "Setting JVM_XMX=1024 and START=1 should be rejected in ERROR_MSG (JVM_XMS larger than JVM_XMX)"
+echo ""
+
 echo "To test these scenarios:"
 echo "1. Start the IOC"
 echo "2. Use caput to set the _ENABLE PVs to 1 (enabled) or 0 (disabled)"
@@ -0,0 +1,107 @@
+#!/bin/bash
+
+# Test script for the Serval REST API client (SERVAL_*, MEAS_*, HTTP_* PVs)
+# Uses serval_stub.py instead of Serval, so no detector or Serval jar is needed.
+#
+# Without an IOC the script checks the stub and runs tpx3HttpClientTest, which
+# drives the driver's REST client against the stub. To test the IOC, start it
+# with the java shim first in PATH so START launches the stub:
+#   PATH="$(pwd)/test/stub_java:$PATH" ./runServal.sh
+
+P=${P:-TPX3-TEST:Serval:}
+PORT=${PORT:-18081}
+DIR="$(cd "$(dirname "$0")" && pwd)"
+BIN="$DIR/../bin/${EPICS_HOST_ARCH:-linux-x86_64}"
+FAILED=0
+
+check() {
+    if [ "$2" = "$3" ]; then
+        echo "   ✓ $1 = $2"
+    else
+        echo "   ✗ $1 = '$2' (expected '$3')"
+        FAILED=1
+    fi
+}
+
+echo "=== Serval HTTP Client Test Script ==="
+echo ""
+
+echo "1. Checking the Serval stub on port $PORT..."
+"$DIR/serval_stub.py" --httpPort=$PORT > /dev/null &
+STUB_PID=$!
+sleep 1
+check "stub /dashboard version" "$(curl -s localhost:$PORT/dashboard | python3 -c 'import json,sys; print(json.load(sys.stdin)["Server"]["SoftwareVersion"])')" "3.3.2-stub"
+
+echo ""
+echo "2. Running tpx3HttpClientTest against the stub..."
+if [ ! -x "$BIN/tpx3HttpClientTest" ]; then
+    echo "   ✗ $BIN/tpx3HttpClientTest not found - build the IOC first"
+    FAILED=1
+elif ! "$BIN/tpx3HttpClientTest" --port $PORT; then
+    echo "   ✗ tpx3HttpClientTest failed"
+    FAILED=1
+else
+    echo "   ✓ tpx3HttpClientTest passed"
+fi
+kill $STUB_PID 2>/dev/null
+wait $STUB_PID 2>/dev/null
+
+echo ""
+echo "3. Checking if IOC is running..."
+if ! caget -t ${P}STATUS > /dev/null 2>&1; then
+    echo "   IOC not running - skipping IOC tests"
+    exit $FAILED
+fi
+echo "   ✓ IOC is running"
+
+echo ""
+echo "4. Starting the stub through the IOC..."
+caput ${P}HTTP_PORT $PORT > /dev/null
+caput ${P}HTTP_PORT_ENABLE 1 > /dev/null
+caput ${P}HTTP_POLL_PERIOD 0.5 > /dev/null
+caput ${P}START 1 > /dev/null
+# Wait on READY instead of a fixed sleep
+for i in $(seq 1 300); do
+    [ "$(caget -t ${P}READY)" = "Ready" ] && break
+    sleep 0.1
+done
+sleep 2
+
+echo ""
+echo "5. Checking readiness..."
+check "READY" "$(caget -t ${P}READY)" "Ready"
+check "LIFECYCLE_STATE" "$(caget -t ${P}LIFECYCLE_STATE)" "Ready"
+echo "   START_TO_LISTEN_MS = $(caget -t ${P}START_TO_LISTEN_MS)"
+echo "   START_TO_READY_MS = $(caget -t ${P}START_TO_READY_MS)"
+
+echo ""
+echo "6. Checking polled status PVs..."
+check "SERVAL_CONNECTED" "$(caget -t ${P}SERVAL_CONNECTED)" "Connected"
+check "SERVAL_VERSION" "$(caget -t -S ${P}SERVAL_VERSION)" "3.3.2-stub"
+check "DETECTOR_CONNECTED" "$(caget -t ${P}DETECTOR_CONNECTED)" "Connected"
+check "DETECTOR_TYPE" "$(caget -t -S ${P}DETECTOR_TYPE)" "Tpx3"
+check "MEAS_STATUS" "$(caget -t -S ${P}MEAS_STATUS)" "DA_RECORDING"
+check "MEAS_PIXEL_RATE" "$(caget -t ${P}MEAS_PIXEL_RATE)" "1.25e+06"
+echo "   MEAS_FRAME_COUNT = $(caget -t ${P}MEAS_FRAME_COUNT)"
+echo "   HTTP_LATENCY_MS = $(caget -t ${P}HTTP_LATENCY_MS)"
+echo "   HTTP_LATENCY_HIST = $(caget -t ${P}HTTP_LATENCY_HIST)"
+
+echo ""
+echo "7. Checking keep-alive (one connection for all requests)..."
+check "HTTP_CONNECTS" "$(caget -t ${P}HTTP_CONNECTS)" "1"
+check "stub connections" "$(curl -s localhost:$PORT/stub/stats | python3 -c 'import json,sys; print(json.load(sys.stdin)["connections"] - 1)')" "1"
+
+echo ""
+echo "8. Stopping the stub..."
+caput ${P}START 0 > /dev/null
+sleep 2
+check "SERVAL_CONNECTED" "$(caget -t ${P}SERVAL_CONNECTED)" "Disconnected"
+check "READY" "$(caget -t ${P}READY)" "Not Ready"
+
+echo ""
+if [ $FAILED -eq 0 ]; then
+    echo "✅ HTTP client test passed"
+else
+    echo "❌ HTTP client test failed"
+fi
+exit $FAILED
@@ -0,0 +1,266 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tpx3Autotune.h"
+
+// Relative differences below these are taken as measurement noise
+#define TUNE_RATE_MARGIN 0.02
+#define TUNE_CPU_MARGIN  0.05
+
+static const char *paramNames[TPX3_TUNE_PARAMS] = {
+    "UDP_RECEIVERS", "FRAME_ASSEMBLERS", "RING_BUFFER_SIZE",
+    "NETWORK_BUFFER_SIZE", "CORRECTION_HANDLERS", "PROCESSING_HANDLERS"
+};
+
+tpx3Autotuner::tpx3Autotuner()
+    : passes_(1), pass_(0), param_(0), candidate_(0), started_(false), improved_(false), done_(0), planned_(0)
+{
+    memset(&best_, 0, sizeof(best_));
+    memset(&current_, 0, sizeof(current_));
+    memset(&bestScore_, 0, sizeof(bestScore_));
+}
+
+const char *tpx3Autotuner::paramName(int param)
+{
+    return param >= 0 && param < TPX3_TUNE_PARAMS ? paramNames[param] : "";
+}
+
+bool tpx3Autotuner::parseCandidates(const std::string &text, std::vector<int> *out, std::string *error)
+{
+    out->clear();
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find(',', pos);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string item = text.substr(pos, end - pos);
+        size_t first = item.find_first_not_of(" \t");
+        size_t last = item.find_last_not_of(" \t");
+        if (first == std::string::npos) {
+            *error = "empty value in \"" + text + "\"";
+            return false;
+        }
+        item = item.substr(first, last - first + 1);
+        char *tail = NULL;
+        errno = 0;
+        long value = strtol(item.c_str(), &tail, 10);
+        if (*tail != '\0' || errno != 0 || value < 0 || value > 0x7FFFFFFF) {
+            *error = "\"" + item + "\" is not a count or size";
+            return false;
+        }
+        out->push_back((int)value);
+        pos = end + 1;
+    }
+    return true;
+}
+
+void tpx3Autotuner::begin(const tpx3TuneProfile &start, const std::vector<int> candidates[TPX3_TUNE_PARAMS],
+                          int passes)
+{
+    best_ = start;
+    current_ = start;
+    memset(&bestScore_, 0, sizeof(bestScore_));
+    measured_.clear();
+    passes_ = passes > 0 ? passes : 1;
+    pass_ = 0;
+    param_ = 0;
+    candidate_ = 0;
+    started_ = false;
+    improved_ = false;
+    done_ = 0;
+    planned_ = 1;
+    for (int p = 0; p < TPX3_TUNE_PARAMS; p++) {
+        candidates_[p] = candidates[p];
+        planned_ += (int)candidates_[p].size() * passes_;
+    }
+}
+
+bool tpx3Autotuner::wasMeasured(const tpx3TuneProfile &profile) const
+{
+    for (size_t i = 0; i < measured_.size(); i++) {
+        if (memcmp(measured_[i].values, profile.values, sizeof(profile.values)) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool tpx3Autotuner::next(tpx3TuneProfile *trial)
+{
+    if (!started_) {
+        started_ = true;
+        current_ = best_;
+        *trial = current_;
+        return true;
+    }
+    while (pass_ < passes_) {
+        while (param_ < TPX3_TUNE_PARAMS) {
+            while (candidate_ < candidates_[param_].size()) {
+                tpx3TuneProfile t = best_;
+                t.values[param_] = candidates_[param_][candidate_++];
+                if (!wasMeasured(t)) {
+                    current_ = t;
+                    *trial = t;
+                    return true;
+                }
+            }
+            param_++;
+            candidate_ = 0;
+        }
+        pass_++;
+        param_ = 0;
+        if (!improved_) {
+            break;
+        }
+        improved_ = false;
+    }
+    return false;
+}
+
+void tpx3Autotuner::report(const tpx3TuneScore &score)
+{
+    bool baseline = measured_.empty();
+    measured_.push_back(current_);
+    done_++;
+    if (better(score, bestScore_)) {
+        best_ = current_;
+        bestScore_ = score;
+        // The starting profile winning over nothing is not an improvement
+        if (!baseline) {
+            improved_ = true;
+        }
+    }
+}
+
+bool tpx3Autotuner::better(const tpx3TuneScore &a, const tpx3TuneScore &b)
+{
+    if (a.valid != b.valid) {
+        return a.valid;
+    }
+    if (!a.valid) {
+        return false;
+    }
+    // Any loss outweighs throughput and CPU; among lossy profiles, a clear
+    // reduction counts
+    if ((a.dropRate > 0.0) != (b.dropRate > 0.0)) {
+        return a.dropRate == 0.0;
+    }
+    if (a.dropRate > 0.0) {
+        if (a.dropRate * 2.0 < b.dropRate) {
+            return true;
+        }
+        if (b.dropRate * 2.0 < a.dropRate) {
+            return false;
+        }
+    }
+    // Without loss, the pixel rate is the offered load and ties; CPU decides
+    if (a.pixelRate > b.pixelRate * (1.0 + TUNE_RATE_MARGIN)) {
+        return true;
+    }
+    if (b.pixelRate > a.pixelRate * (1.0 + TUNE_RATE_MARGIN)) {
+        return false;
+    }
+    return a.cpuPercent < b.cpuPercent * (1.0 - TUNE_CPU_MARGIN);
+}
+
+std::string tpx3Autotuner::format(const tpx3TuneProfile &profile)
+{
+    std::string out;
+    for (int p = 0; p < TPX3_TUNE_PARAMS; p++) {
+        if (p > 0) {
+            out += " ";
+        }
+        out += std::string(paramNames[p]) + "=" + std::to_string(profile.values[p]);
+    }
+    return out;
+}
+
+bool tpx3Autotuner::saveProfile(const std::string &path, const tpx3TuneProfile &profile,
+                                const tpx3TuneScore &score, std::string *error)
+{
+    // Written next to the old profile and renamed, so a crash never leaves half a profile
+    std::string temp = path + ".tmp";
+    FILE *f = fopen(temp.c_str(), "w");
+    if (!f) {
+        *error = "Cannot write " + temp + ": " + strerror(errno);
+        return false;
+    }
+    char date[64];
+    time_t now = time(NULL);
+    struct tm tm;
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime_r(&now, &tm));
+    fprintf(f, "# Serval pipeline profile, autotuned %s; 0 leaves the option to Serval\n", date);
+    fprintf(f, "# pixel rate %.0f Hz, drops %.1f Hz, CPU %.0f %%\n", score.pixelRate, score.dropRate,
+            score.cpuPercent);
+    for (int p = 0; p < TPX3_TUNE_PARAMS; p++) {
+        fprintf(f, "%s=%d\n", paramNames[p], profile.values[p]);
+    }
+    if (fclose(f) != 0) {
+        *error = "Cannot write " + temp + ": " + strerror(errno);
+        unlink(temp.c_str());
+        return false;
+    }
+    if (rename(temp.c_str(), path.c_str()) != 0) {
+        *error = "Cannot write " + path + ": " + strerror(errno);
+        unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool tpx3Autotuner::loadProfile(const std::string &path, tpx3TuneProfile *profile, std::string *error)
+{
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f) {
+        *error = "Cannot read " + path + ": " + strerror(errno);
+        return false;
+    }
+    bool seen[TPX3_TUNE_PARAMS] = { false };
+    tpx3TuneProfile loaded;
+    memset(&loaded, 0, sizeof(loaded));
+    char line[256];
+    int lineNo = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f)) {
+        lineNo++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#' || line[0] == '\0') {
+            continue;
+        }
+        char *eq = strchr(line, '=');
+        int param = -1;
+        if (eq) {
+            *eq = '\0';
+            for (int p = 0; p < TPX3_TUNE_PARAMS; p++) {
+                if (strcmp(line, paramNames[p]) == 0) {
+                    param = p;
+                }
+            }
+        }
+        char *tail = NULL;
+        long value = eq ? strtol(eq + 1, &tail, 10) : -1;
+        if (param < 0 || *tail != '\0' || value < 0 || value > 0x7FFFFFFF) {
+            *error = path + ":" + std::to_string(lineNo) + ": not a pipeline option";
+            ok = false;
+        } else {
+            loaded.values[param] = (int)value;
+            seen[param] = true;
+        }
+    }
+    fclose(f);
+    for (int p = 0; ok && p < TPX3_TUNE_PARAMS; p++) {
+        if (!seen[p]) {
+            *error = path + " has no " + paramNames[p];
+            ok = false;
+        }
+    }
+    if (ok) {
+        *profile = loaded;
+    }
+    return ok;
+}
@@ -0,0 +1,87 @@
+#ifndef tpx3Autotune_H
+#define tpx3Autotune_H
+
+#include <string>
+#include <vector>
+
+// Serval pipeline options the autotuner searches over
+#define TPX3_TUNE_UDP_RECEIVERS       0
+#define TPX3_TUNE_FRAME_ASSEMBLERS    1
+#define TPX3_TUNE_RING_BUFFER_SIZE    2
+#define TPX3_TUNE_NETWORK_BUFFER_SIZE 3
+#define TPX3_TUNE_CORRECTION_HANDLERS 4
+#define TPX3_TUNE_PROCESSING_HANDLERS 5
+#define TPX3_TUNE_PARAMS              6
+
+// A value per option; 0 leaves the option to Serval's own autotuning
+struct tpx3TuneProfile {
+    int values[TPX3_TUNE_PARAMS];
+};
+
+// Outcome of one trial, averaged over its measurement window
+struct tpx3TuneScore {
+    bool valid;         // Serval ran through the whole trial
+    double pixelRate;   // Hz, Serval's pixel event rate
+    double dropRate;    // Hz, UDP socket drops plus frames Serval dropped
+    double cpuPercent;  // % of one core
+};
+
+// Coordinate search over the pipeline options. The starting profile is
+// measured first; then each option in turn is set to each of its candidates,
+// the others held at the best values so far, and the search is repeated for
+// up to the given number of passes, ending early once a pass improves
+// nothing. Profiles already measured are not measured again.
+// Not thread safe: the caller serializes access.
+class tpx3Autotuner {
+public:
+    tpx3Autotuner();
+
+    static const char *paramName(int param);
+
+    // Comma-separated values >= 0, e.g. "0,1,2,4"; empty keeps the option fixed
+    static bool parseCandidates(const std::string &text, std::vector<int> *out, std::string *error);
+
+    void begin(const tpx3TuneProfile &start, const std::vector<int> candidates[TPX3_TUNE_PARAMS], int passes);
+    // The next profile to measure, false once the search is over
+    bool next(tpx3TuneProfile *trial);
+    // Result of the profile last returned by next()
+    void report(const tpx3TuneScore &score);
+
+    int trialsDone() const { return done_; }
+    // Upper bound: repeats are skipped and the search may end early
+    int trialsPlanned() const { return planned_; }
+    bool haveBest() const { return bestScore_.valid; }
+    const tpx3TuneProfile &best() const { return best_; }
+    const tpx3TuneScore &bestScore() const { return bestScore_; }
+
+    // Fewer drops first, then a higher pixel rate, then less CPU; differences
+    // within the measurement noise keep the incumbent
+    static bool better(const tpx3TuneScore &a, const tpx3TuneScore &b);
+
+    // "UDP_RECEIVERS=4 FRAME_ASSEMBLERS=0 ..."
+    static std::string format(const tpx3TuneProfile &profile);
+
+    // Text file of NAME=value lines, comments start with #
+    static bool saveProfile(const std::string &path, const tpx3TuneProfile &profile,
+                            const tpx3TuneScore &score, std::string *error);
+    static bool loadProfile(const std::string &path, tpx3TuneProfile *profile, std::string *error);
+
+private:
+    std::vector<int> candidates_[TPX3_TUNE_PARAMS];
+    std::vector<tpx3TuneProfile> measured_;
+    tpx3TuneProfile best_;
+    tpx3TuneProfile current_;
+    tpx3TuneScore bestScore_;
+    int passes_;
+    int pass_;
+    int param_;
+    size_t candidate_;
+    bool started_;
+    bool improved_;  // in the current pass
+    int done_;
+    int planned_;
+
+    bool wasMeasured(const tpx3TuneProfile &profile) const;
+};
+
+#endif // tpx3Autotune_H
@@ -0,0 +1,495 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <algorithm>
+#include <new>
+
+#include "tpx3Centroid.h"
+
+#define TOA_MASK ((1ull << TPX3_TOA_BITS) - 1)
+
+// Output thread: bytes held for a slow client before the worker queues back up
+#define OUTPUT_BUFFER_BYTES (1024 * 1024)
+#define OUTPUT_POLL_MS      5
+
+static_assert(sizeof(tpx3CentroidEvent) == 24, "tpx3CentroidEvent is a wire format");
+
+void tpx3CentroidDefaults(tpx3CentroidConfig *config)
+{
+    config->timeWindowNs = 500.0;
+    config->spaceWindow = 1;
+}
+
+static inline uint32_t findRoot(std::vector<uint32_t> &parent, uint32_t i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// Hits come nearly in time order (time walk and the column readout reorder
+// them locally), so insertion sort usually wins; badly shuffled input falls
+// back to std::sort once the moves pass a budget
+void tpx3Centroid::sortByToa(std::vector<hitRecord> &hits)
+{
+    size_t n = hits.size();
+    size_t budget = 8 * n;
+    for (size_t i = 1; i < n; i++) {
+        hitRecord h = hits[i];
+        size_t j = i;
+        while (j > 0 && hits[j - 1].toa > h.toa) {
+            hits[j] = hits[j - 1];
+            j--;
+        }
+        hits[j] = h;
+        size_t moves = i - j;
+        if (moves > budget) {
+            std::sort(hits.begin(), hits.end(),
+                      [](const hitRecord &a, const hitRecord &b) { return a.toa < b.toa; });
+            return;
+        }
+        budget -= moves;
+    }
+}
+
+static inline void addCounter(std::atomic<uint64_t> &counter, uint64_t n)
+{
+    // Single writer: relaxed load/store instead of a locked add
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+tpx3Centroid::tpx3Centroid()
+    : enabled_(true), generation_(1), outputActive_(false),
+      outputRunning_(false), outputConnected_(false), sent_(0), listenFd_(-1), stopFd_(-1)
+{
+    tpx3CentroidDefaults(&config_);
+    memset(&baseline_, 0, sizeof(baseline_));
+}
+
+tpx3Centroid::~tpx3Centroid()
+{
+    stopOutput();
+    for (size_t i = 0; i < workers_.size(); i++) {
+        workers_[i]->~workerState();
+        free(workers_[i]);
+    }
+}
+
+void tpx3Centroid::configure(int numWorkers)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    while ((int)workers_.size() < numWorkers) {
+        // operator new does not honour alignas(64) before C++17
+        void *memory = NULL;
+        if (posix_memalign(&memory, 64, sizeof(workerState)) != 0) {
+            throw std::bad_alloc();
+        }
+        workerState *w = new (memory) workerState();
+        w->generation = 0;
+        w->events = 0;
+        w->clusteredHits = 0;
+        w->dropped = 0;
+        for (int b = 0; b < TPX3_CENT_SIZE_BINS; b++) {
+            w->sizeHist[b] = 0;
+        }
+        w->head = 0;
+        w->tail = 0;
+        w->queue.reset(new tpx3CentroidEvent[TPX3_CENT_QUEUE_EVENTS]);
+        // Sized for a full chunk plus the carried hits, so consume() never allocates
+        size_t capacity = TPX3_MAX_CHUNK_BYTES / 8 + TPX3_CENT_MAX_CARRY;
+        w->hits.reserve(capacity);
+        w->parent.reserve(capacity);
+        w->sums.reserve(capacity);
+        for (int c = 0; c < TPX3_CENT_CHIPS; c++) {
+            w->carry[c].reserve(TPX3_CENT_MAX_CARRY);
+        }
+        workers_.push_back(w);
+    }
+}
+
+void tpx3Centroid::setConfig(const tpx3CentroidConfig &config)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    config_ = config;
+    generation_++;
+}
+
+// Worker: copy the configuration after a change
+void tpx3Centroid::loadConfig(workerState &w)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    w.config = config_;
+    w.generation = generation_.load(std::memory_order_relaxed);
+    w.windowUnits = (uint64_t)(config_.timeWindowNs / TPX3_TOA_UNIT_NS);
+}
+
+void tpx3Centroid::consume(int worker, const tpx3StreamChunk &chunk)
+{
+    if (!enabled_.load(std::memory_order_relaxed) || chunk.chip < 0 || chunk.chip >= TPX3_CENT_CHIPS) {
+        return;
+    }
+    workerState &w = *workers_[worker];
+    if (w.generation != generation_.load(std::memory_order_acquire)) {
+        // Finish the open clusters with the windows they were started with
+        flushCarry(w);
+        loadConfig(w);
+    }
+
+    std::vector<hitRecord> &hits = w.hits;
+    std::vector<hitRecord> &carry = w.carry[chunk.chip];
+    hits.assign(carry.begin(), carry.end());
+    carry.clear();
+    uint16_t originX = (uint16_t)((chunk.chip & 1) * TPX3_CHIP_PIXELS);
+    uint16_t originY = (uint16_t)((chunk.chip >> 1) * TPX3_CHIP_PIXELS);
+    for (size_t i = 0; i < chunk.count; i++) {
+        uint64_t word = chunk.words[i];
+        // ToA/ToT mode hits only; count-mode hits carry no time
+        if ((unsigned)(word >> 60) != TPX3_PKT_HIT) {
+            continue;
+        }
+        tpx3Hit hit;
+        tpx3DecodeHit(word, &hit);
+        hitRecord h;
+        h.toa = hit.toa & TOA_MASK;
+        h.x = (uint16_t)(originX + hit.x);
+        h.y = (uint16_t)(originY + hit.y);
+        h.tot = (uint16_t)hit.tot;
+        hits.push_back(h);
+    }
+    if (!hits.empty()) {
+        cluster(w, chunk.chip, false);
+    }
+}
+
+void tpx3Centroid::endBlock(int worker, uint64_t sequence)
+{
+    (void)sequence;
+    flushCarry(*workers_[worker]);
+}
+
+// Emit every cluster still held back
+void tpx3Centroid::flushCarry(workerState &w)
+{
+    for (int c = 0; c < TPX3_CENT_CHIPS; c++) {
+        if (!w.carry[c].empty()) {
+            // Copied rather than swapped, so each vector keeps its reserved capacity
+            w.hits.assign(w.carry[c].begin(), w.carry[c].end());
+            w.carry[c].clear();
+            cluster(w, c, true);
+        }
+    }
+}
+
+// Cluster w.hits of one chip; with flush set every cluster is emitted, else
+// those that a later hit could still join go back to the chip's carry list
+void tpx3Centroid::cluster(workerState &w, int chip, bool flush)
+{
+    std::vector<hitRecord> &hits = w.hits;
+    // A ToA wrap-around (every 26.8 s) sorts to the front and splits the clusters across it
+    sortByToa(hits);
+    uint32_t n = (uint32_t)hits.size();
+    uint64_t window = w.windowUnits;
+    int space = w.config.spaceWindow;
+
+    std::vector<uint32_t> &parent = w.parent;
+    parent.resize(n);
+    for (uint32_t i = 0; i < n; i++) {
+        parent[i] = i;
+    }
+    // Link each hit to its earlier neighbours within the time window; the
+    // root of a cluster is its earliest hit
+    for (uint32_t i = 1; i < n; i++) {
+        const hitRecord &a = hits[i];
+        uint32_t root = i;  // root of hit i's cluster so far
+        for (uint32_t j = i; j-- > 0 && a.toa - hits[j].toa <= window; ) {
+            const hitRecord &b = hits[j];
+            if (abs((int)a.x - (int)b.x) <= space && abs((int)a.y - (int)b.y) <= space) {
+                uint32_t other = findRoot(parent, j);
+                if (other < root) {
+                    parent[root] = other;
+                    root = other;
+                } else if (other > root) {
+                    parent[other] = root;
+                }
+            }
+        }
+    }
+
+    // Roots come before their members, so one ascending pass sums every cluster
+    std::vector<clusterSum> &sums = w.sums;
+    sums.resize(n);
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t r = findRoot(parent, i);
+        parent[i] = r;
+        const hitRecord &h = hits[i];
+        // ToT 0 still counts, as 1
+        double weight = h.tot ? (double)h.tot : 1.0;
+        clusterSum &s = sums[r];
+        if (r == i) {
+            s.lastToa = h.toa;
+            s.peakToa = h.toa;
+            s.weight = weight;
+            s.sumX = weight * h.x;
+            s.sumY = weight * h.y;
+            s.totSum = h.tot;
+            s.peakTot = h.tot;
+            s.size = 1;
+            continue;
+        }
+        s.lastToa = h.toa;
+        if (h.tot > s.peakTot) {
+            s.peakTot = h.tot;
+            s.peakToa = h.toa;
+        }
+        s.weight += weight;
+        s.sumX += weight * h.x;
+        s.sumY += weight * h.y;
+        s.totSum += h.tot;
+        if (s.size < 0xFFFF) {
+            s.size++;
+        }
+    }
+
+    // A cluster is open while a hit later than the last one could still join it
+    uint64_t openFrom = hits[n - 1].toa > window ? hits[n - 1].toa - window : 0;
+    if (!flush) {
+        uint32_t carried = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            carried += (sums[parent[i]].lastToa >= openFrom);
+        }
+        flush = carried > TPX3_CENT_MAX_CARRY;
+    }
+
+    std::vector<hitRecord> &carry = w.carry[chip];
+    uint64_t events = 0, clustered = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t r = parent[i];
+        if (!flush && sums[r].lastToa >= openFrom) {
+            carry.push_back(hits[i]);
+        } else if (r == i) {
+            emit(w, chip, sums[i]);
+            events++;
+            clustered += sums[i].size;
+        }
+    }
+    addCounter(w.events, events);
+    addCounter(w.clusteredHits, clustered);
+}
+
+void tpx3Centroid::emit(workerState &w, int chip, const clusterSum &sum)
+{
+    int bin = std::min((int)sum.size, TPX3_CENT_SIZE_BINS) - 1;
+    addCounter(w.sizeHist[bin], 1);
+    if (!outputActive_.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    tpx3CentroidEvent ev;
+    ev.toa = sum.peakToa;
+    ev.x = (float)(sum.sumX / sum.weight);
+    ev.y = (float)(sum.sumY / sum.weight);
+    ev.totSum = sum.totSum;
+    ev.size = sum.size;
+    ev.chip = (uint8_t)chip;
+    ev.reserved = 0;
+
+    uint32_t head = w.head.load(std::memory_order_relaxed);
+    if (head - w.tail.load(std::memory_order_acquire) >= TPX3_CENT_QUEUE_EVENTS) {
+        addCounter(w.dropped, 1);
+        return;
+    }
+    w.queue[head & (TPX3_CENT_QUEUE_EVENTS - 1)] = ev;
+    w.head.store(head + 1, std::memory_order_release);
+}
+
+// Caller holds mutex_
+void tpx3Centroid::sumCounters(tpx3CentroidStats *out) const
+{
+    memset(out, 0, sizeof(*out));
+    for (size_t i = 0; i < workers_.size(); i++) {
+        const workerState &w = *workers_[i];
+        out->events += w.events.load(std::memory_order_relaxed);
+        out->hits += w.clusteredHits.load(std::memory_order_relaxed);
+        out->dropped += w.dropped.load(std::memory_order_relaxed);
+        for (int b = 0; b < TPX3_CENT_SIZE_BINS; b++) {
+            out->sizeHist[b] += w.sizeHist[b].load(std::memory_order_relaxed);
+        }
+    }
+    out->sent = sent_;
+}
+
+void tpx3Centroid::reset()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    sumCounters(&baseline_);
+}
+
+void tpx3Centroid::getStats(tpx3CentroidStats *out) const
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    sumCounters(out);
+    out->events -= baseline_.events;
+    out->hits -= baseline_.hits;
+    out->dropped -= baseline_.dropped;
+    out->sent -= baseline_.sent;
+    for (int b = 0; b < TPX3_CENT_SIZE_BINS; b++) {
+        out->sizeHist[b] -= baseline_.sizeHist[b];
+    }
+    out->outputRunning = outputRunning_;
+    out->outputConnected = outputConnected_;
+}
+
+bool tpx3Centroid::startOutput(int port, std::string *error)
+{
+    if (outputRunning_) {
+        *error = "Centroid output already running";
+        return false;
+    }
+    listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (listenFd_ < 0 || bind(listenFd_, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listenFd_, 1) < 0) {
+        *error = std::string("Cannot listen on centroid output port: ") + strerror(errno);
+        stopOutput();
+        return false;
+    }
+    stopFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (stopFd_ < 0) {
+        *error = std::string("Cannot create centroid output stop event: ") + strerror(errno);
+        stopOutput();
+        return false;
+    }
+    outputRunning_ = true;
+    output_ = std::thread(&tpx3Centroid::outputLoop, this);
+    return true;
+}
+
+void tpx3Centroid::stopOutput()
+{
+    outputRunning_ = false;
+    if (stopFd_ >= 0) {
+        uint64_t one = 1;
+        ssize_t n = write(stopFd_, &one, sizeof(one));
+        (void)n;
+    }
+    if (output_.joinable()) {
+        output_.join();
+    }
+    if (listenFd_ >= 0) {
+        close(listenFd_);
+        listenFd_ = -1;
+    }
+    if (stopFd_ >= 0) {
+        close(stopFd_);
+        stopFd_ = -1;
+    }
+}
+
+// Output thread: serve one client at a time, draining the worker queues into a
+// send buffer. A client that reads too slowly fills the buffer, then the
+// queues, and the workers count the events they cannot queue as dropped.
+void tpx3Centroid::outputLoop()
+{
+    pthread_setname_np(pthread_self(), "tpx3CentOut");
+    std::vector<char> buffer;
+    buffer.reserve(OUTPUT_BUFFER_BYTES);
+    size_t offset = 0;
+    int client = -1;
+    std::vector<workerState *> workers;
+
+    while (outputRunning_) {
+        struct pollfd pfds[3] = {
+            { listenFd_, POLLIN, 0 },
+            { stopFd_, POLLIN, 0 },
+            { client, (short)(offset < buffer.size() ? POLLIN | POLLOUT : POLLIN), 0 },
+        };
+        if (poll(pfds, client >= 0 ? 3 : 2, OUTPUT_POLL_MS) < 0 && errno != EINTR) {
+            break;
+        }
+        if (!outputRunning_) {
+            break;
+        }
+        bool closeClient = false;
+        if (pfds[0].revents & POLLIN) {
+            int fd = accept4(listenFd_, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (fd >= 0) {
+                // A new client replaces the old one
+                if (client >= 0) {
+                    close(client);
+                }
+                client = fd;
+                buffer.clear();
+                offset = 0;
+                outputConnected_ = true;
+                outputActive_ = true;
+            }
+        } else if (client >= 0 && (pfds[2].revents & (POLLIN | POLLHUP | POLLERR))) {
+            // Anything the client sends is ignored; end of file means it went away
+            char discard[256];
+            ssize_t n = recv(client, discard, sizeof(discard), MSG_DONTWAIT);
+            closeClient = n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            workers = workers_;
+        }
+        // Without a client, whatever was queued before it left is discarded
+        for (size_t i = 0; i < workers.size(); i++) {
+            workerState &w = *workers[i];
+            uint32_t tail = w.tail.load(std::memory_order_relaxed);
+            uint32_t head = w.head.load(std::memory_order_acquire);
+            while (tail != head && (client < 0 || buffer.size() + sizeof(tpx3CentroidEvent) <= OUTPUT_BUFFER_BYTES)) {
+                if (client >= 0) {
+                    const char *ev = (const char *)&w.queue[tail & (TPX3_CENT_QUEUE_EVENTS - 1)];
+                    buffer.insert(buffer.end(), ev, ev + sizeof(tpx3CentroidEvent));
+                }
+                tail++;
+            }
+            w.tail.store(tail, std::memory_order_release);
+        }
+
+        if (client >= 0 && !closeClient && offset < buffer.size()) {
+            ssize_t n = send(client, &buffer[offset], buffer.size() - offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n > 0) {
+                offset += (size_t)n;
+            } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                closeClient = true;
+            }
+            if (offset == buffer.size()) {
+                sent_ += buffer.size() / sizeof(tpx3CentroidEvent);
+                buffer.clear();
+                offset = 0;
+            }
+        }
+        if (closeClient) {
+            outputActive_ = false;
+            outputConnected_ = false;
+            close(client);
+            client = -1;
+            buffer.clear();
+            offset = 0;
+        }
+    }
+
+    outputActive_ = false;
+    outputConnected_ = false;
+    if (client >= 0) {
+        close(client);
+    }
+}
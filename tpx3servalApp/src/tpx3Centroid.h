@@ -0,0 +1,145 @@
+#ifndef tpx3Centroid_H
+#define tpx3Centroid_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tpx3Packet.h"
+#include "tpx3Stream.h"
+
+#define TPX3_CENT_CHIPS            4
+#define TPX3_CENT_SIZE_BINS        64     // cluster sizes 1-63, the last bin 64 and up
+#define TPX3_CENT_MAX_SPACE_WINDOW 8
+#define TPX3_CENT_MAX_CARRY        4096   // open-cluster hits held back per chip
+#define TPX3_CENT_QUEUE_EVENTS     65536  // per-worker output queue, a power of 2
+
+struct tpx3CentroidConfig {
+    double timeWindowNs;  // largest ToA gap between neighbouring hits of one cluster
+    int spaceWindow;      // largest x and y pixel distance between neighbouring hits
+};
+
+void tpx3CentroidDefaults(tpx3CentroidConfig *config);
+
+// One event as sent to the output client: 24 bytes in host (little-endian) order
+struct tpx3CentroidEvent {
+    uint64_t toa;      // ToA of the cluster's highest-ToT hit, 1.5625 ns units
+    float x;           // ToT-weighted centroid in quad coordinates (see tpx3Preview.h)
+    float y;
+    uint32_t totSum;   // summed ToT, 25 ns units
+    uint16_t size;     // hits in the cluster
+    uint8_t chip;
+    uint8_t reserved;
+};
+
+// Totals since start or reset()
+struct tpx3CentroidStats {
+    uint64_t events;
+    uint64_t hits;      // hits assigned to events
+    uint64_t sizeHist[TPX3_CENT_SIZE_BINS];
+    uint64_t sent;      // events written to the output client
+    uint64_t dropped;   // events lost to a full output queue
+    bool outputRunning;
+    bool outputConnected;
+};
+
+// Groups the hits of each chip into clusters of spatio-temporal neighbours and
+// reduces every cluster to one ToT-weighted centroid. Each worker sorts a
+// chunk's hits by ToA, links hits within the time and space windows with a
+// union-find pass, and emits the clusters that can no longer grow. Clusters
+// still open at the end of a chunk are carried into the next chunk of the same
+// chip, and everything is emitted at the end of the block, so only clusters
+// straddling two 4 MiB blocks are split. Counters are per worker, as in
+// tpx3Histogram. Events can also be sent to one TCP client: workers push them
+// into lock-free per-worker queues that an output thread drains.
+class tpx3Centroid : public tpx3StreamConsumer {
+public:
+    tpx3Centroid();
+    ~tpx3Centroid();
+
+    void configure(int numWorkers);
+    void consume(int worker, const tpx3StreamChunk &chunk);
+    void endBlock(int worker, uint64_t sequence);
+
+    // Any thread; take effect on the next chunk
+    void setEnabled(bool enabled) { enabled_ = enabled; }
+    void setConfig(const tpx3CentroidConfig &config);
+
+    // Counters restart from 0; any thread
+    void reset();
+    void getStats(tpx3CentroidStats *out) const;
+
+    // Accept one output client at a time on a TCP port, on all interfaces
+    bool startOutput(int port, std::string *error);
+    void stopOutput();
+
+private:
+    struct hitRecord {
+        uint64_t toa;
+        uint16_t x;      // quad coordinates
+        uint16_t y;
+        uint16_t tot;
+    };
+
+    struct clusterSum {
+        uint64_t lastToa;
+        uint64_t peakToa;
+        double weight;
+        double sumX;
+        double sumY;
+        uint32_t totSum;
+        uint16_t peakTot;
+        uint16_t size;
+    };
+
+    struct alignas(64) workerState {
+        // Worker-private state
+        tpx3CentroidConfig config;
+        unsigned generation;
+        uint64_t windowUnits;  // time window in ToA units
+        std::vector<hitRecord> carry[TPX3_CENT_CHIPS];
+        std::vector<hitRecord> hits;
+        std::vector<uint32_t> parent;
+        std::vector<clusterSum> sums;
+        // Counters, read by getStats()
+        alignas(64) std::atomic<uint64_t> events;
+        std::atomic<uint64_t> clusteredHits;
+        std::atomic<uint64_t> dropped;
+        std::atomic<uint64_t> sizeHist[TPX3_CENT_SIZE_BINS];
+        // Output queue: the worker advances head, the output thread tail
+        alignas(64) std::atomic<uint32_t> head;
+        alignas(64) std::atomic<uint32_t> tail;
+        std::unique_ptr<tpx3CentroidEvent[]> queue;
+    };
+
+    std::atomic<bool> enabled_;
+    std::atomic<unsigned> generation_;
+    std::atomic<bool> outputActive_;  // workers queue events only while a client is connected
+
+    mutable std::mutex mutex_;  // guards config_, the worker list and the baseline
+    tpx3CentroidConfig config_;
+    std::vector<workerState *> workers_;
+    tpx3CentroidStats baseline_;  // totals at the last reset()
+
+    // Output thread
+    std::thread output_;
+    std::atomic<bool> outputRunning_;
+    std::atomic<bool> outputConnected_;
+    std::atomic<uint64_t> sent_;
+    int listenFd_;
+    int stopFd_;
+
+    static void sortByToa(std::vector<hitRecord> &hits);
+    void loadConfig(workerState &w);
+    void flushCarry(workerState &w);
+    void cluster(workerState &w, int chip, bool flush);
+    void emit(workerState &w, int chip, const clusterSum &sum);
+    void sumCounters(tpx3CentroidStats *out) const;
+    void outputLoop();
+};
+
+#endif // tpx3Centroid_H
@@ -0,0 +1,284 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <vector>
+
+#include "tpx3GcLog.h"
+
+// gc* at info level is a dozen lines per collection; room for a burst of them
+#define GC_PIPE_BYTES (1024 * 1024)
+#define GC_LINE_CHARS 1024
+
+static double monotonicNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+tpx3GcLog::tpx3GcLog()
+    : readFd_(-1), writeFd_(-1), pid_(0)
+{
+    reset();
+}
+
+tpx3GcLog::~tpx3GcLog()
+{
+    if (readFd_ >= 0) {
+        close(readFd_);
+    }
+    if (writeFd_ >= 0) {
+        close(writeFd_);
+    }
+    if (!path_.empty()) {
+        unlink(path_.c_str());
+    }
+    if (!dir_.empty()) {
+        rmdir(dir_.c_str());
+    }
+}
+
+bool tpx3GcLog::open(std::string *error)
+{
+    const char *tmp = getenv("TMPDIR");
+    std::string templ = std::string(tmp && *tmp ? tmp : "/tmp") + "/tpx3gc.XXXXXX";
+    std::vector<char> buf(templ.begin(), templ.end());
+    buf.push_back('\0');
+    if (!mkdtemp(&buf[0])) {
+        *error = "Cannot create GC log directory " + templ + ": " + strerror(errno);
+        return false;
+    }
+    dir_ = &buf[0];
+    path_ = dir_ + "/gc.fifo";
+    if (mkfifo(path_.c_str(), 0600) != 0) {
+        *error = "Cannot create GC log FIFO " + path_ + ": " + strerror(errno);
+        path_.clear();
+        return false;
+    }
+    readFd_ = ::open(path_.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (readFd_ >= 0) {
+        writeFd_ = ::open(path_.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    }
+    if (readFd_ < 0 || writeFd_ < 0) {
+        *error = "Cannot open GC log FIFO " + path_ + ": " + strerror(errno);
+        if (readFd_ >= 0) {
+            close(readFd_);
+            readFd_ = -1;
+        }
+        return false;
+    }
+#ifdef F_SETPIPE_SZ
+    fcntl(readFd_, F_SETPIPE_SZ, GC_PIPE_BYTES);
+#endif
+    return true;
+}
+
+// filecount=0: HotSpot would otherwise try to rotate the FIFO like a log file
+std::string tpx3GcLog::jvmOption() const
+{
+    return "-Xlog:gc*:file=" + path_ + ":uptime,pid,level,tags:filecount=0";
+}
+
+void tpx3GcLog::drain()
+{
+    if (readFd_ < 0) {
+        return;
+    }
+    char buf[16384];
+    for (;;) {
+        ssize_t n = read(readFd_, buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+        std::lock_guard<std::mutex> guard(mutex_);
+        for (ssize_t i = 0; i < n; i++) {
+            if (buf[i] == '\n') {
+                addLine(partial_);
+                partial_.clear();
+            } else if (partial_.size() < GC_LINE_CHARS) {
+                partial_ += buf[i];
+            }
+        }
+    }
+}
+
+void tpx3GcLog::setPid(pid_t pid)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    pid_ = pid;
+}
+
+// Caller holds mutex_
+void tpx3GcLog::addLine(const std::string &line)
+{
+    tpx3GcLine parsed;
+    if (!parseLine(line, &parsed)) {
+        return;
+    }
+    // The standby or retiring JVM of a switchover writes here too
+    if (parsed.pid != 0 && pid_ != 0 && parsed.pid != pid_) {
+        return;
+    }
+    if (parsed.pause) {
+        pauses_++;
+        lastPauseMs_ = parsed.pauseMs;
+        if (parsed.pauseMs > maxPauseMs_) {
+            maxPauseMs_ = parsed.pauseMs;
+        }
+        int bin = 0;
+        double edge = 0.125;
+        while (bin < TPX3_GC_HIST_BINS - 1 && parsed.pauseMs >= edge) {
+            bin++;
+            edge *= 2.0;
+        }
+        hist_[bin]++;
+        windowPauses_++;
+        windowPauseMs_ += parsed.pauseMs;
+        if (parsed.pauseMs > windowMaxPauseMs_) {
+            windowMaxPauseMs_ = parsed.pauseMs;
+        }
+    }
+    if (parsed.haveHeap) {
+        haveHeap_ = true;
+        heapAfterMB_ = parsed.heapAfterMB;
+        if (parsed.heapSizeMB > 0.0) {
+            heapSizeMB_ = parsed.heapSizeMB;
+        }
+    }
+}
+
+// "24M" etc. at p, in MB; advances p past it
+static bool parseSize(const char **p, double *mb)
+{
+    char *end = NULL;
+    double value = strtod(*p, &end);
+    if (end == *p) {
+        return false;
+    }
+    switch (*end) {
+    case 'B':
+        value /= 1024.0 * 1024.0;
+        break;
+    case 'K':
+        value /= 1024.0;
+        break;
+    case 'M':
+        break;
+    case 'G':
+        value *= 1024.0;
+        break;
+    case 'T':
+        value *= 1024.0 * 1024.0;
+        break;
+    default:
+        return false;
+    }
+    *mb = value;
+    *p = end + 1;
+    return true;
+}
+
+// e.g. "[12.345s][4711][info][gc] GC(7) Pause Young (Normal) (G1 Evacuation Pause) 24M->4M(256M) 3.456ms"
+bool tpx3GcLog::parseLine(const std::string &line, tpx3GcLine *out)
+{
+    memset(out, 0, sizeof(*out));
+    std::string tags;
+    size_t pos = 0;
+    while (pos < line.size() && line[pos] == '[') {
+        size_t close = line.find(']', pos);
+        if (close == std::string::npos) {
+            return false;
+        }
+        std::string field = line.substr(pos + 1, close - pos - 1);
+        size_t last = field.find_last_not_of(' ');
+        field = last == std::string::npos ? "" : field.substr(0, last + 1);
+        if (!field.empty() && field.find_first_not_of("0123456789") == std::string::npos) {
+            out->pid = (pid_t)atol(field.c_str());
+        }
+        // Decorators come in a fixed order and the tags are the last of them
+        tags = field;
+        pos = close + 1;
+    }
+    if (tags != "gc" && tags != "gc,phases") {
+        return false;
+    }
+    size_t start = line.find_first_not_of(' ', pos);
+    if (start == std::string::npos) {
+        return false;
+    }
+    std::string message = line.substr(start);
+
+    // A pause ends in its duration
+    size_t end = message.find_last_not_of(' ');
+    if (message.find("Pause ") != std::string::npos && end != std::string::npos && end >= 2 &&
+        message.compare(end - 1, 2, "ms") == 0) {
+        size_t number = message.find_last_of(' ', end);
+        number = number == std::string::npos ? 0 : number + 1;
+        char *tail = NULL;
+        double ms = strtod(message.c_str() + number, &tail);
+        if (tail == message.c_str() + end - 1) {
+            out->pause = true;
+            out->pauseMs = ms;
+        }
+    }
+
+    // "24M->4M(256M)", or ZGC's "14M(1%)->6M(0%)"
+    if (tags == "gc") {
+        size_t arrow = message.find("->");
+        if (arrow != std::string::npos) {
+            const char *p = message.c_str() + arrow + 2;
+            if (parseSize(&p, &out->heapAfterMB)) {
+                out->haveHeap = true;
+                if (*p == '(') {
+                    p++;
+                    double size = 0.0;
+                    if (parseSize(&p, &size) && *p == ')') {
+                        out->heapSizeMB = size;
+                    }
+                }
+            }
+        }
+    }
+    return out->pause || out->haveHeap;
+}
+
+void tpx3GcLog::getStats(tpx3GcStats *out)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    double now = monotonicNow();
+    out->pauses = pauses_;
+    out->lastPauseMs = lastPauseMs_;
+    out->maxPauseMs = maxPauseMs_;
+    memcpy(out->hist, hist_, sizeof(hist_));
+    out->haveHeap = haveHeap_;
+    out->heapAfterMB = heapAfterMB_;
+    out->heapSizeMB = heapSizeMB_;
+    out->windowPauses = windowPauses_;
+    out->windowPauseMs = windowPauseMs_;
+    out->windowMaxPauseMs = windowMaxPauseMs_;
+    out->windowSeconds = now - windowStart_;
+    windowPauses_ = 0;
+    windowPauseMs_ = 0.0;
+    windowMaxPauseMs_ = 0.0;
+    windowStart_ = now;
+}
+
+void tpx3GcLog::reset()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    pauses_ = 0;
+    lastPauseMs_ = 0.0;
+    maxPauseMs_ = 0.0;
+    memset(hist_, 0, sizeof(hist_));
+    haveHeap_ = false;
+    heapAfterMB_ = 0.0;
+    heapSizeMB_ = 0.0;
+    windowPauses_ = 0;
+    windowPauseMs_ = 0.0;
+    windowMaxPauseMs_ = 0.0;
+    windowStart_ = monotonicNow();
+}
@@ -0,0 +1,90 @@
+#ifndef tpx3GcLog_H
+#define tpx3GcLog_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <mutex>
+#include <string>
+
+// Pause histogram: bin 0 is under 0.125 ms, each later bin doubles the range
+#define TPX3_GC_HIST_BINS 16
+
+// Totals since the last reset(); the window is since the previous getStats()
+struct tpx3GcStats {
+    uint64_t pauses;
+    double lastPauseMs;
+    double maxPauseMs;
+    uint64_t hist[TPX3_GC_HIST_BINS];
+    bool haveHeap;
+    double heapAfterMB;   // occupancy after the last collection
+    double heapSizeMB;    // committed heap, 0 if the collector does not log it
+    int windowPauses;
+    double windowPauseMs;     // summed
+    double windowMaxPauseMs;
+    double windowSeconds;
+};
+
+// One parsed line of JVM unified logging (-Xlog), decorated with uptime,pid,level,tags
+struct tpx3GcLine {
+    pid_t pid;            // 0 if not decorated
+    bool pause;
+    double pauseMs;
+    bool haveHeap;
+    double heapAfterMB;
+    double heapSizeMB;    // 0 if not in the line
+};
+
+// Reads the JVM's unified GC log from a FIFO the instance owns. The FIFO is
+// created in a private directory and kept open for reading (non-blocking) and
+// for writing, so the read end never sees EOF between JVMs and a JVM opening
+// it never waits for a reader. Stop-the-world pauses are the "Pause ...
+// <duration>ms" lines of the gc and gc,phases tag sets, which covers G1,
+// Parallel, Serial, ZGC and Shenandoah; heap occupancy comes from the
+// "before->after(size)" of the gc lines. Only lines of the JVM given to
+// setPid() count. All methods may be called from any thread.
+class tpx3GcLog {
+public:
+    tpx3GcLog();
+    ~tpx3GcLog();
+
+    bool open(std::string *error);
+    bool isOpen() const { return readFd_ >= 0; }
+    const std::string &path() const { return path_; }
+    int readFd() const { return readFd_; }
+
+    // The -Xlog option that logs to the FIFO
+    std::string jvmOption() const;
+
+    // Parse whatever the FIFO holds
+    void drain();
+    void setPid(pid_t pid);
+    void getStats(tpx3GcStats *out);
+    void reset();
+
+    static bool parseLine(const std::string &line, tpx3GcLine *out);
+
+private:
+    mutable std::mutex mutex_;
+    std::string dir_;
+    std::string path_;
+    int readFd_;
+    int writeFd_;
+    std::string partial_;
+    pid_t pid_;
+
+    uint64_t pauses_;
+    double lastPauseMs_;
+    double maxPauseMs_;
+    uint64_t hist_[TPX3_GC_HIST_BINS];
+    bool haveHeap_;
+    double heapAfterMB_;
+    double heapSizeMB_;
+    int windowPauses_;
+    double windowPauseMs_;
+    double windowMaxPauseMs_;
+    double windowStart_;
+
+    void addLine(const std::string &line);
+};
+
+#endif // tpx3GcLog_H
@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+
+#include "tpx3Histogram.h"
+
+// Layout of the merged arrays
+#define HIST_TOA_BASE TPX3_HIST_TOT_BINS
+#define HIST_NO_TDC   (TPX3_HIST_TOT_BINS + TPX3_HIST_TOA_MAX_BINS)
+#define HIST_ELEMENTS (HIST_NO_TDC + 1)
+
+#define TOA_MASK ((1ull << TPX3_TOA_BITS) - 1)
+#define TOA_HALF (1ull << (TPX3_TOA_BITS - 1))  // differences past this are negative
+
+void tpx3HistDefaults(tpx3HistConfig *config)
+{
+    config->totBinWidth = 1;
+    config->toaBinNs = 25.0;
+    config->toaOffsetNs = 0.0;
+    config->toaBins = 1000;
+    config->tdcEdge = TPX3_TDC1_RISE;
+    config->roiX = 0;
+    config->roiY = 0;
+    config->roiWidth = 2 * TPX3_CHIP_PIXELS;
+    config->roiHeight = 2 * TPX3_CHIP_PIXELS;
+}
+
+tpx3Histogram::tpx3Histogram()
+    : enabled_(true), generation_(1),
+      lastSum_(HIST_ELEMENTS, 0), accumulated_(HIST_ELEMENTS, 0), live_(HIST_ELEMENTS, 0),
+      scratch_(HIST_ELEMENTS, 0)
+{
+    tpx3HistDefaults(&config_);
+}
+
+tpx3Histogram::~tpx3Histogram()
+{
+    for (size_t i = 0; i < workers_.size(); i++) {
+        workers_[i]->~workerHist();
+        free(workers_[i]);
+    }
+}
+
+void tpx3Histogram::configure(int numWorkers)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    while ((int)workers_.size() < numWorkers) {
+        // operator new does not honour alignas(64) before C++17
+        void *memory = NULL;
+        if (posix_memalign(&memory, 64, sizeof(workerHist)) != 0) {
+            throw std::bad_alloc();
+        }
+        workerHist *h = new (memory) workerHist();
+        h->generation = 0;
+        h->sequence = ~0ull;
+        h->numTdc = 0;
+        workers_.push_back(h);
+    }
+}
+
+void tpx3Histogram::setConfig(const tpx3HistConfig &config)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    config_ = config;
+    generation_++;
+    rebase();
+}
+
+// Worker: copy the configuration after a change; precomputes the ToA scaling
+void tpx3Histogram::loadConfig(workerHist &h)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    h.config = config_;
+    h.generation = generation_.load(std::memory_order_relaxed);
+    h.toaUnitsPerBin = config_.toaBinNs / TPX3_TOA_UNIT_NS;
+    h.toaOffsetUnits = config_.toaOffsetNs / TPX3_TOA_UNIT_NS;
+}
+
+void tpx3Histogram::consume(int worker, const tpx3StreamChunk &chunk)
+{
+    if (!enabled_.load(std::memory_order_relaxed) || chunk.chip < 0 || chunk.chip >= TPX3_HIST_CHIPS) {
+        return;
+    }
+    workerHist &h = *workers_[worker];
+    if (h.generation != generation_.load(std::memory_order_acquire)) {
+        loadConfig(h);
+    }
+    // A new block may not follow this worker's previous one in the stream
+    if (chunk.sequence != h.sequence) {
+        h.sequence = chunk.sequence;
+        h.numTdc = 0;
+    }
+
+    const tpx3HistConfig &c = h.config;
+    int originX = (chunk.chip & 1) * TPX3_CHIP_PIXELS;
+    int originY = (chunk.chip >> 1) * TPX3_CHIP_PIXELS;
+    double binScale = 1.0 / h.toaUnitsPerBin;
+    uint32_t noTdc = 0;
+
+    for (size_t i = 0; i < chunk.count; i++) {
+        uint64_t word = chunk.words[i];
+        unsigned type = (unsigned)(word >> 60);
+        if (type == TPX3_PKT_TDC) {
+            if ((int)((word >> 56) & 0xF) == c.tdcEdge) {
+                tpx3Tdc tdc;
+                tpx3DecodeTdc(word, &tdc);
+                // ps to 1.5625 ns ToA units, on the ToA counter's wrap-around
+                h.tdc[h.numTdc++ % TPX3_HIST_TDC_HISTORY] = (tdc.timePs * 2 / 3125) & TOA_MASK;
+            }
+            continue;
+        }
+        // ToA/ToT mode hits only; count-mode hits carry no time
+        if (type != TPX3_PKT_HIT) {
+            continue;
+        }
+        tpx3Hit hit;
+        tpx3DecodeHit(word, &hit);
+        int x = originX + hit.x - c.roiX;
+        int y = originY + hit.y - c.roiY;
+        if ((unsigned)x >= (unsigned)c.roiWidth || (unsigned)y >= (unsigned)c.roiHeight) {
+            continue;
+        }
+
+        // Single writer per counter: relaxed load/store instead of a locked add
+        int totBin = hit.tot / c.totBinWidth;
+        h.tot[totBin].store(h.tot[totBin].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        // Newest edge at or before the hit
+        uint64_t delta = TOA_HALF;
+        unsigned kept = std::min(h.numTdc, (unsigned)TPX3_HIST_TDC_HISTORY);
+        for (unsigned k = 1; k <= kept; k++) {
+            uint64_t d = (hit.toa - h.tdc[(h.numTdc - k) % TPX3_HIST_TDC_HISTORY]) & TOA_MASK;
+            if (d < TOA_HALF) {
+                delta = d;
+                break;
+            }
+        }
+        if (delta == TOA_HALF) {
+            noTdc++;
+            continue;
+        }
+        double units = (double)delta - h.toaOffsetUnits;
+        if (units >= 0.0) {
+            uint64_t toaBin = (uint64_t)(units * binScale);
+            if (toaBin < (uint64_t)c.toaBins) {
+                h.toa[toaBin].store(h.toa[toaBin].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+        }
+    }
+    if (noTdc) {
+        h.noTdc.store(h.noTdc.load(std::memory_order_relaxed) + noTdc, std::memory_order_relaxed);
+    }
+}
+
+// Caller holds mutex_
+void tpx3Histogram::sumCounters(std::vector<uint32_t> *sums) const
+{
+    std::fill(sums->begin(), sums->end(), 0);
+    uint32_t *s = &(*sums)[0];
+    for (size_t w = 0; w < workers_.size(); w++) {
+        const workerHist &h = *workers_[w];
+        for (int b = 0; b < TPX3_HIST_TOT_BINS; b++) {
+            s[b] += h.tot[b].load(std::memory_order_relaxed);
+        }
+        for (int b = 0; b < TPX3_HIST_TOA_MAX_BINS; b++) {
+            s[HIST_TOA_BASE + b] += h.toa[b].load(std::memory_order_relaxed);
+        }
+        s[HIST_NO_TDC] += h.noTdc.load(std::memory_order_relaxed);
+    }
+}
+
+// Caller holds mutex_: drop everything counted so far
+void tpx3Histogram::rebase()
+{
+    sumCounters(&lastSum_);
+    std::fill(accumulated_.begin(), accumulated_.end(), 0);
+    std::fill(live_.begin(), live_.end(), 0);
+}
+
+void tpx3Histogram::merge()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    sumCounters(&scratch_);
+    for (size_t i = 0; i < HIST_ELEMENTS; i++) {
+        // Unsigned wrap-around keeps the difference right after a counter overflows
+        uint32_t delta = scratch_[i] - lastSum_[i];
+        lastSum_[i] = scratch_[i];
+        live_[i] = delta;
+        accumulated_[i] += delta;
+    }
+}
+
+void tpx3Histogram::reset()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    rebase();
+}
+
+void tpx3Histogram::read(bool live, int32_t *tot, int32_t *toa,
+                         uint64_t *totCount, uint64_t *toaCount, uint64_t *noTdcCount) const
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    const std::vector<uint64_t> &source = live ? live_ : accumulated_;
+    uint64_t totSum = 0, toaSum = 0;
+    for (int b = 0; b < TPX3_HIST_TOT_BINS; b++) {
+        uint64_t v = source[b];
+        totSum += v;
+        tot[b] = (int32_t)std::min(v, (uint64_t)0x7FFFFFFF);
+    }
+    for (int b = 0; b < TPX3_HIST_TOA_MAX_BINS; b++) {
+        uint64_t v = source[HIST_TOA_BASE + b];
+        toaSum += v;
+        toa[b] = (int32_t)std::min(v, (uint64_t)0x7FFFFFFF);
+    }
+    *totCount = totSum;
+    *toaCount = toaSum;
+    *noTdcCount = source[HIST_NO_TDC];
+}
@@ -0,0 +1,99 @@
+#ifndef tpx3Histogram_H
+#define tpx3Histogram_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "tpx3Packet.h"
+#include "tpx3Stream.h"
+
+#define TPX3_HIST_CHIPS        4
+#define TPX3_HIST_TOT_BINS     1024  // one per ToT code at bin width 1
+#define TPX3_HIST_TOA_MAX_BINS 4096
+#define TPX3_HIST_TDC_HISTORY  4     // reference edges kept per worker, a power of 2
+
+struct tpx3HistConfig {
+    int totBinWidth;     // ToT codes (25 ns) per bin
+    double toaBinNs;     // ToA-TDC bin width
+    double toaOffsetNs;  // ToA-TDC value at the start of bin 0
+    int toaBins;
+    int tdcEdge;         // reference edge, TPX3_TDC1_RISE ...
+    int roiX;            // pixel ROI in quad coordinates (see tpx3Preview.h)
+    int roiY;
+    int roiWidth;
+    int roiHeight;
+};
+
+void tpx3HistDefaults(tpx3HistConfig *config);
+
+// Bins in use in the ToT spectrum
+inline int tpx3HistTotBins(const tpx3HistConfig &config)
+{
+    return (TPX3_HIST_TOT_BINS + config.totBinWidth - 1) / config.totBinWidth;
+}
+
+// ToT spectrum and ToA-relative-to-TDC histogram of the hits in a pixel ROI.
+// Each decode worker owns a cache-line aligned block holding its private state
+// and its bin counters, so workers never write to a shared line. Workers pick up
+// configuration changes through a generation counter. The ToA reference is the
+// latest TDC edge, seen by the same worker in the same receive block, that is
+// not later than the hit: Serval sends per-chip chunks, so the hits of one chip
+// can trail an edge reported in another chip's chunk. Hits with no such edge
+// are counted as unreferenced. merge() folds the counters into the published
+// histograms by difference, like tpx3Preview.
+class tpx3Histogram : public tpx3StreamConsumer {
+public:
+    tpx3Histogram();
+    ~tpx3Histogram();
+
+    void configure(int numWorkers);
+    void consume(int worker, const tpx3StreamChunk &chunk);
+
+    void setEnabled(bool enabled) { enabled_ = enabled; }
+    // Any thread; the histograms restart with the new binning
+    void setConfig(const tpx3HistConfig &config);
+
+    // merge() is called from one publisher thread; reset() and read() from any
+    void merge();
+    void reset();
+    // tot gets TPX3_HIST_TOT_BINS elements, toa TPX3_HIST_TOA_MAX_BINS; counts saturate at 2^31-1
+    void read(bool live, int32_t *tot, int32_t *toa,
+              uint64_t *totCount, uint64_t *toaCount, uint64_t *noTdcCount) const;
+
+private:
+    struct alignas(64) workerHist {
+        // Worker-private state
+        tpx3HistConfig config;
+        unsigned generation;
+        double toaUnitsPerBin;
+        double toaOffsetUnits;
+        uint64_t sequence;
+        uint64_t tdc[TPX3_HIST_TDC_HISTORY];  // recent edges in ToA units (1.5625 ns)
+        unsigned numTdc;                      // edges in tdc[], newest at (numTdc - 1)
+        // Counters, read by merge()
+        alignas(64) std::atomic<uint32_t> tot[TPX3_HIST_TOT_BINS];
+        std::atomic<uint32_t> toa[TPX3_HIST_TOA_MAX_BINS];
+        std::atomic<uint32_t> noTdc;
+    };
+
+    std::atomic<bool> enabled_;
+    std::atomic<unsigned> generation_;
+
+    mutable std::mutex mutex_;  // guards config_, the worker list and the merged histograms
+    tpx3HistConfig config_;
+    std::vector<workerHist *> workers_;
+
+    // Merged histograms: tot bins, toa bins, then the unreferenced-hit count
+    std::vector<uint32_t> lastSum_;
+    std::vector<uint64_t> accumulated_;
+    std::vector<uint64_t> live_;
+    std::vector<uint32_t> scratch_;  // merge()'s counter sums, allocated once
+
+    void loadConfig(workerHist &h);
+    void sumCounters(std::vector<uint32_t> *sums) const;
+    void rebase();
+};
+
+#endif // tpx3Histogram_H
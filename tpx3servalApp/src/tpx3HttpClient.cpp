@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "tpx3HttpClient.h"
+
+// Largest response body accepted; Serval's status documents are a few kB
+#define MAX_BODY_BYTES (4 * 1024 * 1024)
+
+static double monotonicNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Wait until fd is ready for events or the deadline passes
+static bool waitFd(int fd, short events, double deadline, std::string *error)
+{
+    for (;;) {
+        int remainingMs = (int)((deadline - monotonicNow()) * 1000.0);
+        if (remainingMs <= 0) {
+            *error = "timeout";
+            return false;
+        }
+        struct pollfd pfd = { fd, events, 0 };
+        int n = poll(&pfd, 1, remainingMs);
+        if (n > 0) {
+            return true;
+        }
+        if (n == 0) {
+            *error = "timeout";
+            return false;
+        }
+        if (errno != EINTR) {
+            *error = strerror(errno);
+            return false;
+        }
+    }
+}
+
+tpx3HttpClient::tpx3HttpClient()
+    : port_(0), fd_(-1), timeout_(2.0), connects_(0), buf_(16384), bufStart_(0), bufEnd_(0)
+{
+}
+
+tpx3HttpClient::~tpx3HttpClient()
+{
+    disconnect();
+}
+
+void tpx3HttpClient::setEndpoint(const std::string &host, int port)
+{
+    if (host != host_ || port != port_) {
+        disconnect();
+        host_ = host;
+        port_ = port;
+    }
+}
+
+void tpx3HttpClient::disconnect()
+{
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+    bufStart_ = bufEnd_ = 0;
+}
+
+bool tpx3HttpClient::connectSocket(std::string *error)
+{
+    double deadline = monotonicNow() + timeout_;
+    char portStr[16];
+    snprintf(portStr, sizeof(portStr), "%d", port_);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *addrs = NULL;
+    int rc = getaddrinfo(host_.c_str(), portStr, &hints, &addrs);
+    if (rc != 0) {
+        *error = gai_strerror(rc);
+        return false;
+    }
+
+    *error = "connection refused";
+    for (struct addrinfo *ai = addrs; ai; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) {
+            *error = strerror(errno);
+            continue;
+        }
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+            if (errno != EINPROGRESS || !waitFd(fd, POLLOUT, deadline, error)) {
+                if (errno != EINPROGRESS) {
+                    *error = strerror(errno);
+                }
+                close(fd);
+                continue;
+            }
+            int soError = 0;
+            socklen_t len = sizeof(soError);
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &soError, &len);
+            if (soError != 0) {
+                *error = strerror(soError);
+                close(fd);
+                continue;
+            }
+        }
+        // Requests are small and latency matters more than packet count
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fd_ = fd;
+        connects_++;
+        break;
+    }
+    freeaddrinfo(addrs);
+    bufStart_ = bufEnd_ = 0;
+    return fd_ >= 0;
+}
+
+bool tpx3HttpClient::sendAll(const std::string &data, double deadline, std::string *error)
+{
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += n;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!waitFd(fd_, POLLOUT, deadline, error)) {
+                return false;
+            }
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            *error = strerror(errno);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Receive more bytes into buf_
+bool tpx3HttpClient::fill(double deadline, std::string *error)
+{
+    if (bufStart_ == bufEnd_) {
+        bufStart_ = bufEnd_ = 0;
+    } else if (bufEnd_ == buf_.size()) {
+        if (bufStart_ > 0) {
+            memmove(&buf_[0], &buf_[bufStart_], bufEnd_ - bufStart_);
+            bufEnd_ -= bufStart_;
+            bufStart_ = 0;
+        } else {
+            buf_.resize(buf_.size() * 2);
+        }
+    }
+    for (;;) {
+        ssize_t n = recv(fd_, &buf_[bufEnd_], buf_.size() - bufEnd_, 0);
+        if (n > 0) {
+            bufEnd_ += n;
+            return true;
+        }
+        if (n == 0) {
+            *error = "connection closed by server";
+            return false;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            if (!waitFd(fd_, POLLIN, deadline, error)) {
+                return false;
+            }
+        } else if (errno != EINTR) {
+            *error = strerror(errno);
+            return false;
+        }
+    }
+}
+
+// Read one CRLF-terminated line, without the terminator
+bool tpx3HttpClient::readLine(std::string *line, double deadline, std::string *error)
+{
+    for (;;) {
+        char *start = &buf_[0] + bufStart_;
+        char *nl = (char *)memchr(start, '\n', bufEnd_ - bufStart_);
+        if (nl) {
+            size_t len = nl - start;
+            line->assign(start, (len > 0 && start[len - 1] == '\r') ? len - 1 : len);
+            bufStart_ += len + 1;
+            return true;
+        }
+        if (bufEnd_ - bufStart_ > 65536) {
+            *error = "header line too long";
+            return false;
+        }
+        if (!fill(deadline, error)) {
+            return false;
+        }
+    }
+}
+
+bool tpx3HttpClient::readBytes(size_t count, std::string *out, double deadline, std::string *error)
+{
+    while (count > 0) {
+        if (bufStart_ == bufEnd_ && !fill(deadline, error)) {
+            return false;
+        }
+        size_t take = bufEnd_ - bufStart_;
+        if (take > count) {
+            take = count;
+        }
+        out->append(&buf_[bufStart_], take);
+        bufStart_ += take;
+        count -= take;
+    }
+    return true;
+}
+
+bool tpx3HttpClient::request(const std::string &path, tpx3HttpResponse *response, bool *keepAlive)
+{
+    double start = monotonicNow();
+    double deadline = start + timeout_;
+    std::string &error = response->error;
+    char hostHeader[300];
+    snprintf(hostHeader, sizeof(hostHeader), "%s:%d", host_.c_str(), port_);
+    std::string req = "GET " + path + " HTTP/1.1\r\nHost: " + hostHeader +
+                      "\r\nAccept: application/json\r\nConnection: keep-alive\r\n\r\n";
+    if (!sendAll(req, deadline, &error)) {
+        return false;
+    }
+
+    // Status line and headers
+    std::string line;
+    if (!readLine(&line, deadline, &error)) {
+        return false;
+    }
+    int status = 0;
+    int minor = 1;
+    if (sscanf(line.c_str(), "HTTP/1.%d %d", &minor, &status) != 2) {
+        error = "malformed status line";
+        return false;
+    }
+    *keepAlive = (minor >= 1);
+    long long contentLength = -1;
+    bool chunked = false;
+    for (;;) {
+        if (!readLine(&line, deadline, &error)) {
+            return false;
+        }
+        if (line.empty()) {
+            break;
+        }
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string name = line.substr(0, colon);
+        const char *value = line.c_str() + colon + 1;
+        while (*value == ' ' || *value == '\t') {
+            value++;
+        }
+        if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+            contentLength = atoll(value);
+        } else if (strcasecmp(name.c_str(), "Transfer-Encoding") == 0) {
+            chunked = strcasestr(value, "chunked") != NULL;
+        } else if (strcasecmp(name.c_str(), "Connection") == 0) {
+            if (strcasestr(value, "close")) {
+                *keepAlive = false;
+            } else if (strcasestr(value, "keep-alive")) {
+                *keepAlive = true;
+            }
+        }
+    }
+
+    // Body
+    response->body.clear();
+    if (chunked) {
+        for (;;) {
+            if (!readLine(&line, deadline, &error)) {
+                return false;
+            }
+            unsigned long size = strtoul(line.c_str(), NULL, 16);
+            if (size == 0) {
+                // Trailers end with an empty line
+                do {
+                    if (!readLine(&line, deadline, &error)) {
+                        return false;
+                    }
+                } while (!line.empty());
+                break;
+            }
+            if (response->body.size() + size > MAX_BODY_BYTES) {
+                error = "response too large";
+                return false;
+            }
+            if (!readBytes(size, &response->body, deadline, &error) ||
+                !readLine(&line, deadline, &error)) {
+                return false;
+            }
+        }
+    } else if (contentLength >= 0) {
+        if (contentLength > MAX_BODY_BYTES) {
+            error = "response too large";
+            return false;
+        }
+        if (!readBytes((size_t)contentLength, &response->body, deadline, &error)) {
+            return false;
+        }
+    } else if (status != 204 && status != 304) {
+        // Body delimited by connection close
+        std::string ignored;
+        while (fill(deadline, &ignored)) {
+            if (bufEnd_ - bufStart_ > MAX_BODY_BYTES) {
+                error = "response too large";
+                return false;
+            }
+        }
+        response->body.assign(&buf_[bufStart_], bufEnd_ - bufStart_);
+        bufStart_ = bufEnd_;
+        *keepAlive = false;
+    }
+
+    response->status = status;
+    response->latencyMs = (monotonicNow() - start) * 1000.0;
+    error.clear();
+    return true;
+}
+
+bool tpx3HttpClient::get(const std::string &path, tpx3HttpResponse *response)
+{
+    response->status = 0;
+    response->latencyMs = 0.0;
+    response->error.clear();
+    response->body.clear();
+
+    // A kept-alive connection may have been closed by the server while idle;
+    // retry once on a fresh connection in that case
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool reused = (fd_ >= 0);
+        if (!reused && !connectSocket(&response->error)) {
+            return false;
+        }
+        bool keepAlive = false;
+        if (request(path, response, &keepAlive)) {
+            if (!keepAlive) {
+                disconnect();
+            }
+            return true;
+        }
+        disconnect();
+        if (!reused || response->error == "timeout") {
+            break;
+        }
+    }
+    response->status = 0;
+    return false;
+}
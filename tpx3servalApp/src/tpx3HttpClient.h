@@ -0,0 +1,50 @@
+#ifndef tpx3HttpClient_H
+#define tpx3HttpClient_H
+
+#include <string>
+#include <vector>
+
+// Response of one HTTP request
+struct tpx3HttpResponse {
+    int status;          // HTTP status code, 0 if no response was received
+    std::string body;
+    double latencyMs;    // request sent to response body complete
+    std::string error;   // set when status is 0
+};
+
+// Minimal blocking HTTP/1.1 client for Serval's REST API. The connection is
+// kept alive between requests and re-established once if the server closed it.
+// Not thread safe: one thread owns an instance.
+class tpx3HttpClient {
+public:
+    tpx3HttpClient();
+    ~tpx3HttpClient();
+
+    // Changing the endpoint drops the current connection
+    void setEndpoint(const std::string &host, int port);
+    void setTimeout(double seconds) { timeout_ = seconds; }
+    void disconnect();
+    bool connected() const { return fd_ >= 0; }
+    unsigned long connects() const { return connects_; }
+
+    bool get(const std::string &path, tpx3HttpResponse *response);
+
+private:
+    std::string host_;
+    int port_;
+    int fd_;
+    double timeout_;
+    unsigned long connects_;
+    std::vector<char> buf_;  // received but not yet consumed bytes
+    size_t bufStart_;
+    size_t bufEnd_;
+
+    bool connectSocket(std::string *error);
+    bool sendAll(const std::string &data, double deadline, std::string *error);
+    bool fill(double deadline, std::string *error);
+    bool readLine(std::string *line, double deadline, std::string *error);
+    bool readBytes(size_t count, std::string *out, double deadline, std::string *error);
+    bool request(const std::string &path, tpx3HttpResponse *response, bool *keepAlive);
+};
+
+#endif // tpx3HttpClient_H
@@ -0,0 +1,168 @@
+/* tpx3HttpClientTest.cpp
+ *
+ * Test of tpx3HttpClient against test/serval_stub.py, the way the driver's
+ * polling thread uses it: repeated /dashboard and /detector/health requests
+ * on one keep-alive connection, parsed with tpx3JsonFlatten(). It also has the
+ * stub drop the connection unannounced and checks that the next request
+ * recovers on a new one. Exits non-zero when any check fails
+ * (see test/test_http_client.sh).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+
+#include "tpx3HttpClient.h"
+#include "tpx3Json.h"
+
+#define TEST_POLLS 5
+#define TEST_POLL_INTERVAL_US 100000
+#define TEST_TIMEOUT 2.0
+
+static int failures = 0;
+
+static void check(const char *name, const std::string &actual, const std::string &expected)
+{
+    if (actual == expected) {
+        printf("   ok   %s = %s\n", name, actual.c_str());
+    } else {
+        printf("   FAIL %s = '%s' (expected '%s')\n", name, actual.c_str(), expected.c_str());
+        failures++;
+    }
+}
+
+static void check(const char *name, double actual, double expected)
+{
+    char a[64], e[64];
+    snprintf(a, sizeof(a), "%g", actual);
+    snprintf(e, sizeof(e), "%g", expected);
+    check(name, std::string(a), std::string(e));
+}
+
+static std::string field(const std::map<std::string, std::string> &json, const char *key)
+{
+    std::map<std::string, std::string>::const_iterator it = json.find(key);
+    return it == json.end() ? std::string("<missing>") : it->second;
+}
+
+// GET path and flatten the JSON body; a failed request counts as a failure
+static bool getJson(tpx3HttpClient &client, const char *path, std::map<std::string, std::string> *json)
+{
+    tpx3HttpResponse response;
+    json->clear();
+    if (!client.get(path, &response)) {
+        printf("   FAIL GET %s: %s\n", path, response.error.c_str());
+        failures++;
+        return false;
+    }
+    if (response.status != 200 || !tpx3JsonFlatten(response.body, json)) {
+        printf("   FAIL GET %s: HTTP %d, %zu byte body\n", path, response.status, response.body.size());
+        failures++;
+        return false;
+    }
+    return true;
+}
+
+static double number(const std::map<std::string, std::string> &json, const char *key)
+{
+    std::string text = field(json, key);
+    char *end;
+    double value = strtod(text.c_str(), &end);
+    return (end != text.c_str() && *end == '\0') ? value : -1.0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --host NAME   stub host (default localhost)\n"
+            "  --port N      stub HTTP port (default 18081)\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    std::string host = "localhost";
+    int port = 18081;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--host" && hasValue) {
+            host = argv[++i];
+        } else if (arg == "--port" && hasValue) {
+            port = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (port <= 0 || port > 65535) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    tpx3HttpClient client;
+    client.setEndpoint(host, port);
+    client.setTimeout(TEST_TIMEOUT);
+    std::map<std::string, std::string> json;
+
+    // The stub's counters include earlier clients, so only differences count
+    printf("Polling /dashboard and /detector/health...\n");
+    if (!getJson(client, "/stub/stats", &json)) {
+        return 1;
+    }
+    double connections = number(json, "connections");
+    double requests = number(json, "requests");
+    double frames = -1.0;
+    bool framesGrow = true;
+    for (int i = 0; i < TEST_POLLS; i++) {
+        if (i > 0) {
+            usleep(TEST_POLL_INTERVAL_US);
+        }
+        if (!getJson(client, "/dashboard", &json)) {
+            break;
+        }
+        double frameCount = number(json, "Measurement.FrameCount");
+        framesGrow = framesGrow && frameCount >= frames;
+        frames = frameCount;
+    }
+    check("Server.SoftwareVersion", field(json, "Server.SoftwareVersion"), "3.3.2-stub");
+    check("Detector.DetectorType", field(json, "Detector.DetectorType"), "Tpx3");
+    check("Detector.NumberOfChips", number(json, "Detector.NumberOfChips"), 4);
+    check("Measurement.Status", field(json, "Measurement.Status"), "DA_RECORDING");
+    check("Measurement.PixelEventRate", number(json, "Measurement.PixelEventRate"), 1.25e6);
+    check("Measurement.Tdc1EventRate", number(json, "Measurement.Tdc1EventRate"), 1000);
+    check("Measurement.FrameCount grows", framesGrow && frames > 0 ? "yes" : "no", "yes");
+    check("Server.Notifications", field(json, "Server.Notifications"), "[]");
+    if (getJson(client, "/detector/health", &json)) {
+        check("LocalTemperature", number(json, "LocalTemperature"), 35.5);
+        check("FPGATemperature", number(json, "FPGATemperature"), 52.25);
+        check("Humidity", number(json, "Humidity"), 12.0);
+        check("ChipTemperatures.3", number(json, "ChipTemperatures.3"), 43);
+    }
+
+    printf("Checking keep-alive (one connection for all requests)...\n");
+    if (getJson(client, "/stub/stats", &json)) {
+        check("stub new connections", number(json, "connections") - connections, 0);
+        check("stub requests", number(json, "requests") - requests, TEST_POLLS + 2);
+    }
+    check("client connects", (double)client.connects(), 1);
+    check("client connected", client.connected() ? "yes" : "no", "yes");
+
+    // The request on the dead connection fails and get() retries once on a new one
+    printf("Recovering after the stub closes the connection...\n");
+    getJson(client, "/stub/close", &json);
+    usleep(TEST_POLL_INTERVAL_US);
+    if (getJson(client, "/dashboard", &json)) {
+        check("Server.SoftwareVersion", field(json, "Server.SoftwareVersion"), "3.3.2-stub");
+    }
+    check("client connects", (double)client.connects(), 2);
+    if (getJson(client, "/stub/stats", &json)) {
+        check("stub new connections", number(json, "connections") - connections, 1);
+    }
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tpx3Json.h"
+
+namespace {
+
+class jsonFlattener {
+public:
+    jsonFlattener(const std::string &text, std::map<std::string, std::string> *out)
+        : p_(text.c_str()), end_(text.c_str() + text.size()), out_(out), depth_(0) {}
+
+    bool parse()
+    {
+        if (!value("")) {
+            return false;
+        }
+        skipSpace();
+        return p_ == end_;
+    }
+
+private:
+    const char *p_;
+    const char *end_;
+    std::map<std::string, std::string> *out_;
+    int depth_;
+
+    void skipSpace()
+    {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+            p_++;
+        }
+    }
+
+    static std::string join(const std::string &prefix, const std::string &key)
+    {
+        return prefix.empty() ? key : prefix + "." + key;
+    }
+
+    static void appendUtf8(std::string *s, unsigned long cp)
+    {
+        if (cp < 0x80) {
+            *s += (char)cp;
+        } else if (cp < 0x800) {
+            *s += (char)(0xC0 | (cp >> 6));
+            *s += (char)(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            *s += (char)(0xE0 | (cp >> 12));
+            *s += (char)(0x80 | ((cp >> 6) & 0x3F));
+            *s += (char)(0x80 | (cp & 0x3F));
+        } else {
+            *s += (char)(0xF0 | (cp >> 18));
+            *s += (char)(0x80 | ((cp >> 12) & 0x3F));
+            *s += (char)(0x80 | ((cp >> 6) & 0x3F));
+            *s += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+
+    bool hex4(unsigned long *cp)
+    {
+        if (end_ - p_ < 4) {
+            return false;
+        }
+        char digits[5];
+        memcpy(digits, p_, 4);
+        digits[4] = '\0';
+        char *stop;
+        *cp = strtoul(digits, &stop, 16);
+        if (stop != digits + 4) {
+            return false;
+        }
+        p_ += 4;
+        return true;
+    }
+
+    bool string(std::string *s)
+    {
+        if (p_ >= end_ || *p_ != '"') {
+            return false;
+        }
+        p_++;
+        while (p_ < end_ && *p_ != '"') {
+            if (*p_ != '\\') {
+                *s += *p_++;
+                continue;
+            }
+            if (++p_ >= end_) {
+                return false;
+            }
+            char c = *p_++;
+            switch (c) {
+            case 'b': *s += '\b'; break;
+            case 'f': *s += '\f'; break;
+            case 'n': *s += '\n'; break;
+            case 'r': *s += '\r'; break;
+            case 't': *s += '\t'; break;
+            case 'u': {
+                unsigned long cp;
+                if (!hex4(&cp)) {
+                    return false;
+                }
+                // Combine a surrogate pair
+                if (cp >= 0xD800 && cp < 0xDC00 && end_ - p_ >= 6 && p_[0] == '\\' && p_[1] == 'u') {
+                    p_ += 2;
+                    unsigned long low;
+                    if (!hex4(&low)) {
+                        return false;
+                    }
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                appendUtf8(s, cp);
+                break;
+            }
+            default: *s += c; break;
+            }
+        }
+        if (p_ >= end_) {
+            return false;
+        }
+        p_++;
+        return true;
+    }
+
+    bool value(const std::string &path)
+    {
+        skipSpace();
+        if (p_ >= end_ || depth_ > 64) {
+            return false;
+        }
+        if (*p_ == '{') {
+            return object(path);
+        }
+        if (*p_ == '[') {
+            return array(path);
+        }
+        if (*p_ == '"') {
+            std::string s;
+            if (!string(&s)) {
+                return false;
+            }
+            (*out_)[path] = s;
+            return true;
+        }
+        // Number or literal: keep the token text
+        const char *start = p_;
+        while (p_ < end_ && !strchr(",]} \t\r\n", *p_)) {
+            p_++;
+        }
+        if (p_ == start) {
+            return false;
+        }
+        (*out_)[path] = std::string(start, p_ - start);
+        return true;
+    }
+
+    bool object(const std::string &path)
+    {
+        p_++;
+        depth_++;
+        skipSpace();
+        if (p_ < end_ && *p_ == '}') {
+            p_++;
+            depth_--;
+            (*out_)[path] = "{}";
+            return true;
+        }
+        for (;;) {
+            skipSpace();
+            std::string key;
+            if (!string(&key)) {
+                return false;
+            }
+            skipSpace();
+            if (p_ >= end_ || *p_++ != ':') {
+                return false;
+            }
+            if (!value(join(path, key))) {
+                return false;
+            }
+            skipSpace();
+            if (p_ >= end_) {
+                return false;
+            }
+            if (*p_ == ',') {
+                p_++;
+            } else if (*p_ == '}') {
+                p_++;
+                depth_--;
+                return true;
+            } else {
+                return false;
+            }
+        }
+    }
+
+    bool array(const std::string &path)
+    {
+        p_++;
+        depth_++;
+        skipSpace();
+        if (p_ < end_ && *p_ == ']') {
+            p_++;
+            depth_--;
+            (*out_)[path] = "[]";
+            return true;
+        }
+        for (int index = 0; ; index++) {
+            char key[16];
+            snprintf(key, sizeof(key), "%d", index);
+            if (!value(join(path, key))) {
+                return false;
+            }
+            skipSpace();
+            if (p_ >= end_) {
+                return false;
+            }
+            if (*p_ == ',') {
+                p_++;
+            } else if (*p_ == ']') {
+                p_++;
+                depth_--;
+                return true;
+            } else {
+                return false;
+            }
+        }
+    }
+};
+
+} // namespace
+
+bool tpx3JsonFlatten(const std::string &text, std::map<std::string, std::string> *out)
+{
+    jsonFlattener flattener(text, out);
+    return flattener.parse();
+}
@@ -0,0 +1,13 @@
+#ifndef tpx3Json_H
+#define tpx3Json_H
+
+#include <map>
+#include <string>
+
+// Flatten a JSON document into dotted paths, e.g. {"a":{"b":[1,"x"]}} gives
+// "a.b.0" -> "1" and "a.b.1" -> "x". Strings are unescaped; numbers, true,
+// false and null keep their JSON text. Empty objects and arrays map to "{}"/"[]".
+// Serval's status documents are small, so a flat map is all the driver needs.
+bool tpx3JsonFlatten(const std::string &text, std::map<std::string, std::string> *out);
+
+#endif // tpx3Json_H
@@ -0,0 +1,108 @@
+#ifndef tpx3Packet_H
+#define tpx3Packet_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Field layout of the 64-bit TPX3 packet words inside a raw stream chunk (see
+// tpx3Stream.h for the chunk header). Shared by the stream generator and the
+// analysis stages so both sides agree on the encoding.
+
+#define TPX3_CHIP_PIXELS 256
+
+// Pixel hit (type 0xB): pixaddr[59:44] toa[43:30] tot[29:20] ftoa[19:16] spidrTime[15:0].
+// Time of arrival is counted in 1.5625 ns units: ((spidrTime << 14) + toa) * 16 - ftoa.
+#define TPX3_TOA_UNIT_NS  1.5625
+#define TPX3_TOT_UNIT_NS  25.0
+#define TPX3_TOA_BITS     34  // spidrTime + toa + ftoa, wraps after ~26.8 s
+
+// TDC (type 0x6): edge[59:56] trigger[55:44] coarse[43:9] fine[8:5].
+// coarse counts 3.125 ns; fine is 1-12 in 260 ps steps (0 is invalid).
+#define TPX3_TDC1_RISE 0xF
+#define TPX3_TDC1_FALL 0xA
+#define TPX3_TDC2_RISE 0xE
+#define TPX3_TDC2_FALL 0xB
+#define TPX3_TDC_COARSE_PS 3125
+#define TPX3_TDC_FINE_PS   260
+
+// Global time (type 0x4): subtype 0x4 carries bits 31:0 and 0x5 bits 47:32 of
+// the 25 ns clock, in word bits [47:16].
+#define TPX3_GT_LSB 0x4
+#define TPX3_GT_MSB 0x5
+
+struct tpx3Hit {
+    int x;           // 0-255 within the chip
+    int y;
+    uint64_t toa;    // 1.5625 ns units, TPX3_TOA_BITS wide
+    int tot;         // 25 ns units
+};
+
+struct tpx3Tdc {
+    int edge;        // TPX3_TDC1_RISE, ...
+    int trigger;     // 12-bit trigger counter
+    uint64_t timePs; // 35-bit coarse counter plus fine phase, in ps
+};
+
+inline uint64_t tpx3ChunkHeader(int chip, int mode, size_t payloadBytes)
+{
+    return ((uint64_t)payloadBytes << 48) | ((uint64_t)(mode & 0xFF) << 40) |
+           ((uint64_t)(chip & 0xFF) << 32) | 0x33585054u;
+}
+
+inline uint64_t tpx3EncodeHit(int x, int y, uint64_t toa, int tot)
+{
+    uint64_t coarse = (toa + 15) >> 4;   // 25 ns ticks, rounded up so ftoa >= 0
+    uint64_t ftoa = (coarse << 4) - toa;
+    uint64_t pixaddr = ((uint64_t)(x >> 1) << 9) | ((uint64_t)(y >> 2) << 3) |
+                       ((uint64_t)(x & 1) << 2) | (uint64_t)(y & 3);
+    return (0xBull << 60) | (pixaddr << 44) | ((coarse & 0x3FFF) << 30) |
+           ((uint64_t)(tot & 0x3FF) << 20) | (ftoa << 16) | ((coarse >> 14) & 0xFFFF);
+}
+
+// Pixel index y * TPX3_CHIP_PIXELS + x of a hit word (either hit type). The
+// double column, super pixel and pixel fields never overlap, so OR is enough.
+inline unsigned tpx3HitPixel(uint64_t word)
+{
+    unsigned pixaddr = (unsigned)(word >> 44) & 0xFFFF;
+    unsigned x = ((pixaddr >> 8) & 0xFE) | ((pixaddr >> 2) & 1);
+    unsigned y = ((pixaddr >> 1) & 0xFC) | (pixaddr & 3);
+    return y * TPX3_CHIP_PIXELS + x;
+}
+
+inline void tpx3DecodeHit(uint64_t word, tpx3Hit *hit)
+{
+    unsigned pixel = tpx3HitPixel(word);
+    hit->x = (int)(pixel % TPX3_CHIP_PIXELS);
+    hit->y = (int)(pixel / TPX3_CHIP_PIXELS);
+    uint64_t coarse = ((word & 0xFFFF) << 14) | ((word >> 30) & 0x3FFF);
+    hit->toa = (coarse << 4) - ((word >> 16) & 0xF);
+    hit->tot = (int)((word >> 20) & 0x3FF);
+}
+
+inline uint64_t tpx3EncodeTdc(int edge, int trigger, uint64_t timePs)
+{
+    uint64_t coarse = timePs / TPX3_TDC_COARSE_PS;
+    uint64_t fine = (timePs % TPX3_TDC_COARSE_PS) / TPX3_TDC_FINE_PS + 1;
+    if (fine > 12) {
+        fine = 12;
+    }
+    return (0x6ull << 60) | ((uint64_t)(edge & 0xF) << 56) | ((uint64_t)(trigger & 0xFFF) << 44) |
+           ((coarse & 0x7FFFFFFFFull) << 9) | (fine << 5);
+}
+
+inline void tpx3DecodeTdc(uint64_t word, tpx3Tdc *tdc)
+{
+    tdc->edge = (int)((word >> 56) & 0xF);
+    tdc->trigger = (int)((word >> 44) & 0xFFF);
+    uint64_t coarse = (word >> 9) & 0x7FFFFFFFFull;
+    uint64_t fine = (word >> 5) & 0xF;
+    tdc->timePs = coarse * TPX3_TDC_COARSE_PS + (fine ? (fine - 1) * TPX3_TDC_FINE_PS : 0);
+}
+
+inline uint64_t tpx3EncodeGlobalTime(int subtype, uint64_t ticks25ns)
+{
+    uint64_t bits = subtype == TPX3_GT_LSB ? (ticks25ns & 0xFFFFFFFFull) : ((ticks25ns >> 32) & 0xFFFF);
+    return (0x4ull << 60) | ((uint64_t)(subtype & 0xF) << 56) | (bits << 16);
+}
+
+#endif // tpx3Packet_H
@@ -0,0 +1,274 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+
+#include "tpx3PixelMask.h"
+
+#define MASK_ELEMENTS (TPX3_MASK_CHIPS * TPX3_MASK_CHIP_ELEMENTS)
+#define MASK_MAX_PASSES 10
+#define BPC_MASK_BIT 0x01
+
+tpx3PixelMask::tpx3PixelMask()
+    : acquiring_(false), baseline_(MASK_ELEMENTS, 0), counts_(MASK_ELEMENTS, 0),
+      flagged_(MASK_ELEMENTS, 0), haveResult_(false)
+{
+    memset(&result_, 0, sizeof(result_));
+}
+
+tpx3PixelMask::~tpx3PixelMask()
+{
+    for (size_t i = 0; i < workers_.size(); i++) {
+        workers_[i]->~workerState();
+        free(workers_[i]);
+    }
+}
+
+void tpx3PixelMask::configure(int numWorkers)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    // Workers are kept across restarts; new ones start at 0, which leaves the sums unchanged
+    while ((int)workers_.size() < numWorkers) {
+        // operator new does not honour alignas(64) before C++17
+        void *memory = NULL;
+        if (posix_memalign(&memory, 64, sizeof(workerState)) != 0) {
+            throw std::bad_alloc();
+        }
+        workerState *w = new (memory) workerState();
+        for (int c = 0; c < TPX3_MASK_CHIPS; c++) {
+            w->chipHits[c].store(0, std::memory_order_relaxed);
+        }
+        w->counts.reset(new std::atomic<uint32_t>[MASK_ELEMENTS]());
+        workers_.push_back(w);
+    }
+}
+
+void tpx3PixelMask::consume(int worker, const tpx3StreamChunk &chunk)
+{
+    if (chunk.chip < 0 || chunk.chip >= TPX3_MASK_CHIPS || chunk.hits == 0) {
+        return;
+    }
+    workerState &w = *workers_[worker];
+    // Only this worker writes its counters, so a relaxed load/store pair is a plain increment
+    std::atomic<uint64_t> &hits = w.chipHits[chunk.chip];
+    hits.store(hits.load(std::memory_order_relaxed) + chunk.hits, std::memory_order_relaxed);
+    if (!acquiring_.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    std::atomic<uint32_t> *chip = w.counts.get() + chunk.chip * TPX3_MASK_CHIP_ELEMENTS;
+    for (size_t i = 0; i < chunk.count; i++) {
+        uint64_t word = chunk.words[i];
+        if (((word >> 60) | 1) != TPX3_PKT_HIT) {
+            continue;
+        }
+        std::atomic<uint32_t> &count = chip[tpx3HitPixel(word)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+void tpx3PixelMask::chipHits(uint64_t out[TPX3_MASK_CHIPS]) const
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (int c = 0; c < TPX3_MASK_CHIPS; c++) {
+        out[c] = 0;
+        for (size_t w = 0; w < workers_.size(); w++) {
+            out[c] += workers_[w]->chipHits[c].load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Caller holds mutex_
+void tpx3PixelMask::sumCounts(std::vector<uint32_t> &out) const
+{
+    size_t numWorkers = workers_.size();
+    for (size_t p = 0; p < MASK_ELEMENTS; p++) {
+        uint32_t sum = 0;
+        for (size_t w = 0; w < numWorkers; w++) {
+            sum += workers_[w]->counts[p].load(std::memory_order_relaxed);
+        }
+        out[p] = sum;
+    }
+}
+
+void tpx3PixelMask::startAcquisition()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    // Chunks counted between this snapshot and the flag are not in the baseline; a
+    // few hits at the very start of the acquisition are within its noise
+    sumCounts(baseline_);
+    acquiring_ = true;
+}
+
+void tpx3PixelMask::abortAcquisition()
+{
+    acquiring_ = false;
+}
+
+void tpx3PixelMask::finishAcquisition(double seconds, double nSigma, tpx3MaskResult *out)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    acquiring_ = false;
+    sumCounts(counts_);
+    // Unsigned wrap-around keeps the difference right even after a counter overflows
+    for (size_t p = 0; p < MASK_ELEMENTS; p++) {
+        counts_[p] -= baseline_[p];
+    }
+    std::fill(flagged_.begin(), flagged_.end(), 0);
+
+    tpx3MaskResult &r = result_;
+    memset(&r, 0, sizeof(r));
+    r.seconds = seconds;
+    r.nSigma = nSigma;
+    for (int c = 0; c < TPX3_MASK_CHIPS; c++) {
+        const uint32_t *counts = &counts_[c * TPX3_MASK_CHIP_ELEMENTS];
+        uint8_t *flagged = &flagged_[c * TPX3_MASK_CHIP_ELEMENTS];
+        for (int p = 0; p < TPX3_MASK_CHIP_ELEMENTS; p++) {
+            r.hits[c] += counts[p];
+        }
+        // Sigma clipping: hot pixels inflate the spread, so flag, drop them and repeat
+        // until no pixel is added. The spread is never taken below the Poisson spread
+        // of the mean count (one count on a dark chip), or a single stray hit would do.
+        double mean = 0.0, threshold = 0.0;
+        for (int pass = 0; pass < MASK_MAX_PASSES; pass++) {
+            double n = 0.0, sum = 0.0, sum2 = 0.0;
+            for (int p = 0; p < TPX3_MASK_CHIP_ELEMENTS; p++) {
+                if (!flagged[p]) {
+                    double v = counts[p];
+                    n += 1.0;
+                    sum += v;
+                    sum2 += v * v;
+                }
+            }
+            if (n == 0.0) {
+                break;
+            }
+            mean = sum / n;
+            double variance = sum2 / n - mean * mean;
+            double sigma = std::max(sqrt(variance > 0.0 ? variance : 0.0), sqrt(std::max(mean, 1.0)));
+            threshold = mean + nSigma * sigma;
+            uint32_t added = 0;
+            for (int p = 0; p < TPX3_MASK_CHIP_ELEMENTS; p++) {
+                if (!flagged[p] && counts[p] > threshold) {
+                    flagged[p] = 1;
+                    added++;
+                }
+            }
+            r.noisy[c] += added;
+            if (added == 0) {
+                break;
+            }
+        }
+        for (int p = 0; p < TPX3_MASK_CHIP_ELEMENTS; p++) {
+            if (flagged[p]) {
+                r.noisyHits += counts[p];
+            }
+        }
+        if (seconds > 0.0) {
+            r.meanRate[c] = mean / seconds;
+            r.thresholdRate[c] = threshold / seconds;
+        }
+    }
+    haveResult_ = true;
+    *out = r;
+}
+
+bool tpx3PixelMask::exportMask(const std::string &path, const std::string &basePath, std::string *error) const
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (!haveResult_) {
+        *error = "No noisy-pixel acquisition has finished";
+        return false;
+    }
+    if (path.empty()) {
+        *error = "Mask file not set";
+        return false;
+    }
+    return basePath.empty() ? writeList(path, error) : writeBpc(path, basePath, error);
+}
+
+// Caller holds mutex_
+bool tpx3PixelMask::writeList(const std::string &path, std::string *error) const
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f) {
+        *error = "Cannot write " + path + ": " + strerror(errno);
+        return false;
+    }
+    uint32_t total = 0;
+    for (int c = 0; c < TPX3_MASK_CHIPS; c++) {
+        total += result_.noisy[c];
+    }
+    fprintf(f, "# Noisy pixels: %u above %.1f sigma over a %.1f s acquisition\n",
+            total, result_.nSigma, result_.seconds);
+    fprintf(f, "# chip x y rate_hz\n");
+    for (int p = 0; p < MASK_ELEMENTS; p++) {
+        if (flagged_[p]) {
+            int chip = p / TPX3_MASK_CHIP_ELEMENTS;
+            int pixel = p % TPX3_MASK_CHIP_ELEMENTS;
+            fprintf(f, "%d %d %d %.3f\n", chip, pixel % TPX3_CHIP_PIXELS, pixel / TPX3_CHIP_PIXELS,
+                    result_.seconds > 0.0 ? counts_[p] / result_.seconds : 0.0);
+        }
+    }
+    if (fclose(f) != 0) {
+        *error = "Cannot write " + path + ": " + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+// Caller holds mutex_. Serval's .bpc holds one byte per pixel, chip after chip,
+// pixel x * 256 + y within a chip; bit 0 masks the pixel. The other bits (the
+// threshold trim) are kept from the base configuration.
+bool tpx3PixelMask::writeBpc(const std::string &path, const std::string &basePath, std::string *error) const
+{
+    FILE *f = fopen(basePath.c_str(), "rb");
+    if (!f) {
+        *error = "Cannot read " + basePath + ": " + strerror(errno);
+        return false;
+    }
+    std::vector<uint8_t> bpc;
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0 && bpc.size() <= MASK_ELEMENTS) {
+        bpc.insert(bpc.end(), buffer, buffer + n);
+    }
+    fclose(f);
+    if (bpc.empty() || bpc.size() % TPX3_MASK_CHIP_ELEMENTS != 0 || bpc.size() > MASK_ELEMENTS) {
+        *error = basePath + " is not a pixel configuration of 1-4 chips";
+        return false;
+    }
+
+    int chips = (int)(bpc.size() / TPX3_MASK_CHIP_ELEMENTS);
+    for (int c = chips; c < TPX3_MASK_CHIPS; c++) {
+        if (result_.noisy[c] > 0) {
+            *error = basePath + " has fewer chips than the stream";
+            return false;
+        }
+    }
+    for (int p = 0; p < chips * TPX3_MASK_CHIP_ELEMENTS; p++) {
+        if (flagged_[p]) {
+            int chip = p / TPX3_MASK_CHIP_ELEMENTS;
+            int pixel = p % TPX3_MASK_CHIP_ELEMENTS;
+            int x = pixel % TPX3_CHIP_PIXELS, y = pixel / TPX3_CHIP_PIXELS;
+            bpc[chip * TPX3_MASK_CHIP_ELEMENTS + x * TPX3_CHIP_PIXELS + y] |= BPC_MASK_BIT;
+        }
+    }
+
+    f = fopen(path.c_str(), "wb");
+    if (!f) {
+        *error = "Cannot write " + path + ": " + strerror(errno);
+        return false;
+    }
+    bool ok = fwrite(&bpc[0], 1, bpc.size(), f) == bpc.size();
+    if (fclose(f) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        *error = "Cannot write " + path + ": " + strerror(errno);
+    }
+    return ok;
+}
@@ -0,0 +1,78 @@
+#ifndef tpx3PixelMask_H
+#define tpx3PixelMask_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "tpx3Packet.h"
+#include "tpx3Stream.h"
+
+#define TPX3_MASK_CHIPS 4
+#define TPX3_MASK_CHIP_ELEMENTS (TPX3_CHIP_PIXELS * TPX3_CHIP_PIXELS)
+
+// Outcome of one noisy-pixel acquisition
+struct tpx3MaskResult {
+    double seconds;
+    double nSigma;
+    uint64_t hits[TPX3_MASK_CHIPS];          // all pixels
+    uint32_t noisy[TPX3_MASK_CHIPS];         // pixels flagged
+    double meanRate[TPX3_MASK_CHIPS];        // Hz per pixel, flagged pixels excluded
+    double thresholdRate[TPX3_MASK_CHIPS];   // Hz; pixels above it are flagged
+    uint64_t noisyHits;                      // hits in flagged pixels, all chips
+};
+
+// Per-chip hit totals, always counted, and per-pixel hit counts over a
+// dark or flat acquisition, from which noisy pixels are flagged chip by chip.
+// Per-chip totals come from the hit count the engine attaches to each chunk,
+// so they cost one add per chunk; pixels are only decoded while an
+// acquisition runs. Counters are per worker and only grow, as in tpx3Preview:
+// an acquisition is the difference between two snapshots of their sums.
+class tpx3PixelMask : public tpx3StreamConsumer {
+public:
+    tpx3PixelMask();
+    ~tpx3PixelMask();
+
+    void configure(int numWorkers);
+    void consume(int worker, const tpx3StreamChunk &chunk);
+
+    // Hits per chip since construction; any thread
+    void chipHits(uint64_t out[TPX3_MASK_CHIPS]) const;
+
+    // Any thread. start() begins counting per pixel, finish() stops and
+    // flags, per chip, the pixels whose count is more than nSigma standard
+    // deviations above the mean of the others. abort() drops the counts.
+    void startAcquisition();
+    void finishAcquisition(double seconds, double nSigma, tpx3MaskResult *out);
+    void abortAcquisition();
+
+    // Write the pixels flagged by the last finish(). With a base pixel
+    // configuration (Serval .bpc, one byte per pixel and chip) the file is a
+    // copy of it with the mask bit set; without one it is a text list.
+    bool exportMask(const std::string &path, const std::string &basePath, std::string *error) const;
+
+private:
+    struct alignas(64) workerState {
+        std::atomic<uint64_t> chipHits[TPX3_MASK_CHIPS];
+        std::unique_ptr<std::atomic<uint32_t>[]> counts;  // TPX3_MASK_CHIPS chips, y * 256 + x
+    };
+
+    std::atomic<bool> acquiring_;
+
+    mutable std::mutex mutex_;  // guards everything below, never taken by consume()
+    std::vector<workerState *> workers_;
+    std::vector<uint32_t> baseline_;  // pixel sums when the acquisition started
+    std::vector<uint32_t> counts_;    // last finished acquisition
+    std::vector<uint8_t> flagged_;
+    bool haveResult_;
+    tpx3MaskResult result_;
+
+    void sumCounts(std::vector<uint32_t> &out) const;
+    bool writeList(const std::string &path, std::string *error) const;
+    bool writeBpc(const std::string &path, const std::string &basePath, std::string *error) const;
+};
+
+#endif // tpx3PixelMask_H
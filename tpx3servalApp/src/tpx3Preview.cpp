@@ -0,0 +1,128 @@
+#include <string.h>
+#include <algorithm>
+
+#include "tpx3Preview.h"
+
+#define CHIP_ELEMENTS (TPX3_CHIP_PIXELS * TPX3_CHIP_PIXELS)
+#define TILE_ELEMENTS (TPX3_PREVIEW_CHIPS * CHIP_ELEMENTS)
+
+tpx3Preview::tpx3Preview()
+    : enabled_(true), decimation_(1),
+      lastSum_(TILE_ELEMENTS, 0), accumulated_(TILE_ELEMENTS, 0), live_(TILE_ELEMENTS, 0)
+{
+}
+
+void tpx3Preview::configure(int numWorkers)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    // Tiles are kept across restarts; new ones start at 0, which leaves the sums unchanged
+    while ((int)workers_.size() < numWorkers) {
+        workerTiles tiles;
+        tiles.counts.reset(new std::atomic<uint32_t>[TILE_ELEMENTS]());
+        tiles.skip = 0;
+        workers_.push_back(std::move(tiles));
+    }
+}
+
+void tpx3Preview::consume(int worker, const tpx3StreamChunk &chunk)
+{
+    if (!enabled_.load(std::memory_order_relaxed) || chunk.chip < 0 || chunk.chip >= TPX3_PREVIEW_CHIPS) {
+        return;
+    }
+    workerTiles &tiles = workers_[worker];
+    int decimation = decimation_.load(std::memory_order_relaxed);
+    if (decimation > 1 && (tiles.skip++ % decimation) != 0) {
+        return;
+    }
+
+    // Only this worker writes its tile, so a relaxed load/store pair is a plain increment
+    std::atomic<uint32_t> *tile = tiles.counts.get() + chunk.chip * CHIP_ELEMENTS;
+    for (size_t i = 0; i < chunk.count; i++) {
+        uint64_t word = chunk.words[i];
+        if (((word >> 60) | 1) != TPX3_PKT_HIT) {
+            continue;
+        }
+        std::atomic<uint32_t> &count = tile[tpx3HitPixel(word)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+void tpx3Preview::merge()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    size_t numWorkers = workers_.size();
+    for (size_t p = 0; p < TILE_ELEMENTS; p++) {
+        uint32_t sum = 0;
+        for (size_t w = 0; w < numWorkers; w++) {
+            sum += workers_[w].counts[p].load(std::memory_order_relaxed);
+        }
+        // Unsigned wrap-around keeps the difference right even after a counter overflows
+        uint32_t delta = sum - lastSum_[p];
+        lastSum_[p] = sum;
+        live_[p] = delta;
+        accumulated_[p] += delta;
+    }
+}
+
+void tpx3Preview::reset()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    // Counts not merged yet are dropped too: the new sums become the baseline
+    size_t numWorkers = workers_.size();
+    for (size_t p = 0; p < TILE_ELEMENTS; p++) {
+        uint32_t sum = 0;
+        for (size_t w = 0; w < numWorkers; w++) {
+            sum += workers_[w].counts[p].load(std::memory_order_relaxed);
+        }
+        lastSum_[p] = sum;
+    }
+    std::fill(accumulated_.begin(), accumulated_.end(), 0);
+    std::fill(live_.begin(), live_.end(), 0);
+}
+
+size_t tpx3Preview::render(int layout, int chip, int binning, bool live, int32_t *out,
+                           int *sizeX, int *sizeY, uint64_t *total, uint32_t *maxCount) const
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    const std::vector<uint32_t> &source = live ? live_ : accumulated_;
+    if (binning < 1) {
+        binning = 1;
+    }
+    int firstChip = 0, numChips = TPX3_PREVIEW_CHIPS, chipsAcross = 2;
+    if (layout == TPX3_PREVIEW_LAYOUT_CHIP) {
+        firstChip = (chip >= 0 && chip < TPX3_PREVIEW_CHIPS) ? chip : 0;
+        numChips = 1;
+        chipsAcross = 1;
+    }
+    int chipBins = TPX3_CHIP_PIXELS / binning;
+    int width = chipBins * chipsAcross;
+    int height = chipBins * ((numChips + chipsAcross - 1) / chipsAcross);
+    memset(out, 0, sizeof(int32_t) * width * height);
+
+    for (int c = 0; c < numChips; c++) {
+        const uint32_t *counts = &source[(firstChip + c) * CHIP_ELEMENTS];
+        int originX = (c % chipsAcross) * chipBins;
+        int originY = (c / chipsAcross) * chipBins;
+        for (int y = 0; y < chipBins * binning; y++) {
+            int32_t *row = out + (originY + y / binning) * width + originX;
+            const uint32_t *in = counts + y * TPX3_CHIP_PIXELS;
+            for (int x = 0; x < chipBins * binning; x++) {
+                row[x / binning] += (int32_t)in[x];
+            }
+        }
+    }
+
+    uint64_t sum = 0;
+    uint32_t peak = 0;
+    for (int i = 0; i < width * height; i++) {
+        sum += (uint32_t)out[i];
+        if ((uint32_t)out[i] > peak) {
+            peak = (uint32_t)out[i];
+        }
+    }
+    *sizeX = width;
+    *sizeY = height;
+    *total = sum;
+    *maxCount = peak;
+    return (size_t)(width * height);
+}
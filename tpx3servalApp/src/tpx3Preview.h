@@ -0,0 +1,65 @@
+#ifndef tpx3Preview_H
+#define tpx3Preview_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "tpx3Packet.h"
+#include "tpx3Stream.h"
+
+#define TPX3_PREVIEW_CHIPS 4
+#define TPX3_PREVIEW_QUAD_PIXELS (2 * TPX3_CHIP_PIXELS)
+#define TPX3_PREVIEW_MAX_ELEMENTS (TPX3_PREVIEW_QUAD_PIXELS * TPX3_PREVIEW_QUAD_PIXELS)
+
+// Image layouts
+#define TPX3_PREVIEW_LAYOUT_QUAD 0  // 512x512, chip c at column (c & 1), row (c >> 1)
+#define TPX3_PREVIEW_LAYOUT_CHIP 1  // 256x256, one chip
+
+// Hit-count image built from the raw stream. Each decode worker counts into
+// its own per-chip tiles; merge() folds the tiles into the preview image from
+// one publisher thread. Tile counters only ever grow, so merge() works on
+// differences against the previous pass and never has to clear a tile that a
+// worker may be writing. Tiles are allocated in configure(), the images up
+// front, so nothing is allocated while data flows.
+class tpx3Preview : public tpx3StreamConsumer {
+public:
+    tpx3Preview();
+
+    void configure(int numWorkers);
+    void consume(int worker, const tpx3StreamChunk &chunk);
+
+    // Callable from any thread; take effect on the next chunk
+    void setEnabled(bool enabled) { enabled_ = enabled; }
+    // Count only every Nth chunk of each worker, to cut hot-path cost
+    void setDecimation(int decimation) { decimation_ = decimation < 1 ? 1 : decimation; }
+
+    // merge() folds the worker tiles into the accumulated and last-interval
+    // images; it and render() are called from one publisher thread.
+    // reset() clears both images and may be called from any thread.
+    void merge();
+    void reset();
+    // Returns the number of elements written to out (TPX3_PREVIEW_MAX_ELEMENTS max)
+    size_t render(int layout, int chip, int binning, bool live, int32_t *out,
+                  int *sizeX, int *sizeY, uint64_t *total, uint32_t *maxCount) const;
+
+private:
+    struct workerTiles {
+        std::unique_ptr<std::atomic<uint32_t>[]> counts;  // TPX3_PREVIEW_CHIPS chip tiles
+        unsigned skip;                                    // decimation phase, worker only
+    };
+
+    std::atomic<bool> enabled_;
+    std::atomic<int> decimation_;
+
+    mutable std::mutex mutex_;  // guards the tile list and the images, never taken by consume()
+    std::vector<workerTiles> workers_;
+
+    std::vector<uint32_t> lastSum_;      // tile sums at the previous merge
+    std::vector<uint32_t> accumulated_;  // since reset()
+    std::vector<uint32_t> live_;         // last merge interval
+};
+
+#endif // tpx3Preview_H
@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
+#include <ctype.h>
+
+#include "tpx3ProcStats.h"
+
+static double monotonicNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Find "key:" at the start of a line and return the number that follows
+static uint64_t findField(const char *buf, const char *key)
+{
+    size_t keyLen = strlen(key);
+    const char *p = buf;
+    while (p && *p) {
+        if (strncmp(p, key, keyLen) == 0) {
+            return strtoull(p + keyLen, NULL, 10);
+        }
+        p = strchr(p, '\n');
+        if (p) {
+            p++;
+        }
+    }
+    return 0;
+}
+
+// Parse utime+stime and the thread count from a stat line
+static bool parseStat(const char *buf, uint64_t *cpuTicks, long *threads)
+{
+    const char *p = strrchr(buf, ')');
+    if (!p || !p[1]) {
+        return false;
+    }
+    p += 2;
+    unsigned long long utime = 0, stime = 0;
+    long numThreads = 0;
+    char state;
+    int fields = sscanf(p, "%c %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %llu %llu %*s %*s %*s %*s %ld",
+                        &state, &utime, &stime, &numThreads);
+    if (fields != 4) {
+        return false;
+    }
+    *cpuTicks = utime + stime;
+    if (threads) {
+        *threads = numThreads;
+    }
+    return true;
+}
+
+static const char *stageNames[TPX3_NUM_STAGES] = {
+    "UDP", "FRAME", "CORRECTION", "PROCESSING", "WRITER", "JVM", "OTHER"
+};
+
+// Thread names are truncated to 15 characters by the kernel, so keep patterns short
+static const char *stageDefaults[TPX3_NUM_STAGES] = {
+    "udp,receiv",
+    "assembl,frame",
+    "correct",
+    "process,handler",
+    "writ,sink",
+    "gc,g1 ,c1 compi,c2 compi,vm thread,vm periodic,reference handl,finalizer,signal disp,sweeper,common-clean",
+    ""
+};
+
+tpx3ProcStats::tpx3ProcStats()
+    : pid_(0), statFd_(-1), statusFd_(-1), ioFd_(-1),
+      clockTicks_(sysconf(_SC_CLK_TCK)), havePrevious_(false), prevTime_(0.0),
+      prevCpuTicks_(0), prevReadBytes_(0), prevWriteBytes_(0),
+      patternGeneration_(0), activeGeneration_(0)
+{
+    if (clockTicks_ <= 0) {
+        clockTicks_ = 100;
+    }
+    for (int stage = 0; stage < TPX3_NUM_STAGES; stage++) {
+        setStagePatterns(stage, stageDefaults[stage]);
+    }
+}
+
+const char *tpx3ProcStats::stageName(int stage)
+{
+    return (stage >= 0 && stage < TPX3_NUM_STAGES) ? stageNames[stage] : "";
+}
+
+const char *tpx3ProcStats::defaultStagePatterns(int stage)
+{
+    return (stage >= 0 && stage < TPX3_NUM_STAGES) ? stageDefaults[stage] : "";
+}
+
+void tpx3ProcStats::setStagePatterns(int stage, const std::string &patterns)
+{
+    if (stage < 0 || stage >= TPX3_STAGE_OTHER) {
+        return;
+    }
+    std::vector<std::string> list;
+    size_t start = 0;
+    while (start <= patterns.size()) {
+        size_t comma = patterns.find(',', start);
+        if (comma == std::string::npos) {
+            comma = patterns.size();
+        }
+        std::string item = patterns.substr(start, comma - start);
+        // Trim leading blanks only; a trailing blank can be part of a pattern ("g1 ")
+        size_t first = item.find_first_not_of(" \t");
+        if (first != std::string::npos) {
+            item = item.substr(first);
+            for (size_t i = 0; i < item.size(); i++) {
+                item[i] = (char)tolower((unsigned char)item[i]);
+            }
+            list.push_back(item);
+        }
+        start = comma + 1;
+    }
+
+    std::lock_guard<std::mutex> guard(patternMutex_);
+    patterns_[stage] = list;
+    patternGeneration_++;
+}
+
+// JVM service threads are matched first so e.g. "Reference Handler" is not
+// counted as a processing handler; then the pipeline stages in order
+int tpx3ProcStats::classify(const char *name)
+{
+    char lower[32];
+    size_t i;
+    for (i = 0; name[i] && name[i] != '\n' && i < sizeof(lower) - 1; i++) {
+        lower[i] = (char)tolower((unsigned char)name[i]);
+    }
+    lower[i] = '\0';
+
+    static const int order[] = {
+        TPX3_STAGE_JVM, TPX3_STAGE_UDP, TPX3_STAGE_FRAME, TPX3_STAGE_CORRECTION,
+        TPX3_STAGE_PROCESSING, TPX3_STAGE_WRITER
+    };
+    for (size_t k = 0; k < sizeof(order) / sizeof(order[0]); k++) {
+        const std::vector<std::string> &list = activePatterns_[order[k]];
+        for (size_t j = 0; j < list.size(); j++) {
+            if (strstr(lower, list[j].c_str())) {
+                return order[k];
+            }
+        }
+    }
+    return TPX3_STAGE_OTHER;
+}
+
+tpx3ProcStats::~tpx3ProcStats()
+{
+    close();
+}
+
+bool tpx3ProcStats::open(pid_t pid)
+{
+    close();
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    statFd_ = ::open(path, O_RDONLY | O_CLOEXEC);
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    statusFd_ = ::open(path, O_RDONLY | O_CLOEXEC);
+    // io needs ptrace access; it is optional
+    snprintf(path, sizeof(path), "/proc/%d/io", (int)pid);
+    ioFd_ = ::open(path, O_RDONLY | O_CLOEXEC);
+
+    if (statFd_ < 0 || statusFd_ < 0) {
+        close();
+        return false;
+    }
+    pid_ = pid;
+    return true;
+}
+
+void tpx3ProcStats::close()
+{
+    if (statFd_ >= 0) {
+        ::close(statFd_);
+    }
+    if (statusFd_ >= 0) {
+        ::close(statusFd_);
+    }
+    if (ioFd_ >= 0) {
+        ::close(ioFd_);
+    }
+    statFd_ = statusFd_ = ioFd_ = -1;
+    closeTasks();
+    pid_ = 0;
+    havePrevious_ = false;
+}
+
+void tpx3ProcStats::closeTask(taskFiles &task)
+{
+    if (task.statFd >= 0) {
+        ::close(task.statFd);
+    }
+    if (task.statusFd >= 0) {
+        ::close(task.statusFd);
+    }
+    if (task.commFd >= 0) {
+        ::close(task.commFd);
+    }
+}
+
+void tpx3ProcStats::closeTasks()
+{
+    for (std::map<pid_t, taskFiles>::iterator it = tasks_.begin(); it != tasks_.end(); ++it) {
+        closeTask(it->second);
+    }
+    tasks_.clear();
+}
+
+// Scan all threads: sum context switches and attribute CPU to pipeline stages.
+// Deltas are taken per thread so threads exiting between samples do not make
+// the rates go negative. Files of known threads stay open between scans.
+void tpx3ProcStats::sampleTasks(tpx3ProcSample *out, double dt,
+                                uint64_t *volDelta, uint64_t *involDelta)
+{
+    *volDelta = *involDelta = 0;
+
+    bool reclassify = false;
+    {
+        std::lock_guard<std::mutex> guard(patternMutex_);
+        if (activeGeneration_ != patternGeneration_) {
+            for (int stage = 0; stage < TPX3_NUM_STAGES; stage++) {
+                activePatterns_[stage] = patterns_[stage];
+            }
+            activeGeneration_ = patternGeneration_;
+            reclassify = true;
+        }
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task", (int)pid_);
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return;
+    }
+
+    for (std::map<pid_t, taskFiles>::iterator it = tasks_.begin(); it != tasks_.end(); ++it) {
+        it->second.seen = false;
+    }
+
+    char buf[4096];
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') {
+            continue;
+        }
+        pid_t tid = (pid_t)atoi(entry->d_name);
+        std::map<pid_t, taskFiles>::iterator it = tasks_.find(tid);
+        bool isNew = false;
+        if (it == tasks_.end()) {
+            taskFiles task = { -1, -1, -1, 0, 0, 0, TPX3_STAGE_OTHER, 0, false };
+            snprintf(path, sizeof(path), "/proc/%d/task/%d/stat", (int)pid_, (int)tid);
+            task.statFd = ::open(path, O_RDONLY | O_CLOEXEC);
+            snprintf(path, sizeof(path), "/proc/%d/task/%d/status", (int)pid_, (int)tid);
+            task.statusFd = ::open(path, O_RDONLY | O_CLOEXEC);
+            snprintf(path, sizeof(path), "/proc/%d/task/%d/comm", (int)pid_, (int)tid);
+            task.commFd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (task.statFd < 0 || task.statusFd < 0) {
+                closeTask(task);
+                continue;
+            }
+            it = tasks_.insert(std::make_pair(tid, task)).first;
+            isNew = true;
+        }
+        taskFiles &task = it->second;
+
+        if (readAll(task.statusFd, buf, sizeof(buf)) <= 0) {
+            continue;
+        }
+        uint64_t vol = findField(buf, "voluntary_ctxt_switches:");
+        uint64_t invol = findField(buf, "nonvoluntary_ctxt_switches:");
+
+        uint64_t ticks = task.cpuTicks;
+        if (readAll(task.statFd, buf, sizeof(buf)) <= 0 || !parseStat(buf, &ticks, NULL)) {
+            continue;
+        }
+
+        if (task.commFd >= 0 && (task.nameReads < 3 || reclassify)) {
+            if (readAll(task.commFd, buf, sizeof(buf)) > 0) {
+                task.stage = classify(buf);
+            }
+            task.nameReads++;
+        }
+
+        if (!isNew) {
+            *volDelta += vol - task.volCtx;
+            *involDelta += invol - task.involCtx;
+            if (dt > 0.0) {
+                double cpu = 100.0 * (double)(ticks - task.cpuTicks) / clockTicks_ / dt;
+                out->stageCpu[task.stage] += cpu;
+                if (cpu > out->stageMaxCpu[task.stage]) {
+                    out->stageMaxCpu[task.stage] = cpu;
+                }
+            }
+        }
+        task.volCtx = vol;
+        task.involCtx = invol;
+        task.cpuTicks = ticks;
+        task.seen = true;
+        out->volCtxSwitches += vol;
+        out->involCtxSwitches += invol;
+        out->stageThreads[task.stage]++;
+    }
+    closedir(dir);
+
+    // Drop threads that have exited
+    for (std::map<pid_t, taskFiles>::iterator it = tasks_.begin(); it != tasks_.end(); ) {
+        if (!it->second.seen) {
+            closeTask(it->second);
+            tasks_.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+ssize_t tpx3ProcStats::readAll(int fd, char *buf, size_t len)
+{
+    ssize_t n = pread(fd, buf, len - 1, 0);
+    if (n < 0) {
+        return n;
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+bool tpx3ProcStats::sample(tpx3ProcSample *out)
+{
+    if (statFd_ < 0) {
+        return false;
+    }
+
+    char buf[4096];
+    double now = monotonicNow();
+    memset(out, 0, sizeof(*out));
+
+    // stat: fields after the ")" that closes comm, starting with state (field 3)
+    if (readAll(statFd_, buf, sizeof(buf)) <= 0) {
+        return false;
+    }
+    uint64_t cpuTicks = 0;
+    long threads = 0;
+    if (!parseStat(buf, &cpuTicks, &threads)) {
+        return false;
+    }
+    out->threads = (int)threads;
+
+    // status: memory
+    if (readAll(statusFd_, buf, sizeof(buf)) <= 0) {
+        return false;
+    }
+    out->rssMB = findField(buf, "VmRSS:") / 1024.0;
+    out->vmHwmMB = findField(buf, "VmHWM:") / 1024.0;
+
+    // task/*: context switches and per-stage CPU of every thread
+    double dt = (havePrevious_ && now > prevTime_) ? now - prevTime_ : 0.0;
+    uint64_t volDelta, involDelta;
+    sampleTasks(out, dt, &volDelta, &involDelta);
+
+    // io: storage bytes, only when permitted
+    if (ioFd_ >= 0 && readAll(ioFd_, buf, sizeof(buf)) > 0) {
+        out->readBytes = findField(buf, "read_bytes:");
+        out->writeBytes = findField(buf, "write_bytes:");
+    }
+
+    if (dt > 0.0) {
+        out->cpuPercent = 100.0 * (double)(cpuTicks - prevCpuTicks_) / clockTicks_ / dt;
+        out->volCtxSwitchRate = (double)volDelta / dt;
+        out->involCtxSwitchRate = (double)involDelta / dt;
+        out->readRate = (double)(out->readBytes - prevReadBytes_) / dt;
+        out->writeRate = (double)(out->writeBytes - prevWriteBytes_) / dt;
+    }
+
+    havePrevious_ = true;
+    prevTime_ = now;
+    prevCpuTicks_ = cpuTicks;
+    prevReadBytes_ = out->readBytes;
+    prevWriteBytes_ = out->writeBytes;
+    return true;
+}
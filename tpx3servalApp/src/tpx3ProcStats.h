@@ -0,0 +1,102 @@
+#ifndef tpx3ProcStats_H
+#define tpx3ProcStats_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Serval pipeline stages that JVM threads are grouped into by name
+#define TPX3_STAGE_UDP        0
+#define TPX3_STAGE_FRAME      1
+#define TPX3_STAGE_CORRECTION 2
+#define TPX3_STAGE_PROCESSING 3
+#define TPX3_STAGE_WRITER     4
+#define TPX3_STAGE_JVM        5  // GC, JIT compilers and other JVM service threads
+#define TPX3_STAGE_OTHER      6
+#define TPX3_NUM_STAGES       7
+
+// One telemetry sample of a process; rates are per second since the previous sample
+struct tpx3ProcSample {
+    double cpuPercent;        // % of one core, may exceed 100 for multi-threaded processes
+    double rssMB;
+    double vmHwmMB;
+    int threads;
+    uint64_t volCtxSwitches;  // summed over all threads
+    uint64_t involCtxSwitches;
+    double volCtxSwitchRate;
+    double involCtxSwitchRate;
+    uint64_t readBytes;
+    uint64_t writeBytes;
+    double readRate;          // bytes/s
+    double writeRate;         // bytes/s
+    double stageCpu[TPX3_NUM_STAGES];     // % of one core, summed over the stage's threads
+    double stageMaxCpu[TPX3_NUM_STAGES];  // % of one core used by the stage's busiest thread
+    int stageThreads[TPX3_NUM_STAGES];
+};
+
+// Low-overhead sampler of /proc/<pid>/{stat,status,io}. The files are opened
+// once and re-read with pread. Context switches are only kept per thread by the
+// kernel, so each /proc/<pid>/task/<tid>/{stat,status} is also kept open and
+// summed; the thread's comm is used to attribute its CPU to a pipeline stage.
+// Not thread safe apart from setStagePatterns: one thread owns an instance.
+class tpx3ProcStats {
+public:
+    tpx3ProcStats();
+    ~tpx3ProcStats();
+
+    bool open(pid_t pid);
+    void close();
+    pid_t pid() const { return pid_; }
+
+    // Returns false once the process is gone
+    bool sample(tpx3ProcSample *out);
+
+    // Comma-separated, case-insensitive substrings matched against thread names.
+    // May be called from any thread; threads are reclassified on the next sample.
+    void setStagePatterns(int stage, const std::string &patterns);
+    static const char *stageName(int stage);
+    static const char *defaultStagePatterns(int stage);
+
+private:
+    struct taskFiles {
+        int statFd;
+        int statusFd;
+        int commFd;
+        uint64_t volCtx;
+        uint64_t involCtx;
+        uint64_t cpuTicks;
+        int stage;
+        int nameReads;  // comm is re-read for a few samples while the JVM names the thread
+        bool seen;
+    };
+
+    pid_t pid_;
+    int statFd_;
+    int statusFd_;
+    int ioFd_;
+    long clockTicks_;
+    bool havePrevious_;
+    double prevTime_;
+    uint64_t prevCpuTicks_;
+    std::map<pid_t, taskFiles> tasks_;
+    uint64_t prevReadBytes_;
+    uint64_t prevWriteBytes_;
+
+    std::mutex patternMutex_;
+    std::vector<std::string> patterns_[TPX3_NUM_STAGES];        // guarded by patternMutex_
+    unsigned patternGeneration_;                                 // guarded by patternMutex_
+    std::vector<std::string> activePatterns_[TPX3_NUM_STAGES];  // sampler's copy
+    unsigned activeGeneration_;
+
+    void sampleTasks(tpx3ProcSample *out, double dt,
+                     uint64_t *volDelta, uint64_t *involDelta);
+    int classify(const char *name);
+    static void closeTask(taskFiles &task);
+    void closeTasks();
+    static ssize_t readAll(int fd, char *buf, size_t len);
+};
+
+#endif // tpx3ProcStats_H
@@ -0,0 +1,382 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <algorithm>
+
+#include "tpx3Relay.h"
+
+#define RELAY_POLL_MS        100
+#define RELAY_SOCKET_SNDBUF  (4 * 1024 * 1024)
+#define RELAY_DEFAULT_LAG    8000000
+// A subscriber inside one block this far behind the stream is taken as stuck
+#define RELAY_MAX_BEHIND     1024
+
+tpx3StreamRelay::tpx3StreamRelay(tpx3StreamEngine &engine)
+    : engine_(engine), clients_(0), running_(false), headSequence_(0),
+      maxLag_(RELAY_DEFAULT_LAG), wakeFd_(-1)
+{
+    for (int i = 0; i < TPX3_RELAY_SLOTS; i++) {
+        slot &s = slots_[i];
+        memset(&s, 0, sizeof(s));
+        s.listenFd = -1;
+        s.client = -1;
+        s.policy = TPX3_RELAY_BLOCK;
+    }
+}
+
+tpx3StreamRelay::~tpx3StreamRelay()
+{
+    stop();
+}
+
+bool tpx3StreamRelay::tapBlock(int index, const char *data, size_t length)
+{
+    if (clients_.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(mutex_);
+    // Subscribers only come and go under the lock
+    if (clients_ == 0) {
+        return false;
+    }
+    queuedBlock b = { index, data, length, false };
+    queue_.push_back(b);
+    uint64_t one = 1;
+    ssize_t n = write(wakeFd_, &one, sizeof(one));
+    (void)n;
+    return true;
+}
+
+void tpx3StreamRelay::dropBlocks()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (int i = 0; i < TPX3_RELAY_SLOTS; i++) {
+        // The rest of a half-sent block goes away with the stream, and a chunk cut
+        // short would throw the subscriber out of step
+        if (slots_[i].client >= 0 && slots_[i].offset > 0) {
+            closeClient(slots_[i], true);
+        }
+    }
+    while (!queue_.empty()) {
+        if (!queue_.front().released) {
+            engine_.releaseBlock(queue_.front().index);
+        }
+        queue_.pop_front();
+        headSequence_++;
+    }
+    for (int i = 0; i < TPX3_RELAY_SLOTS; i++) {
+        slots_[i].position = headSequence_;
+        slots_[i].skipTo = 0;
+    }
+}
+
+void tpx3StreamRelay::setPolicy(int slot, int policy)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (slot >= 0 && slot < TPX3_RELAY_SLOTS) {
+        slots_[slot].policy = policy;
+    }
+}
+
+void tpx3StreamRelay::setMaxLag(uint64_t bytes)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    maxLag_ = bytes;
+}
+
+bool tpx3StreamRelay::start(const int ports[TPX3_RELAY_SLOTS], std::string *error)
+{
+    if (running_) {
+        *error = "Relay already running";
+        return false;
+    }
+    wakeFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wakeFd_ < 0) {
+        *error = std::string("Cannot create relay wake event: ") + strerror(errno);
+        return false;
+    }
+    for (int i = 0; i < TPX3_RELAY_SLOTS; i++) {
+        slot &s = slots_[i];
+        s.sent = 0;
+        s.dropped = 0;
+        s.disconnects = 0;
+        if (ports[i] <= 0) {
+            continue;
+        }
+        s.listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int one = 1;
+        setsockopt(s.listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)ports[i]);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (s.listenFd < 0 || bind(s.listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+            listen(s.listenFd, 1) < 0) {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "Cannot listen on relay port %d: %s", ports[i], strerror(errno));
+            *error = msg;
+            stop();
+            return false;
+        }
+    }
+    running_ = true;
+    thread_ = std::thread(&tpx3StreamRelay::sendLoop, this);
+    return true;
+}
+
+void tpx3StreamRelay::stop()
+{
+    running_ = false;
+    if (wakeFd_ >= 0) {
+        uint64_t one = 1;
+        ssize_t n = write(wakeFd_, &one, sizeof(one));
+        (void)n;
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (int i = 0; i < TPX3_RELAY_SLOTS; i++) {
+        slot &s = slots_[i];
+        if (s.client >= 0) {
+            closeClient(s, false);
+        }
+        if (s.listenFd >= 0) {
+            close(s.listenFd);
+            s.listenFd = -1;
+        }
+    }
+    while (!queue_.empty()) {
+        if (!queue_.front().released) {
+            engine_.releaseBlock(queue_.front().index);
+        }
+        queue_.pop_front();
+        headSequence_++;
+    }
+    if (wakeFd_ >= 0) {
+        close(wakeFd_);
+        wakeFd_ = -1;
+    }
+}
+
+void tpx3StreamRelay::getStats(tpx3RelaySlotStats out[TPX3_RELAY_SLOTS]) const
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (int i = 0; i < TPX3_RELAY_SLOTS; i++) {
+        const slot &s = slots_[i];
+        out[i].listening = s.listenFd >= 0;
+        out[i].connected = s.client >= 0;
+        out[i].lagBytes = lag(s);
+        out[i].sentBytes = s.sent;
+        out[i].droppedBytes = s.dropped;
+        out[i].disconnects = s.disconnects;
+    }
+}
+
+// Bytes still to send to the subscriber; caller holds mutex_
+uint64_t tpx3StreamRelay::lag(const slot &s) const
+{
+    uint64_t end = endSequence();
+    if (s.client < 0 || s.position >= end) {
+        return 0;
+    }
+    uint64_t bytes = queue_[s.position - headSequence_].length - s.offset;
+    for (uint64_t q = std::max(s.position + 1, s.skipTo); q < end; q++) {
+        bytes += queue_[q - headSequence_].length;
+    }
+    return bytes;
+}
+
+// Whether a connected subscriber has still to send any of the block; caller holds mutex_
+bool tpx3StreamRelay::needed(uint64_t sequence) const
+{
+    for (int i = 0; i < TPX3_RELAY_SLOTS; i++) {
+        const slot &s = slots_[i];
+        if (s.client >= 0 && (sequence == s.position || (sequence > s.position && sequence >= s.skipTo))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Caller holds mutex_
+void tpx3StreamRelay::applyPolicy(slot &s)
+{
+    if (s.client < 0 || s.policy == TPX3_RELAY_BLOCK) {
+        return;
+    }
+    uint64_t pending = lag(s);
+    if (pending <= maxLag_) {
+        return;
+    }
+    if (s.policy == TPX3_RELAY_DISCONNECT) {
+        closeClient(s, true);
+        return;
+    }
+
+    // Drop oldest: skip whole blocks the subscriber has not started on
+    uint64_t end = endSequence();
+    while (pending > maxLag_) {
+        uint64_t first = s.offset == 0 ? s.position : std::max(s.position + 1, s.skipTo);
+        if (first >= end) {
+            break;
+        }
+        size_t length = queue_[first - headSequence_].length;
+        s.dropped += length;
+        pending -= length;
+        if (s.offset == 0) {
+            s.position++;
+        } else {
+            s.skipTo = first + 1;
+        }
+    }
+    // Skipped blocks go back to the engine at once, but a subscriber that stops
+    // reading inside one block would hold the queue head for good
+    if (end - s.position > RELAY_MAX_BEHIND) {
+        closeClient(s, true);
+    }
+}
+
+// Send as much as the socket takes, straight from the engine's blocks; caller holds mutex_
+void tpx3StreamRelay::sendTo(slot &s)
+{
+    uint64_t end = endSequence();
+    while (s.client >= 0 && s.position < end) {
+        const queuedBlock &b = queue_[s.position - headSequence_];
+        ssize_t n = send(s.client, b.data + s.offset, b.length - s.offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                closeClient(s, false);
+            }
+            return;
+        }
+        s.offset += (size_t)n;
+        s.sent += (uint64_t)n;
+        if (s.offset == b.length) {
+            s.offset = 0;
+            s.position = std::max(s.position + 1, s.skipTo);
+            s.skipTo = 0;
+        }
+    }
+}
+
+// letGo: the relay drops the subscriber, rather than the subscriber leaving;
+// caller holds mutex_
+void tpx3StreamRelay::closeClient(slot &s, bool letGo)
+{
+    if (letGo) {
+        s.dropped += lag(s);
+        s.disconnects++;
+    }
+    close(s.client);
+    s.client = -1;
+    s.offset = 0;
+    s.skipTo = 0;
+    clients_--;
+}
+
+// Give back the blocks every subscriber has sent or skipped; caller holds mutex_
+void tpx3StreamRelay::releaseSent()
+{
+    for (uint64_t q = headSequence_; q < endSequence(); q++) {
+        queuedBlock &b = queue_[q - headSequence_];
+        if (!b.released && !needed(q)) {
+            engine_.releaseBlock(b.index);
+            b.released = true;
+        }
+    }
+    while (!queue_.empty() && queue_.front().released) {
+        queue_.pop_front();
+        headSequence_++;
+    }
+}
+
+// Send thread: accepts subscribers, applies the policies and sends, woken by
+// new blocks and by subscribers' sockets draining
+void tpx3StreamRelay::sendLoop()
+{
+    pthread_setname_np(pthread_self(), "tpx3Relay");
+
+    while (running_) {
+        struct pollfd pfds[1 + 2 * TPX3_RELAY_SLOTS];
+        int owner[1 + 2 * TPX3_RELAY_SLOTS];
+        int n = 0;
+        pfds[n].fd = wakeFd_;
+        pfds[n].events = POLLIN;
+        owner[n++] = -1;
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            for (int i = 0; i < TPX3_RELAY_SLOTS; i++) {
+                const slot &s = slots_[i];
+                if (s.listenFd >= 0) {
+                    pfds[n].fd = s.listenFd;
+                    pfds[n].events = POLLIN;
+                    owner[n++] = i;
+                }
+                if (s.client >= 0) {
+                    pfds[n].fd = s.client;
+                    pfds[n].events = (short)(s.position < endSequence() ? POLLIN | POLLOUT : POLLIN);
+                    owner[n++] = i;
+                }
+            }
+        }
+        for (int k = 0; k < n; k++) {
+            pfds[k].revents = 0;
+        }
+        if (poll(pfds, n, RELAY_POLL_MS) < 0 && errno != EINTR) {
+            break;
+        }
+        if (!running_) {
+            break;
+        }
+        if (pfds[0].revents & POLLIN) {
+            uint64_t count;
+            ssize_t got = read(wakeFd_, &count, sizeof(count));
+            (void)got;
+        }
+
+        std::lock_guard<std::mutex> guard(mutex_);
+        for (int k = 1; k < n; k++) {
+            slot &s = slots_[owner[k]];
+            if (pfds[k].fd == s.listenFd) {
+                if (!(pfds[k].revents & POLLIN)) {
+                    continue;
+                }
+                int fd = accept4(s.listenFd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+                if (fd < 0) {
+                    continue;
+                }
+                // A new subscriber replaces the old one; it starts with the next block
+                if (s.client >= 0) {
+                    closeClient(s, false);
+                }
+                int sndbuf = RELAY_SOCKET_SNDBUF;
+                setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+                s.client = fd;
+                s.position = endSequence();
+                s.offset = 0;
+                s.skipTo = 0;
+                clients_++;
+            } else if (pfds[k].fd == s.client && (pfds[k].revents & (POLLIN | POLLHUP | POLLERR))) {
+                // Anything the subscriber sends is ignored; end of file means it went away
+                char discard[256];
+                ssize_t got = recv(s.client, discard, sizeof(discard), MSG_DONTWAIT);
+                if (got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                    closeClient(s, false);
+                }
+            }
+        }
+        for (int i = 0; i < TPX3_RELAY_SLOTS; i++) {
+            applyPolicy(slots_[i]);
+            sendTo(slots_[i]);
+        }
+        releaseSent();
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef tpx3Relay_H
+#define tpx3Relay_H
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "tpx3Stream.h"
+
+#define TPX3_RELAY_SLOTS 4
+
+// Backpressure policies, per subscriber
+#define TPX3_RELAY_BLOCK       0  // never skip data: the whole stream slows to the subscriber's pace
+#define TPX3_RELAY_DROP_OLDEST 1  // past the lag limit, skip the oldest whole blocks not yet started
+#define TPX3_RELAY_DISCONNECT  2  // past the lag limit, drop the subscriber
+
+// Per-slot counters; totals since start()
+struct tpx3RelaySlotStats {
+    bool listening;
+    bool connected;
+    uint64_t lagBytes;      // queued for the subscriber, not yet sent
+    uint64_t sentBytes;
+    uint64_t droppedBytes;  // skipped by drop-oldest, or unsent when the relay let go of the subscriber
+    uint64_t disconnects;   // subscribers the relay let go of
+};
+
+// Fans the raw stream out to local TCP subscribers, one per slot, each on its
+// own port. The relay is a tap on the stream engine: it holds on to the
+// engine's receive blocks and every subscriber is sent the bytes straight out
+// of them, so nothing is copied per subscriber in user space. A block goes back
+// to the engine once every connected subscriber has sent or skipped it. Blocks
+// end on chunk boundaries, so a subscriber that joins late or skips blocks
+// still sees whole chunks. With no subscriber connected, tapBlock() returns at
+// once and the engine runs as without a relay.
+class tpx3StreamRelay : public tpx3StreamTap {
+public:
+    explicit tpx3StreamRelay(tpx3StreamEngine &engine);
+    ~tpx3StreamRelay();
+
+    bool tapBlock(int index, const char *data, size_t length);
+    void dropBlocks();
+
+    // Any thread; take effect on the next pass of the send thread. Keep the lag
+    // limit well below the engine's pool, or drop-oldest subscribers stall it.
+    void setPolicy(int slot, int policy);
+    void setMaxLag(uint64_t bytes);
+
+    // Listen on ports[slot], on all interfaces, for every slot with a port above 0
+    bool start(const int ports[TPX3_RELAY_SLOTS], std::string *error);
+    void stop();
+    bool running() const { return running_; }
+    void getStats(tpx3RelaySlotStats out[TPX3_RELAY_SLOTS]) const;
+
+private:
+    struct queuedBlock {
+        int index;
+        const char *data;
+        size_t length;
+        bool released;  // skipped by every subscriber and given back out of turn
+    };
+
+    struct slot {
+        int listenFd;
+        int client;
+        int policy;
+        uint64_t position;  // relay sequence of the block being sent
+        size_t offset;      // bytes of it already sent
+        uint64_t skipTo;    // drop-oldest: where to go on once the current block is sent, 0 for the next
+        uint64_t sent;
+        uint64_t dropped;
+        uint64_t disconnects;
+    };
+
+    tpx3StreamEngine &engine_;
+    std::atomic<int> clients_;
+    std::atomic<bool> running_;
+
+    // Guards the queue and the slots. Sends are made under it, non-blocking,
+    // so dropBlocks() never pulls a block from under one.
+    mutable std::mutex mutex_;
+    std::deque<queuedBlock> queue_;
+    uint64_t headSequence_;  // relay sequence of queue_.front()
+    slot slots_[TPX3_RELAY_SLOTS];
+    uint64_t maxLag_;
+
+    std::thread thread_;
+    int wakeFd_;  // a new block, or stop
+
+    void sendLoop();
+    uint64_t endSequence() const { return headSequence_ + queue_.size(); }
+    uint64_t lag(const slot &s) const;
+    bool needed(uint64_t sequence) const;
+    void applyPolicy(slot &s);
+    void sendTo(slot &s);
+    void closeClient(slot &s, bool letGo);
+    void releaseSent();
+};
+
+#endif // tpx3Relay_H
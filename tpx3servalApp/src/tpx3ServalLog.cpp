@@ -0,0 +1,349 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tpx3ServalLog.h"
+
+// Per drain() call, so one chatty stream cannot hold up the event loop
+#define LOG_DRAIN_BYTES (256 * 1024)
+// Room for bursts, e.g. a stack trace, while the reader is busy
+#define LOG_PIPE_BYTES (1024 * 1024)
+
+static const char *kindNames[TPX3_LOG_KINDS] = { "ERROR", "DROP", "BUFFER_FULL" };
+
+// Log levels and exception headers rather than the bare words, which also turn
+// up in benign lines ("0 errors", "errorRate=0")
+static const char *kindDefaults[TPX3_LOG_KINDS] = {
+    "ERROR ,ERROR:,[ERROR],SEVERE,FATAL,Exception:,Exception in thread",
+    "dropped,lost packet,packet loss,missing packet",
+    "buffer full,buffer is full,queue full,no free buffer,buffer overflow"
+};
+
+// True if the match at pos reports a count of zero: "0 dropped", "dropped=0",
+// "droppedFrames: 0", "packet loss 0.0". Such lines are statistics, not events.
+static bool zeroCount(const std::string &line, size_t pos, size_t length)
+{
+    size_t i = pos + length;
+    while (i < line.size() && (isalnum((unsigned char)line[i]) || line[i] == '_')) {
+        i++;
+    }
+    while (i < line.size() && (line[i] == ' ' || line[i] == '=' || line[i] == ':')) {
+        i++;
+    }
+    if (i < line.size() && isdigit((unsigned char)line[i])) {
+        return strtod(line.c_str() + i, NULL) == 0.0;
+    }
+    size_t j = pos;
+    while (j > 0 && line[j - 1] == ' ') {
+        j--;
+    }
+    size_t end = j;
+    while (j > 0 && (isdigit((unsigned char)line[j - 1]) || line[j - 1] == '.')) {
+        j--;
+    }
+    return end > j && (j == 0 || !isalpha((unsigned char)line[j - 1])) && strtod(line.c_str() + j, NULL) == 0.0;
+}
+
+static double monotonicNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+tpx3ServalLog::tpx3ServalLog()
+    : totalLines_(0), totalBytes_(0), prevTime_(0.0), prevLines_(0),
+      file_(NULL), fileMaxBytes_(0), fileBytes_(0)
+{
+    for (int s = 0; s < TPX3_LOG_STREAMS; s++) {
+        readFds_[s] = -1;
+        writeFds_[s] = -1;
+    }
+    for (int kind = 0; kind < TPX3_LOG_KINDS; kind++) {
+        counts_[kind] = 0;
+        prevCounts_[kind] = 0;
+        setPatterns(kind, kindDefaults[kind]);
+    }
+}
+
+tpx3ServalLog::~tpx3ServalLog()
+{
+    for (int s = 0; s < TPX3_LOG_STREAMS; s++) {
+        if (readFds_[s] >= 0) {
+            close(readFds_[s]);
+        }
+        if (writeFds_[s] >= 0) {
+            close(writeFds_[s]);
+        }
+    }
+    closeFile();
+}
+
+const char *tpx3ServalLog::kindName(int kind)
+{
+    return (kind >= 0 && kind < TPX3_LOG_KINDS) ? kindNames[kind] : "";
+}
+
+const char *tpx3ServalLog::defaultPatterns(int kind)
+{
+    return (kind >= 0 && kind < TPX3_LOG_KINDS) ? kindDefaults[kind] : "";
+}
+
+bool tpx3ServalLog::open(std::string *error)
+{
+    for (int s = 0; s < TPX3_LOG_STREAMS; s++) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0) {
+            *error = std::string("Cannot create log pipe: ") + strerror(errno);
+            return false;
+        }
+        // Only the reader is non-blocking; the JVM's writes block as they would on a terminal
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+#ifdef F_SETPIPE_SZ
+        fcntl(fds[0], F_SETPIPE_SZ, LOG_PIPE_BYTES);
+#endif
+        readFds_[s] = fds[0];
+        writeFds_[s] = fds[1];
+    }
+    return true;
+}
+
+int tpx3ServalLog::drain(int stream)
+{
+    if (stream < 0 || stream >= TPX3_LOG_STREAMS || readFds_[stream] < 0) {
+        return 0;
+    }
+    char buf[16384];
+    size_t total = 0;
+    int lines = 0;
+    while (total < LOG_DRAIN_BYTES) {
+        ssize_t n = read(readFds_[stream], buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+        total += (size_t)n;
+        std::lock_guard<std::mutex> guard(mutex_);
+        totalBytes_ += (uint64_t)n;
+        std::string &partial = partial_[stream];
+        for (ssize_t i = 0; i < n; i++) {
+            char c = buf[i];
+            if (c == '\n') {
+                addLine(partial, true);
+                partial.clear();
+                lines++;
+            } else if (c != '\r') {
+                partial += c;
+                // An overlong line is cut into pieces, each taken as a line
+                if (partial.size() >= TPX3_LOG_LINE_CHARS) {
+                    addLine(partial, true);
+                    partial.clear();
+                    lines++;
+                }
+            }
+        }
+    }
+    return lines;
+}
+
+void tpx3ServalLog::mark(const std::string &text)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    addLine(text, false);
+}
+
+// Caller holds mutex_
+void tpx3ServalLog::addLine(const std::string &line, bool parse)
+{
+    lines_.push_back(line);
+    if (lines_.size() > TPX3_LOG_RING_LINES) {
+        lines_.pop_front();
+    }
+    writeFile(line);
+    if (!parse) {
+        return;
+    }
+    totalLines_++;
+    if (line.empty() || line[0] == ' ' || line[0] == '\t' || line.compare(0, 10, "Caused by:") == 0) {
+        return;
+    }
+    std::string lower(line);
+    for (size_t i = 0; i < lower.size(); i++) {
+        lower[i] = (char)tolower((unsigned char)lower[i]);
+    }
+    for (int kind = 0; kind < TPX3_LOG_KINDS; kind++) {
+        bool matched = false;
+        for (size_t p = 0; p < patterns_[kind].size() && !matched; p++) {
+            const logPattern &pattern = patterns_[kind][p];
+            const std::string &text = pattern.matchCase ? line : lower;
+            for (size_t pos = text.find(pattern.text); pos != std::string::npos && !matched;
+                 pos = text.find(pattern.text, pos + 1)) {
+                matched = !zeroCount(line, pos, pattern.text.size());
+            }
+        }
+        if (matched) {
+            counts_[kind]++;
+            last_[kind] = line;
+        }
+    }
+}
+
+void tpx3ServalLog::setPatterns(int kind, const std::string &patterns)
+{
+    if (kind < 0 || kind >= TPX3_LOG_KINDS) {
+        return;
+    }
+    std::vector<logPattern> list;
+    size_t start = 0;
+    while (start <= patterns.size()) {
+        size_t comma = patterns.find(',', start);
+        if (comma == std::string::npos) {
+            comma = patterns.size();
+        }
+        std::string item = patterns.substr(start, comma - start);
+        size_t first = item.find_first_not_of(" \t");
+        if (first != std::string::npos) {
+            logPattern pattern;
+            pattern.text = item.substr(first);
+            pattern.matchCase = false;
+            for (size_t i = 0; i < pattern.text.size(); i++) {
+                pattern.matchCase |= isupper((unsigned char)pattern.text[i]) != 0;
+            }
+            list.push_back(pattern);
+        }
+        start = comma + 1;
+    }
+
+    std::lock_guard<std::mutex> guard(mutex_);
+    patterns_[kind] = list;
+}
+
+bool tpx3ServalLog::setFile(const std::string &path, size_t maxBytes, std::string *error)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    closeFile();
+    filePath_ = path;
+    fileMaxBytes_ = maxBytes;
+    fileError_.clear();
+    if (path.empty()) {
+        return true;
+    }
+    if (!openFile(error)) {
+        filePath_.clear();
+        return false;
+    }
+    return true;
+}
+
+// Caller holds mutex_
+bool tpx3ServalLog::openFile(std::string *error)
+{
+    file_ = fopen(filePath_.c_str(), "ae");
+    if (!file_) {
+        *error = "Cannot open " + filePath_ + ": " + strerror(errno);
+        return false;
+    }
+    fseek(file_, 0, SEEK_END);
+    long size = ftell(file_);
+    fileBytes_ = size > 0 ? (size_t)size : 0;
+    return true;
+}
+
+// Caller holds mutex_
+void tpx3ServalLog::closeFile()
+{
+    if (file_) {
+        fclose(file_);
+        file_ = NULL;
+    }
+}
+
+// Caller holds mutex_. A failed write closes the file rather than retry on every line.
+void tpx3ServalLog::writeFile(const std::string &line)
+{
+    if (!file_) {
+        return;
+    }
+    if (fileMaxBytes_ > 0 && fileBytes_ + line.size() + 1 > fileMaxBytes_ && fileBytes_ > 0) {
+        closeFile();
+        std::string rotated = filePath_ + ".1";
+        std::string error;
+        if (rename(filePath_.c_str(), rotated.c_str()) != 0) {
+            fileError_ = "Cannot rotate " + filePath_ + ": " + strerror(errno);
+            return;
+        }
+        if (!openFile(&error)) {
+            fileError_ = error;
+            return;
+        }
+    }
+    if (fwrite(line.data(), 1, line.size(), file_) != line.size() || fputc('\n', file_) == EOF) {
+        fileError_ = "Cannot write " + filePath_ + ": " + strerror(errno);
+        closeFile();
+        return;
+    }
+    fileBytes_ += line.size() + 1;
+}
+
+std::string tpx3ServalLog::tail(int lines, size_t maxChars) const
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    std::string out;
+    size_t count = lines > 0 ? (size_t)lines : 0;
+    if (count > lines_.size()) {
+        count = lines_.size();
+    }
+    // Newest first, so the cut falls on the oldest lines
+    for (size_t i = 0; i < count; i++) {
+        const std::string &line = lines_[lines_.size() - 1 - i];
+        if (out.size() + line.size() + 1 > maxChars) {
+            break;
+        }
+        out.insert(0, line + (i > 0 ? "\n" : ""));
+    }
+    return out;
+}
+
+void tpx3ServalLog::getStats(tpx3LogStats *out)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    double now = monotonicNow();
+    double dt = prevTime_ > 0.0 ? now - prevTime_ : 0.0;
+    out->lines = totalLines_;
+    out->bytes = totalBytes_;
+    out->lineRate = dt > 0.0 ? (totalLines_ - prevLines_) / dt : 0.0;
+    for (int kind = 0; kind < TPX3_LOG_KINDS; kind++) {
+        out->counts[kind] = counts_[kind];
+        out->rates[kind] = dt > 0.0 ? (counts_[kind] - prevCounts_[kind]) / dt : 0.0;
+        out->last[kind] = last_[kind];
+        prevCounts_[kind] = counts_[kind];
+    }
+    out->fileError = fileError_;
+    prevTime_ = now;
+    prevLines_ = totalLines_;
+    if (file_) {
+        fflush(file_);
+    }
+}
+
+void tpx3ServalLog::resetCounts()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    totalLines_ = 0;
+    totalBytes_ = 0;
+    prevTime_ = 0.0;
+    prevLines_ = 0;
+    for (int kind = 0; kind < TPX3_LOG_KINDS; kind++) {
+        counts_[kind] = 0;
+        prevCounts_[kind] = 0;
+        last_[kind].clear();
+    }
+}
+
+void tpx3ServalLog::clearLines()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    lines_.clear();
+}
@@ -0,0 +1,112 @@
+#ifndef tpx3ServalLog_H
+#define tpx3ServalLog_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Output streams of the Serval child
+#define TPX3_LOG_STDOUT 0
+#define TPX3_LOG_STDERR 1
+#define TPX3_LOG_STREAMS 2
+
+// Kinds of log line counted, by pattern
+#define TPX3_LOG_ERROR       0
+#define TPX3_LOG_DROP        1
+#define TPX3_LOG_BUFFER_FULL 2
+#define TPX3_LOG_KINDS       3
+
+// Lines kept in memory, and the length a line is cut to
+#define TPX3_LOG_RING_LINES 1000
+#define TPX3_LOG_LINE_CHARS 512
+
+// Totals since the last resetCounts(); rates are per second since the previous getStats()
+struct tpx3LogStats {
+    uint64_t lines;
+    uint64_t bytes;
+    double lineRate;
+    uint64_t counts[TPX3_LOG_KINDS];
+    double rates[TPX3_LOG_KINDS];
+    std::string last[TPX3_LOG_KINDS];  // most recent matching line
+    std::string fileError;             // the log file was closed after this error
+};
+
+// Captures the Serval child's stdout and stderr through two pipes, so the JVM
+// never writes to (and never blocks on) the IOC console. The pipes are created
+// once and kept for the life of the instance: every Serval started writes into
+// them, and the read ends never see EOF. The reader drains them non-blocking
+// into a ring of recent lines, optionally appends the lines to a log file
+// rotated by size, and counts lines matching the pattern of each kind.
+// Lines starting with blanks and "Caused by:" continue a stack trace and are
+// not counted again, nor are matches next to a count of zero ("dropped=0").
+// Patterns are plain substrings, not expressions. All methods may be called
+// from any thread.
+class tpx3ServalLog {
+public:
+    tpx3ServalLog();
+    ~tpx3ServalLog();
+
+    bool open(std::string *error);
+    bool isOpen() const { return readFds_[TPX3_LOG_STDOUT] >= 0; }
+    // Read ends, non-blocking, for the reader's event loop
+    int readFd(int stream) const { return readFds_[stream]; }
+    // Write ends, to be dup2'ed onto the child's fd 1 and 2; close-on-exec
+    int writeFd(int stream) const { return writeFds_[stream]; }
+
+    // Parse whatever the pipe holds; returns the number of complete lines
+    int drain(int stream);
+    // Add a line of the driver's own, e.g. where a new Serval starts
+    void mark(const std::string &text);
+
+    // Comma-separated substrings, leading blanks removed. A substring with
+    // an upper-case letter matches that case only, others match any case.
+    void setPatterns(int kind, const std::string &patterns);
+    static const char *kindName(int kind);
+    static const char *defaultPatterns(int kind);
+
+    // Append lines to path from now on, empty for none. At maxBytes (0: no
+    // limit) the file is renamed to path.1, replacing the previous one.
+    bool setFile(const std::string &path, size_t maxBytes, std::string *error);
+
+    // The last lines, oldest first and newline separated, cut from the front to maxChars
+    std::string tail(int lines, size_t maxChars) const;
+    void getStats(tpx3LogStats *out);
+    void resetCounts();
+    void clearLines();
+
+private:
+    mutable std::mutex mutex_;
+    int readFds_[TPX3_LOG_STREAMS];
+    int writeFds_[TPX3_LOG_STREAMS];
+    std::string partial_[TPX3_LOG_STREAMS];  // read but not yet ended by a newline
+    std::deque<std::string> lines_;
+    struct logPattern {
+        std::string text;
+        bool matchCase;
+    };
+    std::vector<logPattern> patterns_[TPX3_LOG_KINDS];
+
+    uint64_t totalLines_;
+    uint64_t totalBytes_;
+    uint64_t counts_[TPX3_LOG_KINDS];
+    std::string last_[TPX3_LOG_KINDS];
+    double prevTime_;
+    uint64_t prevLines_;
+    uint64_t prevCounts_[TPX3_LOG_KINDS];
+
+    FILE *file_;
+    std::string filePath_;
+    size_t fileMaxBytes_;
+    size_t fileBytes_;
+    std::string fileError_;
+
+    void addLine(const std::string &line, bool parse);
+    void writeFile(const std::string &line);
+    bool openFile(std::string *error);
+    void closeFile();
+};
+
+#endif // tpx3ServalLog_H
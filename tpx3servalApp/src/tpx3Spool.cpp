@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <chrono>
+
+#include "tpx3Spool.h"
+
+static double monotonicNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+tpx3StreamSpool::tpx3StreamSpool(tpx3StreamEngine &engine)
+    : engine_(engine), running_(false), recording_(true), segmentBytes_(0), current_(0),
+      written_(0), skipped_(0), exporting_(false), exported_(0)
+{
+    exportFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+}
+
+tpx3StreamSpool::~tpx3StreamSpool()
+{
+    stop();
+    if (exportFd_ >= 0) {
+        close(exportFd_);
+    }
+}
+
+bool tpx3StreamSpool::tapBlock(int index, const char *data, size_t length)
+{
+    if (!running_ || !recording_) {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(mutex_);
+    // stop() clears running_ under the lock; after that the writer may be gone
+    if (!running_) {
+        return false;
+    }
+    if (queue_.size() >= TPX3_SPOOL_MAX_QUEUED) {
+        // The disk fell behind; better a gap in the spool than a stalled stream
+        skipped_ += length;
+        return false;
+    }
+    pendingBlock b = { index, data, length, monotonicNow(), false };
+    queue_.push_back(b);
+    queueCond_.notify_one();
+    return true;
+}
+
+void tpx3StreamSpool::dropBlocks()
+{
+    // Nothing is dropped if the disk keeps up: the last blocks of a run are the ones most wanted
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (drainedCond_.wait_for(lock, std::chrono::duration<double>(TPX3_SPOOL_DRAIN_TIMEOUT),
+                              [this] { return queue_.empty(); })) {
+        return;
+    }
+    // The front block is the writer's; it stays queued, marked, until the copy returns
+    for (size_t i = 0; i < queue_.size(); i++) {
+        if (!queue_[i].abandoned) {
+            engine_.releaseBlock(queue_[i].index);
+            skipped_ += queue_[i].length;
+        }
+    }
+    queue_.resize(1);
+    queue_.front().abandoned = true;
+}
+
+void tpx3StreamSpool::setRecording(bool recording)
+{
+    recording_ = recording;
+}
+
+bool tpx3StreamSpool::start(const std::string &dir, int segments, size_t segmentBytes, std::string *error)
+{
+    if (running_) {
+        *error = "Spool already running";
+        return false;
+    }
+    if (dir.empty()) {
+        *error = "Spool directory not set";
+        return false;
+    }
+    if (segments < 2 || segmentBytes < TPX3_STREAM_BLOCK_BYTES || segmentBytes % sysconf(_SC_PAGESIZE) != 0) {
+        *error = "Invalid spool geometry";
+        return false;
+    }
+    segmentBytes_ = segmentBytes;
+    for (int i = 0; i < segments; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "/tpx3spool_%03d.dat", i);
+        std::string path = dir + name;
+        segment seg;
+        seg.fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        seg.data = NULL;
+        seg.used = 0;
+        seg.generation = 0;
+        int err = 0;
+        if (seg.fd < 0) {
+            err = errno;
+        } else if (ftruncate(seg.fd, (off_t)segmentBytes) != 0) {
+            err = errno;
+        } else {
+            // Reserve the blocks now, so the disk cannot fill up under a running spool
+            int rc = posix_fallocate(seg.fd, 0, (off_t)segmentBytes);
+            if (rc != 0 && rc != EOPNOTSUPP && rc != EINVAL) {
+                err = rc;
+            }
+        }
+        if (err == 0) {
+            void *data = mmap(NULL, segmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED, seg.fd, 0);
+            if (data == MAP_FAILED) {
+                err = errno;
+            } else {
+                seg.data = (char *)data;
+            }
+        }
+        if (err != 0) {
+            *error = "Cannot create spool segment " + path + ": " + strerror(err);
+            if (seg.fd >= 0) {
+                close(seg.fd);
+            }
+            unmap();
+            return false;
+        }
+        segments_.push_back(seg);
+    }
+    current_ = 0;
+    prefault(segments_[0]);
+    written_ = 0;
+    skipped_ = 0;
+    running_ = true;
+    writer_ = std::thread(&tpx3StreamSpool::writeLoop, this);
+    return true;
+}
+
+void tpx3StreamSpool::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        running_ = false;
+        queueCond_.notify_all();
+    }
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    if (exporter_.joinable()) {
+        exporter_.join();
+    }
+    unmap();
+}
+
+// Fault the whole segment in at once: a page fault per 4 KiB page in the block
+// copies costs the writer about a fifth of its bandwidth
+void tpx3StreamSpool::prefault(const segment &seg)
+{
+#ifdef MADV_POPULATE_WRITE
+    madvise(seg.data, segmentBytes_, MADV_POPULATE_WRITE);
+#else
+    (void)seg;
+#endif
+}
+
+// Stopping; the writer has emptied the queue
+void tpx3StreamSpool::unmap()
+{
+    for (size_t i = 0; i < segments_.size(); i++) {
+        munmap(segments_[i].data, segmentBytes_);
+        close(segments_[i].fd);
+    }
+    segments_.clear();
+}
+
+// Writer thread: copy queued blocks into the current segment and index them
+void tpx3StreamSpool::writeLoop()
+{
+    pthread_setname_np(pthread_self(), "tpx3Spool");
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        queueCond_.wait(lock, [this] { return !queue_.empty() || !running_; });
+        if (queue_.empty()) {
+            break;
+        }
+        pendingBlock b = queue_.front();
+        segment *seg = &segments_[current_];
+        if (seg->used + b.length > segmentBytes_) {
+            int previous = current_;
+            current_ = (current_ + 1) % (int)segments_.size();
+            seg = &segments_[current_];
+            // Reuse the oldest segment; its records go first, so nothing reads
+            // it while it is overwritten
+            seg->records.clear();
+            seg->used = 0;
+            seg->generation++;
+            lock.unlock();
+            // Start writing back the full segment now, rather than let dirty pages pile up
+            sync_file_range(segments_[previous].fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+            prefault(*seg);
+            lock.lock();
+        }
+        size_t offset = seg->used;
+        lock.unlock();
+        memcpy(seg->data + offset, b.data, b.length);
+        lock.lock();
+        if (queue_.front().abandoned) {
+            // The engine has the block back and may have reused it; the copy is not indexed
+            queue_.pop_front();
+            if (queue_.empty()) {
+                drainedCond_.notify_all();
+            }
+            continue;
+        }
+        engine_.releaseBlock(b.index);
+        record r = { offset, b.length, b.time };
+        seg->records.push_back(r);
+        seg->used += b.length;
+        written_ += b.length;
+        queue_.pop_front();
+        if (queue_.empty()) {
+            drainedCond_.notify_all();
+        }
+    }
+    drainedCond_.notify_all();
+}
+
+// Records in the time range, oldest first, with their segment; caller holds mutex_
+bool tpx3StreamSpool::selectRecords(double fromAge, double toAge, std::vector<std::pair<int, record> > *out,
+                                    std::string *error) const
+{
+    out->clear();
+    if (segments_.empty()) {
+        *error = "Spool not running";
+        return false;
+    }
+    double now = monotonicNow();
+    double from = fromAge > 0.0 ? now - fromAge : 0.0;
+    double to = now - toAge;
+    int n = (int)segments_.size();
+    // The segment after the current one is the oldest
+    for (int k = 1; k <= n; k++) {
+        int s = (current_ + k) % n;
+        const std::vector<record> &records = segments_[s].records;
+        if (records.empty() || records.back().time < from || records.front().time > to) {
+            continue;
+        }
+        for (size_t i = 0; i < records.size(); i++) {
+            if (records[i].time >= from && records[i].time <= to) {
+                out->push_back(std::make_pair(s, records[i]));
+            }
+        }
+    }
+    if (out->empty()) {
+        *error = "No spooled data in the range";
+        return false;
+    }
+    return true;
+}
+
+bool tpx3StreamSpool::selectRange(double fromAge, double toAge, std::vector<tpx3StreamExtent> *out,
+                                  std::string *error) const
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    std::vector<std::pair<int, record> > records;
+    if (!selectRecords(fromAge, toAge, &records, error)) {
+        return false;
+    }
+    out->clear();
+    for (size_t i = 0; i < records.size(); i++) {
+        tpx3StreamExtent e = { segments_[records[i].first].data + records[i].second.offset,
+                               records[i].second.length };
+        out->push_back(e);
+    }
+    return true;
+}
+
+bool tpx3StreamSpool::startExport(const std::string &path, double fromAge, double toAge, std::string *error)
+{
+    // Until finishExport() has collected the last one
+    if (exporting_ || exporter_.joinable()) {
+        *error = "Spool export already running";
+        return false;
+    }
+    std::vector<std::pair<int, record> > records;
+    std::vector<uint64_t> generations;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (!selectRecords(fromAge, toAge, &records, error)) {
+            return false;
+        }
+        for (size_t i = 0; i < segments_.size(); i++) {
+            generations.push_back(segments_[i].generation);
+        }
+        exportError_.clear();
+    }
+    exported_ = 0;
+    exporting_ = true;
+    exporter_ = std::thread(&tpx3StreamSpool::exportLoop, this, path, records, generations);
+    return true;
+}
+
+// Export thread. Each block is copied out under the lock, so the writer cannot
+// reuse its segment meanwhile; a block whose segment was reused since the range
+// was selected ends the export.
+void tpx3StreamSpool::exportLoop(std::string path, std::vector<std::pair<int, record> > records,
+                                 std::vector<uint64_t> generations)
+{
+    pthread_setname_np(pthread_self(), "tpx3SpoolExport");
+
+    std::string error;
+    std::vector<char> buffer(TPX3_STREAM_BLOCK_BYTES);
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f) {
+        error = "Cannot write " + path + ": " + strerror(errno);
+    }
+    for (size_t i = 0; f && error.empty() && i < records.size(); i++) {
+        const record &r = records[i].second;
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            const segment &seg = segments_[records[i].first];
+            if (!running_) {
+                error = "Spool export cut short: the spool was stopped";
+                break;
+            }
+            if (seg.generation != generations[records[i].first]) {
+                error = "Spool export cut short: the range was overwritten";
+                break;
+            }
+            memcpy(&buffer[0], seg.data + r.offset, r.length);
+        }
+        if (fwrite(&buffer[0], 1, r.length, f) != r.length) {
+            error = "Cannot write " + path + ": " + strerror(errno);
+            break;
+        }
+        exported_ += r.length;
+    }
+    if (f && fclose(f) != 0 && error.empty()) {
+        error = "Cannot write " + path + ": " + strerror(errno);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        exportError_ = error;
+    }
+    exporting_ = false;
+    uint64_t one = 1;
+    ssize_t n = write(exportFd_, &one, sizeof(one));
+    (void)n;
+}
+
+bool tpx3StreamSpool::finishExport(std::string *error)
+{
+    uint64_t count;
+    while (read(exportFd_, &count, sizeof(count)) > 0) {
+    }
+    if (exporter_.joinable()) {
+        exporter_.join();
+    }
+    std::lock_guard<std::mutex> guard(mutex_);
+    *error = exportError_;
+    return exportError_.empty();
+}
+
+void tpx3StreamSpool::getStats(tpx3SpoolStats *out) const
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    out->running = running_;
+    out->recording = recording_;
+    out->capacity = (uint64_t)segments_.size() * segmentBytes_;
+    out->held = 0;
+    out->oldestAge = 0.0;
+    double oldest = 0.0;
+    for (size_t i = 0; i < segments_.size(); i++) {
+        const segment &seg = segments_[i];
+        out->held += seg.used;
+        if (!seg.records.empty() && (oldest == 0.0 || seg.records.front().time < oldest)) {
+            oldest = seg.records.front().time;
+        }
+    }
+    if (oldest > 0.0) {
+        out->oldestAge = monotonicNow() - oldest;
+    }
+    out->written = written_;
+    out->skipped = skipped_;
+    out->exporting = exporting_;
+    out->exported = exported_;
+}
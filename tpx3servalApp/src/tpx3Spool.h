@@ -0,0 +1,130 @@
+#ifndef tpx3Spool_H
+#define tpx3Spool_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tpx3Stream.h"
+
+// Blocks waiting for the writer; past this the spool skips blocks rather than
+// hold the engine's pool
+#define TPX3_SPOOL_MAX_QUEUED 8
+// Seconds dropBlocks() waits for the writer before it skips what is still queued
+#define TPX3_SPOOL_DRAIN_TIMEOUT 2.0
+
+// Snapshot of the spool; totals since start()
+struct tpx3SpoolStats {
+    bool running;
+    bool recording;
+    uint64_t capacity;   // bytes, all segments
+    uint64_t held;       // bytes of stream in the ring
+    uint64_t written;
+    uint64_t skipped;    // not spooled because the writer fell behind
+    double oldestAge;    // s, 0 while empty
+    bool exporting;
+    uint64_t exported;   // bytes, current or last export
+};
+
+// Spools the raw stream to a ring of preallocated, memory-mapped segment files
+// on local disk. The spool is a tap on the stream engine: blocks are queued on
+// the receive thread and copied into the mapped segment by a writer thread,
+// which then gives them back to the engine. Blocks are never split across
+// segments, so every spooled block is whole chunks. When the ring is full the
+// oldest segment is reused. The index (the arrival time of every block, and
+// so the start time of every segment) lives in memory: the segment files are
+// rewritten from the start on every start().
+class tpx3StreamSpool : public tpx3StreamTap {
+public:
+    explicit tpx3StreamSpool(tpx3StreamEngine &engine);
+    ~tpx3StreamSpool();
+
+    bool tapBlock(int index, const char *data, size_t length);
+    // Waits for the writer to catch up, up to TPX3_SPOOL_DRAIN_TIMEOUT; a
+    // stalled disk must not hold up stopping the stream. The blocks still
+    // queued then go back to the engine and count as skipped.
+    void dropBlocks();
+
+    // Create or reuse dir/tpx3spool_NNN.dat, segments of segmentBytes each
+    bool start(const std::string &dir, int segments, size_t segmentBytes, std::string *error);
+    void stop();
+    bool running() const { return running_; }
+
+    // While not recording, blocks are not spooled and the ring does not change
+    void setRecording(bool recording);
+
+    // Blocks that arrived from fromAge to toAge seconds ago, oldest first;
+    // fromAge 0 starts at the oldest. The extents point into the mapped
+    // segments, so they are valid until recording resumes or stop().
+    bool selectRange(double fromAge, double toAge, std::vector<tpx3StreamExtent> *out, std::string *error) const;
+
+    // Write a range, as selectRange(), to a .tpx3 file on a thread of its
+    // own. exportEvent() becomes readable when it is done; finishExport()
+    // then collects the result, and another export may start.
+    bool startExport(const std::string &path, double fromAge, double toAge, std::string *error);
+    int exportEvent() const { return exportFd_; }
+    bool finishExport(std::string *error);
+
+    void getStats(tpx3SpoolStats *out) const;
+
+private:
+    struct record {
+        size_t offset;
+        size_t length;
+        double time;  // arrival, monotonic
+    };
+
+    struct segment {
+        int fd;
+        char *data;
+        size_t used;
+        uint64_t generation;  // bumped whenever the segment is reused
+        std::vector<record> records;
+    };
+
+    struct pendingBlock {
+        int index;
+        const char *data;
+        size_t length;
+        double time;
+        bool abandoned;  // given back by dropBlocks() while the writer copied it
+    };
+
+    tpx3StreamEngine &engine_;
+    std::atomic<bool> running_;
+    std::atomic<bool> recording_;
+
+    // Guards the queue and the index. Block copies into a segment are made
+    // without it, into space no record points at yet.
+    mutable std::mutex mutex_;
+    std::condition_variable queueCond_;
+    std::condition_variable drainedCond_;
+    std::deque<pendingBlock> queue_;
+    std::vector<segment> segments_;
+    size_t segmentBytes_;
+    int current_;
+    uint64_t written_;
+    uint64_t skipped_;
+    std::thread writer_;
+
+    std::thread exporter_;
+    std::atomic<bool> exporting_;
+    std::atomic<uint64_t> exported_;
+    std::string exportError_;  // guarded by mutex_
+    int exportFd_;
+
+    void writeLoop();
+    void exportLoop(std::string path, std::vector<std::pair<int, record> > records,
+                    std::vector<uint64_t> generations);
+    bool selectRecords(double fromAge, double toAge, std::vector<std::pair<int, record> > *out,
+                       std::string *error) const;
+    void prefault(const segment &seg);
+    void unmap();
+};
+
+#endif // tpx3Spool_H
@@ -0,0 +1,662 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "tpx3Stream.h"
+
+// Receive buffer for the Serval connection, to absorb bursts while a block is handed over
+#define STREAM_SOCKET_RCVBUF (8 * 1024 * 1024)
+// A block is handed to the workers when less than this is left, or when the source goes quiet
+#define STREAM_BLOCK_LOW_WATER (TPX3_MAX_CHUNK_BYTES + 8)
+#define STREAM_IDLE_FLUSH_MS 10
+
+static double monotonicNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void tpx3ClassifyWordsScalar(const uint64_t *words, size_t count, tpx3PacketCounts *counts)
+{
+    uint64_t hits = 0, tdcs = 0, globalTimes = 0, controls = 0;
+    for (size_t i = 0; i < count; i++) {
+        unsigned type = (unsigned)(words[i] >> 60);
+        hits += ((type | 1) == TPX3_PKT_HIT);
+        tdcs += (type == TPX3_PKT_TDC);
+        globalTimes += (type == TPX3_PKT_GLOBAL_TIME);
+        controls += (type == TPX3_PKT_CONTROL);
+    }
+    counts->hits += hits;
+    counts->tdcs += tdcs;
+    counts->globalTimes += globalTimes;
+    counts->controls += controls;
+    counts->others += count - hits - tdcs - globalTimes - controls;
+}
+
+#if defined(__SSE2__)
+// Sum the two 64-bit lanes of a counter vector
+static inline uint64_t laneSum(__m128i v)
+{
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, v);
+    return lanes[0] + lanes[1];
+}
+
+// Two words per step: shift the type nibble down, compare it in the low 32 bits
+// of each 64-bit lane and add the masked result to per-type lane counters.
+// SSE2 has no 64-bit compare, hence the low-dword mask.
+void tpx3ClassifyWords(const uint64_t *words, size_t count, tpx3PacketCounts *counts)
+{
+    const __m128i one = _mm_set1_epi64x(1);
+    const __m128i hitType = _mm_set1_epi64x(TPX3_PKT_HIT);
+    const __m128i tdcType = _mm_set1_epi64x(TPX3_PKT_TDC);
+    const __m128i globalTimeType = _mm_set1_epi64x(TPX3_PKT_GLOBAL_TIME);
+    const __m128i controlType = _mm_set1_epi64x(TPX3_PKT_CONTROL);
+    __m128i hits = _mm_setzero_si128();
+    __m128i tdcs = _mm_setzero_si128();
+    __m128i globalTimes = _mm_setzero_si128();
+    __m128i controls = _mm_setzero_si128();
+
+    size_t pairs = count / 2;
+    const __m128i *p = (const __m128i *)words;
+    for (size_t i = 0; i < pairs; i++) {
+        __m128i type = _mm_srli_epi64(_mm_loadu_si128(p + i), 60);
+        hits = _mm_add_epi64(hits, _mm_and_si128(_mm_cmpeq_epi32(_mm_or_si128(type, one), hitType), one));
+        tdcs = _mm_add_epi64(tdcs, _mm_and_si128(_mm_cmpeq_epi32(type, tdcType), one));
+        globalTimes = _mm_add_epi64(globalTimes, _mm_and_si128(_mm_cmpeq_epi32(type, globalTimeType), one));
+        controls = _mm_add_epi64(controls, _mm_and_si128(_mm_cmpeq_epi32(type, controlType), one));
+    }
+
+    uint64_t nHits = laneSum(hits);
+    uint64_t nTdcs = laneSum(tdcs);
+    uint64_t nGlobalTimes = laneSum(globalTimes);
+    uint64_t nControls = laneSum(controls);
+    counts->hits += nHits;
+    counts->tdcs += nTdcs;
+    counts->globalTimes += nGlobalTimes;
+    counts->controls += nControls;
+    counts->others += 2 * pairs - nHits - nTdcs - nGlobalTimes - nControls;
+    if (count & 1) {
+        tpx3ClassifyWordsScalar(words + count - 1, 1, counts);
+    }
+}
+#else
+void tpx3ClassifyWords(const uint64_t *words, size_t count, tpx3PacketCounts *counts)
+{
+    tpx3ClassifyWordsScalar(words, count, counts);
+}
+#endif
+
+tpx3StreamEngine::tpx3StreamEngine()
+    : minFreeBlocks_(0), numWorkers_(0), running_(false), stopping_(false),
+      connected_(false), sourceDone_(false), bytes_(0), stalls_(0), sequence_(0),
+      listenFd_(-1), fileFd_(-1), stopFd_(-1), loop_(false), rateMBs_(0.0)
+{
+    resetCounters();
+}
+
+void tpx3StreamEngine::resetCounters()
+{
+    for (int i = 0; i < TPX3_STREAM_MAX_WORKERS; i++) {
+        workerCounters &wc = counters_[i];
+        wc.chunks = 0;
+        wc.hits = 0;
+        wc.tdcs = 0;
+        wc.globalTimes = 0;
+        wc.controls = 0;
+        wc.others = 0;
+        wc.framingErrors = 0;
+    }
+}
+
+tpx3StreamEngine::~tpx3StreamEngine()
+{
+    stop();
+    for (size_t i = 0; i < blocks_.size(); i++) {
+        free(blocks_[i].data);
+    }
+}
+
+void tpx3StreamEngine::addConsumer(tpx3StreamConsumer *consumer)
+{
+    if (!running_) {
+        consumers_.push_back(consumer);
+    }
+}
+
+void tpx3StreamEngine::addTap(tpx3StreamTap *tap)
+{
+    if (!running_) {
+        taps_.push_back(tap);
+    }
+}
+
+void tpx3StreamEngine::clearTaps()
+{
+    if (!running_) {
+        taps_.clear();
+    }
+}
+
+bool tpx3StreamEngine::allocate(std::string *error)
+{
+    if (!blocks_.empty()) {
+        return true;
+    }
+    for (int i = 0; i < TPX3_STREAM_NUM_BLOCKS; i++) {
+        void *mem = NULL;
+        if (posix_memalign(&mem, 4096, TPX3_STREAM_BLOCK_BYTES) != 0) {
+            *error = "Cannot allocate stream buffers";
+            for (size_t j = 0; j < blocks_.size(); j++) {
+                free(blocks_[j].data);
+            }
+            blocks_.clear();
+            return false;
+        }
+        // Touch the pages now so the first data does not take page faults
+        memset(mem, 0, TPX3_STREAM_BLOCK_BYTES);
+        block blk = { (char *)mem, 0, 0 };
+        blocks_.push_back(blk);
+    }
+    refs_.reset(new std::atomic<int>[TPX3_STREAM_NUM_BLOCKS]());
+    return true;
+}
+
+bool tpx3StreamEngine::startTcp(int port, int workers, std::string *error)
+{
+    if (running_) {
+        *error = "Stream already running";
+        return false;
+    }
+    if (!allocate(error)) {
+        return false;
+    }
+    listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (listenFd_ < 0 || bind(listenFd_, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listenFd_, 1) < 0) {
+        *error = std::string("Cannot listen on stream port: ") + strerror(errno);
+        if (listenFd_ >= 0) {
+            close(listenFd_);
+            listenFd_ = -1;
+        }
+        return false;
+    }
+    return startThreads(workers, error);
+}
+
+bool tpx3StreamEngine::startFile(const std::string &path, int workers, bool loop, double rateMBs, std::string *error)
+{
+    if (running_) {
+        *error = "Stream already running";
+        return false;
+    }
+    if (!allocate(error)) {
+        return false;
+    }
+    fileFd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fileFd_ < 0) {
+        *error = std::string("Cannot open replay file: ") + strerror(errno);
+        return false;
+    }
+    posix_fadvise(fileFd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    loop_ = loop;
+    rateMBs_ = rateMBs;
+    return startThreads(workers, error);
+}
+
+bool tpx3StreamEngine::startExtents(const std::vector<tpx3StreamExtent> &extents, int workers, double rateMBs,
+                                    std::string *error)
+{
+    if (running_) {
+        *error = "Stream already running";
+        return false;
+    }
+    if (extents.empty()) {
+        *error = "Nothing to replay";
+        return false;
+    }
+    if (!allocate(error)) {
+        return false;
+    }
+    for (size_t i = 0; i < extents.size(); i++) {
+        if (extents[i].length > TPX3_STREAM_BLOCK_BYTES) {
+            *error = "Stream extent larger than a block";
+            return false;
+        }
+    }
+    extents_ = extents;
+    rateMBs_ = rateMBs;
+    return startThreads(workers, error);
+}
+
+bool tpx3StreamEngine::startThreads(int workers, std::string *error)
+{
+    stopFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (stopFd_ < 0) {
+        *error = std::string("Cannot create stream stop event: ") + strerror(errno);
+        stop();
+        return false;
+    }
+    if (workers < 1) {
+        workers = 1;
+    }
+    if (workers > TPX3_STREAM_MAX_WORKERS) {
+        workers = TPX3_STREAM_MAX_WORKERS;
+    }
+    numWorkers_ = workers;
+
+    resetCounters();
+    bytes_ = 0;
+    stalls_ = 0;
+    sequence_ = 0;
+    connected_ = false;
+    sourceDone_ = false;
+    stopping_ = false;
+    freeBlocks_.clear();
+    fullBlocks_.clear();
+    for (size_t i = 0; i < blocks_.size(); i++) {
+        freeBlocks_.push_back((int)i);
+    }
+    minFreeBlocks_ = (int)freeBlocks_.size();
+
+    for (size_t i = 0; i < consumers_.size(); i++) {
+        consumers_[i]->configure(numWorkers_);
+    }
+
+    running_ = true;
+    for (int i = 0; i < numWorkers_; i++) {
+        workers_.push_back(std::thread(&tpx3StreamEngine::decodeLoop, this, i));
+    }
+    receiver_ = std::thread(&tpx3StreamEngine::receiveLoop, this);
+    return true;
+}
+
+void tpx3StreamEngine::stop()
+{
+    // Wake the receiver wherever it waits: poll (stopFd_) or a free block (freeCond_)
+    {
+        std::lock_guard<std::mutex> guard(queueMutex_);
+        stopping_ = true;
+    }
+    if (stopFd_ >= 0) {
+        uint64_t one = 1;
+        ssize_t n = write(stopFd_, &one, sizeof(one));
+        (void)n;
+    }
+    fullCond_.notify_all();
+    freeCond_.notify_all();
+    if (receiver_.joinable()) {
+        receiver_.join();
+    }
+    for (size_t i = 0; i < workers_.size(); i++) {
+        workers_[i].join();
+    }
+    workers_.clear();
+    for (size_t i = 0; i < taps_.size(); i++) {
+        taps_[i]->dropBlocks();
+    }
+
+    if (listenFd_ >= 0) {
+        close(listenFd_);
+        listenFd_ = -1;
+    }
+    if (fileFd_ >= 0) {
+        close(fileFd_);
+        fileFd_ = -1;
+    }
+    extents_.clear();
+    if (stopFd_ >= 0) {
+        close(stopFd_);
+        stopFd_ = -1;
+    }
+    connected_ = false;
+    running_ = false;
+}
+
+int tpx3StreamEngine::acquireFree()
+{
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    if (freeBlocks_.empty()) {
+        stalls_++;
+        freeCond_.wait(lock, [this] { return !freeBlocks_.empty() || stopping_; });
+        if (freeBlocks_.empty()) {
+            return -1;
+        }
+    }
+    int index = freeBlocks_.back();
+    freeBlocks_.pop_back();
+    if ((int)freeBlocks_.size() < minFreeBlocks_) {
+        minFreeBlocks_ = (int)freeBlocks_.size();
+    }
+    return index;
+}
+
+// Length of the leading part of data made of complete chunks. Words that are not
+// a valid chunk header are consumed one at a time (the workers count them).
+size_t tpx3StreamEngine::completeLength(const char *data, size_t length)
+{
+    size_t offset = 0;
+    while (offset + 8 <= length) {
+        uint64_t header;
+        memcpy(&header, data + offset, 8);
+        size_t size = tpx3ChunkBytes(header);
+        if (!tpx3IsChunkHeader(header) || (size & 7) != 0) {
+            offset += 8;
+            continue;
+        }
+        if (offset + 8 + size > length) {
+            break;
+        }
+        offset += 8 + size;
+    }
+    return offset;
+}
+
+void tpx3StreamEngine::dispatch(int index, size_t length)
+{
+    blocks_[index].length = length;
+    blocks_[index].sequence = sequence_++;
+    // Set before the taps see the block: one may release it before the next is asked
+    refs_[index] = 1 + (int)taps_.size();
+    for (size_t i = 0; i < taps_.size(); i++) {
+        if (!taps_[i]->tapBlock(index, blocks_[index].data, length)) {
+            refs_[index].fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> guard(queueMutex_);
+        fullBlocks_.push_back(index);
+    }
+    fullCond_.notify_one();
+}
+
+// Read fd until EOF, error or stop; returns false on stop
+bool tpx3StreamEngine::pumpFd(int fd, bool isFile)
+{
+    int current = acquireFree();
+    if (current < 0) {
+        return false;
+    }
+    size_t used = 0;
+    double pumpStart = monotonicNow();
+    uint64_t pumpBytes = 0;
+
+    for (;;) {
+        struct pollfd pfds[2] = { { fd, POLLIN, 0 }, { stopFd_, POLLIN, 0 } };
+        int timeoutMs = used > 0 ? STREAM_IDLE_FLUSH_MS : 100;
+        int n = isFile ? 1 : poll(pfds, 2, timeoutMs);
+        if (stopping_) {
+            break;
+        }
+        if (n < 0 && errno != EINTR) {
+            break;
+        }
+
+        if (n == 0) {
+            // Source went quiet: hand over whatever is complete
+            size_t complete = completeLength(blocks_[current].data, used);
+            if (complete > 0) {
+                int next = acquireFree();
+                if (next < 0) {
+                    break;
+                }
+                memcpy(blocks_[next].data, blocks_[current].data + complete, used - complete);
+                dispatch(current, complete);
+                current = next;
+                used -= complete;
+            }
+            continue;
+        }
+        if (n < 0) {
+            continue;
+        }
+
+        ssize_t got = read(fd, blocks_[current].data + used, TPX3_STREAM_BLOCK_BYTES - used);
+        if (got < 0 && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+        }
+        if (got <= 0) {
+            // EOF or error: flush complete chunks; a trailing partial chunk is dropped
+            size_t complete = completeLength(blocks_[current].data, used);
+            if (complete > 0) {
+                dispatch(current, complete);
+            } else {
+                std::lock_guard<std::mutex> guard(queueMutex_);
+                freeBlocks_.push_back(current);
+                freeCond_.notify_one();
+            }
+            return true;
+        }
+        used += got;
+        bytes_ += got;
+
+        if (isFile) {
+            pumpBytes += got;
+            pace(pumpStart, pumpBytes);
+        }
+
+        if (TPX3_STREAM_BLOCK_BYTES - used < STREAM_BLOCK_LOW_WATER) {
+            size_t complete = completeLength(blocks_[current].data, used);
+            int next = acquireFree();
+            if (next < 0) {
+                break;
+            }
+            memcpy(blocks_[next].data, blocks_[current].data + complete, used - complete);
+            dispatch(current, complete);
+            current = next;
+            used -= complete;
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(queueMutex_);
+    freeBlocks_.push_back(current);
+    freeCond_.notify_one();
+    return false;
+}
+
+// Pace a replay to the requested rate, if any
+void tpx3StreamEngine::pace(double start, uint64_t bytes)
+{
+    if (rateMBs_ <= 0.0) {
+        return;
+    }
+    double due = start + bytes / (rateMBs_ * 1e6);
+    double wait = due - monotonicNow();
+    if (wait > 0.0) {
+        struct pollfd pfd = { stopFd_, POLLIN, 0 };
+        poll(&pfd, 1, (int)(wait * 1000.0) + 1);
+    }
+}
+
+// Copy each extent into a block of its own; they already end on chunk boundaries
+void tpx3StreamEngine::pumpExtents()
+{
+    double start = monotonicNow();
+    uint64_t sent = 0;
+    for (size_t i = 0; i < extents_.size() && !stopping_; i++) {
+        int index = acquireFree();
+        if (index < 0) {
+            return;
+        }
+        memcpy(blocks_[index].data, extents_[i].data, extents_[i].length);
+        bytes_ += extents_[i].length;
+        dispatch(index, extents_[i].length);
+        sent += extents_[i].length;
+        pace(start, sent);
+    }
+    sourceDone_ = !stopping_;
+}
+
+void tpx3StreamEngine::receiveLoop()
+{
+    pthread_setname_np(pthread_self(), "tpx3StreamRecv");
+
+    if (!extents_.empty()) {
+        connected_ = true;
+        pumpExtents();
+        connected_ = false;
+        return;
+    }
+
+    if (fileFd_ >= 0) {
+        connected_ = true;
+        while (!stopping_) {
+            if (!pumpFd(fileFd_, true)) {
+                break;
+            }
+            if (!loop_) {
+                sourceDone_ = true;
+                break;
+            }
+            lseek(fileFd_, 0, SEEK_SET);
+        }
+        connected_ = false;
+        return;
+    }
+
+    // TCP: serve one Serval connection at a time
+    while (!stopping_) {
+        struct pollfd pfds[2] = { { listenFd_, POLLIN, 0 }, { stopFd_, POLLIN, 0 } };
+        if (poll(pfds, 2, -1) <= 0 || stopping_) {
+            continue;
+        }
+        int fd = accept4(listenFd_, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (fd < 0) {
+            continue;
+        }
+        int rcvbuf = STREAM_SOCKET_RCVBUF;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        connected_ = true;
+        pumpFd(fd, false);
+        connected_ = false;
+        close(fd);
+    }
+}
+
+void tpx3StreamEngine::decodeLoop(int worker)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "tpx3Decode%d", worker);
+    pthread_setname_np(pthread_self(), name);
+
+    for (;;) {
+        int index;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            fullCond_.wait(lock, [this] { return !fullBlocks_.empty() || stopping_; });
+            if (fullBlocks_.empty()) {
+                return;
+            }
+            index = fullBlocks_.front();
+            fullBlocks_.pop_front();
+        }
+        decodeBlock(worker, blocks_[index]);
+        releaseBlock(index);
+    }
+}
+
+void tpx3StreamEngine::releaseBlock(int index)
+{
+    if (refs_[index].fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(queueMutex_);
+        freeBlocks_.push_back(index);
+    }
+    freeCond_.notify_one();
+}
+
+void tpx3StreamEngine::decodeBlock(int worker, const block &blk)
+{
+    workerCounters &wc = counters_[worker];
+    tpx3PacketCounts counts;
+    memset(&counts, 0, sizeof(counts));
+    uint64_t chunks = 0, framingErrors = 0;
+
+    // Blocks start 4 KiB aligned and chunks are whole words, so words are aligned
+    const uint64_t *words = (const uint64_t *)blk.data;
+    size_t total = blk.length / 8;
+    size_t i = 0;
+    while (i < total) {
+        uint64_t header = words[i];
+        size_t size = tpx3ChunkBytes(header);
+        if (!tpx3IsChunkHeader(header) || (size & 7) != 0) {
+            framingErrors++;
+            i++;
+            continue;
+        }
+        tpx3StreamChunk chunk;
+        chunk.chip = tpx3ChunkChip(header);
+        chunk.mode = (int)((header >> 40) & 0xFF);
+        chunk.words = words + i + 1;
+        chunk.count = size / 8;
+        chunk.sequence = blk.sequence;
+        uint64_t hitsBefore = counts.hits, tdcsBefore = counts.tdcs;
+        tpx3ClassifyWords(chunk.words, chunk.count, &counts);
+        chunk.hits = counts.hits - hitsBefore;
+        chunk.tdcs = counts.tdcs - tdcsBefore;
+        for (size_t c = 0; c < consumers_.size(); c++) {
+            consumers_[c]->consume(worker, chunk);
+        }
+        chunks++;
+        i += 1 + chunk.count;
+    }
+    for (size_t c = 0; c < consumers_.size(); c++) {
+        consumers_[c]->endBlock(worker, blk.sequence);
+    }
+
+    // Single writer per counter set: plain load/store, no locked RMW
+    wc.chunks.store(wc.chunks.load(std::memory_order_relaxed) + chunks, std::memory_order_relaxed);
+    wc.hits.store(wc.hits.load(std::memory_order_relaxed) + counts.hits, std::memory_order_relaxed);
+    wc.tdcs.store(wc.tdcs.load(std::memory_order_relaxed) + counts.tdcs, std::memory_order_relaxed);
+    wc.globalTimes.store(wc.globalTimes.load(std::memory_order_relaxed) + counts.globalTimes, std::memory_order_relaxed);
+    wc.controls.store(wc.controls.load(std::memory_order_relaxed) + counts.controls, std::memory_order_relaxed);
+    wc.others.store(wc.others.load(std::memory_order_relaxed) + counts.others, std::memory_order_relaxed);
+    wc.framingErrors.store(wc.framingErrors.load(std::memory_order_relaxed) + framingErrors, std::memory_order_relaxed);
+}
+
+void tpx3StreamEngine::getStats(tpx3StreamStats *out) const
+{
+    memset(out, 0, sizeof(*out));
+    out->running = running_;
+    out->connected = connected_;
+    out->sourceDone = sourceDone_;
+    out->bytes = bytes_;
+    out->stalls = stalls_;
+    for (int i = 0; i < numWorkers_; i++) {
+        const workerCounters &wc = counters_[i];
+        out->chunks += wc.chunks.load(std::memory_order_relaxed);
+        out->packets.hits += wc.hits.load(std::memory_order_relaxed);
+        out->packets.tdcs += wc.tdcs.load(std::memory_order_relaxed);
+        out->packets.globalTimes += wc.globalTimes.load(std::memory_order_relaxed);
+        out->packets.controls += wc.controls.load(std::memory_order_relaxed);
+        out->packets.others += wc.others.load(std::memory_order_relaxed);
+        out->framingErrors += wc.framingErrors.load(std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> guard(queueMutex_);
+    out->freeBlocks = (int)freeBlocks_.size();
+    out->minFreeBlocks = minFreeBlocks_;
+}
@@ -0,0 +1,218 @@
+#ifndef tpx3Stream_H
+#define tpx3Stream_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Raw TPX3 stream as sent by Serval: chunks of 64-bit little-endian words, each
+// chunk starting with a header word holding "TPX3" in the low 32 bits, the chip
+// index in byte 4, the readout mode in byte 5 and the payload size in bytes in
+// bytes 6-7.
+#define TPX3_CHUNK_MAGIC 0x33585054u
+#define TPX3_MAX_CHUNK_BYTES 65535
+
+// Packet type = top nibble of a word
+#define TPX3_PKT_HIT_COUNT   0xA  // pixel hit, count mode
+#define TPX3_PKT_HIT         0xB  // pixel hit, ToA/ToT mode
+#define TPX3_PKT_TDC         0x6
+#define TPX3_PKT_GLOBAL_TIME 0x4
+#define TPX3_PKT_CONTROL     0x7
+
+// Ingest buffers: allocated once, on the first start
+#define TPX3_STREAM_BLOCK_BYTES (4 * 1024 * 1024)
+#define TPX3_STREAM_NUM_BLOCKS  16
+#define TPX3_STREAM_MAX_WORKERS 16
+
+inline bool tpx3IsChunkHeader(uint64_t word)
+{
+    return (uint32_t)word == TPX3_CHUNK_MAGIC;
+}
+
+inline size_t tpx3ChunkBytes(uint64_t header)
+{
+    return (size_t)(header >> 48);
+}
+
+inline int tpx3ChunkChip(uint64_t header)
+{
+    return (int)((header >> 32) & 0xFF);
+}
+
+// Per-type packet counts
+struct tpx3PacketCounts {
+    uint64_t hits;
+    uint64_t tdcs;
+    uint64_t globalTimes;
+    uint64_t controls;
+    uint64_t others;
+};
+
+// Count packets by type. Uses SSE2 where available; results are added to counts.
+void tpx3ClassifyWords(const uint64_t *words, size_t count, tpx3PacketCounts *counts);
+// Portable reference implementation, for tests and benchmarks
+void tpx3ClassifyWordsScalar(const uint64_t *words, size_t count, tpx3PacketCounts *counts);
+
+// One chunk handed to consumers; words excludes the header
+struct tpx3StreamChunk {
+    int chip;
+    int mode;
+    const uint64_t *words;
+    size_t count;
+    uint64_t sequence;  // block sequence number, increasing in arrival order
+    uint64_t hits;      // pixel hits and TDC packets among the words, from the classification pass
+    uint64_t tdcs;
+};
+
+// Hook for stages that need the decoded stream (preview, histograms, ...).
+// consume() is called concurrently from all decode workers, each passing its
+// own worker index, so per-worker state needs no locking. A worker hands over
+// the chunks of one block in stream order, then calls endBlock(); every block
+// sequence number, counted from 0 at each start(), reaches endBlock() once, in
+// whatever order workers finish.
+class tpx3StreamConsumer {
+public:
+    virtual ~tpx3StreamConsumer() {}
+    // Called from start() before any data flows
+    virtual void configure(int numWorkers) = 0;
+    virtual void consume(int worker, const tpx3StreamChunk &chunk) = 0;
+    // State carried from chunk to chunk must be settled here: the next block
+    // of the stream may go to another worker
+    virtual void endBlock(int worker, uint64_t sequence) { (void)worker; (void)sequence; }
+};
+
+// Hook for stages that need the raw bytes in stream order (the relay, the
+// spool). tapBlock() is called on the receive thread for every block, in
+// order, before the workers see it. A tap that returns true keeps the block's memory until it
+// hands the block back with tpx3StreamEngine::releaseBlock(); the receiver
+// waits for free blocks meanwhile. stop() calls dropBlocks(), after which the
+// tap may hold no block, since a restart refills them.
+class tpx3StreamTap {
+public:
+    virtual ~tpx3StreamTap() {}
+    virtual bool tapBlock(int index, const char *data, size_t length) = 0;
+    virtual void dropBlocks() = 0;
+};
+
+// Stream data already in memory, e.g. a range of the spool. Each extent holds
+// whole chunks and is at most one block.
+struct tpx3StreamExtent {
+    const char *data;
+    size_t length;
+};
+
+// Snapshot of the engine counters; totals since start()
+struct tpx3StreamStats {
+    bool running;
+    bool connected;      // TCP client connected, or replay file open
+    bool sourceDone;     // replay reached the end of the file
+    uint64_t bytes;      // bytes received
+    uint64_t chunks;
+    tpx3PacketCounts packets;
+    uint64_t framingErrors;  // words skipped while resynchronising on a chunk header
+    uint64_t stalls;     // times the receiver had to wait for a free block
+    int freeBlocks;
+    int minFreeBlocks;   // low-water mark; near 0 means decoding is falling behind
+};
+
+// Stream ingest: one receive thread fills large preallocated blocks straight
+// from the socket or file and cuts them at chunk boundaries (only the partial
+// last chunk is copied, into the next block); decode workers classify the
+// chunks and pass them to the consumers. Taps may share the blocks meanwhile.
+class tpx3StreamEngine {
+public:
+    tpx3StreamEngine();
+    ~tpx3StreamEngine();
+
+    // Consumers and taps must be added while stopped
+    void addConsumer(tpx3StreamConsumer *consumer);
+    void addTap(tpx3StreamTap *tap);
+    // Detach all taps, e.g. before they are destroyed; only while stopped
+    void clearTaps();
+    // Any thread: a tap is done with a block
+    void releaseBlock(int index);
+
+    // Listen on a local TCP port for Serval's raw stream
+    bool startTcp(int port, int workers, std::string *error);
+    // Replay a raw .tpx3 file; rateMBs <= 0 replays as fast as possible
+    bool startFile(const std::string &path, int workers, bool loop, double rateMBs, std::string *error);
+    // Replay extents in order, once; the memory must stay valid until stop()
+    bool startExtents(const std::vector<tpx3StreamExtent> &extents, int workers, double rateMBs, std::string *error);
+    void stop();
+    bool running() const { return running_; }
+
+    void getStats(tpx3StreamStats *out) const;
+
+private:
+    struct block {
+        char *data;
+        size_t length;
+        uint64_t sequence;
+    };
+
+    // Padded so workers never share a cache line
+    struct workerCounters {
+        std::atomic<uint64_t> chunks;
+        std::atomic<uint64_t> hits;
+        std::atomic<uint64_t> tdcs;
+        std::atomic<uint64_t> globalTimes;
+        std::atomic<uint64_t> controls;
+        std::atomic<uint64_t> others;
+        std::atomic<uint64_t> framingErrors;
+        char pad[128 - 7 * sizeof(std::atomic<uint64_t>)];
+    };
+
+    std::vector<block> blocks_;
+    std::unique_ptr<std::atomic<int>[]> refs_;  // per block: the workers, plus each tap holding it
+    std::vector<tpx3StreamConsumer *> consumers_;
+    std::vector<tpx3StreamTap *> taps_;
+
+    mutable std::mutex queueMutex_;
+    std::condition_variable freeCond_;
+    std::condition_variable fullCond_;
+    std::vector<int> freeBlocks_;
+    std::deque<int> fullBlocks_;
+    int minFreeBlocks_;
+
+    std::thread receiver_;
+    std::vector<std::thread> workers_;
+    workerCounters counters_[TPX3_STREAM_MAX_WORKERS];
+    int numWorkers_;
+
+    std::atomic<bool> running_;
+    std::atomic<bool> stopping_;
+    std::atomic<bool> connected_;
+    std::atomic<bool> sourceDone_;
+    std::atomic<uint64_t> bytes_;
+    std::atomic<uint64_t> stalls_;
+    uint64_t sequence_;
+
+    int listenFd_;
+    int fileFd_;
+    int stopFd_;
+    bool loop_;
+    double rateMBs_;
+    std::vector<tpx3StreamExtent> extents_;
+
+    void resetCounters();
+    bool allocate(std::string *error);
+    bool startThreads(int workers, std::string *error);
+    void receiveLoop();
+    bool pumpFd(int fd, bool isFile);
+    void pumpExtents();
+    void pace(double start, uint64_t bytes);
+    int acquireFree();
+    size_t completeLength(const char *data, size_t length);
+    void dispatch(int index, size_t length);
+    void decodeLoop(int worker);
+    void decodeBlock(int worker, const block &blk);
+};
+
+#endif // tpx3Stream_H
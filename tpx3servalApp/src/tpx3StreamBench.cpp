@@ -0,0 +1,673 @@
+/* tpx3StreamBench.cpp
+ *
+ * Benchmark of the IOC's raw stream paths on synthetic data from
+ * tpx3StreamGenerator. Every stage reports packets/s and bytes/s; the TCP
+ * stages also report end-to-end latency, from the sender's write() to the
+ * decode worker handing the chunk to the consumers. Results are printed as
+ * JSON so runs from different releases can be compared
+ * (see test/run_stream_bench.sh).
+ *
+ * Before timing, each analysis consumer is run once over a stream with hot
+ * pixels and its output checked against what the generator produced; any
+ * mismatch makes the benchmark exit non-zero.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tpx3Packet.h"
+#include "tpx3Preview.h"
+#include "tpx3Histogram.h"
+#include "tpx3Centroid.h"
+#include "tpx3Trigger.h"
+#include "tpx3PixelMask.h"
+#include "tpx3Stream.h"
+#include "tpx3StreamGen.h"
+
+// Latency markers: a one-word chunk on a chip number no detector uses,
+// carrying the CLOCK_MONOTONIC time of the write() that sent it
+#define BENCH_MARKER_CHIP 0xFF
+#define BENCH_MARKER_PERIOD 0.001
+#define BENCH_SEND_BYTES (256 * 1024)
+#define BENCH_MIN_SECONDS 0.5
+#define BENCH_MAX_SAMPLES 100000
+
+// Checked stream: hot pixels far above the cluster background but rare
+// enough that two of a pixel's hits seldom fall in one centroiding time
+// window, and the share of events the centroider may split at a block
+// boundary, on top of the clusters that pile up (see centroidTolerance())
+#define BENCH_HOT_PIXELS 8
+#define BENCH_HOT_RATE 1000.0
+#define BENCH_MASK_SIGMA 10.0
+#define BENCH_CENTROID_TOLERANCE 0.001
+
+static uint64_t monotonicNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static double monotonicNow()
+{
+    return monotonicNs() * 1e-9;
+}
+
+// Records marker latencies; each worker appends to its own preallocated vector
+class latencyProbe : public tpx3StreamConsumer {
+public:
+    void configure(int numWorkers)
+    {
+        samples_.assign(numWorkers, std::vector<double>());
+        for (size_t i = 0; i < samples_.size(); i++) {
+            samples_[i].reserve(BENCH_MAX_SAMPLES);
+        }
+    }
+
+    void consume(int worker, const tpx3StreamChunk &chunk)
+    {
+        if (chunk.chip != BENCH_MARKER_CHIP || chunk.count != 1 || chunk.words[0] == 0) {
+            return;
+        }
+        std::vector<double> &v = samples_[worker];
+        if (v.size() < BENCH_MAX_SAMPLES) {
+            v.push_back((monotonicNs() - chunk.words[0]) * 1e-3);
+        }
+    }
+
+    void collect(std::vector<double> *out) const
+    {
+        out->clear();
+        for (size_t i = 0; i < samples_.size(); i++) {
+            out->insert(out->end(), samples_[i].begin(), samples_[i].end());
+        }
+        std::sort(out->begin(), out->end());
+    }
+
+private:
+    std::vector<std::vector<double> > samples_;
+};
+
+struct benchStream {
+    std::vector<uint64_t> words;
+    std::vector<size_t> markers;  // word index of each marker payload
+    uint64_t packets;             // words excluding chunk headers
+    uint64_t chunks;
+    uint64_t clusters;            // particle clusters generated, for the centroiding stage
+    std::vector<tpx3PacketCounts> chunkCounts;  // per chunk, as the engine's classification pass counts them
+};
+
+struct benchResult {
+    std::string name;
+    double seconds;
+    double bytes;
+    double packets;
+    double events;      // centroided events, where counted
+    std::vector<double> latencyUs;
+    uint64_t stalls;
+    int minFreeBlocks;
+    bool hasEngine;
+};
+
+static std::vector<benchResult> results;
+
+struct benchCheck {
+    std::string name;
+    double expected;
+    double actual;
+    bool ok;
+};
+
+static std::vector<benchCheck> checks;
+
+static bool addCheck(const std::string &name, double expected, double actual, double tolerance)
+{
+    benchCheck c;
+    c.name = name;
+    c.expected = expected;
+    c.actual = actual;
+    c.ok = fabs(actual - expected) <= tolerance * expected;
+    checks.push_back(c);
+    if (!c.ok) {
+        fprintf(stderr, "tpx3StreamBench: %s: expected %.0f, got %.0f\n", name.c_str(), expected, actual);
+    }
+    return c.ok;
+}
+
+static void addResult(const std::string &name, double seconds, double bytes, double packets)
+{
+    benchResult r;
+    r.name = name;
+    r.seconds = seconds;
+    r.bytes = bytes;
+    r.packets = packets;
+    r.events = 0.0;
+    r.stalls = 0;
+    r.minFreeBlocks = 0;
+    r.hasEngine = false;
+    results.push_back(r);
+}
+
+// Count chunks and packets, and classify each chunk as the engine would
+static void classifyChunks(benchStream *stream)
+{
+    stream->packets = 0;
+    stream->chunks = 0;
+    stream->chunkCounts.clear();
+    for (size_t i = 0; i < stream->words.size(); i += 1 + tpx3ChunkBytes(stream->words[i]) / 8) {
+        size_t count = tpx3ChunkBytes(stream->words[i]) / 8;
+        tpx3PacketCounts counts;
+        memset(&counts, 0, sizeof(counts));
+        tpx3ClassifyWordsScalar(&stream->words[i + 1], count, &counts);
+        stream->chunks++;
+        stream->packets += count;
+        stream->chunkCounts.push_back(counts);
+    }
+}
+
+static void buildStream(const tpx3GenConfig &config, double seconds, benchStream *stream)
+{
+    tpx3StreamGenerator generator(config);
+    stream->words.clear();
+    stream->markers.clear();
+    stream->words.reserve((size_t)(seconds * config.hitRate * 1.05) + 1024);
+    double start = monotonicNow();
+    while (generator.time() < seconds) {
+        generator.generate(BENCH_MARKER_PERIOD, &stream->words);
+        stream->words.push_back(tpx3ChunkHeader(BENCH_MARKER_CHIP, 0, 8));
+        stream->markers.push_back(stream->words.size());
+        stream->words.push_back(0);
+    }
+    double elapsed = monotonicNow() - start;
+    stream->clusters = generator.clusters();
+    classifyChunks(stream);
+    addResult("generate", elapsed, stream->words.size() * 8.0, (double)stream->packets);
+}
+
+static void benchClassify(const benchStream &stream)
+{
+    const char *names[2] = { "classify_simd", "classify_scalar" };
+    for (int variant = 0; variant < 2; variant++) {
+        tpx3PacketCounts counts;
+        memset(&counts, 0, sizeof(counts));
+        int passes = 0;
+        double start = monotonicNow(), elapsed;
+        do {
+            if (variant == 0) {
+                tpx3ClassifyWords(stream.words.data(), stream.words.size(), &counts);
+            } else {
+                tpx3ClassifyWordsScalar(stream.words.data(), stream.words.size(), &counts);
+            }
+            passes++;
+            elapsed = monotonicNow() - start;
+        } while (elapsed < BENCH_MIN_SECONDS);
+        addResult(names[variant], elapsed, passes * stream.words.size() * 8.0,
+                  (double)passes * stream.words.size());
+    }
+}
+
+// Feed the whole stream once to a consumer configured for one worker, as a decode worker would
+static void feedStream(tpx3StreamConsumer *consumer, const benchStream &stream, uint64_t *sequence)
+{
+    // Blocks end where the engine's would, at most every TPX3_STREAM_BLOCK_BYTES
+    size_t blockStart = 0, chunkIndex = 0;
+    for (size_t i = 0; i < stream.words.size(); ) {
+        if ((i - blockStart) * 8 >= TPX3_STREAM_BLOCK_BYTES - TPX3_MAX_CHUNK_BYTES) {
+            consumer->endBlock(0, (*sequence)++);
+            blockStart = i;
+        }
+        tpx3StreamChunk chunk;
+        chunk.chip = tpx3ChunkChip(stream.words[i]);
+        chunk.mode = (int)((stream.words[i] >> 40) & 0xFF);
+        chunk.count = tpx3ChunkBytes(stream.words[i]) / 8;
+        chunk.words = &stream.words[i + 1];
+        chunk.hits = stream.chunkCounts[chunkIndex].hits;
+        chunk.tdcs = stream.chunkCounts[chunkIndex].tdcs;
+        chunkIndex++;
+        chunk.sequence = *sequence;
+        consumer->consume(0, chunk);
+        i += 1 + chunk.count;
+    }
+    consumer->endBlock(0, (*sequence)++);
+}
+
+static void benchConsumer(const std::string &name, tpx3StreamConsumer *consumer, const benchStream &stream)
+{
+    consumer->configure(1);
+    int passes = 0;
+    uint64_t sequence = 0;
+    double start = monotonicNow(), elapsed;
+    do {
+        feedStream(consumer, stream, &sequence);
+        passes++;
+        elapsed = monotonicNow() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    addResult(name, elapsed, passes * stream.words.size() * 8.0, (double)passes * stream.packets);
+}
+
+// Share of clusters expected to merge with another: a second cluster on the
+// chip within the time window either side, close enough to touch
+static double centroidTolerance(const tpx3GenConfig &config)
+{
+    tpx3CentroidConfig centroid;
+    tpx3CentroidDefaults(&centroid);
+    double clusterRate = config.hitRate / config.chips / std::max(config.clusterSize, 1.0);
+    double reach = 2.0 * ceil(sqrt(std::max(config.clusterSize, 1.0))) + 2.0 * centroid.spaceWindow + 1.0;
+    double pileup = clusterRate * 2.0 * centroid.timeWindowNs * 1e-9 * reach * reach /
+                    (TPX3_CHIP_PIXELS * TPX3_CHIP_PIXELS);
+    return BENCH_CENTROID_TOLERANCE + pileup;
+}
+
+// Run each analysis consumer once over a generated stream with hot pixels and
+// compare its output with what the generator produced
+static bool verifyConsumers(const tpx3GenConfig &base, double seconds)
+{
+    tpx3GenConfig config = base;
+    config.hotPixels = BENCH_HOT_PIXELS;
+    config.hotPixelRate = BENCH_HOT_RATE;
+    tpx3StreamGenerator generator(config);
+    benchStream stream;
+    generator.generate(seconds, &stream.words);
+    classifyChunks(&stream);
+    bool ok = true;
+
+    // Every cluster and every hot pixel hit is an event of its own
+    tpx3Centroid centroid;
+    uint64_t sequence = 0;
+    centroid.configure(1);
+    feedStream(&centroid, stream, &sequence);
+    tpx3CentroidStats centroidStats;
+    centroid.getStats(&centroidStats);
+    ok &= addCheck("centroid_events", (double)(generator.clusters() + generator.hotHits()),
+                   (double)centroidStats.events, centroidTolerance(config));
+
+    tpx3Histogram histogram;
+    sequence = 0;
+    histogram.configure(1);
+    feedStream(&histogram, stream, &sequence);
+    histogram.merge();
+    std::vector<int32_t> tot(TPX3_HIST_TOT_BINS), toa(TPX3_HIST_TOA_MAX_BINS);
+    uint64_t totCount, toaCount, noTdcCount;
+    histogram.read(false, tot.data(), toa.data(), &totCount, &toaCount, &noTdcCount);
+    ok &= addCheck("histogram_tot_hits", (double)generator.hits(), (double)totCount, 0.0);
+
+    // Edges alternate rising and falling, starting with a rising one
+    tpx3TriggerMonitor trigger;
+    sequence = 0;
+    trigger.configure(1);
+    feedStream(&trigger, stream, &sequence);
+    tpx3TriggerStats triggerStats;
+    trigger.analyze(seconds, &triggerStats);
+    ok &= addCheck("trigger_edges", (double)((generator.tdcs() + 1) / 2), (double)triggerStats.edges, 0.0);
+
+    // Exactly the injected pixels are flagged, and each is in the exported list
+    tpx3PixelMask mask;
+    sequence = 0;
+    mask.configure(1);
+    mask.startAcquisition();
+    feedStream(&mask, stream, &sequence);
+    tpx3MaskResult maskResult;
+    mask.finishAcquisition(seconds, BENCH_MASK_SIGMA, &maskResult);
+    uint32_t noisy = 0;
+    for (int c = 0; c < TPX3_MASK_CHIPS; c++) {
+        noisy += maskResult.noisy[c];
+    }
+    const std::vector<tpx3GenPixel> &hot = generator.hotPixels();
+    size_t found = 0;
+    char path[] = "/tmp/tpx3StreamBenchMaskXXXXXX";
+    int fd = mkstemp(path);
+    std::string error;
+    if (fd >= 0) {
+        close(fd);
+        FILE *f = mask.exportMask(path, "", &error) ? fopen(path, "r") : NULL;
+        char line[128];
+        while (f && fgets(line, sizeof(line), f)) {
+            int chip, x, y;
+            if (line[0] == '#' || sscanf(line, "%d %d %d", &chip, &x, &y) != 3) {
+                continue;
+            }
+            for (size_t i = 0; i < hot.size(); i++) {
+                if (hot[i].chip == chip && hot[i].x == x && hot[i].y == y) {
+                    found++;
+                }
+            }
+        }
+        if (f) {
+            fclose(f);
+        } else {
+            fprintf(stderr, "tpx3StreamBench: mask export: %s\n", error.c_str());
+        }
+        unlink(path);
+    }
+    ok &= addCheck("mask_noisy_pixels", (double)hot.size(), (double)noisy, 0.0);
+    ok &= addCheck("mask_hot_pixels_listed", (double)hot.size(), (double)found, 0.0);
+    return ok;
+}
+
+// Merge and render of a full quad image; packets here are pixels
+static void benchPreviewPublish(tpx3Preview &preview)
+{
+    std::vector<int32_t> image(TPX3_PREVIEW_MAX_ELEMENTS);
+    int passes = 0, sizeX, sizeY;
+    uint64_t total;
+    uint32_t maxCount;
+    double start = monotonicNow(), elapsed;
+    do {
+        preview.merge();
+        preview.render(TPX3_PREVIEW_LAYOUT_QUAD, 0, 1, false, image.data(), &sizeX, &sizeY, &total, &maxCount);
+        passes++;
+        elapsed = monotonicNow() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    addResult("preview_publish", elapsed, passes * image.size() * 4.0, (double)passes * image.size());
+}
+
+// Wait until the engine has decoded the whole stream
+static bool waitForChunks(tpx3StreamEngine &engine, uint64_t chunks, double timeout, tpx3StreamStats *stats)
+{
+    double deadline = monotonicNow() + timeout;
+    for (;;) {
+        engine.getStats(stats);
+        if (stats->chunks >= chunks) {
+            return true;
+        }
+        if (monotonicNow() > deadline) {
+            return false;
+        }
+        usleep(1000);
+    }
+}
+
+static void engineResult(const std::string &name, double seconds, const benchStream &stream,
+                         const tpx3StreamStats &stats, const latencyProbe *probe)
+{
+    addResult(name, seconds, (double)stats.bytes, (double)stream.packets);
+    benchResult &r = results.back();
+    r.hasEngine = true;
+    r.stalls = stats.stalls;
+    r.minFreeBlocks = stats.minFreeBlocks;
+    if (probe) {
+        probe->collect(&r.latencyUs);
+    }
+}
+
+// The engine is shared by all stages so its block pool is allocated and
+// touched once, by an untimed first replay
+static bool benchFile(tpx3StreamEngine &engine, const benchStream &stream, int workers, bool timed)
+{
+    char path[] = "/tmp/tpx3StreamBenchXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "tpx3StreamBench: mkstemp: %s\n", strerror(errno));
+        return false;
+    }
+    bool ok = write(fd, stream.words.data(), stream.words.size() * 8) == (ssize_t)(stream.words.size() * 8);
+    close(fd);
+
+    std::string error;
+    tpx3StreamStats stats;
+    double start = monotonicNow();
+    if (ok && engine.startFile(path, workers, false, 0.0, &error)) {
+        ok = waitForChunks(engine, stream.chunks, 60.0, &stats);
+        double elapsed = monotonicNow() - start;
+        engine.stop();
+        if (ok && timed) {
+            engineResult("ingest_file", elapsed, stream, stats, NULL);
+        }
+    } else {
+        fprintf(stderr, "tpx3StreamBench: file replay: %s\n", error.c_str());
+        ok = false;
+    }
+    unlink(path);
+    return ok;
+}
+
+// Send the stream over loopback, stamping each marker as its segment goes out.
+// realtime paces the segments to detector time using the 1 ms marker spacing.
+static void sendStream(int port, benchStream *stream, bool realtime, bool *ok)
+{
+    *ok = false;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "tpx3StreamBench: connect: %s\n", strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+
+    const size_t segmentWords = BENCH_SEND_BYTES / 8;
+    size_t marker = 0;
+    double start = monotonicNow();
+    for (size_t offset = 0; offset < stream->words.size(); offset += segmentWords) {
+        size_t end = std::min(offset + segmentWords, stream->words.size());
+        if (realtime && marker < stream->markers.size()) {
+            double wait = start + marker * BENCH_MARKER_PERIOD - monotonicNow();
+            if (wait > 0.0) {
+                usleep((useconds_t)(wait * 1e6));
+            }
+        }
+        uint64_t now = monotonicNs();
+        while (marker < stream->markers.size() && stream->markers[marker] < end) {
+            stream->words[stream->markers[marker]] = now;
+            marker++;
+        }
+        const char *data = (const char *)(stream->words.data() + offset);
+        size_t length = (end - offset) * 8;
+        while (length > 0) {
+            ssize_t n = write(fd, data, length);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                fprintf(stderr, "tpx3StreamBench: send: %s\n", strerror(errno));
+                close(fd);
+                return;
+            }
+            data += n;
+            length -= n;
+        }
+    }
+    close(fd);
+    *ok = true;
+}
+
+static bool benchTcp(tpx3StreamEngine &engine, const latencyProbe &probe, const std::string &name,
+                     benchStream *stream, int workers, int port, bool realtime)
+{
+    std::string error;
+    if (!engine.startTcp(port, workers, &error)) {
+        fprintf(stderr, "tpx3StreamBench: %s\n", error.c_str());
+        return false;
+    }
+    bool sent = false;
+    double start = monotonicNow();
+    std::thread sender(sendStream, port, stream, realtime, &sent);
+    sender.join();
+    tpx3StreamStats stats;
+    bool ok = sent && waitForChunks(engine, stream->chunks, 60.0, &stats);
+    double elapsed = monotonicNow() - start;
+    engine.stop();
+    if (ok) {
+        engineResult(name, elapsed, *stream, stats, &probe);
+    }
+    for (size_t i = 0; i < stream->markers.size(); i++) {
+        stream->words[stream->markers[i]] = 0;
+    }
+    return ok;
+}
+
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+static void printJson(FILE *out, const tpx3GenConfig &config, double seconds, int workers,
+                      const benchStream &stream)
+{
+    fprintf(out, "{\n  \"tool\": \"tpx3StreamBench\",\n  \"format\": 1,\n");
+    fprintf(out, "  \"config\": {\"hit_rate\": %.0f, \"chips\": %d, \"tdc_hz\": %.0f, \"cluster_size\": %.2f, "
+                 "\"chunk_words\": %d, \"detector_seconds\": %.3f, \"workers\": %d, \"seed\": %llu},\n",
+            config.hitRate, config.chips, config.tdcFrequency, config.clusterSize, config.chunkWords,
+            seconds, workers, (unsigned long long)config.seed);
+    fprintf(out, "  \"stream\": {\"bytes\": %llu, \"packets\": %llu, \"chunks\": %llu, \"clusters\": %llu},\n",
+            (unsigned long long)(stream.words.size() * 8), (unsigned long long)stream.packets,
+            (unsigned long long)stream.chunks, (unsigned long long)stream.clusters);
+    fprintf(out, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const benchResult &r = results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"seconds\": %.4f, \"bytes_per_s\": %.0f, \"packets_per_s\": %.0f",
+                r.name.c_str(), r.seconds, r.seconds > 0.0 ? r.bytes / r.seconds : 0.0,
+                r.seconds > 0.0 ? r.packets / r.seconds : 0.0);
+        if (r.events > 0.0) {
+            fprintf(out, ", \"events_per_s\": %.0f", r.seconds > 0.0 ? r.events / r.seconds : 0.0);
+        }
+        if (r.hasEngine) {
+            fprintf(out, ", \"stalls\": %llu, \"min_free_blocks\": %d",
+                    (unsigned long long)r.stalls, r.minFreeBlocks);
+        }
+        if (!r.latencyUs.empty()) {
+            fprintf(out, ", \"latency_us\": {\"samples\": %zu, \"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f}",
+                    r.latencyUs.size(), percentile(r.latencyUs, 0.5), percentile(r.latencyUs, 0.99),
+                    r.latencyUs.back());
+        }
+        fprintf(out, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ],\n  \"checks\": [\n");
+    for (size_t i = 0; i < checks.size(); i++) {
+        const benchCheck &c = checks[i];
+        fprintf(out, "    {\"name\": \"%s\", \"expected\": %.0f, \"actual\": %.0f, \"ok\": %s}%s\n",
+                c.name.c_str(), c.expected, c.actual, c.ok ? "true" : "false", i + 1 < checks.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --rate HITS_PER_S   pixel hits per second, all chips (default 10e6)\n"
+            "  --chips N           chips, 1-4 (default 4)\n"
+            "  --tdc HZ            TDC1 pulse frequency (default 1000)\n"
+            "  --cluster MEAN      mean cluster size in pixels (default 4)\n"
+            "  --seconds S         detector seconds of data (default 1)\n"
+            "  --workers N         decode workers (default 2)\n"
+            "  --port N            loopback port for the TCP stages (default 18085)\n"
+            "  --no-realtime       skip the paced TCP stage\n"
+            "  --output FILE       write the JSON report to FILE instead of stdout\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    tpx3GenConfig config;
+    tpx3GenDefaults(&config);
+    double seconds = 1.0;
+    int workers = 2;
+    int port = 18085;
+    bool realtime = true;
+    std::string output;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--rate" && hasValue) {
+            config.hitRate = atof(argv[++i]);
+        } else if (arg == "--chips" && hasValue) {
+            config.chips = atoi(argv[++i]);
+        } else if (arg == "--tdc" && hasValue) {
+            config.tdcFrequency = atof(argv[++i]);
+        } else if (arg == "--cluster" && hasValue) {
+            config.clusterSize = atof(argv[++i]);
+        } else if (arg == "--seconds" && hasValue) {
+            seconds = atof(argv[++i]);
+        } else if (arg == "--workers" && hasValue) {
+            workers = atoi(argv[++i]);
+        } else if (arg == "--port" && hasValue) {
+            port = atoi(argv[++i]);
+        } else if (arg == "--output" && hasValue) {
+            output = argv[++i];
+        } else if (arg == "--no-realtime") {
+            realtime = false;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (config.chips < 1 || config.chips > 4 || workers < 1 || workers > TPX3_STREAM_MAX_WORKERS ||
+        seconds <= 0.0 || config.hitRate <= 0.0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    bool verified = verifyConsumers(config, seconds);
+    benchStream stream;
+    buildStream(config, seconds, &stream);
+    benchClassify(stream);
+    // The ingest stages run with the same consumers as the IOC
+    tpx3Preview preview;
+    benchConsumer("consume_preview", &preview, stream);
+    benchPreviewPublish(preview);
+    tpx3Histogram histogram;
+    benchConsumer("consume_histogram", &histogram, stream);
+    tpx3Centroid centroid;
+    benchConsumer("consume_centroid", &centroid, stream);
+    tpx3CentroidStats centroidStats;
+    centroid.getStats(&centroidStats);
+    results.back().events = (double)centroidStats.events;
+    tpx3TriggerMonitor trigger;
+    benchConsumer("consume_trigger", &trigger, stream);
+    // Timed while a noisy-pixel acquisition runs, its costly state
+    tpx3PixelMask mask;
+    mask.configure(1);
+    mask.startAcquisition();
+    benchConsumer("consume_mask", &mask, stream);
+    mask.abortAcquisition();
+    tpx3StreamEngine engine;
+    latencyProbe probe;
+    engine.addConsumer(&preview);
+    engine.addConsumer(&histogram);
+    engine.addConsumer(&centroid);
+    engine.addConsumer(&trigger);
+    engine.addConsumer(&mask);
+    engine.addConsumer(&probe);
+    bool ok = benchFile(engine, stream, workers, false);
+    ok = ok && benchFile(engine, stream, workers, true);
+    ok = benchTcp(engine, probe, "ingest_tcp", &stream, workers, port, false) && ok;
+    if (realtime) {
+        ok = benchTcp(engine, probe, "ingest_tcp_realtime", &stream, workers, port, true) && ok;
+    }
+
+    FILE *out = stdout;
+    if (!output.empty()) {
+        out = fopen(output.c_str(), "w");
+        if (!out) {
+            fprintf(stderr, "tpx3StreamBench: %s: %s\n", output.c_str(), strerror(errno));
+            return 1;
+        }
+    }
+    printJson(out, config, seconds, workers, stream);
+    if (out != stdout) {
+        fclose(out);
+    }
+    return ok && verified ? 0 : 1;
+}
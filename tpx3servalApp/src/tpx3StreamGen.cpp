@@ -0,0 +1,202 @@
+#include <math.h>
+#include <stddef.h>
+
+#include "tpx3Packet.h"
+#include "tpx3StreamGen.h"
+
+// Detector time is generated in slices; each chip's slice is cut into chunks
+#define GEN_SLICE_NS 100000.0
+#define GEN_MAX_CHUNK_WORDS 8191
+#define GEN_MAX_CLUSTER 25
+#define GEN_MAX_HOT_PIXELS 1024  // per chip
+
+// Cluster pixels in order of distance from the centre (5x5 neighbourhood)
+static const int clusterOffsets[GEN_MAX_CLUSTER][2] = {
+    { 0, 0 }, { 1, 0 }, { 0, 1 }, { -1, 0 }, { 0, -1 },
+    { 1, 1 }, { -1, 1 }, { -1, -1 }, { 1, -1 },
+    { 2, 0 }, { 0, 2 }, { -2, 0 }, { 0, -2 },
+    { 2, 1 }, { 1, 2 }, { -1, 2 }, { -2, 1 }, { -2, -1 }, { -1, -2 }, { 1, -2 }, { 2, -1 },
+    { 2, 2 }, { -2, 2 }, { -2, -2 }, { 2, -2 }
+};
+
+void tpx3GenDefaults(tpx3GenConfig *config)
+{
+    config->hitRate = 10e6;
+    config->chips = 4;
+    config->tdcFrequency = 1000.0;
+    config->clusterSize = 4.0;
+    config->chunkWords = 500;
+    config->hotPixels = 0;
+    config->hotPixelRate = 1000.0;
+    config->seed = 1;
+}
+
+tpx3StreamGenerator::tpx3StreamGenerator(const tpx3GenConfig &config)
+    : config_(config), timeNs_(0.0), rng_(config.seed ? config.seed : 1),
+      nextTdcNs_(0.0), tdcFalling_(false), trigger_(0), hits_(0), tdcs_(0), clusters_(0),
+      hotHits_(0)
+{
+    if (config_.chips < 1) {
+        config_.chips = 1;
+    }
+    if (config_.clusterSize < 1.0) {
+        config_.clusterSize = 1.0;
+    }
+    if (config_.chunkWords < 1 || config_.chunkWords > GEN_MAX_CHUNK_WORDS) {
+        config_.chunkWords = GEN_MAX_CHUNK_WORDS;
+    }
+    if (config_.hotPixels > config_.chips * GEN_MAX_HOT_PIXELS) {
+        config_.hotPixels = config_.chips * GEN_MAX_HOT_PIXELS;
+    }
+    nextClusterNs_.resize(config_.chips);
+    pending_.resize(config_.chips);
+    for (int chip = 0; chip < config_.chips; chip++) {
+        nextClusterNs_[chip] = exponential(1e9 * config_.chips * config_.clusterSize / config_.hitRate);
+    }
+    // Drawn after the cluster times, so a stream without hot pixels is unchanged
+    while ((int)hotPixels_.size() < config_.hotPixels && config_.hotPixelRate > 0.0) {
+        tpx3GenPixel pixel;
+        pixel.chip = (int)hotPixels_.size() % config_.chips;
+        pixel.x = (int)(uniform() * TPX3_CHIP_PIXELS);
+        pixel.y = (int)(uniform() * TPX3_CHIP_PIXELS);
+        bool taken = false;
+        for (size_t i = 0; i < hotPixels_.size(); i++) {
+            taken |= hotPixels_[i].chip == pixel.chip && hotPixels_[i].x == pixel.x && hotPixels_[i].y == pixel.y;
+        }
+        if (!taken) {
+            hotPixels_.push_back(pixel);
+            nextHotNs_.push_back(exponential(1e9 / config_.hotPixelRate));
+        }
+    }
+}
+
+// xorshift64*: fast enough not to dominate the benchmark
+double tpx3StreamGenerator::uniform()
+{
+    rng_ ^= rng_ >> 12;
+    rng_ ^= rng_ << 25;
+    rng_ ^= rng_ >> 27;
+    return ((rng_ * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double tpx3StreamGenerator::exponential(double mean)
+{
+    return -mean * log(1.0 - uniform());
+}
+
+void tpx3StreamGenerator::emitCluster(int chip, double timeNs)
+{
+    // Geometric cluster size with the configured mean
+    int size = 1 + (int)floor(log(1.0 - uniform()) / log(1.0 - 1.0 / config_.clusterSize + 1e-12));
+    if (size < 1 || size > GEN_MAX_CLUSTER) {
+        size = GEN_MAX_CLUSTER;
+    }
+    int cx = (int)(uniform() * TPX3_CHIP_PIXELS);
+    int cy = (int)(uniform() * TPX3_CHIP_PIXELS);
+    double energy = 100.0 + 300.0 * uniform();
+    std::vector<uint64_t> &packets = pending_[chip];
+    for (int i = 0; i < size; i++) {
+        int x = cx + clusterOffsets[i][0];
+        int y = cy + clusterOffsets[i][1];
+        if (x < 0 || y < 0 || x >= TPX3_CHIP_PIXELS || y >= TPX3_CHIP_PIXELS) {
+            continue;
+        }
+        double r2 = (double)(clusterOffsets[i][0] * clusterOffsets[i][0] + clusterOffsets[i][1] * clusterOffsets[i][1]);
+        int tot = (int)(energy * exp(-r2 / 2.0) + 2.0 + 4.0 * uniform());
+        if (tot > 1023) {
+            tot = 1023;
+        }
+        // Time walk: small signals cross the threshold later
+        double walkNs = 40.0 / sqrt((double)tot) + 2.0 * uniform();
+        uint64_t toa = (uint64_t)((timeNs + walkNs) / TPX3_TOA_UNIT_NS) & ((1ull << TPX3_TOA_BITS) - 1);
+        packets.push_back(tpx3EncodeHit(x, y, toa, tot));
+        hits_++;
+    }
+    clusters_++;
+}
+
+// TDC edges before untilNs, into chip 0's packets in time order like the SPIDR readout
+void tpx3StreamGenerator::emitTdcs(double untilNs)
+{
+    if (config_.tdcFrequency <= 0.0) {
+        return;
+    }
+    // 50% duty cycle pulse
+    double halfPeriodNs = 0.5e9 / config_.tdcFrequency;
+    while (nextTdcNs_ < untilNs) {
+        uint64_t ps = (uint64_t)(nextTdcNs_ * 1000.0);
+        if (tdcFalling_) {
+            pending_[0].push_back(tpx3EncodeTdc(TPX3_TDC1_FALL, trigger_, ps));
+            trigger_ = (trigger_ + 1) & 0xFFF;
+        } else {
+            pending_[0].push_back(tpx3EncodeTdc(TPX3_TDC1_RISE, trigger_, ps));
+        }
+        tdcFalling_ = !tdcFalling_;
+        tdcs_++;
+        nextTdcNs_ += halfPeriodNs;
+    }
+}
+
+// Hot pixel hits of a chip before untilNs, each its own event
+void tpx3StreamGenerator::emitHotHits(int chip, double untilNs)
+{
+    for (size_t i = 0; i < hotPixels_.size(); i++) {
+        if (hotPixels_[i].chip != chip) {
+            continue;
+        }
+        while (nextHotNs_[i] < untilNs) {
+            int tot = (int)(10.0 + 20.0 * uniform());
+            uint64_t toa = (uint64_t)(nextHotNs_[i] / TPX3_TOA_UNIT_NS) & ((1ull << TPX3_TOA_BITS) - 1);
+            pending_[chip].push_back(tpx3EncodeHit(hotPixels_[i].x, hotPixels_[i].y, toa, tot));
+            hits_++;
+            hotHits_++;
+            nextHotNs_[i] += exponential(1e9 / config_.hotPixelRate);
+        }
+    }
+}
+
+void tpx3StreamGenerator::flushChip(int chip, std::vector<uint64_t> *out)
+{
+    std::vector<uint64_t> &packets = pending_[chip];
+    for (size_t i = 0; i < packets.size(); i += config_.chunkWords) {
+        size_t n = packets.size() - i;
+        if (n > (size_t)config_.chunkWords) {
+            n = config_.chunkWords;
+        }
+        out->push_back(tpx3ChunkHeader(chip, 0, n * 8));
+        out->insert(out->end(), packets.begin() + i, packets.begin() + i + n);
+    }
+    packets.clear();
+}
+
+void tpx3StreamGenerator::generate(double seconds, std::vector<uint64_t> *out)
+{
+    double endNs = timeNs_ + seconds * 1e9;
+    double meanGapNs = config_.hitRate > 0.0 ?
+        1e9 * config_.chips * config_.clusterSize / config_.hitRate : HUGE_VAL;
+
+    while (timeNs_ < endNs) {
+        double sliceEnd = timeNs_ + GEN_SLICE_NS;
+        if (sliceEnd > endNs) {
+            sliceEnd = endNs;
+        }
+        uint64_t ticks = (uint64_t)(timeNs_ / TPX3_TOT_UNIT_NS);
+        for (int chip = 0; chip < config_.chips; chip++) {
+            pending_[chip].push_back(tpx3EncodeGlobalTime(TPX3_GT_LSB, ticks));
+            pending_[chip].push_back(tpx3EncodeGlobalTime(TPX3_GT_MSB, ticks));
+            while (nextClusterNs_[chip] < sliceEnd) {
+                if (chip == 0) {
+                    emitTdcs(nextClusterNs_[chip]);
+                }
+                emitCluster(chip, nextClusterNs_[chip]);
+                nextClusterNs_[chip] += exponential(meanGapNs);
+            }
+            emitHotHits(chip, sliceEnd);
+        }
+        emitTdcs(sliceEnd);
+        for (int chip = 0; chip < config_.chips; chip++) {
+            flushChip(chip, out);
+        }
+        timeNs_ = sliceEnd;
+    }
+}
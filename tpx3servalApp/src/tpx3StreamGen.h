@@ -0,0 +1,70 @@
+#ifndef tpx3StreamGen_H
+#define tpx3StreamGen_H
+
+#include <stdint.h>
+#include <vector>
+
+// Synthetic detector settings
+struct tpx3GenConfig {
+    double hitRate;       // pixel hits per second, all chips together
+    int chips;            // 1-4
+    double tdcFrequency;  // TDC1 pulses per second on chip 0, 0 for none
+    double clusterSize;   // mean pixels per cluster
+    int chunkWords;       // packets per chunk, at most 8191
+    int hotPixels;        // pixels firing on their own, spread over the chips
+    double hotPixelRate;  // hits per second of each hot pixel
+    uint64_t seed;
+};
+
+struct tpx3GenPixel {
+    int chip;
+    int x;
+    int y;
+};
+
+void tpx3GenDefaults(tpx3GenConfig *config);
+
+// Produces a raw TPX3 stream shaped like Serval's: per-chip chunks of hit
+// packets from Poisson-distributed particle clusters (ToT falling off from
+// the cluster centre, ToA with time walk), TDC1 rising/falling edges on chip 0
+// and a global time pair per chip and slice. Hot pixels, if any, add
+// Poisson-timed single hits. Deterministic for a given seed.
+class tpx3StreamGenerator {
+public:
+    explicit tpx3StreamGenerator(const tpx3GenConfig &config);
+
+    // Append the next `seconds` of detector time to out
+    void generate(double seconds, std::vector<uint64_t> *out);
+
+    double time() const { return timeNs_ * 1e-9; }
+    uint64_t hits() const { return hits_; }
+    uint64_t tdcs() const { return tdcs_; }
+    uint64_t clusters() const { return clusters_; }
+    uint64_t hotHits() const { return hotHits_; }  // included in hits()
+    const std::vector<tpx3GenPixel> &hotPixels() const { return hotPixels_; }
+
+private:
+    tpx3GenConfig config_;
+    double timeNs_;
+    uint64_t rng_;
+    std::vector<double> nextClusterNs_;  // per chip
+    double nextTdcNs_;  // next TDC edge
+    bool tdcFalling_;   // that edge is the falling one
+    int trigger_;
+    uint64_t hits_;
+    uint64_t tdcs_;
+    uint64_t clusters_;
+    uint64_t hotHits_;
+    std::vector<tpx3GenPixel> hotPixels_;
+    std::vector<double> nextHotNs_;  // per hot pixel
+    std::vector<std::vector<uint64_t> > pending_;  // per chip, packets of the current slice
+
+    double uniform();
+    double exponential(double mean);
+    void emitCluster(int chip, double timeNs);
+    void emitTdcs(double untilNs);
+    void emitHotHits(int chip, double untilNs);
+    void flushChip(int chip, std::vector<uint64_t> *out);
+};
+
+#endif // tpx3StreamGen_H
@@ -0,0 +1,204 @@
+/* tpx3StreamGenMain.cpp
+ *
+ * Synthetic TPX3 raw stream source, for exercising the IOC's stream ingest
+ * without a detector:
+ *
+ *   tpx3StreamGen --connect localhost:8085 --rate 20e6 --realtime
+ *   tpx3StreamGen --output /tmp/quad.tpx3 --duration 5
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <string>
+#include <vector>
+
+#include "tpx3StreamGen.h"
+
+// Detector time generated per write
+#define GEN_BATCH_SECONDS 0.01
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void handleSignal(int sig)
+{
+    (void)sig;
+    stopRequested = 1;
+}
+
+static double monotonicNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s (--output FILE | --connect HOST:PORT) [options]\n"
+            "  --rate HITS_PER_S   pixel hits per second, all chips (default 10e6)\n"
+            "  --chips N           chips, 1-4 (default 4)\n"
+            "  --tdc HZ            TDC1 pulse frequency, 0 for none (default 1000)\n"
+            "  --cluster MEAN      mean cluster size in pixels (default 4)\n"
+            "  --chunk WORDS       packets per chunk (default 500)\n"
+            "  --hot N             hot pixels, spread over the chips (default 0)\n"
+            "  --hot-rate HZ       hits per second of each hot pixel (default 1000)\n"
+            "  --duration S        detector seconds to generate, 0 until interrupted (default 1)\n"
+            "  --realtime          pace output to detector time\n"
+            "  --seed N            random seed (default 1)\n"
+            "A JSON summary is printed to stderr on exit.\n", prog);
+}
+
+static int connectTo(const std::string &target)
+{
+    size_t colon = target.rfind(':');
+    if (colon == std::string::npos) {
+        fprintf(stderr, "tpx3StreamGen: --connect needs HOST:PORT\n");
+        return -1;
+    }
+    std::string host = target.substr(0, colon);
+    std::string port = target.substr(colon + 1);
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+    if (rc != 0) {
+        fprintf(stderr, "tpx3StreamGen: %s: %s\n", target.c_str(), gai_strerror(rc));
+        return -1;
+    }
+    int fd = socket(res->ai_family, res->ai_socktype | SOCK_CLOEXEC, res->ai_protocol);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+        fprintf(stderr, "tpx3StreamGen: connect %s: %s\n", target.c_str(), strerror(errno));
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+static bool writeAll(int fd, const char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR && !stopRequested) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    tpx3GenConfig config;
+    tpx3GenDefaults(&config);
+    std::string output, target;
+    double duration = 1.0;
+    bool realtime = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--output" && hasValue) {
+            output = argv[++i];
+        } else if (arg == "--connect" && hasValue) {
+            target = argv[++i];
+        } else if (arg == "--rate" && hasValue) {
+            config.hitRate = atof(argv[++i]);
+        } else if (arg == "--chips" && hasValue) {
+            config.chips = atoi(argv[++i]);
+        } else if (arg == "--tdc" && hasValue) {
+            config.tdcFrequency = atof(argv[++i]);
+        } else if (arg == "--cluster" && hasValue) {
+            config.clusterSize = atof(argv[++i]);
+        } else if (arg == "--chunk" && hasValue) {
+            config.chunkWords = atoi(argv[++i]);
+        } else if (arg == "--hot" && hasValue) {
+            config.hotPixels = atoi(argv[++i]);
+        } else if (arg == "--hot-rate" && hasValue) {
+            config.hotPixelRate = atof(argv[++i]);
+        } else if (arg == "--duration" && hasValue) {
+            duration = atof(argv[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            config.seed = strtoull(argv[++i], NULL, 0);
+        } else if (arg == "--realtime") {
+            realtime = true;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (output.empty() == target.empty() || config.chips < 1 || config.chips > 4 || config.hitRate < 0.0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int fd;
+    if (!output.empty()) {
+        fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "tpx3StreamGen: %s: %s\n", output.c_str(), strerror(errno));
+            return 1;
+        }
+    } else {
+        fd = connectTo(target);
+        if (fd < 0) {
+            return 1;
+        }
+    }
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    tpx3StreamGenerator generator(config);
+    std::vector<uint64_t> batch;
+    uint64_t bytes = 0;
+    bool ok = true;
+    double start = monotonicNow();
+    while (!stopRequested && (duration <= 0.0 || generator.time() < duration)) {
+        double seconds = GEN_BATCH_SECONDS;
+        if (duration > 0.0 && generator.time() + seconds > duration) {
+            seconds = duration - generator.time();
+        }
+        batch.clear();
+        generator.generate(seconds, &batch);
+        if (realtime) {
+            double wait = start + generator.time() - monotonicNow();
+            if (wait > 0.0) {
+                usleep((useconds_t)(wait * 1e6));
+            }
+        }
+        if (!writeAll(fd, (const char *)batch.data(), batch.size() * 8)) {
+            if (!stopRequested) {
+                fprintf(stderr, "tpx3StreamGen: write: %s\n", strerror(errno));
+                ok = false;
+            }
+            break;
+        }
+        bytes += batch.size() * 8;
+    }
+    double elapsed = monotonicNow() - start;
+    close(fd);
+
+    fprintf(stderr,
+            "{\"tool\": \"tpx3StreamGen\", \"detector_seconds\": %.3f, \"wall_seconds\": %.3f, "
+            "\"bytes\": %llu, \"hits\": %llu, \"tdcs\": %llu, \"clusters\": %llu, "
+            "\"bytes_per_s\": %.0f}\n",
+            generator.time(), elapsed, (unsigned long long)bytes,
+            (unsigned long long)generator.hits(), (unsigned long long)generator.tdcs(),
+            (unsigned long long)generator.clusters(), elapsed > 0.0 ? bytes / elapsed : 0.0);
+    return ok ? 0 : 1;
+}
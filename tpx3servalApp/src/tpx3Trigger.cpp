@@ -0,0 +1,221 @@
+#include <math.h>
+#include <string.h>
+
+#include "tpx3Trigger.h"
+
+// The TDC coarse counter has 35 bits
+#define TDC_WRAP_PS ((1ull << 35) * TPX3_TDC_COARSE_PS)
+
+void tpx3TriggerDefaults(tpx3TriggerConfig *config)
+{
+    config->edge = TPX3_TDC1_RISE;
+    config->expectedPeriodNs = 0.0;
+    config->tolerance = 0.1;
+}
+
+// Time from a to b, across a counter wrap-around
+static inline uint64_t elapsedPs(uint64_t a, uint64_t b)
+{
+    return b >= a ? b - a : b + TDC_WRAP_PS - a;
+}
+
+tpx3TriggerMonitor::tpx3TriggerMonitor()
+{
+    tpx3TriggerDefaults(&config_);
+    memset(&totals_, 0, sizeof(totals_));
+    configure(0);
+}
+
+void tpx3TriggerMonitor::configure(int numWorkers)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    while ((int)workers_.size() < numWorkers) {
+        std::unique_ptr<workerState> w(new workerState());
+        w->pending.reserve(4096);
+        w->ready.reserve(4096);
+        w->readyBlocks.reserve(64);
+        workers_.push_back(std::move(w));
+    }
+    // A new stream: block sequence numbers start again from 0
+    for (size_t i = 0; i < workers_.size(); i++) {
+        workerState &w = *workers_[i];
+        std::lock_guard<std::mutex> workerGuard(w.mutex);
+        w.pending.clear();
+        w.ready.clear();
+        w.readyBlocks.clear();
+    }
+    early_.clear();
+    nextSequence_ = 0;
+    haveLast_ = false;
+    haveRise_ = false;
+    intervals_ = 0;
+    intervalEdges_ = 0;
+    widths_ = 0;
+    sumWidth_ = 0.0;
+}
+
+void tpx3TriggerMonitor::consume(int worker, const tpx3StreamChunk &chunk)
+{
+    // Most chunks carry no TDC packet at all
+    if (chunk.tdcs == 0) {
+        return;
+    }
+    workerState &w = *workers_[worker];
+    for (size_t i = 0; i < chunk.count; i++) {
+        uint64_t word = chunk.words[i];
+        if ((unsigned)(word >> 60) == TPX3_PKT_TDC) {
+            tpx3Tdc tdc;
+            tpx3DecodeTdc(word, &tdc);
+            edgeRecord e;
+            e.timePs = tdc.timePs;
+            e.edge = tdc.edge;
+            w.pending.push_back(e);
+        }
+    }
+}
+
+void tpx3TriggerMonitor::endBlock(int worker, uint64_t sequence)
+{
+    workerState &w = *workers_[worker];
+    std::lock_guard<std::mutex> guard(w.mutex);
+    blockEdges b;
+    b.sequence = sequence;
+    b.first = w.ready.size();
+    b.count = w.pending.size();
+    w.ready.insert(w.ready.end(), w.pending.begin(), w.pending.end());
+    w.readyBlocks.push_back(b);
+    w.pending.clear();
+}
+
+void tpx3TriggerMonitor::setConfig(const tpx3TriggerConfig &config)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    config_ = config;
+    // Intervals are measured between edges of the new reference only
+    haveLast_ = false;
+    haveRise_ = false;
+}
+
+void tpx3TriggerMonitor::reset()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    memset(&totals_, 0, sizeof(totals_));
+}
+
+// Caller holds mutex_
+void tpx3TriggerMonitor::addEdge(const edgeRecord &e)
+{
+    bool tdc1 = config_.edge == TPX3_TDC1_RISE || config_.edge == TPX3_TDC1_FALL;
+    if (e.edge == (tdc1 ? TPX3_TDC1_RISE : TPX3_TDC2_RISE)) {
+        haveRise_ = true;
+        risePs_ = e.timePs;
+    } else if (e.edge == (tdc1 ? TPX3_TDC1_FALL : TPX3_TDC2_FALL) && haveRise_) {
+        haveRise_ = false;
+        widths_++;
+        sumWidth_ += elapsedPs(risePs_, e.timePs) * 1e-3;
+    }
+    if (e.edge != config_.edge) {
+        return;
+    }
+
+    totals_.edges++;
+    intervalEdges_++;
+    if (!haveLast_) {
+        haveLast_ = true;
+        lastPs_ = e.timePs;
+        return;
+    }
+    double period = elapsedPs(lastPs_, e.timePs) * 1e-3;
+    double expected = config_.expectedPeriodNs;
+    if (expected > 0.0) {
+        double periods = floor(period / expected + 0.5);
+        if (periods < 1.0) {
+            // A glitch or a double edge: the next interval still counts from the last good edge
+            totals_.extra++;
+            return;
+        }
+        if (fabs(period - periods * expected) > config_.tolerance * expected) {
+            totals_.outOfTolerance++;
+        }
+        if (periods >= 2.0) {
+            // Gaps stay out of the period statistics
+            totals_.missing += (uint64_t)periods - 1;
+            lastPs_ = e.timePs;
+            return;
+        }
+    }
+    lastPs_ = e.timePs;
+
+    if (intervals_ == 0) {
+        shift_ = period;
+        sumPeriod_ = 0.0;
+        sumPeriod2_ = 0.0;
+        minPeriod_ = period;
+        maxPeriod_ = period;
+    }
+    intervals_++;
+    sumPeriod_ += period - shift_;
+    sumPeriod2_ += (period - shift_) * (period - shift_);
+    if (period < minPeriod_) {
+        minPeriod_ = period;
+    }
+    if (period > maxPeriod_) {
+        maxPeriod_ = period;
+    }
+}
+
+void tpx3TriggerMonitor::walk(const std::vector<edgeRecord> &edges, size_t first, size_t count)
+{
+    for (size_t i = first; i < first + count; i++) {
+        addEdge(edges[i]);
+    }
+}
+
+void tpx3TriggerMonitor::analyze(double dt, tpx3TriggerStats *out)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (size_t i = 0; i < workers_.size(); i++) {
+        workerState &w = *workers_[i];
+        std::lock_guard<std::mutex> workerGuard(w.mutex);
+        for (size_t b = 0; b < w.readyBlocks.size(); b++) {
+            const blockEdges &blk = w.readyBlocks[b];
+            if (blk.sequence == nextSequence_) {
+                // The usual case: the block is next in line, walk it in place
+                walk(w.ready, blk.first, blk.count);
+                nextSequence_++;
+            } else {
+                early_[blk.sequence].assign(w.ready.begin() + blk.first, w.ready.begin() + blk.first + blk.count);
+            }
+        }
+        w.ready.clear();
+        w.readyBlocks.clear();
+    }
+    // Blocks finished out of order wait for the ones before them
+    std::map<uint64_t, std::vector<edgeRecord> >::iterator it;
+    while ((it = early_.begin()) != early_.end() && it->first == nextSequence_) {
+        walk(it->second, 0, it->second.size());
+        early_.erase(it);
+        nextSequence_++;
+    }
+
+    *out = totals_;
+    out->rate = dt > 0.0 ? intervalEdges_ / dt : 0.0;
+    if (intervals_ > 0) {
+        double mean = sumPeriod_ / intervals_;
+        double variance = sumPeriod2_ / intervals_ - mean * mean;
+        out->periodMeanNs = shift_ + mean;
+        out->periodMinNs = minPeriod_;
+        out->periodMaxNs = maxPeriod_;
+        out->jitterNs = variance > 0.0 ? sqrt(variance) : 0.0;
+    } else {
+        out->periodMeanNs = 0.0;
+        out->periodMinNs = 0.0;
+        out->periodMaxNs = 0.0;
+        out->jitterNs = 0.0;
+    }
+    out->pulseWidthNs = widths_ ? sumWidth_ / widths_ : 0.0;
+    intervals_ = 0;
+    intervalEdges_ = 0;
+    widths_ = 0;
+    sumWidth_ = 0.0;
+}
@@ -0,0 +1,102 @@
+#ifndef tpx3Trigger_H
+#define tpx3Trigger_H
+
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "tpx3Packet.h"
+#include "tpx3Stream.h"
+
+struct tpx3TriggerConfig {
+    int edge;                // reference edge, TPX3_TDC1_RISE ...
+    double expectedPeriodNs; // 0: no missing/extra checks
+    double tolerance;        // allowed period deviation, fraction of the expected period
+};
+
+void tpx3TriggerDefaults(tpx3TriggerConfig *config);
+
+struct tpx3TriggerStats {
+    // Since reset()
+    uint64_t edges;          // reference edges
+    uint64_t missing;        // expected triggers that never came
+    uint64_t extra;          // edges less than half an expected period after the previous one
+    uint64_t outOfTolerance; // other intervals off a whole number of periods by more than the tolerance
+    // Over the last analyze() interval; 0 without enough edges
+    double rate;             // reference edges per second
+    double periodMeanNs;
+    double periodMinNs;
+    double periodMaxNs;
+    double jitterNs;         // RMS deviation of the period from its mean
+    double pulseWidthNs;     // mean rising-to-falling time on the reference edge's channel
+};
+
+// Trigger timing from the TDC packets. Workers only copy TDC edges out of the
+// chunks that hold any (the engine counts them while classifying, so other
+// chunks cost one compare) and hand each block's edges over at endBlock().
+// analyze(), called periodically from one thread, puts the blocks back in
+// stream order and works through the edges; workers never wait for it.
+class tpx3TriggerMonitor : public tpx3StreamConsumer {
+public:
+    tpx3TriggerMonitor();
+
+    void configure(int numWorkers);
+    void consume(int worker, const tpx3StreamChunk &chunk);
+    void endBlock(int worker, uint64_t sequence);
+
+    // Any thread; applies from the next edge
+    void setConfig(const tpx3TriggerConfig &config);
+    // Counters restart from 0; any thread
+    void reset();
+    // Process the edges handed over since the last call, dt seconds ago
+    void analyze(double dt, tpx3TriggerStats *out);
+
+private:
+    struct edgeRecord {
+        uint64_t timePs;
+        int edge;
+    };
+
+    struct blockEdges {
+        uint64_t sequence;
+        size_t first;   // index into the worker's ready list
+        size_t count;
+    };
+
+    struct workerState {
+        std::vector<edgeRecord> pending;  // worker only: the current block's edges
+        std::mutex mutex;                 // guards ready and readyBlocks, per block
+        std::vector<edgeRecord> ready;
+        std::vector<blockEdges> readyBlocks;
+    };
+
+    std::vector<std::unique_ptr<workerState> > workers_;
+
+    std::mutex mutex_;  // guards everything below and the worker list
+    tpx3TriggerConfig config_;
+    std::map<uint64_t, std::vector<edgeRecord> > early_;  // blocks finished ahead of their turn
+    uint64_t nextSequence_;
+    // Edge walk state, carried across analyze() calls until the next start
+    bool haveLast_;
+    uint64_t lastPs_;
+    bool haveRise_;
+    uint64_t risePs_;
+    tpx3TriggerStats totals_;
+    // Sums for the current interval
+    uint64_t intervals_;
+    uint64_t intervalEdges_;
+    double shift_;       // first period of the interval; sums are taken relative to it
+    double sumPeriod_;
+    double sumPeriod2_;
+    double minPeriod_;
+    double maxPeriod_;
+    uint64_t widths_;
+    double sumWidth_;
+
+    void walk(const std::vector<edgeRecord> &edges, size_t first, size_t count);
+    void addEdge(const edgeRecord &e);
+};
+
+#endif // tpx3Trigger_H
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
+
+#include "tpx3UdpStats.h"
+
+// Re-resolve every fd (not just new ones) this often, in case fd numbers are reused
+#define FULL_FD_SCAN_INTERVAL 10
+
+static double monotonicNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int openProcFile(pid_t pid, const char *name)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/%s", (int)pid, name);
+    return ::open(path, O_RDONLY | O_CLOEXEC);
+}
+
+tpx3UdpStats::tpx3UdpStats()
+    : pid_(0), snmpFd_(-1), udpFd_(-1), udp6Fd_(-1), buf_(16384), scanCount_(0),
+      havePrevious_(false), prevTime_(0.0),
+      baseInDatagrams_(0), baseInErrors_(0), baseRcvbufErrors_(0),
+      prevInDatagrams_(0), prevInErrors_(0), prevRcvbufErrors_(0), socketDropTotal_(0)
+{
+}
+
+tpx3UdpStats::~tpx3UdpStats()
+{
+    close();
+}
+
+bool tpx3UdpStats::open(pid_t pid)
+{
+    close();
+
+    snmpFd_ = openProcFile(pid, "net/snmp");
+    udpFd_ = openProcFile(pid, "net/udp");
+    // IPv6 may be disabled; it is optional
+    udp6Fd_ = openProcFile(pid, "net/udp6");
+
+    if (snmpFd_ < 0 || udpFd_ < 0) {
+        close();
+        return false;
+    }
+    pid_ = pid;
+    return true;
+}
+
+void tpx3UdpStats::close()
+{
+    if (snmpFd_ >= 0) {
+        ::close(snmpFd_);
+    }
+    if (udpFd_ >= 0) {
+        ::close(udpFd_);
+    }
+    if (udp6Fd_ >= 0) {
+        ::close(udp6Fd_);
+    }
+    snmpFd_ = udpFd_ = udp6Fd_ = -1;
+    fdInodes_.clear();
+    socketDrops_.clear();
+    scanCount_ = 0;
+    socketDropTotal_ = 0;
+    pid_ = 0;
+    havePrevious_ = false;
+}
+
+// Read a whole /proc file into buf_, growing it as needed
+bool tpx3UdpStats::readFile(int fd)
+{
+    size_t used = 0;
+    for (;;) {
+        if (buf_.size() - used < 4096) {
+            buf_.resize(buf_.size() * 2);
+        }
+        ssize_t n = pread(fd, &buf_[used], buf_.size() - used - 1, used);
+        if (n < 0) {
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        used += n;
+    }
+    buf_[used] = '\0';
+    return used > 0;
+}
+
+// Collect the socket inodes of the process. Known fds are trusted between full scans.
+void tpx3UdpStats::scanFds(std::set<unsigned long> *inodes)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/fd", (int)pid_);
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return;
+    }
+
+    bool fullScan = (scanCount_++ % FULL_FD_SCAN_INTERVAL) == 0;
+    std::map<int, unsigned long> current;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') {
+            continue;
+        }
+        int fd = atoi(entry->d_name);
+        std::map<int, unsigned long>::iterator it = fdInodes_.find(fd);
+        unsigned long inode = 0;
+        if (it != fdInodes_.end() && !fullScan) {
+            inode = it->second;
+        } else {
+            char link[64];
+            snprintf(path, sizeof(path), "/proc/%d/fd/%d", (int)pid_, fd);
+            ssize_t n = readlink(path, link, sizeof(link) - 1);
+            if (n > 0) {
+                link[n] = '\0';
+                sscanf(link, "socket:[%lu]", &inode);
+            }
+        }
+        current[fd] = inode;
+        if (inode != 0) {
+            inodes->insert(inode);
+        }
+    }
+    closedir(dir);
+    fdInodes_.swap(current);
+}
+
+// Parse a /proc/net/udp{,6} table and account the sockets in inodes
+void tpx3UdpStats::scanSockets(int fd, const std::set<unsigned long> &inodes, tpx3UdpSample *out,
+                               uint64_t *dropDelta, std::set<unsigned long> *seen)
+{
+    if (fd < 0 || !readFile(fd)) {
+        return;
+    }
+    // Skip the header line
+    char *line = strchr(&buf_[0], '\n');
+    while (line && *++line) {
+        char *next = strchr(line, '\n');
+        if (next) {
+            *next = '\0';
+        }
+        unsigned long txQueue = 0, rxQueue = 0, inode = 0;
+        unsigned long long drops = 0;
+        // sl local rem st tx:rx tr:when retrnsmt uid timeout inode ref pointer drops
+        int fields = sscanf(line, " %*s %*s %*s %*s %lx:%lx %*s %*s %*s %*s %lu %*s %*s %llu",
+                            &txQueue, &rxQueue, &inode, &drops);
+        if (fields == 4 && inodes.count(inode)) {
+            out->sockets++;
+            out->rxQueueBytes += rxQueue;
+            if (rxQueue > out->rxQueueMaxBytes) {
+                out->rxQueueMaxBytes = rxQueue;
+            }
+            // Every socket belongs to this process, so drops before first sight count too
+            std::map<unsigned long, uint64_t>::iterator it = socketDrops_.find(inode);
+            if (it == socketDrops_.end()) {
+                *dropDelta += drops;
+            } else if (drops >= it->second) {
+                *dropDelta += drops - it->second;
+            }
+            socketDrops_[inode] = drops;
+            seen->insert(inode);
+        }
+        line = next;
+    }
+}
+
+bool tpx3UdpStats::sample(tpx3UdpSample *out)
+{
+    if (snmpFd_ < 0) {
+        return false;
+    }
+
+    double now = monotonicNow();
+    memset(out, 0, sizeof(*out));
+
+    // snmp: a "Udp:" header line with field names followed by a "Udp:" value line
+    if (!readFile(snmpFd_)) {
+        return false;
+    }
+    const char *header = strstr(&buf_[0], "\nUdp:");
+    const char *values = header ? strstr(header + 1, "\nUdp:") : NULL;
+    if (!values) {
+        return false;
+    }
+    header += 5;
+    values += 5;
+    uint64_t inDatagrams = 0, inErrors = 0, rcvbufErrors = 0;
+    while (*header && *header != '\n' && *values && *values != '\n') {
+        while (*header == ' ') {
+            header++;
+        }
+        size_t nameLen = strcspn(header, " \n");
+        char *end;
+        uint64_t value = strtoull(values, &end, 10);
+        if (nameLen == 11 && strncmp(header, "InDatagrams", nameLen) == 0) {
+            inDatagrams = value;
+        } else if (nameLen == 8 && strncmp(header, "InErrors", nameLen) == 0) {
+            inErrors = value;
+        } else if (nameLen == 12 && strncmp(header, "RcvbufErrors", nameLen) == 0) {
+            rcvbufErrors = value;
+        }
+        header += nameLen;
+        values = end;
+    }
+
+    // udp, udp6: the process's sockets
+    std::set<unsigned long> inodes;
+    scanFds(&inodes);
+    uint64_t dropDelta = 0;
+    std::set<unsigned long> seen;
+    scanSockets(udpFd_, inodes, out, &dropDelta, &seen);
+    scanSockets(udp6Fd_, inodes, out, &dropDelta, &seen);
+    for (std::map<unsigned long, uint64_t>::iterator it = socketDrops_.begin(); it != socketDrops_.end(); ) {
+        if (!seen.count(it->first)) {
+            socketDrops_.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    socketDropTotal_ += dropDelta;
+
+    if (!havePrevious_) {
+        baseInDatagrams_ = inDatagrams;
+        baseInErrors_ = inErrors;
+        baseRcvbufErrors_ = rcvbufErrors;
+    } else if (now > prevTime_) {
+        double dt = now - prevTime_;
+        out->inDatagramRate = (double)(inDatagrams - prevInDatagrams_) / dt;
+        out->inErrorRate = (double)(inErrors - prevInErrors_) / dt;
+        out->rcvbufErrorRate = (double)(rcvbufErrors - prevRcvbufErrors_) / dt;
+        out->socketDropRate = (double)dropDelta / dt;
+    }
+    out->inDatagrams = inDatagrams - baseInDatagrams_;
+    out->inErrors = inErrors - baseInErrors_;
+    out->rcvbufErrors = rcvbufErrors - baseRcvbufErrors_;
+    out->socketDrops = socketDropTotal_;
+
+    havePrevious_ = true;
+    prevTime_ = now;
+    prevInDatagrams_ = inDatagrams;
+    prevInErrors_ = inErrors;
+    prevRcvbufErrors_ = rcvbufErrors;
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef tpx3UdpStats_H
+#define tpx3UdpStats_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <vector>
+
+// One UDP sample; totals count from open(), rates are per second since the previous sample
+struct tpx3UdpSample {
+    uint64_t inDatagrams;       // namespace-wide /proc/net/snmp counters
+    uint64_t inErrors;
+    uint64_t rcvbufErrors;
+    double inDatagramRate;
+    double inErrorRate;
+    double rcvbufErrorRate;
+    int sockets;                // UDP sockets owned by the process
+    uint64_t socketDrops;       // summed over those sockets
+    double socketDropRate;
+    uint64_t rxQueueBytes;      // summed over those sockets
+    uint64_t rxQueueMaxBytes;   // fullest socket
+};
+
+// Sampler of kernel UDP loss for one process. /proc/<pid>/net/{snmp,udp,udp6}
+// are read in the process's network namespace; its sockets are found from the
+// socket:[inode] links in /proc/<pid>/fd, which are only re-read for new fds
+// and periodically in full, so a sample is a handful of syscalls.
+// Not thread safe: one thread owns an instance.
+class tpx3UdpStats {
+public:
+    tpx3UdpStats();
+    ~tpx3UdpStats();
+
+    bool open(pid_t pid);
+    void close();
+    pid_t pid() const { return pid_; }
+
+    // Returns false once the process is gone
+    bool sample(tpx3UdpSample *out);
+
+private:
+    pid_t pid_;
+    int snmpFd_;
+    int udpFd_;
+    int udp6Fd_;
+    std::vector<char> buf_;
+    std::map<int, unsigned long> fdInodes_;  // fd -> socket inode, 0 for non-sockets
+    std::map<unsigned long, uint64_t> socketDrops_;  // last drops counter per socket
+    int scanCount_;
+    bool havePrevious_;
+    double prevTime_;
+    uint64_t baseInDatagrams_;
+    uint64_t baseInErrors_;
+    uint64_t baseRcvbufErrors_;
+    uint64_t prevInDatagrams_;
+    uint64_t prevInErrors_;
+    uint64_t prevRcvbufErrors_;
+    uint64_t socketDropTotal_;
+
+    bool readFile(int fd);
+    void scanFds(std::set<unsigned long> *inodes);
+    void scanSockets(int fd, const std::set<unsigned long> &inodes, tpx3UdpSample *out,
+                     uint64_t *dropDelta, std::set<unsigned long> *seen);
+};
+
+#endif // tpx3UdpStats_H
@@ -1,30 +1,409 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <sched.h>
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
 #include <sys/wait.h>
 #include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <spawn.h>
+#include <linux/mempolicy.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <stdint.h>
 #include <errno.h>
 
 #include "epicsExport.h"
 #include "iocsh.h"
 #include "tpx3servalDriver.h"
+#include "tpx3Json.h"
 
 static const char *driverName = "tpx3servalDriver";
 
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+// epoll tags for the monitor loop
+#define MONITOR_TAG_WAKE  1
+#define MONITOR_TAG_CHILD 2
+#define MONITOR_TAG_TIMER 3
+#define MONITOR_TAG_TELEMETRY 4
+#define MONITOR_TAG_STREAM 5
+#define MONITOR_TAG_SPOOL 6
+#define MONITOR_TAG_AUTOTUNE 7
+#define MONITOR_TAG_STANDBY 8
+#define MONITOR_TAG_RETIRING 9
+#define MONITOR_TAG_SWITCHOVER 10
+#define MONITOR_TAG_LOG_STDOUT 11
+#define MONITOR_TAG_LOG_STDERR 12
+#define MONITOR_TAG_GC_LOG 13
+
+// Seconds the destructor waits for the monitor thread to finish its current handler
+#define MONITOR_EXIT_TIMEOUT 5.0
+
+// Busiest-thread CPU (% of one core) above which a stage is reported as the bottleneck
+#define BOTTLENECK_CPU_PERCENT 90.0
+
+// Characters of LOG_TAIL, the NELM of its waveform
+#define LOG_TAIL_CHARS 16384
+
+// Serval REST API polling
+#define HTTP_TIMEOUT 2.0          // seconds per request
+#define HTTP_HEALTH_DIVIDER 5     // poll /detector/health every Nth dashboard poll
+#define READY_PROBE_INTERVAL 0.1  // seconds between readiness probes while Starting
+#define AUTOTUNE_READY_TIMEOUT 120.0  // seconds a trial waits for Serval when READY_TIMEOUT is 0
+#define STANDBY_READY_TIMEOUT 120.0   // seconds a standby or switched instance gets when READY_TIMEOUT is 0
+#define MEAS_STATUS_RECORDING "DA_RECORDING"  // Measurement.Status while Serval records
+
+static double monotonicSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Bits in the nodemask passed to set_mempolicy/get_mempolicy
+#define NUMA_MAX_NODES 1024
+
+// Parse a Linux CPU list such as "0-7,16-23" into a cpu_set_t
+static bool parseCpuList(const std::string &list, cpu_set_t *cpus)
+{
+    CPU_ZERO(cpus);
+    const char *p = list.c_str();
+    int count = 0;
+    while (*p) {
+        while (*p == ' ' || *p == ',') {
+            p++;
+        }
+        if (!*p) {
+            break;
+        }
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0 || first >= CPU_SETSIZE) {
+            return false;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            p++;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first || last >= CPU_SETSIZE) {
+                return false;
+            }
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, cpus);
+            count++;
+        }
+        if (*p && *p != ',' && *p != ' ') {
+            return false;
+        }
+    }
+    return count > 0;
+}
+
+// Read one "Key:\tvalue" field from /proc/<pid>/status
+static std::string readProcStatusField(pid_t pid, const char *key)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return "";
+    }
+    std::string value;
+    char line[512];
+    size_t keyLen = strlen(key);
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, key, keyLen) == 0 && line[keyLen] == ':') {
+            const char *v = line + keyLen + 1;
+            while (*v == ' ' || *v == '\t') {
+                v++;
+            }
+            value = v;
+            while (!value.empty() && (value.back() == '\n' || value.back() == ' ')) {
+                value.erase(value.size() - 1);
+            }
+            break;
+        }
+    }
+    fclose(fp);
+    return value;
+}
+
+// Placement of the spawning thread saved while the child inherits the new one
+struct threadPlacement {
+    bool cpusSaved;
+    cpu_set_t cpus;
+    bool numaSaved;
+    int mode;
+    unsigned long nodes[NUMA_MAX_NODES / (8 * sizeof(unsigned long))];
+};
+
+// Apply CPU affinity and NUMA memory policy to the calling thread. posix_spawn
+// has no hook between spawn and exec, but both are inherited by the child
+// and preserved across exec, so this places the JVM before its first thread.
+static bool applyThreadPlacement(bool cpuEnable, const std::string &cpuList,
+                                 bool numaEnable, int numaNode, int numaPolicy,
+                                 threadPlacement *saved, char *errMsg, size_t errLen)
+{
+    saved->cpusSaved = false;
+    saved->numaSaved = false;
+
+    if (cpuEnable) {
+        cpu_set_t cpus;
+        if (!parseCpuList(cpuList, &cpus)) {
+            snprintf(errMsg, errLen, "Invalid CPU list '%s'", cpuList.c_str());
+            return false;
+        }
+        if (sched_getaffinity(0, sizeof(saved->cpus), &saved->cpus) != 0) {
+            snprintf(errMsg, errLen, "sched_getaffinity failed: %s", strerror(errno));
+            return false;
+        }
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+            snprintf(errMsg, errLen, "sched_setaffinity(%s) failed: %s", cpuList.c_str(), strerror(errno));
+            return false;
+        }
+        saved->cpusSaved = true;
+    }
+
+    if (numaEnable) {
+        if (numaNode < 0 || numaNode >= NUMA_MAX_NODES) {
+            snprintf(errMsg, errLen, "Invalid NUMA node %d", numaNode);
+            return false;
+        }
+        int mode = (numaPolicy == NUMA_POLICY_BIND) ? MPOL_BIND :
+                   (numaPolicy == NUMA_POLICY_INTERLEAVE) ? MPOL_INTERLEAVE : MPOL_PREFERRED;
+        unsigned long nodes[NUMA_MAX_NODES / (8 * sizeof(unsigned long))];
+        memset(nodes, 0, sizeof(nodes));
+        nodes[numaNode / (8 * sizeof(unsigned long))] |= 1UL << (numaNode % (8 * sizeof(unsigned long)));
+        memset(saved->nodes, 0, sizeof(saved->nodes));
+        if (syscall(SYS_get_mempolicy, &saved->mode, saved->nodes, NUMA_MAX_NODES, NULL, 0) != 0) {
+            snprintf(errMsg, errLen, "get_mempolicy failed: %s", strerror(errno));
+            return false;
+        }
+        if (syscall(SYS_set_mempolicy, mode, nodes, NUMA_MAX_NODES + 1) != 0) {
+            snprintf(errMsg, errLen, "set_mempolicy(node %d) failed: %s", numaNode, strerror(errno));
+            return false;
+        }
+        saved->numaSaved = true;
+    }
+    return true;
+}
+
+// Restore the calling thread's placement after the spawn
+static void restoreThreadPlacement(threadPlacement *saved)
+{
+    if (saved->cpusSaved) {
+        sched_setaffinity(0, sizeof(saved->cpus), &saved->cpus);
+        saved->cpusSaved = false;
+    }
+    if (saved->numaSaved) {
+        syscall(SYS_set_mempolicy, saved->mode, saved->mode == MPOL_DEFAULT ? NULL : saved->nodes,
+                NUMA_MAX_NODES + 1);
+        saved->numaSaved = false;
+    }
+}
+
+// Give a child a clean signal state regardless of what IOC threads block or ignore
+static void initChildSpawnAttr(posix_spawnattr_t *attr, short flags)
+{
+    posix_spawnattr_init(attr);
+    sigset_t emptyMask, defaultSignals;
+    sigemptyset(&emptyMask);
+    sigemptyset(&defaultSignals);
+    sigaddset(&defaultSignals, SIGPIPE);
+    sigaddset(&defaultSignals, SIGCHLD);
+    sigaddset(&defaultSignals, SIGINT);
+    sigaddset(&defaultSignals, SIGTERM);
+    sigaddset(&defaultSignals, SIGQUIT);
+    posix_spawnattr_setsigmask(attr, &emptyMask);
+    posix_spawnattr_setsigdefault(attr, &defaultSignals);
+    flags |= POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+#ifdef POSIX_SPAWN_USEVFORK
+    flags |= POSIX_SPAWN_USEVFORK;
+#endif
+    posix_spawnattr_setflags(attr, flags);
+}
+
+static void addToEpoll(int epollFd, int fd, uint32_t tag)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = tag;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+// Move fd, already in the set, to another tag
+static void retagInEpoll(int epollFd, int fd, uint32_t tag)
+{
+    if (fd < 0) {
+        return;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = tag;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+// eventfds written by the SIGCHLD handler on kernels without pidfd_open (< 5.3),
+// one per driver instance: the signal does not say whose child exited
+#define MAX_SIGCHLD_FDS 16
+static volatile int g_sigchldFds[MAX_SIGCHLD_FDS] = { -1, -1, -1, -1, -1, -1, -1, -1,
+                                                      -1, -1, -1, -1, -1, -1, -1, -1 };
+
+static void sigchldHandler(int sig)
+{
+    (void)sig;
+    int savedErrno = errno;
+    uint64_t one = 1;
+    for (int i = 0; i < MAX_SIGCHLD_FDS; i++) {
+        int fd = g_sigchldFds[i];
+        if (fd >= 0) {
+            ssize_t n = write(fd, &one, sizeof(one));
+            (void)n;
+        }
+    }
+    errno = savedErrno;
+}
+
+// Add or remove a wake fd; the handler is installed with the first and removed with the last
+static bool watchSigchld(int fd, bool add)
+{
+    int slot = -1;
+    int used = 0;
+    for (int i = 0; i < MAX_SIGCHLD_FDS; i++) {
+        if (g_sigchldFds[i] == (add ? -1 : fd) && slot < 0) {
+            slot = i;
+        } else if (g_sigchldFds[i] >= 0) {
+            used++;
+        }
+    }
+    if (slot < 0) {
+        return false;
+    }
+    g_sigchldFds[slot] = add ? fd : -1;
+    if (add && used == 0) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = sigchldHandler;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+        sigaction(SIGCHLD, &sa, NULL);
+    } else if (!add && used == 0) {
+        signal(SIGCHLD, SIG_DFL);
+    }
+    return true;
+}
+
 // Constructor
 tpx3servalDriver::tpx3servalDriver(const char *portName, int maxAddr)
     : asynPortDriver(portName, maxAddr, 
                      NUM_PARAMS,
-                     asynInt32Mask | asynOctetMask | asynDrvUserMask,
-                     asynInt32Mask | asynOctetMask,
+                     asynInt32Mask | asynFloat64Mask | asynOctetMask | asynInt32ArrayMask | asynDrvUserMask,
+                     asynInt32Mask | asynFloat64Mask | asynOctetMask | asynInt32ArrayMask,
                      ASYN_CANBLOCK, 1, 0, 0),
-      processId_(0), isRunning_(false), monitorThreadId_(0)
+      processId_(0), isRunning_(false), runningHttpPort_(0), applyMode_(APPLY_MODE_RESTART),
+      applyRestart_(false), monitorThreadId_(0),
+      epollFd_(-1), wakeFd_(-1), pidFd_(-1), usePidFd_(false), sigchldWatched_(false),
+      timerFd_(-1),
+      lifecycleState_(LIFECYCLE_STOPPED), lifecycleStartTime_(0.0), stopStage_(0),
+      stopTermTimeout_(2.0), stopKillTimeout_(5.0),
+      telemetryFd_(-1), telemetryPeriod_(1.0), telemetryPid_(0),
+      logCapture_(true), logTailLines_(20), logFileMaxMB_(100),
+      gcPauseHist_(TPX3_GC_HIST_BINS, 0), gcDropOverlaps_(0),
+      httpThreadId_(0), httpExit_(false), httpPollPeriod_(1.0), httpPolls_(0),
+      httpLatencyHist_(HTTP_LATENCY_BINS, 0),
+      streamTimerFd_(-1), streamSource_(STREAM_SOURCE_TCP), streamPort_(8085),
+      streamReplayLoop_(false), streamReplayRate_(0.0), streamWorkers_(2), streamPublishPeriod_(0.5),
+      prevStreamTime_(0.0),
+      previewFront_(0), previewElements_(0), previewEnabled_(true),
+      previewLayout_(TPX3_PREVIEW_LAYOUT_QUAD), previewChip_(0), previewBinning_(1),
+      previewMode_(PREVIEW_MODE_ACCUMULATE), previewPeriod_(1.0), previewLastPublish_(0.0),
+      histTot_(TPX3_HIST_TOT_BINS, 0), histToa_(TPX3_HIST_TOA_MAX_BINS, 0), histEnabled_(true),
+      histMode_(HIST_MODE_ACCUMULATE), histPeriod_(1.0), histLastPublish_(0.0),
+      centSizeHist_(TPX3_CENT_SIZE_BINS, 0), centEnabled_(false), centOutputPort_(8086),
+      chipHitRate_(TPX3_MASK_CHIPS, 0), maskNoisy_(TPX3_MASK_CHIPS, 0), maskAcquiring_(false),
+      maskStart_(0.0), maskAcquireTime_(10.0), maskSigma_(5.0), relay_(stream_), relayMaxLag_(8.0),
+      spool_(stream_), spoolSegments_(16), spoolSegmentMB_(256), spoolRangeFrom_(0.0), spoolRangeTo_(0.0),
+      prevSpoolWritten_(0),
+      tuneTimerFd_(-1), tuneState_(AUTOTUNE_IDLE), tuneAborting_(false), tuneWasRunning_(false),
+      tuneWarmup_(10.0), tuneDuration_(30.0), tunePasses_(2), tuneLoadPid_(0), tuneLoadExited_(false),
+      tuneMeasureStart_(0.0), tuneDropsStart_(0.0), tuneCpuSum_(0.0), tuneCpuSamples_(0),
+      tunePixelRateSum_(0.0), tunePixelRateSamples_(0),
+      switchState_(SWITCHOVER_IDLE), switchTimerFd_(-1), standbyHttpPort_(8082),
+      activeHttpPort_(SERVAL_DEFAULT_HTTP_PORT), standbyPid_(0), standbyPidFd_(-1), standbyPort_(0),
+      standbyGeneration_(0), standbyStartTime_(0.0), retiringPid_(0), retiringPidFd_(-1), retiringStage_(0),
+      switchTime_(0.0), switchWaitDetector_(false), switchDetectorSeen_(false),
+      startGeneration_(0), listenSeen_(false), readyTimeoutReported_(false), readyTimeout_(120.0)
 {
     // Create mutex and event
     mutex_ = epicsMutexCreate();
     stopEvent_ = epicsEventCreate(epicsEventEmpty);
+    monitorDoneEvent_ = epicsEventCreate(epicsEventEmpty);
+    httpEvent_ = epicsEventCreate(epicsEventEmpty);
+    httpDoneEvent_ = epicsEventCreate(epicsEventEmpty);
+    httpClient_.setTimeout(HTTP_TIMEOUT);
+    standbyClient_.setTimeout(HTTP_TIMEOUT);
+
+    // Set up the event loop used by the monitor thread
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    timerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    telemetryFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    streamTimerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    tuneTimerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    switchTimerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epollFd_ >= 0 && wakeFd_ >= 0 && timerFd_ >= 0 && telemetryFd_ >= 0 && streamTimerFd_ >= 0 &&
+        tuneTimerFd_ >= 0 && switchTimerFd_ >= 0) {
+        addToEpoll(epollFd_, wakeFd_, MONITOR_TAG_WAKE);
+        addToEpoll(epollFd_, timerFd_, MONITOR_TAG_TIMER);
+        addToEpoll(epollFd_, telemetryFd_, MONITOR_TAG_TELEMETRY);
+        addToEpoll(epollFd_, streamTimerFd_, MONITOR_TAG_STREAM);
+        addToEpoll(epollFd_, spool_.exportEvent(), MONITOR_TAG_SPOOL);
+        addToEpoll(epollFd_, tuneTimerFd_, MONITOR_TAG_AUTOTUNE);
+        addToEpoll(epollFd_, switchTimerFd_, MONITOR_TAG_SWITCHOVER);
+        std::string logError;
+        if (servalLog_.open(&logError)) {
+            addToEpoll(epollFd_, servalLog_.readFd(TPX3_LOG_STDOUT), MONITOR_TAG_LOG_STDOUT);
+            addToEpoll(epollFd_, servalLog_.readFd(TPX3_LOG_STDERR), MONITOR_TAG_LOG_STDERR);
+        } else {
+            printf("%s:%s: %s; Serval will write to the IOC console\n", driverName, __FUNCTION__, logError.c_str());
+        }
+        std::string gcError;
+        if (gcLog_.open(&gcError)) {
+            addToEpoll(epollFd_, gcLog_.readFd(), MONITOR_TAG_GC_LOG);
+        } else {
+            printf("%s:%s: %s; JVM_GC_LOG is not available\n", driverName, __FUNCTION__, gcError.c_str());
+        }
+    } else {
+        printf("%s:%s: Failed to create monitor event loop: %s\n", driverName, __FUNCTION__, strerror(errno));
+    }
+
+    // Prefer a pidfd per child; fall back to SIGCHLD on older kernels
+    int probeFd = (int)syscall(SYS_pidfd_open, getpid(), 0);
+    if (probeFd >= 0) {
+        close(probeFd);
+        usePidFd_ = true;
+    } else if (wakeFd_ >= 0 && watchSigchld(wakeFd_, true)) {
+        sigchldWatched_ = true;
+        printf("%s:%s: pidfd_open not available, using SIGCHLD for child supervision\n", driverName, __FUNCTION__);
+    } else if (wakeFd_ >= 0) {
+        printf("%s:%s: pidfd_open not available and more than %d instances; no child supervision for %s\n",
+               driverName, __FUNCTION__, MAX_SIGCHLD_FDS, portName);
+    }
 
     // Create parameters
     createParam("START", asynParamInt32, &startIndex_);
@@ -72,6 +451,284 @@ tpx3servalDriver::tpx3servalDriver(const char *portName, int maxAddr)
     createParam("PROCESS_ID", asynParamOctet, &processIdIndex_);
     createParam("COMMAND_LINE", asynParamOctet, &commandLineIndex_);
     createParam("ERROR_MSG", asynParamOctet, &errorMsgIndex_);
+    createParam("LIFECYCLE_STATE", asynParamInt32, &lifecycleStateIndex_);
+    createParam("START_DURATION_MS", asynParamFloat64, &startDurationIndex_);
+    createParam("STOP_DURATION_MS", asynParamFloat64, &stopDurationIndex_);
+    createParam("STOP_TERM_TIMEOUT", asynParamFloat64, &stopTermTimeoutIndex_);
+    createParam("STOP_KILL_TIMEOUT", asynParamFloat64, &stopKillTimeoutIndex_);
+    createParam("SPAWN_LATENCY_US", asynParamFloat64, &spawnLatencyIndex_);
+    createParam("CPU_LIST", asynParamOctet, &cpuListIndex_);
+    createParam("CPU_LIST_ENABLE", asynParamInt32, &cpuListEnableIndex_);
+    createParam("NUMA_NODE", asynParamInt32, &numaNodeIndex_);
+    createParam("NUMA_POLICY", asynParamInt32, &numaPolicyIndex_);
+    createParam("NUMA_ENABLE", asynParamInt32, &numaEnableIndex_);
+    createParam("CPU_AFFINITY_RBV", asynParamOctet, &cpuAffinityRbvIndex_);
+    createParam("NUMA_POLICY_RBV", asynParamOctet, &numaPolicyRbvIndex_);
+    createParam("JVM_XMS", asynParamInt32, &jvmXmsIndex_);
+    createParam("JVM_XMS_ENABLE", asynParamInt32, &jvmXmsEnableIndex_);
+    createParam("JVM_XMX", asynParamInt32, &jvmXmxIndex_);
+    createParam("JVM_XMX_ENABLE", asynParamInt32, &jvmXmxEnableIndex_);
+    createParam("JVM_MAX_DIRECT_MEMORY", asynParamInt32, &jvmMaxDirectMemoryIndex_);
+    createParam("JVM_MAX_DIRECT_MEMORY_ENABLE", asynParamInt32, &jvmMaxDirectMemoryEnableIndex_);
+    createParam("JVM_GC", asynParamInt32, &jvmGcIndex_);
+    createParam("JVM_GC_ENABLE", asynParamInt32, &jvmGcEnableIndex_);
+    createParam("JVM_LARGE_PAGES", asynParamInt32, &jvmLargePagesIndex_);
+    createParam("JVM_PRETOUCH", asynParamInt32, &jvmPreTouchIndex_);
+    createParam("JVM_GC_LOG", asynParamInt32, &jvmGcLogIndex_);
+    createParam("TELEMETRY_PERIOD", asynParamFloat64, &telemetryPeriodIndex_);
+    createParam("PROC_CPU_PERCENT", asynParamFloat64, &procCpuPercentIndex_);
+    createParam("PROC_RSS_MB", asynParamFloat64, &procRssIndex_);
+    createParam("PROC_VMHWM_MB", asynParamFloat64, &procVmHwmIndex_);
+    createParam("PROC_THREADS", asynParamInt32, &procThreadsIndex_);
+    createParam("PROC_VOL_CTXSW_RATE", asynParamFloat64, &procVolCtxRateIndex_);
+    createParam("PROC_INVOL_CTXSW_RATE", asynParamFloat64, &procInvolCtxRateIndex_);
+    createParam("PROC_READ_RATE", asynParamFloat64, &procReadRateIndex_);
+    createParam("PROC_WRITE_RATE", asynParamFloat64, &procWriteRateIndex_);
+    for (int stage = 0; stage < TPX3_NUM_STAGES; stage++) {
+        std::string prefix = std::string("STAGE_") + tpx3ProcStats::stageName(stage);
+        createParam((prefix + "_CPU").c_str(), asynParamFloat64, &stageCpuIndex_[stage]);
+        createParam((prefix + "_MAX_CPU").c_str(), asynParamFloat64, &stageMaxCpuIndex_[stage]);
+        createParam((prefix + "_THREADS").c_str(), asynParamInt32, &stageThreadsIndex_[stage]);
+        // OTHER collects everything unmatched and has no pattern of its own
+        stagePatternIndex_[stage] = -1;
+        if (stage != TPX3_STAGE_OTHER) {
+            createParam((prefix + "_PATTERN").c_str(), asynParamOctet, &stagePatternIndex_[stage]);
+        }
+    }
+    createParam("BOTTLENECK_STAGE", asynParamOctet, &bottleneckStageIndex_);
+    createParam("UDP_IN_DATAGRAM_RATE", asynParamFloat64, &udpInDatagramRateIndex_);
+    createParam("UDP_IN_ERRORS", asynParamFloat64, &udpInErrorsIndex_);
+    createParam("UDP_IN_ERROR_RATE", asynParamFloat64, &udpInErrorRateIndex_);
+    createParam("UDP_RCVBUF_ERRORS", asynParamFloat64, &udpRcvbufErrorsIndex_);
+    createParam("UDP_RCVBUF_ERROR_RATE", asynParamFloat64, &udpRcvbufErrorRateIndex_);
+    createParam("UDP_SOCKETS", asynParamInt32, &udpSocketsIndex_);
+    createParam("UDP_SOCKET_DROPS", asynParamFloat64, &udpSocketDropsIndex_);
+    createParam("UDP_SOCKET_DROP_RATE", asynParamFloat64, &udpSocketDropRateIndex_);
+    createParam("UDP_RX_QUEUE_KB", asynParamFloat64, &udpRxQueueIndex_);
+    createParam("UDP_RX_QUEUE_MAX_KB", asynParamFloat64, &udpRxQueueMaxIndex_);
+    createParam("UDP_LOSS", asynParamInt32, &udpLossIndex_);
+    createParam("UDP_LOSS_RESET", asynParamInt32, &udpLossResetIndex_);
+    createParam("HTTP_POLL_PERIOD", asynParamFloat64, &httpPollPeriodIndex_);
+    createParam("SERVAL_CONNECTED", asynParamInt32, &servalConnectedIndex_);
+    createParam("SERVAL_VERSION", asynParamOctet, &servalVersionIndex_);
+    createParam("SERVAL_ERROR", asynParamOctet, &servalErrorIndex_);
+    createParam("DETECTOR_CONNECTED", asynParamInt32, &detectorConnectedIndex_);
+    createParam("DETECTOR_TYPE", asynParamOctet, &detectorTypeIndex_);
+    createParam("DETECTOR_TEMP_LOCAL", asynParamFloat64, &detectorTempLocalIndex_);
+    createParam("DETECTOR_TEMP_FPGA", asynParamFloat64, &detectorTempFpgaIndex_);
+    createParam("DETECTOR_HUMIDITY", asynParamFloat64, &detectorHumidityIndex_);
+    createParam("MEAS_STATUS", asynParamOctet, &measStatusIndex_);
+    createParam("MEAS_FRAME_COUNT", asynParamFloat64, &measFrameCountIndex_);
+    createParam("MEAS_DROPPED_FRAMES", asynParamFloat64, &measDroppedFramesIndex_);
+    createParam("MEAS_PIXEL_RATE", asynParamFloat64, &measPixelRateIndex_);
+    createParam("MEAS_TDC1_RATE", asynParamFloat64, &measTdc1RateIndex_);
+    createParam("MEAS_ELAPSED_TIME", asynParamFloat64, &measElapsedTimeIndex_);
+    createParam("MEAS_TIME_LEFT", asynParamFloat64, &measTimeLeftIndex_);
+    createParam("HTTP_LATENCY_MS", asynParamFloat64, &httpLatencyIndex_);
+    createParam("HTTP_LATENCY_HIST", asynParamInt32Array, &httpLatencyHistIndex_);
+    createParam("HTTP_LATENCY_HIST_RESET", asynParamInt32, &httpLatencyHistResetIndex_);
+    createParam("HTTP_REQUESTS", asynParamInt32, &httpRequestsIndex_);
+    createParam("HTTP_ERRORS", asynParamInt32, &httpErrorsIndex_);
+    createParam("HTTP_CONNECTS", asynParamInt32, &httpConnectsIndex_);
+    createParam("READY", asynParamInt32, &readyIndex_);
+    createParam("START_TO_LISTEN_MS", asynParamFloat64, &startToListenIndex_);
+    createParam("START_TO_READY_MS", asynParamFloat64, &startToReadyIndex_);
+    createParam("READY_TIMEOUT", asynParamFloat64, &readyTimeoutIndex_);
+    createParam("STREAM_ENABLE", asynParamInt32, &streamEnableIndex_);
+    createParam("STREAM_SOURCE", asynParamInt32, &streamSourceIndex_);
+    createParam("STREAM_PORT", asynParamInt32, &streamPortIndex_);
+    createParam("STREAM_FILE", asynParamOctet, &streamFileIndex_);
+    createParam("STREAM_REPLAY_LOOP", asynParamInt32, &streamReplayLoopIndex_);
+    createParam("STREAM_REPLAY_RATE", asynParamFloat64, &streamReplayRateIndex_);
+    createParam("STREAM_WORKERS", asynParamInt32, &streamWorkersIndex_);
+    createParam("STREAM_PUBLISH_PERIOD", asynParamFloat64, &streamPublishPeriodIndex_);
+    createParam("STREAM_RUNNING", asynParamInt32, &streamRunningIndex_);
+    createParam("STREAM_CONNECTED", asynParamInt32, &streamConnectedIndex_);
+    createParam("STREAM_SOURCE_DONE", asynParamInt32, &streamSourceDoneIndex_);
+    createParam("STREAM_RATE_MBS", asynParamFloat64, &streamRateIndex_);
+    createParam("STREAM_CHUNK_RATE", asynParamFloat64, &streamChunkRateIndex_);
+    createParam("STREAM_HIT_RATE", asynParamFloat64, &streamHitRateIndex_);
+    createParam("STREAM_TDC_RATE", asynParamFloat64, &streamTdcRateIndex_);
+    createParam("STREAM_GLOBAL_TIME_RATE", asynParamFloat64, &streamGlobalTimeRateIndex_);
+    createParam("STREAM_CONTROL_RATE", asynParamFloat64, &streamControlRateIndex_);
+    createParam("STREAM_OTHER_RATE", asynParamFloat64, &streamOtherRateIndex_);
+    createParam("STREAM_BYTES_MB", asynParamFloat64, &streamBytesIndex_);
+    createParam("STREAM_HITS", asynParamFloat64, &streamHitsIndex_);
+    createParam("STREAM_TDCS", asynParamFloat64, &streamTdcsIndex_);
+    createParam("STREAM_FRAMING_ERRORS", asynParamFloat64, &streamFramingErrorsIndex_);
+    createParam("STREAM_STALLS", asynParamFloat64, &streamStallsIndex_);
+    createParam("STREAM_FREE_BLOCKS", asynParamInt32, &streamFreeBlocksIndex_);
+    createParam("STREAM_MIN_FREE_BLOCKS", asynParamInt32, &streamMinFreeBlocksIndex_);
+    createParam("PREVIEW_ENABLE", asynParamInt32, &previewEnableIndex_);
+    createParam("PREVIEW_IMAGE", asynParamInt32Array, &previewImageIndex_);
+    createParam("PREVIEW_SIZE_X", asynParamInt32, &previewSizeXIndex_);
+    createParam("PREVIEW_SIZE_Y", asynParamInt32, &previewSizeYIndex_);
+    createParam("PREVIEW_LAYOUT", asynParamInt32, &previewLayoutIndex_);
+    createParam("PREVIEW_CHIP", asynParamInt32, &previewChipIndex_);
+    createParam("PREVIEW_BINNING", asynParamInt32, &previewBinningIndex_);
+    createParam("PREVIEW_DECIMATION", asynParamInt32, &previewDecimationIndex_);
+    createParam("PREVIEW_MODE", asynParamInt32, &previewModeIndex_);
+    createParam("PREVIEW_PERIOD", asynParamFloat64, &previewPeriodIndex_);
+    createParam("PREVIEW_RESET", asynParamInt32, &previewResetIndex_);
+    createParam("PREVIEW_COUNTS", asynParamFloat64, &previewCountsIndex_);
+    createParam("PREVIEW_MAX_COUNT", asynParamInt32, &previewMaxCountIndex_);
+    createParam("HIST_ENABLE", asynParamInt32, &histEnableIndex_);
+    createParam("HIST_TOT", asynParamInt32Array, &histTotIndex_);
+    createParam("HIST_TOT_BIN_WIDTH", asynParamInt32, &histTotBinWidthIndex_);
+    createParam("HIST_TOT_NBINS", asynParamInt32, &histTotNBinsIndex_);
+    createParam("HIST_TOA", asynParamInt32Array, &histToaIndex_);
+    createParam("HIST_TOA_BIN_NS", asynParamFloat64, &histToaBinNsIndex_);
+    createParam("HIST_TOA_OFFSET_NS", asynParamFloat64, &histToaOffsetNsIndex_);
+    createParam("HIST_TOA_BINS", asynParamInt32, &histToaBinsIndex_);
+    createParam("HIST_TDC_EDGE", asynParamInt32, &histTdcEdgeIndex_);
+    createParam("HIST_ROI_X", asynParamInt32, &histRoiXIndex_);
+    createParam("HIST_ROI_Y", asynParamInt32, &histRoiYIndex_);
+    createParam("HIST_ROI_WIDTH", asynParamInt32, &histRoiWidthIndex_);
+    createParam("HIST_ROI_HEIGHT", asynParamInt32, &histRoiHeightIndex_);
+    createParam("HIST_MODE", asynParamInt32, &histModeIndex_);
+    createParam("HIST_PERIOD", asynParamFloat64, &histPeriodIndex_);
+    createParam("HIST_RESET", asynParamInt32, &histResetIndex_);
+    createParam("HIST_TOT_COUNTS", asynParamFloat64, &histTotCountsIndex_);
+    createParam("HIST_TOA_COUNTS", asynParamFloat64, &histToaCountsIndex_);
+    createParam("HIST_TOA_NO_TDC", asynParamFloat64, &histNoTdcIndex_);
+    createParam("CENT_ENABLE", asynParamInt32, &centEnableIndex_);
+    createParam("CENT_TIME_WINDOW_NS", asynParamFloat64, &centTimeWindowIndex_);
+    createParam("CENT_SPACE_WINDOW", asynParamInt32, &centSpaceWindowIndex_);
+    createParam("CENT_EVENT_RATE", asynParamFloat64, &centEventRateIndex_);
+    createParam("CENT_EVENTS", asynParamFloat64, &centEventsIndex_);
+    createParam("CENT_MEAN_SIZE", asynParamFloat64, &centMeanSizeIndex_);
+    createParam("CENT_SIZE_HIST", asynParamInt32Array, &centSizeHistIndex_);
+    createParam("CENT_RESET", asynParamInt32, &centResetIndex_);
+    createParam("CENT_OUTPUT_ENABLE", asynParamInt32, &centOutputEnableIndex_);
+    createParam("CENT_OUTPUT_PORT", asynParamInt32, &centOutputPortIndex_);
+    createParam("CENT_OUTPUT_CONNECTED", asynParamInt32, &centOutputConnectedIndex_);
+    createParam("CENT_OUTPUT_SENT", asynParamFloat64, &centOutputSentIndex_);
+    createParam("CENT_OUTPUT_DROPPED", asynParamFloat64, &centOutputDroppedIndex_);
+    createParam("TRIG_EDGE", asynParamInt32, &trigEdgeIndex_);
+    createParam("TRIG_EXPECTED_PERIOD_US", asynParamFloat64, &trigExpectedPeriodIndex_);
+    createParam("TRIG_TOLERANCE", asynParamFloat64, &trigToleranceIndex_);
+    createParam("TRIG_RATE", asynParamFloat64, &trigRateIndex_);
+    createParam("TRIG_PERIOD_MEAN_US", asynParamFloat64, &trigPeriodMeanIndex_);
+    createParam("TRIG_PERIOD_MIN_US", asynParamFloat64, &trigPeriodMinIndex_);
+    createParam("TRIG_PERIOD_MAX_US", asynParamFloat64, &trigPeriodMaxIndex_);
+    createParam("TRIG_JITTER_NS", asynParamFloat64, &trigJitterIndex_);
+    createParam("TRIG_PULSE_WIDTH_US", asynParamFloat64, &trigPulseWidthIndex_);
+    createParam("TRIG_EDGES", asynParamFloat64, &trigEdgesIndex_);
+    createParam("TRIG_MISSING", asynParamFloat64, &trigMissingIndex_);
+    createParam("TRIG_EXTRA", asynParamFloat64, &trigExtraIndex_);
+    createParam("TRIG_OUT_OF_TOL", asynParamFloat64, &trigOutOfTolIndex_);
+    createParam("TRIG_RESET", asynParamInt32, &trigResetIndex_);
+    createParam("CHIP_HIT_RATE", asynParamInt32Array, &chipHitRateIndex_);
+    createParam("MASK_ACQUIRE", asynParamInt32, &maskAcquireIndex_);
+    createParam("MASK_ACQUIRE_TIME", asynParamFloat64, &maskAcquireTimeIndex_);
+    createParam("MASK_SIGMA", asynParamFloat64, &maskSigmaIndex_);
+    createParam("MASK_NOISY", asynParamInt32Array, &maskNoisyIndex_);
+    createParam("MASK_NOISY_TOTAL", asynParamInt32, &maskNoisyTotalIndex_);
+    createParam("MASK_NOISY_SHARE", asynParamFloat64, &maskNoisyShareIndex_);
+    createParam("MASK_FILE", asynParamOctet, &maskFileIndex_);
+    createParam("MASK_BPC_BASE", asynParamOctet, &maskBpcBaseIndex_);
+    createParam("MASK_EXPORT", asynParamInt32, &maskExportIndex_);
+    createParam("RELAY_ENABLE", asynParamInt32, &relayEnableIndex_);
+    createParam("RELAY_MAX_LAG", asynParamFloat64, &relayMaxLagIndex_);
+    for (int i = 0; i < TPX3_RELAY_SLOTS; i++) {
+        char prefix[16];
+        snprintf(prefix, sizeof(prefix), "RELAY%d", i + 1);
+        std::string p(prefix);
+        createParam((p + "_PORT").c_str(), asynParamInt32, &relayPortIndex_[i]);
+        createParam((p + "_POLICY").c_str(), asynParamInt32, &relayPolicyIndex_[i]);
+        createParam((p + "_CONNECTED").c_str(), asynParamInt32, &relayConnectedIndex_[i]);
+        createParam((p + "_LAG").c_str(), asynParamFloat64, &relayLagIndex_[i]);
+        createParam((p + "_SENT").c_str(), asynParamFloat64, &relaySentIndex_[i]);
+        createParam((p + "_DROPPED").c_str(), asynParamFloat64, &relayDroppedIndex_[i]);
+        createParam((p + "_DISCONNECTS").c_str(), asynParamFloat64, &relayDisconnectsIndex_[i]);
+    }
+    createParam("SPOOL_ENABLE", asynParamInt32, &spoolEnableIndex_);
+    createParam("SPOOL_DIR", asynParamOctet, &spoolDirIndex_);
+    createParam("SPOOL_SEGMENTS", asynParamInt32, &spoolSegmentsIndex_);
+    createParam("SPOOL_SEGMENT_MB", asynParamInt32, &spoolSegmentMBIndex_);
+    createParam("SPOOL_FILL", asynParamFloat64, &spoolFillIndex_);
+    createParam("SPOOL_WRITE_RATE", asynParamFloat64, &spoolWriteRateIndex_);
+    createParam("SPOOL_OLDEST_AGE", asynParamFloat64, &spoolOldestAgeIndex_);
+    createParam("SPOOL_WRITTEN", asynParamFloat64, &spoolWrittenIndex_);
+    createParam("SPOOL_SKIPPED", asynParamFloat64, &spoolSkippedIndex_);
+    createParam("SPOOL_RANGE_FROM", asynParamFloat64, &spoolRangeFromIndex_);
+    createParam("SPOOL_RANGE_TO", asynParamFloat64, &spoolRangeToIndex_);
+    createParam("SPOOL_EXPORT_FILE", asynParamOctet, &spoolExportFileIndex_);
+    createParam("SPOOL_EXPORT", asynParamInt32, &spoolExportIndex_);
+    createParam("SPOOL_EXPORTED", asynParamFloat64, &spoolExportedIndex_);
+    createParam("AUTOTUNE", asynParamInt32, &autotuneIndex_);
+    createParam("AUTOTUNE_STATE", asynParamInt32, &autotuneStateIndex_);
+    createParam("AUTOTUNE_TRIAL", asynParamInt32, &autotuneTrialIndex_);
+    createParam("AUTOTUNE_TRIALS", asynParamInt32, &autotuneTrialsIndex_);
+    createParam("AUTOTUNE_PROGRESS", asynParamFloat64, &autotuneProgressIndex_);
+    createParam("AUTOTUNE_CANDIDATE", asynParamOctet, &autotuneCandidateIndex_);
+    createParam("AUTOTUNE_BEST", asynParamOctet, &autotuneBestIndex_);
+    createParam("AUTOTUNE_BEST_PIXEL_RATE", asynParamFloat64, &autotuneBestPixelRateIndex_);
+    createParam("AUTOTUNE_BEST_DROP_RATE", asynParamFloat64, &autotuneBestDropRateIndex_);
+    createParam("AUTOTUNE_BEST_CPU", asynParamFloat64, &autotuneBestCpuIndex_);
+    createParam("AUTOTUNE_LAST_PIXEL_RATE", asynParamFloat64, &autotuneLastPixelRateIndex_);
+    createParam("AUTOTUNE_LAST_DROP_RATE", asynParamFloat64, &autotuneLastDropRateIndex_);
+    createParam("AUTOTUNE_LAST_CPU", asynParamFloat64, &autotuneLastCpuIndex_);
+    createParam("AUTOTUNE_WARMUP", asynParamFloat64, &autotuneWarmupIndex_);
+    createParam("AUTOTUNE_DURATION", asynParamFloat64, &autotuneDurationIndex_);
+    createParam("AUTOTUNE_PASSES", asynParamInt32, &autotunePassesIndex_);
+    createParam("AUTOTUNE_LOAD_CMD", asynParamOctet, &autotuneLoadCmdIndex_);
+    createParam("AUTOTUNE_PROFILE_DIR", asynParamOctet, &autotuneProfileDirIndex_);
+    createParam("AUTOTUNE_LOAD_PROFILE", asynParamInt32, &autotuneLoadProfileIndex_);
+    // AUTOTUNE_<option>: candidate values for each pipeline option
+    for (int p = 0; p < TPX3_TUNE_PARAMS; p++) {
+        createParam((std::string("AUTOTUNE_") + tpx3Autotuner::paramName(p)).c_str(), asynParamOctet,
+                    &autotuneCandidatesIndex_[p]);
+    }
+    createParam("SWITCHOVER", asynParamInt32, &switchoverIndex_);
+    createParam("SWITCHOVER_STATE", asynParamInt32, &switchoverStateIndex_);
+    createParam("SWITCHOVER_TIME_MS", asynParamFloat64, &switchoverTimeIndex_);
+    createParam("STANDBY_HTTP_PORT", asynParamInt32, &standbyHttpPortIndex_);
+    createParam("STANDBY_PROCESS_ID", asynParamOctet, &standbyProcessIdIndex_);
+    createParam("STANDBY_TO_READY_MS", asynParamFloat64, &standbyToReadyIndex_);
+    createParam("ACTIVE_HTTP_PORT", asynParamInt32, &activeHttpPortIndex_);
+    createParam("APPLY", asynParamInt32, &applyIndex_);
+    createParam("APPLY_MODE", asynParamInt32, &applyModeIndex_);
+    createParam("CONFIG_DIRTY", asynParamInt32, &configDirtyIndex_);
+    createParam("CONFIG_DIFF", asynParamOctet, &configDiffIndex_);
+    createParam("LOG_CAPTURE", asynParamInt32, &logCaptureIndex_);
+    createParam("LOG_TAIL_LINES", asynParamInt32, &logTailLinesIndex_);
+    createParam("LOG_TAIL", asynParamOctet, &logTailIndex_);
+    createParam("LOG_LINES", asynParamFloat64, &logLinesIndex_);
+    createParam("LOG_LINE_RATE", asynParamFloat64, &logLineRateIndex_);
+    // LOG_<kind>_{COUNT,RATE,LAST,PATTERN} for each kind of line counted
+    for (int kind = 0; kind < TPX3_LOG_KINDS; kind++) {
+        std::string prefix = std::string("LOG_") + tpx3ServalLog::kindName(kind);
+        createParam((prefix + "_COUNT").c_str(), asynParamFloat64, &logCountIndex_[kind]);
+        createParam((prefix + "_RATE").c_str(), asynParamFloat64, &logRateIndex_[kind]);
+        createParam((prefix + "_LAST").c_str(), asynParamOctet, &logLastIndex_[kind]);
+        createParam((prefix + "_PATTERN").c_str(), asynParamOctet, &logPatternIndex_[kind]);
+    }
+    createParam("LOG_FILE", asynParamOctet, &logFileIndex_);
+    createParam("LOG_FILE_MAX_MB", asynParamInt32, &logFileMaxIndex_);
+    createParam("LOG_RESET", asynParamInt32, &logResetIndex_);
+    createParam("GC_PAUSES", asynParamFloat64, &gcPausesIndex_);
+    createParam("GC_LAST_PAUSE_MS", asynParamFloat64, &gcLastPauseIndex_);
+    createParam("GC_MAX_PAUSE_MS", asynParamFloat64, &gcMaxPauseIndex_);
+    createParam("GC_PAUSE_PERCENT", asynParamFloat64, &gcPausePercentIndex_);
+    createParam("GC_PAUSE_HIST", asynParamInt32Array, &gcPauseHistIndex_);
+    createParam("GC_HEAP_AFTER_MB", asynParamFloat64, &gcHeapAfterIndex_);
+    createParam("GC_HEAP_SIZE_MB", asynParamFloat64, &gcHeapSizeIndex_);
+    createParam("GC_DROP_OVERLAP", asynParamInt32, &gcDropOverlapIndex_);
+    createParam("GC_DROP_OVERLAPS", asynParamInt32, &gcDropOverlapsIndex_);
+    createParam("GC_RESET", asynParamInt32, &gcResetIndex_);
+    tuneValueIndex_[TPX3_TUNE_UDP_RECEIVERS] = udpReceiversIndex_;
+    tuneEnableIndex_[TPX3_TUNE_UDP_RECEIVERS] = udpReceiversEnableIndex_;
+    tuneValueIndex_[TPX3_TUNE_FRAME_ASSEMBLERS] = frameAssemblersIndex_;
+    tuneEnableIndex_[TPX3_TUNE_FRAME_ASSEMBLERS] = frameAssemblersEnableIndex_;
+    tuneValueIndex_[TPX3_TUNE_RING_BUFFER_SIZE] = ringBufferSizeIndex_;
+    tuneEnableIndex_[TPX3_TUNE_RING_BUFFER_SIZE] = ringBufferSizeEnableIndex_;
+    tuneValueIndex_[TPX3_TUNE_NETWORK_BUFFER_SIZE] = networkBufferSizeIndex_;
+    tuneEnableIndex_[TPX3_TUNE_NETWORK_BUFFER_SIZE] = networkBufferSizeEnableIndex_;
+    tuneValueIndex_[TPX3_TUNE_CORRECTION_HANDLERS] = correctionHandlersIndex_;
+    tuneEnableIndex_[TPX3_TUNE_CORRECTION_HANDLERS] = correctionHandlersEnableIndex_;
+    tuneValueIndex_[TPX3_TUNE_PROCESSING_HANDLERS] = processingHandlersIndex_;
+    tuneEnableIndex_[TPX3_TUNE_PROCESSING_HANDLERS] = processingHandlersEnableIndex_;
 
     // Initialize configuration with default values
     httpLog_ = "";
@@ -113,6 +770,22 @@ tpx3servalDriver::tpx3servalDriver(const char *portName, int maxAddr)
     jarFileName_ = "serval-4.1.1-rc1.jar";
     jarFilePath_ = "../../ASI";
     jarFileEnable_ = true;  // Default: enabled
+    cpuList_ = "";
+    cpuListEnable_ = false;  // Default: disabled (inherit IOC affinity)
+    numaNode_ = 0;
+    numaPolicy_ = NUMA_POLICY_PREFERRED;
+    numaEnable_ = false;  // Default: disabled (inherit IOC memory policy)
+    jvmXms_ = 4096;
+    jvmXmsEnable_ = false;  // Default: disabled (JVM default)
+    jvmXmx_ = 4096;
+    jvmXmxEnable_ = false;  // Default: disabled (JVM default)
+    jvmMaxDirectMemory_ = 2048;
+    jvmMaxDirectMemoryEnable_ = false;  // Default: disabled (JVM default)
+    jvmGc_ = JVM_GC_G1;
+    jvmGcEnable_ = false;  // Default: disabled (JVM default)
+    jvmLargePages_ = false;
+    jvmPreTouch_ = false;
+    jvmGcLog_ = false;  // Default: disabled (no GC log)
 
     // Set initial values
     setIntegerParam(statusIndex_, 0);
@@ -135,8 +808,240 @@ tpx3servalDriver::tpx3servalDriver(const char *portName, int maxAddr)
     setIntegerParam(integrationPoolSizeEnableIndex_, integrationPoolSizeEnable_ ? 1 : 0);
     setIntegerParam(tcpDebugEnableIndex_, tcpDebugEnable_ ? 1 : 0);
     setIntegerParam(jarFileEnableIndex_, jarFileEnable_ ? 1 : 0);
+    setIntegerParam(lifecycleStateIndex_, LIFECYCLE_STOPPED);
+    setDoubleParam(startDurationIndex_, 0.0);
+    setDoubleParam(stopDurationIndex_, 0.0);
+    setDoubleParam(stopTermTimeoutIndex_, stopTermTimeout_);
+    setDoubleParam(stopKillTimeoutIndex_, stopKillTimeout_);
+    setDoubleParam(spawnLatencyIndex_, 0.0);
+    setIntegerParam(cpuListEnableIndex_, cpuListEnable_ ? 1 : 0);
+    setIntegerParam(numaNodeIndex_, numaNode_);
+    setIntegerParam(numaPolicyIndex_, numaPolicy_);
+    setIntegerParam(numaEnableIndex_, numaEnable_ ? 1 : 0);
+    setStringParam(cpuAffinityRbvIndex_, "");
+    setIntegerParam(jvmXmsIndex_, jvmXms_);
+    setIntegerParam(jvmXmsEnableIndex_, jvmXmsEnable_ ? 1 : 0);
+    setIntegerParam(jvmXmxIndex_, jvmXmx_);
+    setIntegerParam(jvmXmxEnableIndex_, jvmXmxEnable_ ? 1 : 0);
+    setIntegerParam(jvmMaxDirectMemoryIndex_, jvmMaxDirectMemory_);
+    setIntegerParam(jvmMaxDirectMemoryEnableIndex_, jvmMaxDirectMemoryEnable_ ? 1 : 0);
+    setIntegerParam(jvmGcIndex_, jvmGc_);
+    setIntegerParam(jvmGcEnableIndex_, jvmGcEnable_ ? 1 : 0);
+    setIntegerParam(jvmLargePagesIndex_, jvmLargePages_ ? 1 : 0);
+    setIntegerParam(jvmPreTouchIndex_, jvmPreTouch_ ? 1 : 0);
+    setIntegerParam(jvmGcLogIndex_, jvmGcLog_ ? 1 : 0);
+    setDoubleParam(telemetryPeriodIndex_, telemetryPeriod_);
+    for (int stage = 0; stage < TPX3_STAGE_OTHER; stage++) {
+        setStringParam(stagePatternIndex_[stage], tpx3ProcStats::defaultStagePatterns(stage));
+    }
+    setIntegerParam(udpLossIndex_, 0);
+    setIntegerParam(udpLossResetIndex_, 0);
+    setDoubleParam(httpPollPeriodIndex_, httpPollPeriod_);
+    setDoubleParam(httpLatencyIndex_, 0.0);
+    setIntegerParam(httpLatencyHistResetIndex_, 0);
+    setIntegerParam(httpRequestsIndex_, 0);
+    setIntegerParam(httpErrorsIndex_, 0);
+    setIntegerParam(httpConnectsIndex_, 0);
+    setIntegerParam(readyIndex_, 0);
+    setDoubleParam(startToListenIndex_, 0.0);
+    setDoubleParam(startToReadyIndex_, 0.0);
+    setDoubleParam(readyTimeoutIndex_, readyTimeout_);
+    setIntegerParam(streamEnableIndex_, 0);
+    setIntegerParam(streamSourceIndex_, streamSource_);
+    setIntegerParam(streamPortIndex_, streamPort_);
+    setStringParam(streamFileIndex_, "");
+    setIntegerParam(streamReplayLoopIndex_, streamReplayLoop_ ? 1 : 0);
+    setDoubleParam(streamReplayRateIndex_, streamReplayRate_);
+    setIntegerParam(streamWorkersIndex_, streamWorkers_);
+    setDoubleParam(streamPublishPeriodIndex_, streamPublishPeriod_);
+    setIntegerParam(streamRunningIndex_, 0);
+    setIntegerParam(streamConnectedIndex_, 0);
+    setIntegerParam(streamSourceDoneIndex_, 0);
+    setDoubleParam(streamRateIndex_, 0.0);
+    setDoubleParam(streamChunkRateIndex_, 0.0);
+    setDoubleParam(streamHitRateIndex_, 0.0);
+    setDoubleParam(streamTdcRateIndex_, 0.0);
+    setDoubleParam(streamGlobalTimeRateIndex_, 0.0);
+    setDoubleParam(streamControlRateIndex_, 0.0);
+    setDoubleParam(streamOtherRateIndex_, 0.0);
+    setDoubleParam(streamBytesIndex_, 0.0);
+    setDoubleParam(streamHitsIndex_, 0.0);
+    setDoubleParam(streamTdcsIndex_, 0.0);
+    setDoubleParam(streamFramingErrorsIndex_, 0.0);
+    setDoubleParam(streamStallsIndex_, 0.0);
+    setIntegerParam(streamFreeBlocksIndex_, TPX3_STREAM_NUM_BLOCKS);
+    setIntegerParam(streamMinFreeBlocksIndex_, TPX3_STREAM_NUM_BLOCKS);
+    setIntegerParam(previewEnableIndex_, previewEnabled_ ? 1 : 0);
+    setIntegerParam(previewSizeXIndex_, TPX3_PREVIEW_QUAD_PIXELS);
+    setIntegerParam(previewSizeYIndex_, TPX3_PREVIEW_QUAD_PIXELS);
+    setIntegerParam(previewLayoutIndex_, previewLayout_);
+    setIntegerParam(previewChipIndex_, previewChip_);
+    setIntegerParam(previewBinningIndex_, previewBinning_);
+    setIntegerParam(previewDecimationIndex_, 1);
+    setIntegerParam(previewModeIndex_, previewMode_);
+    setDoubleParam(previewPeriodIndex_, previewPeriod_);
+    setIntegerParam(previewResetIndex_, 0);
+    setDoubleParam(previewCountsIndex_, 0.0);
+    setIntegerParam(previewMaxCountIndex_, 0);
+    for (int i = 0; i < PREVIEW_NUM_BUFFERS; i++) {
+        previewImages_[i].assign(TPX3_PREVIEW_MAX_ELEMENTS, 0);
+    }
+    stream_.addConsumer(&preview_);
+    tpx3HistDefaults(&histConfig_);
+    histogram_.setConfig(histConfig_);
+    setIntegerParam(histEnableIndex_, histEnabled_ ? 1 : 0);
+    setIntegerParam(histTotBinWidthIndex_, histConfig_.totBinWidth);
+    setIntegerParam(histTotNBinsIndex_, tpx3HistTotBins(histConfig_));
+    setDoubleParam(histToaBinNsIndex_, histConfig_.toaBinNs);
+    setDoubleParam(histToaOffsetNsIndex_, histConfig_.toaOffsetNs);
+    setIntegerParam(histToaBinsIndex_, histConfig_.toaBins);
+    setIntegerParam(histTdcEdgeIndex_, histConfig_.tdcEdge);
+    setIntegerParam(histRoiXIndex_, histConfig_.roiX);
+    setIntegerParam(histRoiYIndex_, histConfig_.roiY);
+    setIntegerParam(histRoiWidthIndex_, histConfig_.roiWidth);
+    setIntegerParam(histRoiHeightIndex_, histConfig_.roiHeight);
+    setIntegerParam(histModeIndex_, histMode_);
+    setDoubleParam(histPeriodIndex_, histPeriod_);
+    setIntegerParam(histResetIndex_, 0);
+    setDoubleParam(histTotCountsIndex_, 0.0);
+    setDoubleParam(histToaCountsIndex_, 0.0);
+    setDoubleParam(histNoTdcIndex_, 0.0);
+    stream_.addConsumer(&histogram_);
+    // Centroiding costs a few times more CPU per hit than the other consumers, so it starts off
+    tpx3CentroidDefaults(&centConfig_);
+    centroid_.setConfig(centConfig_);
+    centroid_.setEnabled(centEnabled_);
+    memset(&prevCentStats_, 0, sizeof(prevCentStats_));
+    setIntegerParam(centEnableIndex_, centEnabled_ ? 1 : 0);
+    setDoubleParam(centTimeWindowIndex_, centConfig_.timeWindowNs);
+    setIntegerParam(centSpaceWindowIndex_, centConfig_.spaceWindow);
+    setDoubleParam(centEventRateIndex_, 0.0);
+    setDoubleParam(centEventsIndex_, 0.0);
+    setDoubleParam(centMeanSizeIndex_, 0.0);
+    setIntegerParam(centResetIndex_, 0);
+    setIntegerParam(centOutputEnableIndex_, 0);
+    setIntegerParam(centOutputPortIndex_, centOutputPort_);
+    setIntegerParam(centOutputConnectedIndex_, 0);
+    setDoubleParam(centOutputSentIndex_, 0.0);
+    setDoubleParam(centOutputDroppedIndex_, 0.0);
+    stream_.addConsumer(&centroid_);
+    tpx3TriggerDefaults(&trigConfig_);
+    trigger_.setConfig(trigConfig_);
+    setIntegerParam(trigEdgeIndex_, trigConfig_.edge);
+    setDoubleParam(trigExpectedPeriodIndex_, trigConfig_.expectedPeriodNs / 1e3);
+    setDoubleParam(trigToleranceIndex_, trigConfig_.tolerance * 100.0);
+    setDoubleParam(trigRateIndex_, 0.0);
+    setDoubleParam(trigPeriodMeanIndex_, 0.0);
+    setDoubleParam(trigPeriodMinIndex_, 0.0);
+    setDoubleParam(trigPeriodMaxIndex_, 0.0);
+    setDoubleParam(trigJitterIndex_, 0.0);
+    setDoubleParam(trigPulseWidthIndex_, 0.0);
+    setDoubleParam(trigEdgesIndex_, 0.0);
+    setDoubleParam(trigMissingIndex_, 0.0);
+    setDoubleParam(trigExtraIndex_, 0.0);
+    setDoubleParam(trigOutOfTolIndex_, 0.0);
+    setIntegerParam(trigResetIndex_, 0);
+    stream_.addConsumer(&trigger_);
+    memset(prevChipHits_, 0, sizeof(prevChipHits_));
+    setIntegerParam(maskAcquireIndex_, 0);
+    setDoubleParam(maskAcquireTimeIndex_, maskAcquireTime_);
+    setDoubleParam(maskSigmaIndex_, maskSigma_);
+    setIntegerParam(maskNoisyTotalIndex_, 0);
+    setDoubleParam(maskNoisyShareIndex_, 0.0);
+    setStringParam(maskFileIndex_, "");
+    setStringParam(maskBpcBaseIndex_, "");
+    setIntegerParam(maskExportIndex_, 0);
+    stream_.addConsumer(&mask_);
+    // Slots start with no port; RELAY_ENABLE listens on the ones given one
+    relay_.setMaxLag((uint64_t)(relayMaxLag_ * 1e6));
+    setIntegerParam(relayEnableIndex_, 0);
+    setDoubleParam(relayMaxLagIndex_, relayMaxLag_);
+    for (int i = 0; i < TPX3_RELAY_SLOTS; i++) {
+        relayPorts_[i] = 0;
+        setIntegerParam(relayPortIndex_[i], 0);
+        setIntegerParam(relayPolicyIndex_[i], TPX3_RELAY_BLOCK);
+    }
+    publishRelay();
+    stream_.addTap(&relay_);
+    setIntegerParam(spoolEnableIndex_, 0);
+    setStringParam(spoolDirIndex_, "");
+    setIntegerParam(spoolSegmentsIndex_, spoolSegments_);
+    setIntegerParam(spoolSegmentMBIndex_, spoolSegmentMB_);
+    setDoubleParam(spoolFillIndex_, 0.0);
+    setDoubleParam(spoolWriteRateIndex_, 0.0);
+    setDoubleParam(spoolOldestAgeIndex_, 0.0);
+    setDoubleParam(spoolWrittenIndex_, 0.0);
+    setDoubleParam(spoolSkippedIndex_, 0.0);
+    setDoubleParam(spoolRangeFromIndex_, spoolRangeFrom_);
+    setDoubleParam(spoolRangeToIndex_, spoolRangeTo_);
+    setStringParam(spoolExportFileIndex_, "");
+    setIntegerParam(spoolExportIndex_, 0);
+    setDoubleParam(spoolExportedIndex_, 0.0);
+    stream_.addTap(&spool_);
+    // Thread counts are searched by default; buffer sizes only once given
+    // candidates in the units of the Serval version in use
+    tuneCandidates_[TPX3_TUNE_UDP_RECEIVERS] = "0,1,2,4";
+    tuneCandidates_[TPX3_TUNE_FRAME_ASSEMBLERS] = "0,1,2,4";
+    tuneCandidates_[TPX3_TUNE_CORRECTION_HANDLERS] = "0,1,2,4";
+    tuneCandidates_[TPX3_TUNE_PROCESSING_HANDLERS] = "0,1,2,4";
+    for (int p = 0; p < TPX3_TUNE_PARAMS; p++) {
+        setStringParam(autotuneCandidatesIndex_[p], tuneCandidates_[p].c_str());
+    }
+    setIntegerParam(autotuneIndex_, 0);
+    setDoubleParam(autotuneWarmupIndex_, tuneWarmup_);
+    setDoubleParam(autotuneDurationIndex_, tuneDuration_);
+    setIntegerParam(autotunePassesIndex_, tunePasses_);
+    setStringParam(autotuneLoadCmdIndex_, "");
+    setStringParam(autotuneProfileDirIndex_, "");
+    setIntegerParam(autotuneLoadProfileIndex_, 0);
+    setStringParam(autotuneCandidateIndex_, "");
+    setStringParam(autotuneBestIndex_, "");
+    setDoubleParam(autotuneBestPixelRateIndex_, 0.0);
+    setDoubleParam(autotuneBestDropRateIndex_, 0.0);
+    setDoubleParam(autotuneBestCpuIndex_, 0.0);
+    setDoubleParam(autotuneLastPixelRateIndex_, 0.0);
+    setDoubleParam(autotuneLastDropRateIndex_, 0.0);
+    setDoubleParam(autotuneLastCpuIndex_, 0.0);
+    publishAutotune();
+    setIntegerParam(switchoverIndex_, 0);
+    setIntegerParam(switchoverStateIndex_, switchState_);
+    setDoubleParam(switchoverTimeIndex_, 0.0);
+    setIntegerParam(standbyHttpPortIndex_, standbyHttpPort_);
+    setStringParam(standbyProcessIdIndex_, "0");
+    setDoubleParam(standbyToReadyIndex_, 0.0);
+    clearTelemetry();
+    clearServalStatus();
+    setStringParam(numaPolicyRbvIndex_, "");
     setStringParam(processIdIndex_, "0");
+    setIntegerParam(activeHttpPortIndex_, 0);
     setStringParam(commandLineIndex_, "");
+    setIntegerParam(applyIndex_, 0);
+    setIntegerParam(applyModeIndex_, applyMode_);
+    setIntegerParam(configDirtyIndex_, 0);
+    setStringParam(configDiffIndex_, "");
+    setIntegerParam(logCaptureIndex_, logCapture_ ? 1 : 0);
+    setIntegerParam(logTailLinesIndex_, logTailLines_);
+    setStringParam(logTailIndex_, "");
+    setDoubleParam(logLinesIndex_, 0.0);
+    setDoubleParam(logLineRateIndex_, 0.0);
+    for (int kind = 0; kind < TPX3_LOG_KINDS; kind++) {
+        setDoubleParam(logCountIndex_[kind], 0.0);
+        setDoubleParam(logRateIndex_[kind], 0.0);
+        setStringParam(logLastIndex_[kind], "");
+        setStringParam(logPatternIndex_[kind], tpx3ServalLog::defaultPatterns(kind));
+    }
+    setStringParam(logFileIndex_, "");
+    setIntegerParam(logFileMaxIndex_, logFileMaxMB_);
+    setIntegerParam(logResetIndex_, 0);
+    setDoubleParam(gcPausesIndex_, 0.0);
+    setDoubleParam(gcLastPauseIndex_, 0.0);
+    setDoubleParam(gcMaxPauseIndex_, 0.0);
+    setDoubleParam(gcPausePercentIndex_, 0.0);
+    setDoubleParam(gcHeapAfterIndex_, 0.0);
+    setDoubleParam(gcHeapSizeIndex_, 0.0);
+    setIntegerParam(gcDropOverlapIndex_, 0);
+    setIntegerParam(gcDropOverlapsIndex_, 0);
+    setIntegerParam(gcResetIndex_, 0);
     setStringParam(errorMsgIndex_, "IOC initialized successfully");
     setStringParam(jarFileNameIndex_, jarFileName_.c_str());
     setStringParam(jarFilePathIndex_, jarFilePath_.c_str());
@@ -153,6 +1058,15 @@ tpx3servalDriver::tpx3servalDriver(const char *portName, int maxAddr)
         printf("%s:%s: Failed to create monitor thread\n", driverName, __FUNCTION__);
     }
 
+    // Start Serval REST API polling thread
+    httpThreadId_ = epicsThreadCreate("tpx3servalHttp",
+                                      epicsThreadPriorityLow,
+                                      epicsThreadGetStackSize(epicsThreadStackMedium),
+                                      httpThreadC, this);
+    if (!httpThreadId_) {
+        printf("%s:%s: Failed to create HTTP polling thread\n", driverName, __FUNCTION__);
+    }
+
     callParamCallbacks();
 }
 
@@ -161,23 +1075,26 @@ tpx3servalDriver::~tpx3servalDriver()
 {
     printf("%s:%s: Destructor called, cleaning up...\n", driverName, __FUNCTION__);
     
-    // Signal monitor thread to stop first
+    // Signal monitor thread to stop first, and wait for the handler it may be in
     if (monitorThreadId_) {
         epicsEventSignal(stopEvent_);
-        
-        // Wait for monitor thread with timeout to avoid hanging
-        epicsThreadId threadId = monitorThreadId_;
-        monitorThreadId_ = 0;  // Clear the ID first
-        
-        // Try to join with timeout
-        if (epicsThreadIsSuspended(threadId)) {
-            epicsThreadResume(threadId);
+        wakeMonitor();
+        if (epicsEventWaitWithTimeout(monitorDoneEvent_, MONITOR_EXIT_TIMEOUT) != epicsEventWaitOK) {
+            printf("%s:%s: Monitor thread did not exit\n", driverName, __FUNCTION__);
+        } else {
+            printf("%s:%s: Monitor thread cleanup completed\n", driverName, __FUNCTION__);
         }
-        
-        // Use a non-blocking approach
-        epicsThreadSleep(0.1);  // Give thread time to exit
-        
-        printf("%s:%s: Monitor thread cleanup completed\n", driverName, __FUNCTION__);
+        monitorThreadId_ = 0;
+    }
+
+    // The HTTP thread may be inside a request; wait for it up to the request timeout
+    if (httpThreadId_) {
+        httpExit_ = true;
+        epicsEventSignal(httpEvent_);
+        if (epicsEventWaitWithTimeout(httpDoneEvent_, HTTP_TIMEOUT * 2 + 1.0) != epicsEventWaitOK) {
+            printf("%s:%s: HTTP polling thread did not exit\n", driverName, __FUNCTION__);
+        }
+        httpThreadId_ = 0;
     }
     
     // Force kill any running processes after thread cleanup
@@ -185,10 +1102,53 @@ tpx3servalDriver::~tpx3servalDriver()
         forceKillAllProcesses();
     }
     
+    stream_.stop();
+    // The taps are destroyed before stream_, whose destructor must not reach them
+    stream_.clearTaps();
+    relay_.stop();
+    spool_.stop();
+    stopAutotuneLoad();
+
     // Destroy resources in reverse order of creation
+    unwatchChild();
+    unwatchPid(&standbyPidFd_);
+    unwatchPid(&retiringPidFd_);
+    if (timerFd_ >= 0) {
+        close(timerFd_);
+    }
+    if (telemetryFd_ >= 0) {
+        close(telemetryFd_);
+    }
+    if (streamTimerFd_ >= 0) {
+        close(streamTimerFd_);
+    }
+    if (tuneTimerFd_ >= 0) {
+        close(tuneTimerFd_);
+    }
+    if (switchTimerFd_ >= 0) {
+        close(switchTimerFd_);
+    }
+    if (sigchldWatched_) {
+        watchSigchld(wakeFd_, false);
+    }
+    if (wakeFd_ >= 0) {
+        close(wakeFd_);
+    }
+    if (epollFd_ >= 0) {
+        close(epollFd_);
+    }
     if (stopEvent_) {
         epicsEventDestroy(stopEvent_);
     }
+    if (monitorDoneEvent_) {
+        epicsEventDestroy(monitorDoneEvent_);
+    }
+    if (httpEvent_) {
+        epicsEventDestroy(httpEvent_);
+    }
+    if (httpDoneEvent_) {
+        epicsEventDestroy(httpDoneEvent_);
+    }
     if (mutex_) {
         epicsMutexDestroy(mutex_);
     }
@@ -204,29 +1164,44 @@ asynStatus tpx3servalDriver::writeInt32(asynUser *pasynUser, epicsInt32 value)
 
     status = setIntegerParam(function, value);
 
-    if (function == startIndex_) {
-        if (value == 1 && !isRunning_) {
-            // Start the process if not already running
+    if (tuneState_ != AUTOTUNE_IDLE && (function == startIndex_ || tuneParam(function) >= 0)) {
+        // The autotuner owns the process and the pipeline options until it is done
+        int p = tuneParam(function);
+        if (function == startIndex_) {
+            setIntegerParam(startIndex_, lifecycleState_ == LIFECYCLE_STARTING || lifecycleState_ == LIFECYCLE_READY);
+        } else if (function == tuneValueIndex_[p]) {
+            setIntegerParam(function, *tuneValue(p));
+        } else {
+            setIntegerParam(function, *tuneEnable(p) ? 1 : 0);
+        }
+        setStringParam(errorMsgIndex_, "Autotune running - set AUTOTUNE to 0 to abort it first");
+        status = asynError;
+    } else if (function == startIndex_) {
+        // START only kicks off a transition; the monitor thread completes it
+        if (value == 1 && lifecycleState_ == LIFECYCLE_STOPPED) {
+            // startProcess reports the specific failure in ERROR_MSG
             status = startProcess();
-            if (status == asynSuccess) {
-                isRunning_ = true;
-                setIntegerParam(startIndex_, 1);
-            } else {
-                setStringParam(errorMsgIndex_, "Failed to start process - check configuration");
+            if (status != asynSuccess) {
+                setIntegerParam(startIndex_, 0);
             }
-        } else if (value == 0 && isRunning_) {
-            // Stop the process if currently running
+        } else if (value == 0 && (lifecycleState_ == LIFECYCLE_STARTING || lifecycleState_ == LIFECYCLE_READY)) {
+            applyRestart_ = false;
             status = stopProcess();
-            if (status == asynSuccess) {
-                isRunning_ = false;
-                setIntegerParam(startIndex_, 0);
-            } else {
+            if (status != asynSuccess) {
                 setStringParam(errorMsgIndex_, "Failed to stop process");
             }
-        } else if (value == 1 && isRunning_) {
+        } else if (value == 1 && lifecycleState_ == LIFECYCLE_STOPPING) {
+            // Cannot restart until the old process is gone
+            setIntegerParam(startIndex_, 0);
+            setStringParam(errorMsgIndex_, "Stop in progress - start request ignored");
+        } else if (value == 1) {
             // Already running, ignore start request
             setStringParam(errorMsgIndex_, "Process already running - start request ignored");
-        } else if (value == 0 && !isRunning_) {
+        } else if (lifecycleState_ == LIFECYCLE_STOPPING) {
+            // An APPLY restart becomes a plain stop
+            applyRestart_ = false;
+            setStringParam(errorMsgIndex_, "Stop already in progress");
+        } else {
             // Already stopped, ignore stop request
             setStringParam(errorMsgIndex_, "Process already stopped - stop request ignored");
         }
@@ -329,8 +1304,667 @@ asynStatus tpx3servalDriver::writeInt32(asynUser *pasynUser, epicsInt32 value)
     } else if (function == jarFileEnableIndex_) {
         jarFileEnable_ = (value != 0);
         setStringParam(errorMsgIndex_, value ? "JAR file enabled" : "JAR file disabled");
+    } else if (function == cpuListEnableIndex_) {
+        cpuListEnable_ = (value != 0);
+        setStringParam(errorMsgIndex_, value ? "CPU affinity enabled" : "CPU affinity disabled");
+    } else if (function == numaNodeIndex_) {
+        numaNode_ = value;
+        setStringParam(errorMsgIndex_, "NUMA node updated successfully");
+    } else if (function == numaPolicyIndex_) {
+        numaPolicy_ = value;
+        setStringParam(errorMsgIndex_, "NUMA policy updated successfully");
+    } else if (function == numaEnableIndex_) {
+        numaEnable_ = (value != 0);
+        setStringParam(errorMsgIndex_, value ? "NUMA memory policy enabled" : "NUMA memory policy disabled");
+    } else if (function == jvmXmsIndex_) {
+        jvmXms_ = value;
+        setStringParam(errorMsgIndex_, "JVM initial heap updated successfully");
+    } else if (function == jvmXmsEnableIndex_) {
+        jvmXmsEnable_ = (value != 0);
+        setStringParam(errorMsgIndex_, value ? "JVM initial heap enabled" : "JVM initial heap disabled");
+    } else if (function == jvmXmxIndex_) {
+        jvmXmx_ = value;
+        setStringParam(errorMsgIndex_, "JVM maximum heap updated successfully");
+    } else if (function == jvmXmxEnableIndex_) {
+        jvmXmxEnable_ = (value != 0);
+        setStringParam(errorMsgIndex_, value ? "JVM maximum heap enabled" : "JVM maximum heap disabled");
+    } else if (function == jvmMaxDirectMemoryIndex_) {
+        jvmMaxDirectMemory_ = value;
+        setStringParam(errorMsgIndex_, "JVM direct memory updated successfully");
+    } else if (function == jvmMaxDirectMemoryEnableIndex_) {
+        jvmMaxDirectMemoryEnable_ = (value != 0);
+        setStringParam(errorMsgIndex_, value ? "JVM direct memory enabled" : "JVM direct memory disabled");
+    } else if (function == jvmGcIndex_) {
+        jvmGc_ = value;
+        setStringParam(errorMsgIndex_, "JVM garbage collector updated successfully");
+    } else if (function == jvmGcEnableIndex_) {
+        jvmGcEnable_ = (value != 0);
+        setStringParam(errorMsgIndex_, value ? "JVM garbage collector enabled" : "JVM garbage collector disabled");
+    } else if (function == jvmLargePagesIndex_) {
+        jvmLargePages_ = (value != 0);
+        setStringParam(errorMsgIndex_, value ? "JVM large pages enabled" : "JVM large pages disabled");
+    } else if (function == jvmPreTouchIndex_) {
+        jvmPreTouch_ = (value != 0);
+        setStringParam(errorMsgIndex_, value ? "JVM heap pre-touch enabled" : "JVM heap pre-touch disabled");
+    } else if (function == jvmGcLogIndex_) {
+        jvmGcLog_ = (value != 0);
+        setStringParam(errorMsgIndex_, value ? "JVM GC log enabled" : "JVM GC log disabled");
+    } else if (function == gcResetIndex_) {
+        if (value) {
+            gcLog_.reset();
+            gcDropOverlaps_ = 0;
+            std::fill(gcPauseHist_.begin(), gcPauseHist_.end(), 0);
+            doCallbacksInt32Array(&gcPauseHist_[0], gcPauseHist_.size(), gcPauseHistIndex_, 0);
+            setIntegerParam(gcDropOverlapIndex_, 0);
+            setIntegerParam(gcDropOverlapsIndex_, 0);
+            setIntegerParam(gcResetIndex_, 0);
+            publishGc(NULL);
+            setStringParam(errorMsgIndex_, "GC pause statistics reset");
+        }
+    } else if (function == udpLossResetIndex_) {
+        if (value) {
+            setIntegerParam(udpLossIndex_, 0);
+            setIntegerParam(udpLossResetIndex_, 0);
+            setStringParam(errorMsgIndex_, "UDP loss alarm reset");
+        }
+    } else if (function == logCaptureIndex_) {
+        logCapture_ = (value != 0);
+        setStringParam(errorMsgIndex_, value ? "Serval output capture enabled, takes effect on the next START"
+                                             : "Serval output capture disabled, takes effect on the next START");
+    } else if (function == logTailLinesIndex_) {
+        if (value < 1 || value > TPX3_LOG_RING_LINES) {
+            setStringParam(errorMsgIndex_, "Log tail lines must be 1-1000");
+            status = asynError;
+        } else {
+            logTailLines_ = value;
+            setStringParam(logTailIndex_, servalLog_.tail(logTailLines_, LOG_TAIL_CHARS).c_str());
+            setStringParam(errorMsgIndex_, "Log tail lines updated successfully");
+        }
+    } else if (function == logFileMaxIndex_) {
+        std::string error;
+        if (value < 0) {
+            setStringParam(errorMsgIndex_, "Log file size limit must be >= 0");
+            status = asynError;
+        } else if (!servalLog_.setFile(logFile_, (size_t)value * 1024 * 1024, &error)) {
+            logFileMaxMB_ = value;
+            logFile_.clear();
+            setStringParam(logFileIndex_, "");
+            setStringParam(errorMsgIndex_, error.c_str());
+            status = asynError;
+        } else {
+            logFileMaxMB_ = value;
+            setStringParam(errorMsgIndex_, "Log file size limit updated successfully");
+        }
+    } else if (function == logResetIndex_) {
+        if (value) {
+            servalLog_.resetCounts();
+            servalLog_.clearLines();
+            logFileError_.clear();
+            setIntegerParam(logResetIndex_, 0);
+            publishLog();
+            setStringParam(errorMsgIndex_, "Serval log counters and lines cleared");
+        }
+    } else if (function == streamEnableIndex_) {
+        if (value && !stream_.running()) {
+            status = startStream();
+        } else if (!value && stream_.running()) {
+            stopStream();
+        }
+    } else if (function == previewEnableIndex_) {
+        previewEnabled_ = (value != 0);
+        preview_.setEnabled(previewEnabled_);
+        setStringParam(errorMsgIndex_, value ? "Preview enabled" : "Preview disabled");
+    } else if (function == previewLayoutIndex_) {
+        if (value != TPX3_PREVIEW_LAYOUT_QUAD && value != TPX3_PREVIEW_LAYOUT_CHIP) {
+            setStringParam(errorMsgIndex_, "Invalid preview layout");
+            status = asynError;
+        } else {
+            previewLayout_ = value;
+            setStringParam(errorMsgIndex_, "Preview layout updated successfully");
+        }
+    } else if (function == previewChipIndex_) {
+        if (value < 0 || value >= TPX3_PREVIEW_CHIPS) {
+            setStringParam(errorMsgIndex_, "Preview chip must be 0-3");
+            status = asynError;
+        } else {
+            previewChip_ = value;
+            setStringParam(errorMsgIndex_, "Preview chip updated successfully");
+        }
+    } else if (function == previewBinningIndex_) {
+        if (value != 1 && value != 2 && value != 4 && value != 8) {
+            setStringParam(errorMsgIndex_, "Preview binning must be 1, 2, 4 or 8");
+            status = asynError;
+        } else {
+            previewBinning_ = value;
+            setStringParam(errorMsgIndex_, "Preview binning updated successfully");
+        }
+    } else if (function == previewDecimationIndex_) {
+        if (value < 1) {
+            setStringParam(errorMsgIndex_, "Preview decimation must be at least 1");
+            status = asynError;
+        } else {
+            preview_.setDecimation(value);
+            setStringParam(errorMsgIndex_, "Preview decimation updated successfully");
+        }
+    } else if (function == previewModeIndex_) {
+        if (value != PREVIEW_MODE_ACCUMULATE && value != PREVIEW_MODE_LIVE) {
+            setStringParam(errorMsgIndex_, "Invalid preview mode");
+            status = asynError;
+        } else {
+            previewMode_ = value;
+            setStringParam(errorMsgIndex_, "Preview mode updated successfully");
+        }
+    } else if (function == previewResetIndex_) {
+        if (value) {
+            preview_.reset();
+            setIntegerParam(previewResetIndex_, 0);
+            setStringParam(errorMsgIndex_, "Preview reset");
+        }
+    } else if (function == histEnableIndex_) {
+        histEnabled_ = (value != 0);
+        histogram_.setEnabled(histEnabled_);
+        setStringParam(errorMsgIndex_, value ? "Histograms enabled" : "Histograms disabled");
+    } else if (function == histTotBinWidthIndex_ || function == histToaBinsIndex_ ||
+               function == histTdcEdgeIndex_ || function == histRoiXIndex_ || function == histRoiYIndex_ ||
+               function == histRoiWidthIndex_ || function == histRoiHeightIndex_) {
+        tpx3HistConfig config = histConfig_;
+        if (function == histTotBinWidthIndex_) {
+            config.totBinWidth = value;
+        } else if (function == histToaBinsIndex_) {
+            config.toaBins = value;
+        } else if (function == histTdcEdgeIndex_) {
+            config.tdcEdge = value;
+        } else if (function == histRoiXIndex_) {
+            config.roiX = value;
+        } else if (function == histRoiYIndex_) {
+            config.roiY = value;
+        } else if (function == histRoiWidthIndex_) {
+            config.roiWidth = value;
+        } else {
+            config.roiHeight = value;
+        }
+        status = setHistConfig(config);
+    } else if (function == histModeIndex_) {
+        if (value != HIST_MODE_ACCUMULATE && value != HIST_MODE_LIVE) {
+            setStringParam(errorMsgIndex_, "Invalid histogram mode");
+            status = asynError;
+        } else {
+            histMode_ = value;
+            setStringParam(errorMsgIndex_, "Histogram mode updated successfully");
+        }
+    } else if (function == histResetIndex_) {
+        if (value) {
+            histogram_.reset();
+            setIntegerParam(histResetIndex_, 0);
+            setStringParam(errorMsgIndex_, "Histograms reset");
+        }
+    } else if (function == trigEdgeIndex_) {
+        if (value != TPX3_TDC1_RISE && value != TPX3_TDC1_FALL &&
+            value != TPX3_TDC2_RISE && value != TPX3_TDC2_FALL) {
+            setStringParam(errorMsgIndex_, "Invalid trigger TDC edge");
+            status = asynError;
+        } else {
+            trigConfig_.edge = value;
+            trigger_.setConfig(trigConfig_);
+            setStringParam(errorMsgIndex_, "Trigger edge updated successfully");
+        }
+    } else if (function == trigResetIndex_) {
+        if (value) {
+            trigger_.reset();
+            setIntegerParam(trigResetIndex_, 0);
+            setStringParam(errorMsgIndex_, "Trigger counters reset");
+        }
+    } else if (function == maskAcquireIndex_) {
+        if (value && maskAcquiring_) {
+            setStringParam(errorMsgIndex_, "Noisy-pixel acquisition already running");
+        } else if (value && !stream_.running()) {
+            setStringParam(errorMsgIndex_, "Noisy-pixel acquisition needs a running stream (STREAM_ENABLE)");
+            setIntegerParam(maskAcquireIndex_, 0);
+            status = asynError;
+        } else if (value) {
+            mask_.startAcquisition();
+            maskAcquiring_ = true;
+            maskStart_ = monotonicSeconds();
+            char msg[MAX_ERROR_LENGTH];
+            snprintf(msg, sizeof(msg), "Noisy-pixel acquisition started for %.1f s", maskAcquireTime_);
+            setStringParam(errorMsgIndex_, msg);
+        } else if (maskAcquiring_) {
+            mask_.abortAcquisition();
+            maskAcquiring_ = false;
+            setStringParam(errorMsgIndex_, "Noisy-pixel acquisition aborted");
+        }
+    } else if (function == maskExportIndex_) {
+        if (value) {
+            std::string error;
+            setIntegerParam(maskExportIndex_, 0);
+            if (!mask_.exportMask(maskFile_, maskBpcBase_, &error)) {
+                setError(error.c_str());
+                status = asynError;
+            } else {
+                char msg[MAX_ERROR_LENGTH];
+                snprintf(msg, sizeof(msg), "Pixel mask written to %s", maskFile_.c_str());
+                setStringParam(errorMsgIndex_, msg);
+            }
+        }
+    } else if (function == relayEnableIndex_) {
+        if (value) {
+            relay_.stop();
+            status = startRelay();
+        } else {
+            relay_.stop();
+            setStringParam(errorMsgIndex_, "Stream relay stopped");
+        }
+        publishRelay();
+    } else if (relaySlot(relayPortIndex_, function) >= 0) {
+        int slot = relaySlot(relayPortIndex_, function);
+        if (value < 0 || value > 65535) {
+            setStringParam(errorMsgIndex_, "Relay port must be 0-65535 (0 leaves the slot unused)");
+            status = asynError;
+        } else {
+            relayPorts_[slot] = value;
+            int relayEnabled = 0;
+            getIntegerParam(relayEnableIndex_, &relayEnabled);
+            if (relayEnabled) {
+                // Listen on the new set of ports; subscribers of every slot reconnect
+                relay_.stop();
+                status = startRelay();
+                publishRelay();
+            } else {
+                setStringParam(errorMsgIndex_, "Relay port updated successfully");
+            }
+        }
+    } else if (relaySlot(relayPolicyIndex_, function) >= 0) {
+        if (value != TPX3_RELAY_BLOCK && value != TPX3_RELAY_DROP_OLDEST && value != TPX3_RELAY_DISCONNECT) {
+            setStringParam(errorMsgIndex_, "Invalid relay backpressure policy");
+            status = asynError;
+        } else {
+            relay_.setPolicy(relaySlot(relayPolicyIndex_, function), value);
+            setStringParam(errorMsgIndex_, "Relay policy updated successfully");
+        }
+    } else if (function == spoolEnableIndex_) {
+        if (value && !spool_.running()) {
+            status = startSpool();
+        } else if (!value && spool_.running()) {
+            // A replay reads straight from the segments
+            if (streamSource_ == STREAM_SOURCE_SPOOL && stream_.running()) {
+                stopStream();
+            }
+            spool_.stop();
+            setDoubleParam(spoolWriteRateIndex_, 0.0);
+            setStringParam(errorMsgIndex_, "Spool stopped");
+        }
+    } else if (function == spoolSegmentsIndex_) {
+        if (value < 2 || value > 1024) {
+            setStringParam(errorMsgIndex_, "Spool segments must be 2-1024");
+            status = asynError;
+        } else {
+            spoolSegments_ = value;
+            setStringParam(errorMsgIndex_, spool_.running() ? "Spool size takes effect when the spool is next enabled"
+                                                             : "Spool segments updated successfully");
+        }
+    } else if (function == spoolSegmentMBIndex_) {
+        if (value < 16 || value > 4096) {
+            setStringParam(errorMsgIndex_, "Spool segment size must be 16-4096 MB");
+            status = asynError;
+        } else {
+            spoolSegmentMB_ = value;
+            setStringParam(errorMsgIndex_, spool_.running() ? "Spool size takes effect when the spool is next enabled"
+                                                             : "Spool segment size updated successfully");
+        }
+    } else if (function == spoolExportIndex_) {
+        if (value) {
+            std::string error;
+            if (spoolExportFile_.empty()) {
+                setStringParam(errorMsgIndex_, "Spool export file not set");
+                setIntegerParam(spoolExportIndex_, 0);
+                status = asynError;
+            } else if (!spool_.startExport(spoolExportFile_, spoolRangeFrom_, spoolRangeTo_, &error)) {
+                setError(error.c_str());
+                setIntegerParam(spoolExportIndex_, 0);
+                status = asynError;
+            } else {
+                // SPOOL_EXPORT returns to 0 when the monitor thread sees the export finish
+                char msg[MAX_ERROR_LENGTH];
+                snprintf(msg, sizeof(msg), "Writing spool range to %s", spoolExportFile_.c_str());
+                setStringParam(errorMsgIndex_, msg);
+            }
+        }
+    } else if (function == autotuneIndex_) {
+        // AUTOTUNE returns to 0 when the monitor thread finishes the tune
+        if (value && tuneState_ == AUTOTUNE_IDLE) {
+            status = startAutotune();
+        } else if (!value && tuneState_ != AUTOTUNE_IDLE) {
+            abortAutotune();
+        }
+    } else if (function == switchoverIndex_) {
+        // SWITCHOVER returns to 0 when the switch is complete or has failed
+        if (value && switchState_ == SWITCHOVER_IDLE) {
+            status = startSwitchover();
+            if (status != asynSuccess) {
+                setIntegerParam(switchoverIndex_, 0);
+            }
+        } else if (value) {
+            setStringParam(errorMsgIndex_, "Switchover already in progress");
+        } else if (switchState_ == SWITCHOVER_STANDBY) {
+            epicsMutexLock(mutex_);
+            abortSwitchover();
+            epicsMutexUnlock(mutex_);
+            setStringParam(errorMsgIndex_, "Switchover cancelled; standby instance stopped");
+        } else if (switchState_ != SWITCHOVER_IDLE) {
+            // Past the switch there is nothing to cancel
+            setIntegerParam(switchoverIndex_, 1);
+            setStringParam(errorMsgIndex_, "Switchover already done - the old instance is being retired");
+            status = asynError;
+        }
+    } else if (function == applyIndex_) {
+        if (value) {
+            setIntegerParam(applyIndex_, 0);
+            status = applyConfig();
+        }
+    } else if (function == applyModeIndex_) {
+        applyMode_ = value;
+        setStringParam(errorMsgIndex_, value == APPLY_MODE_SWITCHOVER ? "APPLY will switch over to a standby Serval"
+                                                                     : "APPLY will restart Serval");
+    } else if (function == standbyHttpPortIndex_) {
+        if (value < 1 || value > 65535) {
+            setStringParam(errorMsgIndex_, "Standby HTTP port must be 1-65535");
+            status = asynError;
+        } else {
+            standbyHttpPort_ = value;
+            setStringParam(errorMsgIndex_, "Standby HTTP port updated successfully");
+        }
+    } else if (function == autotunePassesIndex_) {
+        if (value < 1 || value > 4) {
+            setStringParam(errorMsgIndex_, "Autotune passes must be 1-4");
+            status = asynError;
+        } else {
+            tunePasses_ = value;
+            setStringParam(errorMsgIndex_, "Autotune passes updated successfully");
+        }
+    } else if (function == autotuneLoadProfileIndex_) {
+        if (value) {
+            std::string path = tuneProfilePath(), error;
+            tpx3TuneProfile profile;
+            setIntegerParam(autotuneLoadProfileIndex_, 0);
+            if (tuneState_ != AUTOTUNE_IDLE) {
+                setStringParam(errorMsgIndex_, "Autotune running - profile not loaded");
+                status = asynError;
+            } else if (tuneProfileDir_.empty()) {
+                setStringParam(errorMsgIndex_, "Autotune profile directory not set");
+                status = asynError;
+            } else if (!tpx3Autotuner::loadProfile(path, &profile, &error)) {
+                setError(error.c_str());
+                status = asynError;
+            } else {
+                applyTuneProfile(profile);
+                char msg[MAX_ERROR_LENGTH];
+                snprintf(msg, sizeof(msg), "Loaded %s; takes effect on the next START or APPLY", path.c_str());
+                setStringParam(errorMsgIndex_, msg);
+            }
+        }
+    } else if (function == centEnableIndex_) {
+        centEnabled_ = (value != 0);
+        centroid_.setEnabled(centEnabled_);
+        setStringParam(errorMsgIndex_, value ? "Centroiding enabled" : "Centroiding disabled");
+    } else if (function == centSpaceWindowIndex_) {
+        if (value < 0 || value > TPX3_CENT_MAX_SPACE_WINDOW) {
+            setStringParam(errorMsgIndex_, "Centroid space window must be 0-8 pixels");
+            status = asynError;
+        } else {
+            centConfig_.spaceWindow = value;
+            centroid_.setConfig(centConfig_);
+            setStringParam(errorMsgIndex_, "Centroid space window updated successfully");
+        }
+    } else if (function == centResetIndex_) {
+        if (value) {
+            centroid_.reset();
+            setIntegerParam(centResetIndex_, 0);
+            setStringParam(errorMsgIndex_, "Centroid counters reset");
+        }
+    } else if (function == centOutputEnableIndex_) {
+        if (value) {
+            status = startCentroidOutput();
+        } else {
+            centroid_.stopOutput();
+            setIntegerParam(centOutputConnectedIndex_, 0);
+            setStringParam(errorMsgIndex_, "Centroid output stopped");
+        }
+    } else if (function == centOutputPortIndex_) {
+        if (value < 1 || value > 65535) {
+            setStringParam(errorMsgIndex_, "Centroid output port must be 1-65535");
+            status = asynError;
+        } else {
+            centOutputPort_ = value;
+            int outputEnabled = 0;
+            getIntegerParam(centOutputEnableIndex_, &outputEnabled);
+            if (outputEnabled) {
+                // Move the listener to the new port
+                centroid_.stopOutput();
+                status = startCentroidOutput();
+            } else {
+                setStringParam(errorMsgIndex_, "Centroid output port updated successfully");
+            }
+        }
+    } else if (function == streamSourceIndex_) {
+        if (value != STREAM_SOURCE_TCP && value != STREAM_SOURCE_FILE && value != STREAM_SOURCE_SPOOL) {
+            setStringParam(errorMsgIndex_, "Invalid stream source");
+            status = asynError;
+        } else {
+            streamSource_ = value;
+            setStringParam(errorMsgIndex_, "Stream source updated - applies on next STREAM_ENABLE");
+        }
+    } else if (function == streamPortIndex_) {
+        if (value < 1 || value > 65535) {
+            setStringParam(errorMsgIndex_, "Stream port must be 1-65535");
+            status = asynError;
+        } else {
+            streamPort_ = value;
+            setStringParam(errorMsgIndex_, "Stream port updated - applies on next STREAM_ENABLE");
+        }
+    } else if (function == streamReplayLoopIndex_) {
+        streamReplayLoop_ = (value != 0);
+        setStringParam(errorMsgIndex_, value ? "Stream replay loop enabled" : "Stream replay loop disabled");
+    } else if (function == streamWorkersIndex_) {
+        if (value < 1 || value > TPX3_STREAM_MAX_WORKERS) {
+            setStringParam(errorMsgIndex_, "Stream workers must be 1-16");
+            status = asynError;
+        } else {
+            streamWorkers_ = value;
+            setStringParam(errorMsgIndex_, "Stream workers updated - applies on next STREAM_ENABLE");
+        }
+    } else if (function == httpLatencyHistResetIndex_) {
+        if (value) {
+            std::fill(httpLatencyHist_.begin(), httpLatencyHist_.end(), 0);
+            doCallbacksInt32Array(&httpLatencyHist_[0], httpLatencyHist_.size(), httpLatencyHistIndex_, 0);
+            setIntegerParam(httpLatencyHistResetIndex_, 0);
+            setStringParam(errorMsgIndex_, "HTTP latency histogram reset");
+        }
+    }
+
+    updateConfigDirty();
+    callParamCallbacks();
+    return status;
+}
+
+// Write float64 parameter
+asynStatus tpx3servalDriver::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
+{
+    int function = pasynUser->reason;
+    asynStatus status = asynSuccess;
+
+    if (function == stopTermTimeoutIndex_) {
+        if (value < 0.0) {
+            setStringParam(errorMsgIndex_, "SIGTERM timeout cannot be negative");
+            status = asynError;
+        } else {
+            stopTermTimeout_ = value;
+            setStringParam(errorMsgIndex_, "SIGTERM timeout updated successfully");
+        }
+    } else if (function == telemetryPeriodIndex_) {
+        if (value < 0.0) {
+            setStringParam(errorMsgIndex_, "Telemetry period cannot be negative");
+            status = asynError;
+        } else {
+            telemetryPeriod_ = value;
+            if (telemetryPid_ != 0) {
+                armTelemetryTimer(telemetryPeriod_);
+            }
+            setStringParam(errorMsgIndex_, value > 0.0 ? "Telemetry period updated successfully" : "Telemetry disabled");
+        }
+    } else if (function == streamReplayRateIndex_) {
+        if (value < 0.0) {
+            setStringParam(errorMsgIndex_, "Stream replay rate cannot be negative");
+            status = asynError;
+        } else {
+            streamReplayRate_ = value;
+            setStringParam(errorMsgIndex_, "Stream replay rate updated - applies on next STREAM_ENABLE");
+        }
+    } else if (function == histToaBinNsIndex_ || function == histToaOffsetNsIndex_) {
+        tpx3HistConfig config = histConfig_;
+        if (function == histToaBinNsIndex_) {
+            config.toaBinNs = value;
+        } else {
+            config.toaOffsetNs = value;
+        }
+        status = setHistConfig(config);
+    } else if (function == trigExpectedPeriodIndex_) {
+        if (value < 0.0 || value > 1e9) {
+            setStringParam(errorMsgIndex_, "Trigger expected period must be 0 (no checks) to 1e9 us");
+            status = asynError;
+        } else {
+            trigConfig_.expectedPeriodNs = value * 1e3;
+            trigger_.setConfig(trigConfig_);
+            setStringParam(errorMsgIndex_, value > 0.0 ? "Trigger expected period updated successfully"
+                                                       : "Trigger period checks disabled");
+        }
+    } else if (function == trigToleranceIndex_) {
+        if (value <= 0.0 || value >= 50.0) {
+            setStringParam(errorMsgIndex_, "Trigger tolerance must be above 0 and below 50 %");
+            status = asynError;
+        } else {
+            trigConfig_.tolerance = value / 100.0;
+            trigger_.setConfig(trigConfig_);
+            setStringParam(errorMsgIndex_, "Trigger tolerance updated successfully");
+        }
+    } else if (function == maskAcquireTimeIndex_) {
+        if (value < 1.0 || value > 3600.0) {
+            setStringParam(errorMsgIndex_, "Noisy-pixel acquisition time must be 1-3600 s");
+            status = asynError;
+        } else {
+            maskAcquireTime_ = value;
+            setStringParam(errorMsgIndex_, "Noisy-pixel acquisition time updated successfully");
+        }
+    } else if (function == autotuneWarmupIndex_) {
+        if (value < 0.0 || value > 600.0) {
+            setStringParam(errorMsgIndex_, "Autotune warm-up must be 0-600 s");
+            status = asynError;
+        } else {
+            tuneWarmup_ = value;
+            setStringParam(errorMsgIndex_, "Autotune warm-up updated successfully");
+        }
+    } else if (function == autotuneDurationIndex_) {
+        if (value < 5.0 || value > 3600.0) {
+            setStringParam(errorMsgIndex_, "Autotune trial duration must be 5-3600 s");
+            status = asynError;
+        } else {
+            tuneDuration_ = value;
+            setStringParam(errorMsgIndex_, "Autotune trial duration updated successfully");
+        }
+    } else if (function == spoolRangeFromIndex_ || function == spoolRangeToIndex_) {
+        if (value < 0.0) {
+            setStringParam(errorMsgIndex_, "Spool range is given in seconds ago and cannot be negative");
+            status = asynError;
+        } else {
+            if (function == spoolRangeFromIndex_) {
+                spoolRangeFrom_ = value;
+            } else {
+                spoolRangeTo_ = value;
+            }
+            setStringParam(errorMsgIndex_, "Spool range updated successfully");
+        }
+    } else if (function == relayMaxLagIndex_) {
+        if (value < 1.0 || value > 8.0) {
+            setStringParam(errorMsgIndex_, "Relay lag limit must be 1-8 MB");
+            status = asynError;
+        } else {
+            relayMaxLag_ = value;
+            relay_.setMaxLag((uint64_t)(value * 1e6));
+            setStringParam(errorMsgIndex_, "Relay lag limit updated successfully");
+        }
+    } else if (function == maskSigmaIndex_) {
+        if (value < 1.0 || value > 100.0) {
+            setStringParam(errorMsgIndex_, "Noisy-pixel threshold must be 1-100 sigma");
+            status = asynError;
+        } else {
+            maskSigma_ = value;
+            setStringParam(errorMsgIndex_, "Noisy-pixel threshold updated successfully");
+        }
+    } else if (function == centTimeWindowIndex_) {
+        if (value < TPX3_TOA_UNIT_NS || value > 1e6) {
+            setStringParam(errorMsgIndex_, "Centroid time window must be 1.5625 ns to 1 ms");
+            status = asynError;
+        } else {
+            centConfig_.timeWindowNs = value;
+            centroid_.setConfig(centConfig_);
+            setStringParam(errorMsgIndex_, "Centroid time window updated successfully");
+        }
+    } else if (function == histPeriodIndex_) {
+        if (value <= 0.0) {
+            setStringParam(errorMsgIndex_, "Histogram period must be positive");
+            status = asynError;
+        } else {
+            histPeriod_ = value;
+            setStringParam(errorMsgIndex_, "Histogram period updated successfully");
+        }
+    } else if (function == previewPeriodIndex_) {
+        if (value <= 0.0) {
+            setStringParam(errorMsgIndex_, "Preview period must be positive");
+            status = asynError;
+        } else {
+            previewPeriod_ = value;
+            setStringParam(errorMsgIndex_, "Preview period updated successfully");
+        }
+    } else if (function == streamPublishPeriodIndex_) {
+        if (value <= 0.0) {
+            setStringParam(errorMsgIndex_, "Stream publish period must be positive");
+            status = asynError;
+        } else {
+            streamPublishPeriod_ = value;
+            if (stream_.running()) {
+                armStreamTimer(streamPublishPeriod_);
+            }
+            setStringParam(errorMsgIndex_, "Stream publish period updated successfully");
+        }
+    } else if (function == readyTimeoutIndex_) {
+        if (value < 0.0) {
+            setStringParam(errorMsgIndex_, "Ready timeout cannot be negative");
+            status = asynError;
+        } else {
+            readyTimeout_ = value;
+            setStringParam(errorMsgIndex_, "Ready timeout updated successfully");
+        }
+    } else if (function == httpPollPeriodIndex_) {
+        if (value < 0.0) {
+            setStringParam(errorMsgIndex_, "HTTP poll period cannot be negative");
+            status = asynError;
+        } else {
+            httpPollPeriod_ = value;
+            epicsEventSignal(httpEvent_);
+            setStringParam(errorMsgIndex_, value > 0.0 ? "HTTP poll period updated successfully" : "HTTP polling disabled");
+        }
+    } else if (function == stopKillTimeoutIndex_) {
+        if (value < 0.0) {
+            setStringParam(errorMsgIndex_, "SIGKILL timeout cannot be negative");
+            status = asynError;
+        } else {
+            stopKillTimeout_ = value;
+            setStringParam(errorMsgIndex_, "SIGKILL timeout updated successfully");
+        }
     }
 
+    if (status == asynSuccess) {
+        setDoubleParam(function, value);
+    }
     callParamCallbacks();
     return status;
 }
@@ -356,6 +1990,71 @@ asynStatus tpx3servalDriver::writeOctet(asynUser *pasynUser, const char *value,
     } else if (function == tcpDebugIndex_) {
         tcpDebug_ = std::string(value, maxChars);
         setStringParam(errorMsgIndex_, "TCP debug path updated successfully");
+    } else if (function == cpuListIndex_) {
+        cpu_set_t cpus;
+        std::string cpuList(value, maxChars);
+        if (!cpuList.empty() && !parseCpuList(cpuList, &cpus)) {
+            setStringParam(errorMsgIndex_, "Invalid CPU list - use e.g. 0-7,16-23");
+        } else {
+            cpuList_ = cpuList;
+            setStringParam(errorMsgIndex_, "CPU list updated successfully");
+        }
+    } else if (function == streamFileIndex_) {
+        streamFile_ = std::string(value, maxChars);
+        setStringParam(errorMsgIndex_, "Stream replay file updated successfully");
+    } else if (function == spoolDirIndex_) {
+        spoolDir_ = std::string(value, maxChars);
+        setStringParam(errorMsgIndex_, spool_.running() ? "Spool directory takes effect when the spool is next enabled"
+                                                         : "Spool directory updated successfully");
+    } else if (function == spoolExportFileIndex_) {
+        spoolExportFile_ = std::string(value, maxChars);
+        setStringParam(errorMsgIndex_, "Spool export file updated successfully");
+    } else if (function == autotuneLoadCmdIndex_) {
+        tuneLoadCmd_ = std::string(value, maxChars);
+        setStringParam(errorMsgIndex_, tuneLoadCmd_.empty() ? "Autotune load is supplied externally"
+                                                            : "Autotune load command updated successfully");
+    } else if (function == autotuneProfileDirIndex_) {
+        tuneProfileDir_ = std::string(value, maxChars);
+        setStringParam(errorMsgIndex_, "Autotune profile directory updated successfully");
+    } else if (tuneCandidatesParam(function) >= 0) {
+        int p = tuneCandidatesParam(function);
+        std::vector<int> candidates;
+        std::string candidateText(value, maxChars), error;
+        if (!tpx3Autotuner::parseCandidates(candidateText, &candidates, &error)) {
+            std::string msg = std::string("Invalid autotune candidates for ") + tpx3Autotuner::paramName(p) +
+                              ": " + error;
+            setStringParam(errorMsgIndex_, msg.c_str());
+        } else {
+            // Read when AUTOTUNE is next started
+            tuneCandidates_[p] = candidateText;
+            setStringParam(errorMsgIndex_, "Autotune candidates updated successfully");
+        }
+    } else if (function == maskFileIndex_) {
+        maskFile_ = std::string(value, maxChars);
+        setStringParam(errorMsgIndex_, "Mask file updated successfully");
+    } else if (function == maskBpcBaseIndex_) {
+        maskBpcBase_ = std::string(value, maxChars);
+        setStringParam(errorMsgIndex_, maskBpcBase_.empty() ? "Mask file will be a text list"
+                                                            : "Mask base pixel configuration updated successfully");
+    } else if (function == logFileIndex_) {
+        std::string path(value, maxChars);
+        std::string error;
+        if (!servalLog_.setFile(path, (size_t)logFileMaxMB_ * 1024 * 1024, &error)) {
+            logFile_.clear();
+            setStringParam(errorMsgIndex_, error.c_str());
+            status = asynError;
+        } else {
+            logFile_ = path;
+            logFileError_.clear();
+            setStringParam(errorMsgIndex_, path.empty() ? "Serval log file closed" : "Serval log file opened");
+        }
+    } else if (logPatternKind(function) >= 0) {
+        servalLog_.setPatterns(logPatternKind(function), std::string(value, maxChars));
+        setStringParam(errorMsgIndex_, "Log patterns updated successfully");
+    } else if (stagePatternStage(function) >= 0) {
+        int stage = stagePatternStage(function);
+        procStats_.setStagePatterns(stage, std::string(value, maxChars));
+        setStringParam(errorMsgIndex_, "Thread stage patterns updated successfully");
     } else if (function == jarFileNameIndex_) {
         if (strlen(value) == 0) {
             setStringParam(errorMsgIndex_, "JAR filename cannot be empty");
@@ -375,23 +2074,21 @@ asynStatus tpx3servalDriver::writeOctet(asynUser *pasynUser, const char *value,
     }
 
     status = setStringParam(function, value);
+    updateConfigDirty();
     callParamCallbacks();
     return status;
 }
 
-// Build command string
-void tpx3servalDriver::buildCommandString(char *command, size_t maxLen)
+// Build the Serval argument vector; args[0] is the java launcher
+// httpPort, if not 0, replaces the configured HTTP port (for a standby instance)
+void tpx3servalDriver::buildArgs(std::vector<std::string> &args, int httpPort)
 {
-    char tempCmd[MAX_COMMAND_LENGTH];
-    size_t len = 0;
+    args.clear();
 
-    // Start with java command
-    len = snprintf(tempCmd, sizeof(tempCmd), "java -jar");
-    if (len >= sizeof(tempCmd)) {
-        strncpy(command, "java -jar", maxLen - 1);
-        command[maxLen - 1] = '\0';
-        return;
-    }
+    // Start with java command; JVM options must come before -jar
+    args.push_back("java");
+    buildJvmArgs(args);
+    args.push_back("-jar");
 
     // Add jar file path if enabled
     if (jarFileEnable_) {
@@ -400,171 +2097,262 @@ void tpx3servalDriver::buildCommandString(char *command, size_t maxLen)
             fullJarPath += "/";
         }
         fullJarPath += jarFileName_;
-        
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " %s", fullJarPath.c_str());
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back(fullJarPath);
     }
 
     // Add HTTP port if enabled
-    if (httpPortEnable_) {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --httpPort=%d", httpPort_);
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+    if (httpPort > 0) {
+        args.push_back("--httpPort=" + std::to_string(httpPort));
+    } else if (httpPortEnable_) {
+        args.push_back("--httpPort=" + std::to_string(httpPort_));
     }
 
     // Add resource pool size if enabled
     if (resourcePoolSizeEnable_) {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --resourcePoolSize=%d", resourcePoolSize_);
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back("--resourcePoolSize=" + std::to_string(resourcePoolSize_));
     }
 
     // Add HTTP log if enabled and not empty
     if (httpLogEnable_ && !httpLog_.empty()) {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --httpLog=%s", httpLog_.c_str());
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back("--httpLog=" + httpLog_);
     }
 
     // Add SPIDR net if enabled and not autodiscover
     if (spidrNetEnable_ && spidrNet_ != "autodiscover") {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --spidrNet=%s", spidrNet_.c_str());
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back("--spidrNet=" + spidrNet_);
     }
 
     // Add TCP IP if enabled and not autodiscover
     if (tcpIpEnable_ && tcpIp_ != "autodiscover") {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --tcpIp=%s", tcpIp_.c_str());
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back("--tcpIp=" + tcpIp_);
     }
 
     // Add TCP port if enabled and not default
     if (tcpPortEnable_ && tcpPort_ != 50000) {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --tcpPort=%d", tcpPort_);
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back("--tcpPort=" + std::to_string(tcpPort_));
     }
 
     // Add device mask if enabled and not 0
     if (deviceMaskEnable_ && deviceMask_ != 0) {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --deviceMask=%d", deviceMask_);
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back("--deviceMask=" + std::to_string(deviceMask_));
     }
 
     // Add UDP receivers if enabled and greater than 0
     if (udpReceiversEnable_ && udpReceivers_ > 0) {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --udpReceivers=%d", udpReceivers_);
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back("--udpReceivers=" + std::to_string(udpReceivers_));
     }
 
     // Add frame assemblers if enabled and greater than 0
     if (frameAssemblersEnable_ && frameAssemblers_ > 0) {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --frameAssemblers=%d", frameAssemblers_);
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back("--frameAssemblers=" + std::to_string(frameAssemblers_));
     }
 
     // Add ring buffer size if enabled and greater than 0
     if (ringBufferSizeEnable_ && ringBufferSize_ > 0) {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --ringBufferSize=%d", ringBufferSize_);
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back("--ringBufferSize=" + std::to_string(ringBufferSize_));
     }
 
     // Add network buffer size if enabled and greater than 0
     if (networkBufferSizeEnable_ && networkBufferSize_ > 0) {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --networkBufferSize=%d", networkBufferSize_);
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back("--networkBufferSize=" + std::to_string(networkBufferSize_));
     }
 
     // Add file writers if enabled and greater than 0
     if (fileWritersEnable_ && fileWriters_ > 0) {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --fileWriters=%d", fileWriters_);
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back("--fileWriters=" + std::to_string(fileWriters_));
     }
 
     // Add correction handlers if enabled and greater than 0
     if (correctionHandlersEnable_ && correctionHandlers_ > 0) {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --correctionHandlers=%d", correctionHandlers_);
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back("--correctionHandlers=" + std::to_string(correctionHandlers_));
     }
 
     // Add processing handlers if enabled and greater than 0
     if (processingHandlersEnable_ && processingHandlers_ > 0) {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --processingHandlers=%d", processingHandlers_);
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back("--processingHandlers=" + std::to_string(processingHandlers_));
     }
 
     // Add image pool size if enabled and greater than 0
     if (imagePoolSizeEnable_ && imagePoolSize_ > 0) {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --imagePoolSize=%d", imagePoolSize_);
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back("--imagePoolSize=" + std::to_string(imagePoolSize_));
     }
 
     // Add integration pool size if enabled and greater than 0
     if (integrationPoolSizeEnable_ && integrationPoolSize_ > 0) {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --integrationPoolSize=%d", integrationPoolSize_);
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back("--integrationPoolSize=" + std::to_string(integrationPoolSize_));
     }
 
     // Add TCP debug if enabled and not empty
     if (tcpDebugEnable_ && !tcpDebug_.empty()) {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --tcpDebug=%s", tcpDebug_.c_str());
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back("--tcpDebug=" + tcpDebug_);
     }
 
     // Add release resources if enabled
     if (releaseResources_) {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --releaseResources");
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
-        }
+        args.push_back("--releaseResources");
     }
 
     // Add experimental if enabled
     if (experimental_) {
-        int newLen = snprintf(tempCmd + len, sizeof(tempCmd) - len, " --experimental");
-        if (newLen > 0 && len + static_cast<size_t>(newLen) < sizeof(tempCmd)) {
-            len += static_cast<size_t>(newLen);
+        args.push_back("--experimental");
+    }
+}
+
+// Append the enabled JVM performance options
+void tpx3servalDriver::buildJvmArgs(std::vector<std::string> &args)
+{
+    // Add initial heap if enabled
+    if (jvmXmsEnable_) {
+        args.push_back("-Xms" + std::to_string(jvmXms_) + "m");
+    }
+
+    // Add maximum heap if enabled
+    if (jvmXmxEnable_) {
+        args.push_back("-Xmx" + std::to_string(jvmXmx_) + "m");
+    }
+
+    // Add direct (off-heap) buffer limit if enabled
+    if (jvmMaxDirectMemoryEnable_) {
+        args.push_back("-XX:MaxDirectMemorySize=" + std::to_string(jvmMaxDirectMemory_) + "m");
+    }
+
+    // Add garbage collector if enabled
+    if (jvmGcEnable_) {
+        switch (jvmGc_) {
+        case JVM_GC_PARALLEL:
+            args.push_back("-XX:+UseParallelGC");
+            break;
+        case JVM_GC_Z:
+            args.push_back("-XX:+UseZGC");
+            break;
+        case JVM_GC_SHENANDOAH:
+            args.push_back("-XX:+UseShenandoahGC");
+            break;
+        case JVM_GC_SERIAL:
+            args.push_back("-XX:+UseSerialGC");
+            break;
+        default:
+            args.push_back("-XX:+UseG1GC");
+            break;
+        }
+    }
+
+    // Add large pages if enabled
+    if (jvmLargePages_) {
+        args.push_back("-XX:+UseLargePages");
+    }
+
+    // Add heap pre-touch if enabled
+    if (jvmPreTouch_) {
+        args.push_back("-XX:+AlwaysPreTouch");
+    }
+
+    // Add unified GC logging to the driver's FIFO if enabled
+    if (jvmGcLog_ && gcLog_.isOpen()) {
+        args.push_back(gcLog_.jvmOption());
+    }
+}
+
+// Check the JVM options for combinations the JVM would reject or that defeat their purpose
+bool tpx3servalDriver::validateJvmOptions(char *errMsg, size_t errLen)
+{
+    if (jvmXmsEnable_ && jvmXms_ <= 0) {
+        snprintf(errMsg, errLen, "JVM_XMS must be greater than 0 MB");
+        return false;
+    }
+    if (jvmXmxEnable_ && jvmXmx_ <= 0) {
+        snprintf(errMsg, errLen, "JVM_XMX must be greater than 0 MB");
+        return false;
+    }
+    if (jvmMaxDirectMemoryEnable_ && jvmMaxDirectMemory_ <= 0) {
+        snprintf(errMsg, errLen, "JVM_MAX_DIRECT_MEMORY must be greater than 0 MB");
+        return false;
+    }
+    if (jvmXmsEnable_ && jvmXmxEnable_ && jvmXms_ > jvmXmx_) {
+        snprintf(errMsg, errLen, "JVM_XMS (%d MB) is larger than JVM_XMX (%d MB)", jvmXms_, jvmXmx_);
+        return false;
+    }
+    if (jvmGcEnable_ && (jvmGc_ < JVM_GC_G1 || jvmGc_ > JVM_GC_SERIAL)) {
+        snprintf(errMsg, errLen, "Invalid JVM_GC selection %d", jvmGc_);
+        return false;
+    }
+    if (jvmPreTouch_ && !jvmXmsEnable_) {
+        // AlwaysPreTouch only commits the initial heap, which is tiny by default
+        snprintf(errMsg, errLen, "JVM_PRETOUCH requires JVM_XMS to size the heap to pre-touch");
+        return false;
+    }
+    if (jvmGcLog_ && !gcLog_.isOpen()) {
+        snprintf(errMsg, errLen, "JVM_GC_LOG is not available: the GC log FIFO could not be created");
+        return false;
+    }
+    return true;
+}
+
+// Build command string for display; matches /proc/<pid>/cmdline joined by spaces
+std::string tpx3servalDriver::buildCommandString(int httpPort)
+{
+    std::vector<std::string> args;
+    buildArgs(args, httpPort);
+
+    std::string command;
+    for (size_t i = 0; i < args.size(); i++) {
+        if (i > 0) {
+            command += " ";
         }
+        command += args[i];
+    }
+    return command;
+}
+
+// Spawn Serval with args, directly with posix_spawn (vfork semantics, no
+// shell) so the IOC is never copied and the pid is the JVM itself (mutex_ held)
+bool tpx3servalDriver::spawnServal(const std::vector<std::string> &args, pid_t *pid, double *spawnUs,
+                                   char *errMsg, size_t errLen)
+{
+    std::vector<char *> argv;
+    for (size_t i = 0; i < args.size(); i++) {
+        argv.push_back(const_cast<char *>(args[i].c_str()));
+    }
+    argv.push_back(NULL);
+
+    posix_spawnattr_t attr;
+    initChildSpawnAttr(&attr, 0);
+
+    // Serval's stdout and stderr go to the log pipes instead of the IOC console
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    bool capture = logCapture_ && servalLog_.isOpen();
+    if (capture) {
+        posix_spawn_file_actions_adddup2(&actions, servalLog_.writeFd(TPX3_LOG_STDOUT), STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, servalLog_.writeFd(TPX3_LOG_STDERR), STDERR_FILENO);
+    }
+
+    // CPU affinity and NUMA policy are inherited by the child through exec
+    threadPlacement savedPlacement;
+    if (!applyThreadPlacement(cpuListEnable_, cpuList_, numaEnable_, numaNode_, numaPolicy_,
+                              &savedPlacement, errMsg, errLen)) {
+        restoreThreadPlacement(&savedPlacement);
+        posix_spawn_file_actions_destroy(&actions);
+        posix_spawnattr_destroy(&attr);
+        return false;
     }
 
-    // Copy to output buffer
-    strncpy(command, tempCmd, maxLen - 1);
-    command[maxLen - 1] = '\0';
+    double spawnStart = monotonicSeconds();
+    int spawnErr = posix_spawnp(pid, argv[0], capture ? &actions : NULL, &attr, &argv[0], environ);
+    *spawnUs = (monotonicSeconds() - spawnStart) * 1e6;
+    restoreThreadPlacement(&savedPlacement);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if (spawnErr != 0) {
+        // Spawn or exec failed; glibc reports exec errors synchronously
+        snprintf(errMsg, errLen, "Failed to spawn %s: %s", argv[0], strerror(spawnErr));
+        return false;
+    }
+    return true;
 }
 
-// Start process
+// Start process: spawn Serval and return; the HTTP thread moves it to Ready
 asynStatus tpx3servalDriver::startProcess()
 {
     epicsMutexLock(mutex_);
@@ -574,87 +2362,192 @@ asynStatus tpx3servalDriver::startProcess()
         return asynError;
     }
 
-    char command[MAX_COMMAND_LENGTH];
-    buildCommandString(command, sizeof(command));
-
-    // Fork and exec
-    pid_t pid = fork();
-    if (pid == 0) {
-        // Child process
-        execl("/bin/bash", "bash", "-c", command, NULL);
-        exit(1);
-    } else if (pid > 0) {
-        // Parent process
-        processId_ = pid;
-        isRunning_ = true;
-        processCommandLine_ = std::string(command);
-        setIntegerParam(statusIndex_, 1);
-        setIntegerParam(startIndex_, 1);
-        setStringParam(processIdIndex_, std::to_string(pid).c_str());
-        setStringParam(commandLineIndex_, command);
-        setStringParam(errorMsgIndex_, "Process started successfully");
-        printf("%s:%s: Started process %d with command: %s\n", 
-               driverName, __FUNCTION__, pid, command);
-    } else {
-        // Fork failed
-        setError("Failed to fork process - system resource limit reached");
+    char jvmMsg[MAX_ERROR_LENGTH];
+    if (!validateJvmOptions(jvmMsg, sizeof(jvmMsg))) {
+        setError(jvmMsg);
+        epicsMutexUnlock(mutex_);
+        return asynError;
+    }
+
+    std::vector<std::string> args;
+    buildArgs(args);
+    std::string command = buildCommandString();
+
+    setLifecycleState(LIFECYCLE_STARTING);
+
+    pid_t pid = 0;
+    double spawnUs = 0.0;
+    char spawnMsg[MAX_ERROR_LENGTH];
+    if (!spawnServal(args, &pid, &spawnUs, spawnMsg, sizeof(spawnMsg))) {
+        setLifecycleState(LIFECYCLE_STOPPED);
+        setError(spawnMsg);
         epicsMutexUnlock(mutex_);
         return asynError;
     }
 
+    processId_ = pid;
+    isRunning_ = true;
+    processCommandLine_ = command;
+    runningArgs_ = args;
+    runningHttpPort_ = 0;
+    activeHttpPort_ = httpPortEnable_ ? httpPort_ : SERVAL_DEFAULT_HTTP_PORT;
+    setIntegerParam(activeHttpPortIndex_, activeHttpPort_);
+    watchChild(pid);
+    telemetryPid_ = pid;
+    armTelemetryTimer(telemetryPeriod_);
+    setIntegerParam(udpLossIndex_, 0);
+    setDoubleParam(spawnLatencyIndex_, spawnUs);
+    setDoubleParam(startDurationIndex_, (monotonicSeconds() - lifecycleStartTime_) * 1000.0);
+    // Log counts start over with each START; the lines of the last run stay in the tail
+    servalLog_.resetCounts();
+    char mark[MAX_ERROR_LENGTH];
+    snprintf(mark, sizeof(mark), "--- Serval %d started on port %d ---", pid, activeHttpPort_);
+    servalLog_.mark(mark);
+    publishLog();
+    gcLog_.setPid(pid);
+    gcLog_.reset();
+    gcDropOverlaps_ = 0;
+    std::fill(gcPauseHist_.begin(), gcPauseHist_.end(), 0);
+    doCallbacksInt32Array(&gcPauseHist_[0], gcPauseHist_.size(), gcPauseHistIndex_, 0);
+    setIntegerParam(gcDropOverlapIndex_, 0);
+    setIntegerParam(gcDropOverlapsIndex_, 0);
+    publishGc(NULL);
+    // Stay in Starting until the HTTP thread sees Serval answer /dashboard
+    startGeneration_++;
+    listenSeen_ = false;
+    readyTimeoutReported_ = false;
+    setDoubleParam(startToListenIndex_, 0.0);
+    setDoubleParam(startToReadyIndex_, 0.0);
+    epicsEventSignal(httpEvent_);
+    setIntegerParam(statusIndex_, 1);
+    setIntegerParam(startIndex_, 1);
+    setStringParam(processIdIndex_, std::to_string(pid).c_str());
+    setStringParam(commandLineIndex_, command.c_str());
+    setStringParam(errorMsgIndex_, "Process started, waiting for Serval to become ready");
+    updatePlacementRbvs(pid);
+    updateConfigDirty();
+    printf("%s:%s: Started process %d in %.0f us with command: %s\n", 
+           driverName, __FUNCTION__, pid, spawnUs, command.c_str());
+
     epicsMutexUnlock(mutex_);
     return asynSuccess;
 }
 
-// Stop process
+// Stop process: send SIGTERM and return; the monitor thread escalates to
+// SIGKILL after STOP_TERM_TIMEOUT and completes the stop when the child exits
 asynStatus tpx3servalDriver::stopProcess()
 {
     epicsMutexLock(mutex_);
     
-    if (!isRunning_) {
+    if (!isRunning_ || processId_ <= 0) {
         epicsMutexUnlock(mutex_);
         return asynSuccess;
     }
 
-    if (processId_ > 0) {
-        // Send SIGTERM first
-        if (kill(processId_, SIGTERM) == 0) {
-            printf("%s:%s: Sent SIGTERM to process %d\n", driverName, __FUNCTION__, processId_);
-            setStringParam(errorMsgIndex_, "Sending SIGTERM to process");
-            
-            // Wait a bit for graceful shutdown
-            epicsThreadSleep(2.0);
-            
-            // Check if process is still running
-            int status;
-            if (waitpid(processId_, &status, WNOHANG) == 0) {
-                // Process still running, send SIGKILL
-                if (kill(processId_, SIGKILL) == 0) {
-                    printf("%s:%s: Sent SIGKILL to process %d\n", driverName, __FUNCTION__, processId_);
-                    setStringParam(errorMsgIndex_, "Sending SIGKILL to process");
-                    waitpid(processId_, &status, 0);
-                }
-            }
-        }
+    // A standby or retiring instance goes at once, without the grace period
+    abortSwitchover();
+
+    if (kill(processId_, SIGTERM) != 0) {
+        setError("Failed to send SIGTERM to process");
+        epicsMutexUnlock(mutex_);
+        return asynError;
     }
+    printf("%s:%s: Sent SIGTERM to process %d\n", driverName, __FUNCTION__, processId_);
+    setStringParam(errorMsgIndex_, "Sending SIGTERM to process");
 
-    processId_ = 0;
-    isRunning_ = false;
-    processCommandLine_.clear();
-    setIntegerParam(statusIndex_, 0);
+    setLifecycleState(LIFECYCLE_STOPPING);
+    stopStage_ = 1;
+    // A zero timeout escalates on the next monitor loop iteration
+    armStopTimer(stopTermTimeout_ > 0.0 ? stopTermTimeout_ : 1e-6);
     setIntegerParam(startIndex_, 0);
-    setStringParam(processIdIndex_, "0");
-    setStringParam(errorMsgIndex_, "Process stopped successfully");
 
     epicsMutexUnlock(mutex_);
     return asynSuccess;
 }
 
+// APPLY: bring a running Serval up to the configured options with a single
+// restart, or a switchover to a standby. Port lock held.
+asynStatus tpx3servalDriver::applyConfig()
+{
+    if (tuneState_ != AUTOTUNE_IDLE) {
+        setStringParam(errorMsgIndex_, "Autotune running - set AUTOTUNE to 0 to abort it first");
+        return asynError;
+    }
+    if (switchState_ != SWITCHOVER_IDLE || applyRestart_) {
+        setStringParam(errorMsgIndex_, "Configuration is already being applied");
+        return asynError;
+    }
+    if (!isRunning_ || lifecycleState_ == LIFECYCLE_STOPPING) {
+        setStringParam(errorMsgIndex_, "Serval not running - the configuration applies on START");
+        return asynSuccess;
+    }
+    int dirty = 0;
+    getIntegerParam(configDirtyIndex_, &dirty);
+    if (!dirty) {
+        setStringParam(errorMsgIndex_, "Serval already runs the configured options");
+        return asynSuccess;
+    }
+    char jvmMsg[MAX_ERROR_LENGTH];
+    if (!validateJvmOptions(jvmMsg, sizeof(jvmMsg))) {
+        setError(jvmMsg);
+        return asynError;
+    }
+
+    char diff[MAX_ERROR_LENGTH];
+    getStringParam(configDiffIndex_, sizeof(diff), diff);
+    printf("%s:%s: Applying configuration (%s)\n", driverName, __FUNCTION__, diff);
+    if (applyMode_ == APPLY_MODE_SWITCHOVER) {
+        asynStatus status = startSwitchover();
+        if (status == asynSuccess) {
+            setIntegerParam(switchoverIndex_, 1);
+        }
+        return status;
+    }
+    // handleChildEvent starts Serval again once it has exited
+    asynStatus status = stopProcess();
+    if (status == asynSuccess) {
+        applyRestart_ = true;
+        setStringParam(errorMsgIndex_, "Restarting Serval to apply the configuration");
+    }
+    return status;
+}
+
+// CONFIG_DIRTY and CONFIG_DIFF: the configured command line against the one
+// Serval runs with. Port lock held.
+void tpx3servalDriver::updateConfigDirty()
+{
+    std::string diff;
+    if (isRunning_) {
+        std::vector<std::string> args;
+        buildArgs(args, runningHttpPort_);
+        std::string added, removed;
+        for (size_t i = 0; i < args.size(); i++) {
+            if (std::find(runningArgs_.begin(), runningArgs_.end(), args[i]) == runningArgs_.end()) {
+                added += " " + args[i];
+            }
+        }
+        for (size_t i = 0; i < runningArgs_.size(); i++) {
+            if (std::find(args.begin(), args.end(), runningArgs_[i]) == args.end()) {
+                removed += " " + runningArgs_[i];
+            }
+        }
+        if (!added.empty()) {
+            diff = "added:" + added;
+        }
+        if (!removed.empty()) {
+            diff += (diff.empty() ? "removed:" : "; removed:") + removed;
+        }
+    }
+    setIntegerParam(configDirtyIndex_, diff.empty() ? 0 : 1);
+    setStringParam(configDiffIndex_, diff.c_str());
+}
+
 // Force kill all child processes (for emergency cleanup)
 void tpx3servalDriver::forceKillAllProcesses()
 {
     epicsMutexLock(mutex_);
     
+    abortSwitchover();
     if (processId_ > 0) {
         printf("%s:%s: Force killing process %d\n", driverName, __FUNCTION__, processId_);
         
@@ -665,70 +2558,47 @@ void tpx3servalDriver::forceKillAllProcesses()
             printf("%s:%s: Process %d killed\n", driverName, __FUNCTION__, processId_);
         }
         
+        unwatchChild();
+        armStopTimer(0.0);
+        stopStage_ = 0;
+        telemetryPid_ = 0;
+        armTelemetryTimer(0.0);
+        clearTelemetry();
         processId_ = 0;
         isRunning_ = false;
         processCommandLine_.clear();
+        runningArgs_.clear();
+        setLifecycleState(LIFECYCLE_STOPPED);
         setIntegerParam(statusIndex_, 0);
         setIntegerParam(startIndex_, 0);
         setStringParam(processIdIndex_, "0");
+        setIntegerParam(activeHttpPortIndex_, 0);
         setStringParam(errorMsgIndex_, "Process force killed");
+        updateConfigDirty();
     }
     
     epicsMutexUnlock(mutex_);
 }
 
-// Kill only the specific Java processes started by this IOC (emergency cleanup)
-void tpx3servalDriver::killAllJavaProcesses()
+// Kill whatever Serval this instance still owns (emergency cleanup). Only its
+// own PIDs: other detectors of this IOC, and other IOCs, may run the same jar.
+void tpx3servalDriver::killOwnProcesses()
 {
-    printf("%s:%s: Killing only Serval Java processes for cleanup\n", driverName, __FUNCTION__);
-    
-    // First, try to kill processes using the exact command line we started
-    if (!processCommandLine_.empty()) {
-        char cmd[512];
-        // Escape special characters in the command line for shell safety
-        std::string escapedCmd = processCommandLine_;
-        // Replace single quotes with '\'' for shell escaping
-        size_t pos = 0;
-        while ((pos = escapedCmd.find("'", pos)) != std::string::npos) {
-            escapedCmd.replace(pos, 1, "'\\''");
-            pos += 4;
-        }
-        
-        snprintf(cmd, sizeof(cmd), "pkill -f '^%s$'", escapedCmd.c_str());
-        printf("%s:%s: Attempting to kill processes with exact command: %s\n", 
-               driverName, __FUNCTION__, escapedCmd.c_str());
-        
-        int result = system(cmd);
-        if (result == 0) {
-            printf("%s:%s: Processes with exact command killed\n", driverName, __FUNCTION__);
-            setStringParam(errorMsgIndex_, "Processes with exact command killed for cleanup");
-            return;
+    epicsMutexLock(mutex_);
+    pid_t pids[3] = { processId_, standbyPid_, retiringPid_ };
+    int killed = 0;
+    for (int i = 0; i < 3; i++) {
+        if (pids[i] > 0 && kill(pids[i], SIGKILL) == 0) {
+            int status;
+            waitpid(pids[i], &status, 0);
+            printf("%s:%s: Process %d killed\n", driverName, __FUNCTION__, pids[i]);
+            killed++;
         }
     }
-    
-    // Fallback: kill only processes containing our specific jar file names
-    std::string jarName = jarFileName_;
-    if (jarName.find("serval") != std::string::npos) {
-        
-        // Kill only processes containing our specific jar names
-        char cmd[256];
-        snprintf(cmd, sizeof(cmd), "pkill -f 'java.*%s'", jarName.c_str());
-        printf("%s:%s: Attempting to kill processes with jar name: %s\n", 
-               driverName, __FUNCTION__, jarName.c_str());
-        
-        int result = system(cmd);
-        
-        if (result == 0) {
-            printf("%s:%s: Serval Java processes killed\n", driverName, __FUNCTION__);
-            setStringParam(errorMsgIndex_, "Serval Java processes killed for cleanup");
-        } else {
-            printf("%s:%s: No Serval Java processes found\n", driverName, __FUNCTION__);
-            setStringParam(errorMsgIndex_, "No Serval Java processes found for cleanup");
-        }
-    } else {
-        printf("%s:%s: No specific jar file configured, skipping Java process cleanup\n", driverName, __FUNCTION__);
-        setStringParam(errorMsgIndex_, "No specific jar file configured for cleanup");
+    if (killed > 0) {
+        setStringParam(errorMsgIndex_, "Serval processes of this instance killed for cleanup");
     }
+    epicsMutexUnlock(mutex_);
 }
 
 // Public cleanup method that can be called externally
@@ -745,8 +2615,11 @@ void tpx3servalDriver::cleanupAllProcesses()
     // Force kill any running processes
     forceKillAllProcesses();
     
-    // Also kill any orphaned Java processes
-    killAllJavaProcesses();
+    // And a standby or retired process left behind
+    killOwnProcesses();
+
+    // And the load command of an autotune trial
+    stopAutotuneLoad();
 }
 
 // Debug method to print current process information
@@ -759,120 +2632,2132 @@ void tpx3servalDriver::printProcessInfo()
     printf("  Jar File: %s\n", jarFileName_.c_str());
     printf("  Jar Path: %s\n", jarFilePath_.c_str());
     printf("  HTTP Port: %d\n", httpPort_);
+    printf("  Active HTTP Port: %d\n", activeHttpPort_);
+    printf("  Standby Process ID: %d (port %d)\n", standbyPid_, standbyPort_);
+    printf("  Retiring Process ID: %d\n", retiringPid_);
     printf("  Resource Pool Size: %d\n", resourcePoolSize_);
+    printf("  CPU List: %s (%s)\n", cpuList_.c_str(), cpuListEnable_ ? "enabled" : "disabled");
+    printf("  NUMA Node: %d policy %d (%s)\n", numaNode_, numaPolicy_, numaEnable_ ? "enabled" : "disabled");
 }
 
-// Monitor process
+// Monitor process: sleeps in epoll_wait until the child exits or the driver
+// wakes it, so there are no periodic wakeups while Serval is running
 void tpx3servalDriver::monitorProcess()
 {
     printf("%s:%s: Monitor thread started\n", driverName, __FUNCTION__);
     
     while (true) {
-        if (epicsEventWaitWithTimeout(stopEvent_, 1.0) == epicsEventWaitOK) {
-            printf("%s:%s: Monitor thread received stop signal\n", driverName, __FUNCTION__);
+        struct epoll_event events[8];
+        int n = epoll_wait(epollFd_, events, 8, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("%s:%s: epoll_wait failed: %s\n", driverName, __FUNCTION__, strerror(errno));
             break;
         }
 
-        epicsMutexLock(mutex_);
-        if (isRunning_ && processId_ > 0) {
-            int status;
-            pid_t result = waitpid(processId_, &status, WNOHANG);
-            
-            if (result == processId_) {
-                // Process has terminated
-                printf("%s:%s: Process %d terminated with status %d\n", 
-                       driverName, __FUNCTION__, processId_, status);
-                processId_ = 0;
-                isRunning_ = false;
-                processCommandLine_.clear();
-                setIntegerParam(statusIndex_, 0);
-                setIntegerParam(startIndex_, 0);
-                setStringParam(processIdIndex_, "0");
-                if (WIFEXITED(status)) {
-                    int exitCode = WEXITSTATUS(status);
-                    char exitMsg[100];
-                    snprintf(exitMsg, sizeof(exitMsg), "Process exited with code %d", exitCode);
-                    setStringParam(errorMsgIndex_, exitMsg);
-                } else if (WIFSIGNALED(status)) {
-                    int signalNum = WTERMSIG(status);
-                    char signalMsg[100];
-                    snprintf(signalMsg, sizeof(signalMsg), "Process terminated by signal %d", signalNum);
-                    setStringParam(errorMsgIndex_, signalMsg);
+        bool childEvent = false;
+        bool timerEvent = false;
+        bool telemetryEvent = false;
+        bool streamEvent = false;
+        bool spoolEvent = false;
+        bool autotuneEvent = false;
+        bool standbyEvent = false;
+        bool retiringEvent = false;
+        bool switchoverEvent = false;
+        bool logEvent = false;
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.u32 == MONITOR_TAG_WAKE) {
+                uint64_t count;
+                while (read(wakeFd_, &count, sizeof(count)) > 0) {
                 }
-            } else if (result == -1 && errno == ECHILD) {
-                // Process not found
-                processId_ = 0;
-                isRunning_ = false;
-                processCommandLine_.clear();
-                setIntegerParam(statusIndex_, 0);
-                setIntegerParam(startIndex_, 0);
-                setStringParam(processIdIndex_, "0");
-                setStringParam(errorMsgIndex_, "Process not found - may have been killed externally");
+                // Without pidfd the wake eventfd doubles as the SIGCHLD notification
+                if (!usePidFd_) {
+                    childEvent = true;
+                    standbyEvent = true;
+                    retiringEvent = true;
+                }
+            } else if (events[i].data.u32 == MONITOR_TAG_CHILD) {
+                childEvent = true;
+            } else if (events[i].data.u32 == MONITOR_TAG_TIMER) {
+                uint64_t expirations;
+                while (read(timerFd_, &expirations, sizeof(expirations)) > 0) {
+                }
+                timerEvent = true;
+            } else if (events[i].data.u32 == MONITOR_TAG_TELEMETRY) {
+                uint64_t expirations;
+                while (read(telemetryFd_, &expirations, sizeof(expirations)) > 0) {
+                }
+                telemetryEvent = true;
+            } else if (events[i].data.u32 == MONITOR_TAG_STREAM) {
+                uint64_t expirations;
+                while (read(streamTimerFd_, &expirations, sizeof(expirations)) > 0) {
+                }
+                streamEvent = true;
+            } else if (events[i].data.u32 == MONITOR_TAG_SPOOL) {
+                spoolEvent = true;
+            } else if (events[i].data.u32 == MONITOR_TAG_AUTOTUNE) {
+                uint64_t expirations;
+                while (read(tuneTimerFd_, &expirations, sizeof(expirations)) > 0) {
+                }
+                autotuneEvent = true;
+            } else if (events[i].data.u32 == MONITOR_TAG_STANDBY) {
+                standbyEvent = true;
+            } else if (events[i].data.u32 == MONITOR_TAG_RETIRING) {
+                retiringEvent = true;
+            } else if (events[i].data.u32 == MONITOR_TAG_SWITCHOVER) {
+                uint64_t expirations;
+                while (read(switchTimerFd_, &expirations, sizeof(expirations)) > 0) {
+                }
+                switchoverEvent = true;
+            } else if (events[i].data.u32 == MONITOR_TAG_LOG_STDOUT) {
+                // Parsed here, off the port lock; published on the telemetry tick
+                servalLog_.drain(TPX3_LOG_STDOUT);
+                logEvent = true;
+            } else if (events[i].data.u32 == MONITOR_TAG_LOG_STDERR) {
+                servalLog_.drain(TPX3_LOG_STDERR);
+                logEvent = true;
+            } else if (events[i].data.u32 == MONITOR_TAG_GC_LOG) {
+                gcLog_.drain();
             }
         }
-        epicsMutexUnlock(mutex_);
-        
-        callParamCallbacks();
+
+        if (epicsEventTryWait(stopEvent_) == epicsEventWaitOK) {
+            printf("%s:%s: Monitor thread received stop signal\n", driverName, __FUNCTION__);
+            break;
+        }
+
+        if (childEvent) {
+            handleChildEvent();
+        }
+        if (timerEvent) {
+            handleTimerEvent();
+        }
+        if (telemetryEvent) {
+            handleTelemetryEvent();
+        }
+        if (streamEvent) {
+            handleStreamEvent();
+        }
+        if (spoolEvent) {
+            handleSpoolExportEvent();
+        }
+        if (autotuneEvent) {
+            handleAutotuneEvent();
+        }
+        if (standbyEvent) {
+            handleStandbyEvent();
+        }
+        if (retiringEvent) {
+            handleRetiringEvent();
+        }
+        if (switchoverEvent) {
+            handleSwitchoverTimer();
+        }
+        // Without a running Serval there is no telemetry tick to publish on
+        if (logEvent && telemetryPid_ == 0) {
+            lock();
+            publishLog();
+            callParamCallbacks();
+            unlock();
+        }
     }
     
     printf("%s:%s: Monitor thread exiting\n", driverName, __FUNCTION__);
+    epicsEventSignal(monitorDoneEvent_);
 }
 
-// Monitor thread C function
-void tpx3servalDriver::monitorThreadC(void *pPvt)
+// Reap the child after the monitor loop saw it exit and publish the result
+void tpx3servalDriver::handleChildEvent()
 {
-    tpx3servalDriver *pPvt_ = (tpx3servalDriver*)pPvt;
-    pPvt_->monitorProcess();
+    // The last lines, e.g. a stack trace, are in the pipes before the exit is seen
+    servalLog_.drain(TPX3_LOG_STDOUT);
+    servalLog_.drain(TPX3_LOG_STDERR);
+    lock();
+    epicsMutexLock(mutex_);
+    if (isRunning_ && processId_ > 0) {
+        int status;
+        pid_t result = waitpid(processId_, &status, WNOHANG);
+        
+        if (result == processId_) {
+            // Process has terminated
+            printf("%s:%s: Process %d terminated with status %d\n", 
+                   driverName, __FUNCTION__, processId_, status);
+            bool requested = (lifecycleState_ == LIFECYCLE_STOPPING);
+            double elapsedMs = (monotonicSeconds() - lifecycleStartTime_) * 1000.0;
+            unwatchChild();
+            armStopTimer(0.0);
+            processId_ = 0;
+            isRunning_ = false;
+            processCommandLine_.clear();
+            runningArgs_.clear();
+            setIntegerParam(statusIndex_, 0);
+            setIntegerParam(startIndex_, 0);
+            setStringParam(processIdIndex_, "0");
+            setIntegerParam(activeHttpPortIndex_, 0);
+            if (requested) {
+                char stopMsg[100];
+                snprintf(stopMsg, sizeof(stopMsg), "Process stopped successfully in %.0f ms%s",
+                         elapsedMs, stopStage_ > 1 ? " (SIGKILL)" : "");
+                setDoubleParam(stopDurationIndex_, elapsedMs);
+                setStringParam(errorMsgIndex_, stopMsg);
+            } else if (WIFEXITED(status)) {
+                int exitCode = WEXITSTATUS(status);
+                char exitMsg[100];
+                snprintf(exitMsg, sizeof(exitMsg), "Process exited with code %d", exitCode);
+                setError(exitMsg);
+            } else if (WIFSIGNALED(status)) {
+                int signalNum = WTERMSIG(status);
+                char signalMsg[100];
+                snprintf(signalMsg, sizeof(signalMsg), "Process terminated by signal %d (%s)%s",
+                         signalNum, strsignal(signalNum), WCOREDUMP(status) ? ", core dumped" : "");
+                setError(signalMsg);
+            }
+            stopStage_ = 0;
+            setLifecycleState(LIFECYCLE_STOPPED);
+        } else if (result == -1 && errno == ECHILD) {
+            // Process not found
+            unwatchChild();
+            armStopTimer(0.0);
+            stopStage_ = 0;
+            setLifecycleState(LIFECYCLE_STOPPED);
+            processId_ = 0;
+            isRunning_ = false;
+            processCommandLine_.clear();
+            runningArgs_.clear();
+            setIntegerParam(statusIndex_, 0);
+            setIntegerParam(startIndex_, 0);
+            setStringParam(processIdIndex_, "0");
+            setIntegerParam(activeHttpPortIndex_, 0);
+            setError("Process not found - may have been killed externally");
+        }
+    } else {
+        // Child was already reaped by stop/cleanup; drop the stale pidfd
+        unwatchChild();
+    }
+    // The standby only ever replaces a running instance
+    if (!isRunning_ && switchState_ != SWITCHOVER_IDLE) {
+        abortSwitchover();
+    }
+    if (!isRunning_ && telemetryPid_ != 0) {
+        telemetryPid_ = 0;
+        armTelemetryTimer(0.0);
+        procStats_.close();
+        udpStats_.close();
+        clearTelemetry();
+        publishLog();
+        gcLog_.drain();
+        publishGc(NULL);
+        setDoubleParam(gcPausePercentIndex_, 0.0);
+    }
+    if (tuneState_ != AUTOTUNE_IDLE && !isRunning_) {
+        autotuneProcessExited();
+    }
+    // The one restart of an APPLY; startProcess reports a failure in ERROR_MSG
+    if (applyRestart_ && !isRunning_) {
+        applyRestart_ = false;
+        if (lifecycleState_ == LIFECYCLE_STOPPED) {
+            startProcess();
+        }
+    }
+    updateConfigDirty();
+    epicsMutexUnlock(mutex_);
+    
+    callParamCallbacks();
+    unlock();
 }
 
-// Set error message
-void tpx3servalDriver::setError(const char *errorMsg)
+// Stop timer expired: escalate SIGTERM to SIGKILL, then give up waiting
+void tpx3servalDriver::handleTimerEvent()
 {
-    setStringParam(errorMsgIndex_, errorMsg);
-    printf("%s:%s: Error: %s\n", driverName, __FUNCTION__, errorMsg);
+    lock();
+    epicsMutexLock(mutex_);
+    if (lifecycleState_ == LIFECYCLE_STOPPING && processId_ > 0) {
+        if (stopStage_ == 1) {
+            if (kill(processId_, SIGKILL) == 0) {
+                printf("%s:%s: Sent SIGKILL to process %d\n", driverName, __FUNCTION__, processId_);
+                setStringParam(errorMsgIndex_, "Sending SIGKILL to process");
+            }
+            stopStage_ = 2;
+            armStopTimer(stopKillTimeout_ > 0.0 ? stopKillTimeout_ : 1e-6);
+        } else if (stopStage_ == 2) {
+            char stuckMsg[100];
+            snprintf(stuckMsg, sizeof(stuckMsg), "Process %d did not exit after SIGKILL", processId_);
+            setError(stuckMsg);
+        }
+    }
+    epicsMutexUnlock(mutex_);
+
+    callParamCallbacks();
+    unlock();
 }
 
-// Update file path RBV parameter with combined path and filename
-void tpx3servalDriver::updateFileRbvs()
+// Arm a one-shot timerfd; 0 disarms it
+static void armOneShotTimer(int fd, double seconds)
 {
-    // Helper function to combine path and filename
-    auto combinePathAndFile = [](const std::string& path, const std::string& filename) -> std::string {
-        std::string fullPath = path;
-        if (!fullPath.empty() && fullPath.back() != '/' && fullPath.back() != '\\') {
-            fullPath += "/";
-        }
-        fullPath += filename;
-        return fullPath;
-    };
-    
-    // Update JarFile_RBV
-    std::string fullJarPath = combinePathAndFile(jarFilePath_, jarFileName_);
-    setStringParam(jarFileRbvIndex_, fullJarPath.c_str());
-    
-    // Trigger callbacks to update PVs
-    callParamCallbacks();
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (seconds > 0.0) {
+        its.it_value.tv_sec = (time_t)seconds;
+        its.it_value.tv_nsec = (long)((seconds - (double)its.it_value.tv_sec) * 1e9);
+    }
+    if (fd >= 0) {
+        timerfd_settime(fd, 0, &its, NULL);
+    }
 }
 
-// Global driver instance for cleanup
-static tpx3servalDriver* g_driver = NULL;
-static bool g_cleanup_done = false;
+// Arm the one-shot stop timer; 0 disarms it
+void tpx3servalDriver::armStopTimer(double seconds)
+{
+    armOneShotTimer(timerFd_, seconds);
+}
 
-// Export driver
-extern "C" {
-    int tpx3servalConfigure(const char *portName, int maxAddr)
-    {
-        // Store the driver instance globally for cleanup during IOC shutdown
-        if (g_driver) {
-            delete g_driver;  // Clean up any existing instance
+// Arm the one-shot autotune timer; 0 disarms it. Any thread.
+void tpx3servalDriver::armAutotuneTimer(double seconds)
+{
+    armOneShotTimer(tuneTimerFd_, seconds);
+}
+
+// Arm a periodic timerfd; 0 disarms it so an idle IOC never wakes up
+static void armPeriodicTimer(int fd, double period)
+{
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (period > 0.0) {
+        its.it_interval.tv_sec = (time_t)period;
+        its.it_interval.tv_nsec = (long)((period - (double)its.it_interval.tv_sec) * 1e9);
+        its.it_value = its.it_interval;
+    }
+    if (fd >= 0) {
+        timerfd_settime(fd, 0, &its, NULL);
+    }
+}
+
+// Arm the periodic telemetry timer while a process runs
+void tpx3servalDriver::armTelemetryTimer(double period)
+{
+    armPeriodicTimer(telemetryFd_, period);
+}
+
+// Arm the stream publish timer while the stream engine runs
+void tpx3servalDriver::armStreamTimer(double period)
+{
+    armPeriodicTimer(streamTimerFd_, period);
+}
+
+// Telemetry tick: read /proc with no lock held, then publish under the port lock
+void tpx3servalDriver::handleTelemetryEvent()
+{
+    pid_t pid = telemetryPid_;
+    if (pid <= 0) {
+        procStats_.close();
+        udpStats_.close();
+        return;
+    }
+    if (procStats_.pid() != pid && !procStats_.open(pid)) {
+        return;
+    }
+    if (udpStats_.pid() != pid) {
+        udpStats_.open(pid);
+    }
+
+    tpx3ProcSample sample;
+    if (!procStats_.sample(&sample)) {
+        // Process is gone; handleChildEvent will report it
+        procStats_.close();
+        udpStats_.close();
+        return;
+    }
+    tpx3UdpSample udp;
+    bool haveUdp = udpStats_.sample(&udp);
+
+    lock();
+    if (telemetryPid_ == pid) {
+        setDoubleParam(procCpuPercentIndex_, sample.cpuPercent);
+        setDoubleParam(procRssIndex_, sample.rssMB);
+        setDoubleParam(procVmHwmIndex_, sample.vmHwmMB);
+        setIntegerParam(procThreadsIndex_, sample.threads);
+        setDoubleParam(procVolCtxRateIndex_, sample.volCtxSwitchRate);
+        setDoubleParam(procInvolCtxRateIndex_, sample.involCtxSwitchRate);
+        setDoubleParam(procReadRateIndex_, sample.readRate / 1e6);
+        setDoubleParam(procWriteRateIndex_, sample.writeRate / 1e6);
+        // A stage whose busiest thread is close to a full core limits the pipeline
+        int bottleneck = -1;
+        double bottleneckCpu = BOTTLENECK_CPU_PERCENT;
+        for (int stage = 0; stage < TPX3_NUM_STAGES; stage++) {
+            setDoubleParam(stageCpuIndex_[stage], sample.stageCpu[stage]);
+            setDoubleParam(stageMaxCpuIndex_[stage], sample.stageMaxCpu[stage]);
+            setIntegerParam(stageThreadsIndex_[stage], sample.stageThreads[stage]);
+            if (stage < TPX3_STAGE_JVM && sample.stageMaxCpu[stage] >= bottleneckCpu) {
+                bottleneck = stage;
+                bottleneckCpu = sample.stageMaxCpu[stage];
+            }
         }
-        g_driver = new tpx3servalDriver(portName, maxAddr);
-        return asynSuccess;
+        setStringParam(bottleneckStageIndex_, bottleneck >= 0 ? tpx3ProcStats::stageName(bottleneck) : "None");
+        if (haveUdp) {
+            publishUdpSample(udp);
+        }
+        publishLog();
+        gcLog_.drain();
+        publishGc(haveUdp ? &udp : NULL);
+        if (tuneState_ == AUTOTUNE_MEASURING) {
+            tuneCpuSum_ += sample.cpuPercent;
+            tuneCpuSamples_++;
+        }
+        callParamCallbacks();
     }
-    
-    // Function to get driver instance for cleanup
-    tpx3servalDriver* getTpx3servalDriver()
-    {
-        return g_driver;
+    unlock();
+}
+
+// Publish kernel UDP counters and latch UDP_LOSS on new drops. The snmp
+// counters are namespace wide, so they only count while Serval has sockets open.
+// Drops outside a measurement (e.g. a stray sender while idle) lose no data, so
+// the latch waits for MEAS_STATUS to read DA_RECORDING. Without REST polling
+// the measurement state is unknown and open sockets are the only guard.
+void tpx3servalDriver::publishUdpSample(const tpx3UdpSample &udp)
+{
+    setDoubleParam(udpInDatagramRateIndex_, udp.inDatagramRate);
+    setDoubleParam(udpInErrorsIndex_, (double)udp.inErrors);
+    setDoubleParam(udpInErrorRateIndex_, udp.inErrorRate);
+    setDoubleParam(udpRcvbufErrorsIndex_, (double)udp.rcvbufErrors);
+    setDoubleParam(udpRcvbufErrorRateIndex_, udp.rcvbufErrorRate);
+    setIntegerParam(udpSocketsIndex_, udp.sockets);
+    setDoubleParam(udpSocketDropsIndex_, (double)udp.socketDrops);
+    setDoubleParam(udpSocketDropRateIndex_, udp.socketDropRate);
+    setDoubleParam(udpRxQueueIndex_, udp.rxQueueBytes / 1024.0);
+    setDoubleParam(udpRxQueueMaxIndex_, udp.rxQueueMaxBytes / 1024.0);
+
+    bool loss = udp.socketDropRate > 0.0 ||
+                (udp.sockets > 0 && (udp.rcvbufErrorRate > 0.0 || udp.inErrorRate > 0.0));
+    bool recording = true;
+    if (httpPollPeriod_ > 0.0) {
+        char measStatus[64] = "";
+        getStringParam(measStatusIndex_, sizeof(measStatus), measStatus);
+        recording = (strcmp(measStatus, MEAS_STATUS_RECORDING) == 0);
+    }
+    int lossLatched = 0;
+    getIntegerParam(udpLossIndex_, &lossLatched);
+    if (loss && recording && !lossLatched) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "UDP packet loss detected: %llu socket drops, %llu receive buffer errors",
+                 (unsigned long long)udp.socketDrops, (unsigned long long)udp.rcvbufErrors);
+        setIntegerParam(udpLossIndex_, 1);
+        setStringParam(errorMsgIndex_, msg);
+    }
+}
+
+// Publish the log tail and counts; the port lock is held. Rates are since the
+// previous call, so this runs on the telemetry tick.
+void tpx3servalDriver::publishLog()
+{
+    tpx3LogStats stats;
+    servalLog_.getStats(&stats);
+    setStringParam(logTailIndex_, servalLog_.tail(logTailLines_, LOG_TAIL_CHARS).c_str());
+    setDoubleParam(logLinesIndex_, (double)stats.lines);
+    setDoubleParam(logLineRateIndex_, stats.lineRate);
+    for (int kind = 0; kind < TPX3_LOG_KINDS; kind++) {
+        setDoubleParam(logCountIndex_[kind], (double)stats.counts[kind]);
+        setDoubleParam(logRateIndex_[kind], stats.rates[kind]);
+        setStringParam(logLastIndex_[kind], stats.last[kind].c_str());
+    }
+    if (!stats.fileError.empty() && stats.fileError != logFileError_) {
+        logFileError_ = stats.fileError;
+        setStringParam(errorMsgIndex_, logFileError_.c_str());
+    }
+}
+
+// Publish GC pause statistics; the port lock is held. The UDP counters are only
+// sampled on the telemetry tick, so a pause overlaps drops when both fall in the
+// same telemetry period.
+void tpx3servalDriver::publishGc(const tpx3UdpSample *udp)
+{
+    tpx3GcStats gc;
+    gcLog_.getStats(&gc);
+    setDoubleParam(gcPausesIndex_, (double)gc.pauses);
+    setDoubleParam(gcLastPauseIndex_, gc.lastPauseMs);
+    setDoubleParam(gcMaxPauseIndex_, gc.maxPauseMs);
+    setDoubleParam(gcPausePercentIndex_,
+                   gc.windowSeconds > 0.0 ? gc.windowPauseMs / (gc.windowSeconds * 10.0) : 0.0);
+    setDoubleParam(gcHeapAfterIndex_, gc.heapAfterMB);
+    setDoubleParam(gcHeapSizeIndex_, gc.heapSizeMB);
+    bool histChanged = false;
+    for (int bin = 0; bin < TPX3_GC_HIST_BINS; bin++) {
+        if (gcPauseHist_[bin] != (epicsInt32)gc.hist[bin]) {
+            gcPauseHist_[bin] = (epicsInt32)gc.hist[bin];
+            histChanged = true;
+        }
+    }
+    if (histChanged) {
+        doCallbacksInt32Array(&gcPauseHist_[0], gcPauseHist_.size(), gcPauseHistIndex_, 0);
+    }
+
+    bool drops = udp && (udp->socketDropRate > 0.0 || (udp->sockets > 0 && udp->rcvbufErrorRate > 0.0));
+    if (gc.windowPauses > 0 && drops) {
+        gcDropOverlaps_++;
+        setIntegerParam(gcDropOverlapsIndex_, gcDropOverlaps_);
+        int latched = 0;
+        getIntegerParam(gcDropOverlapIndex_, &latched);
+        if (!latched) {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "UDP drops in the same %.1f s as a %.1f ms GC pause",
+                     gc.windowSeconds, gc.windowMaxPauseMs);
+            setIntegerParam(gcDropOverlapIndex_, 1);
+            setStringParam(errorMsgIndex_, msg);
+        }
+    }
+}
+
+// Start the stream engine on the configured source; the port lock is held
+asynStatus tpx3servalDriver::startStream()
+{
+    std::string error;
+    bool ok;
+    // The preview and histograms count from STREAM_ENABLE; the engine is stopped so the counters are quiet
+    preview_.reset();
+    histogram_.reset();
+    centroid_.reset();
+    centroid_.getStats(&prevCentStats_);
+    trigger_.reset();
+    mask_.chipHits(prevChipHits_);
+    // A spool replay must not overwrite the ring it reads from
+    spool_.setRecording(streamSource_ != STREAM_SOURCE_SPOOL);
+    if (streamSource_ == STREAM_SOURCE_FILE) {
+        if (streamFile_.empty()) {
+            setStringParam(errorMsgIndex_, "Stream replay file not set");
+            setIntegerParam(streamEnableIndex_, 0);
+            return asynError;
+        }
+        ok = stream_.startFile(streamFile_, streamWorkers_, streamReplayLoop_, streamReplayRate_, &error);
+    } else if (streamSource_ == STREAM_SOURCE_SPOOL) {
+        std::vector<tpx3StreamExtent> extents;
+        ok = spool_.selectRange(spoolRangeFrom_, spoolRangeTo_, &extents, &error) &&
+             stream_.startExtents(extents, streamWorkers_, streamReplayRate_, &error);
+    } else {
+        ok = stream_.startTcp(streamPort_, streamWorkers_, &error);
+    }
+    if (!ok) {
+        setError(error.c_str());
+        setIntegerParam(streamEnableIndex_, 0);
+        return asynError;
+    }
+
+    stream_.getStats(&prevStreamStats_);
+    tpx3SpoolStats spool;
+    spool_.getStats(&spool);
+    prevSpoolWritten_ = spool.written;
+    prevStreamTime_ = monotonicSeconds();
+    previewLastPublish_ = prevStreamTime_;
+    histLastPublish_ = prevStreamTime_;
+    armStreamTimer(streamPublishPeriod_);
+    setIntegerParam(streamRunningIndex_, 1);
+    setIntegerParam(streamSourceDoneIndex_, 0);
+    char msg[MAX_ERROR_LENGTH];
+    if (streamSource_ == STREAM_SOURCE_FILE) {
+        snprintf(msg, sizeof(msg), "Stream replaying %s with %d workers", streamFile_.c_str(), streamWorkers_);
+    } else if (streamSource_ == STREAM_SOURCE_SPOOL) {
+        snprintf(msg, sizeof(msg), "Stream replaying the spool with %d workers", streamWorkers_);
+    } else {
+        snprintf(msg, sizeof(msg), "Stream listening on port %d with %d workers", streamPort_, streamWorkers_);
+    }
+    setStringParam(errorMsgIndex_, msg);
+    return asynSuccess;
+}
+
+// Stop the stream engine; totals stay visible, rates drop to 0
+void tpx3servalDriver::stopStream()
+{
+    armStreamTimer(0.0);
+    stream_.stop();
+    setIntegerParam(streamRunningIndex_, 0);
+    setIntegerParam(streamConnectedIndex_, 0);
+    setDoubleParam(streamRateIndex_, 0.0);
+    setDoubleParam(streamChunkRateIndex_, 0.0);
+    setDoubleParam(streamHitRateIndex_, 0.0);
+    setDoubleParam(streamTdcRateIndex_, 0.0);
+    setDoubleParam(streamGlobalTimeRateIndex_, 0.0);
+    setDoubleParam(streamControlRateIndex_, 0.0);
+    setDoubleParam(streamOtherRateIndex_, 0.0);
+    setDoubleParam(centEventRateIndex_, 0.0);
+    setDoubleParam(trigRateIndex_, 0.0);
+    setDoubleParam(spoolWriteRateIndex_, 0.0);
+    std::fill(chipHitRate_.begin(), chipHitRate_.end(), 0);
+    doCallbacksInt32Array(&chipHitRate_[0], chipHitRate_.size(), chipHitRateIndex_, 0);
+    if (maskAcquiring_) {
+        mask_.abortAcquisition();
+        maskAcquiring_ = false;
+        setIntegerParam(maskAcquireIndex_, 0);
+        setStringParam(errorMsgIndex_, "Stream stopped - noisy-pixel acquisition aborted");
+    } else {
+        setStringParam(errorMsgIndex_, "Stream stopped");
+    }
+    // Subscribers left in the middle of a chunk were let go
+    publishRelay();
+}
+
+// Stream publish tick: snapshot the engine counters with no lock held, then publish
+void tpx3servalDriver::handleStreamEvent()
+{
+    tpx3StreamStats stats;
+    stream_.getStats(&stats);
+    tpx3CentroidStats cent;
+    centroid_.getStats(&cent);
+    double now = monotonicSeconds();
+    double dt = now - prevStreamTime_;
+    if (!stats.running || dt <= 0.0) {
+        return;
+    }
+    const tpx3StreamStats &prev = prevStreamStats_;
+    tpx3TriggerStats trig;
+    trigger_.analyze(dt, &trig);
+    uint64_t chipHits[TPX3_MASK_CHIPS];
+    mask_.chipHits(chipHits);
+    tpx3SpoolStats spool;
+    spool_.getStats(&spool);
+
+    lock();
+    setIntegerParam(streamConnectedIndex_, stats.connected ? 1 : 0);
+    setIntegerParam(streamSourceDoneIndex_, stats.sourceDone ? 1 : 0);
+    setDoubleParam(streamRateIndex_, (stats.bytes - prev.bytes) / dt / 1e6);
+    setDoubleParam(streamChunkRateIndex_, (stats.chunks - prev.chunks) / dt);
+    setDoubleParam(streamHitRateIndex_, (stats.packets.hits - prev.packets.hits) / dt);
+    setDoubleParam(streamTdcRateIndex_, (stats.packets.tdcs - prev.packets.tdcs) / dt);
+    setDoubleParam(streamGlobalTimeRateIndex_, (stats.packets.globalTimes - prev.packets.globalTimes) / dt);
+    setDoubleParam(streamControlRateIndex_, (stats.packets.controls - prev.packets.controls) / dt);
+    setDoubleParam(streamOtherRateIndex_, (stats.packets.others - prev.packets.others) / dt);
+    setDoubleParam(streamBytesIndex_, stats.bytes / 1e6);
+    setDoubleParam(streamHitsIndex_, (double)stats.packets.hits);
+    setDoubleParam(streamTdcsIndex_, (double)stats.packets.tdcs);
+    setDoubleParam(streamFramingErrorsIndex_, (double)stats.framingErrors);
+    setDoubleParam(streamStallsIndex_, (double)stats.stalls);
+    setIntegerParam(streamFreeBlocksIndex_, stats.freeBlocks);
+    setIntegerParam(streamMinFreeBlocksIndex_, stats.minFreeBlocks);
+    publishCentroids(cent, dt);
+    publishTrigger(trig);
+    publishChipRates(chipHits, dt);
+    publishRelay();
+    publishSpool(spool, dt);
+    callParamCallbacks();
+    bool previewDue = previewEnabled_ && now - previewLastPublish_ >= previewPeriod_;
+    bool histDue = histEnabled_ && now - histLastPublish_ >= histPeriod_;
+    bool maskDue = maskAcquiring_ && now - maskStart_ >= maskAcquireTime_;
+    unlock();
+
+    prevStreamStats_ = stats;
+    prevCentStats_ = cent;
+    prevStreamTime_ = now;
+    if (previewDue) {
+        previewLastPublish_ = now;
+        publishPreview();
+    }
+    if (histDue) {
+        histLastPublish_ = now;
+        publishHistograms();
+    }
+    if (maskDue) {
+        finishMaskAcquisition(now);
+    }
+}
+
+// Merge the workers' histograms with no lock held, then publish both arrays
+void tpx3servalDriver::publishHistograms()
+{
+    histogram_.merge();
+
+    lock();
+    uint64_t totCount, toaCount, noTdcCount;
+    histogram_.read(histMode_ == HIST_MODE_LIVE, (int32_t *)&histTot_[0], (int32_t *)&histToa_[0],
+                    &totCount, &toaCount, &noTdcCount);
+    setDoubleParam(histTotCountsIndex_, (double)totCount);
+    setDoubleParam(histToaCountsIndex_, (double)toaCount);
+    setDoubleParam(histNoTdcIndex_, (double)noTdcCount);
+    doCallbacksInt32Array(&histTot_[0], tpx3HistTotBins(histConfig_), histTotIndex_, 0);
+    doCallbacksInt32Array(&histToa_[0], histConfig_.toaBins, histToaIndex_, 0);
+    callParamCallbacks();
+    unlock();
+}
+
+// Centroid rates over the last stream tick and the size distribution since
+// STREAM_ENABLE or CENT_RESET. Port lock held.
+void tpx3servalDriver::publishCentroids(const tpx3CentroidStats &cent, double dt)
+{
+    const tpx3CentroidStats &prev = prevCentStats_;
+    // CENT_RESET between ticks makes the totals go backwards
+    uint64_t events = cent.events >= prev.events ? cent.events - prev.events : cent.events;
+    uint64_t hits = cent.hits >= prev.hits ? cent.hits - prev.hits : cent.hits;
+    setDoubleParam(centEventRateIndex_, events / dt);
+    setDoubleParam(centEventsIndex_, (double)cent.events);
+    if (events > 0) {
+        setDoubleParam(centMeanSizeIndex_, (double)hits / events);
+    }
+    setIntegerParam(centOutputConnectedIndex_, cent.outputConnected ? 1 : 0);
+    setDoubleParam(centOutputSentIndex_, (double)cent.sent);
+    setDoubleParam(centOutputDroppedIndex_, (double)cent.dropped);
+    if (centEnabled_) {
+        for (int b = 0; b < TPX3_CENT_SIZE_BINS; b++) {
+            centSizeHist_[b] = (epicsInt32)std::min(cent.sizeHist[b], (uint64_t)0x7FFFFFFF);
+        }
+        doCallbacksInt32Array(&centSizeHist_[0], centSizeHist_.size(), centSizeHistIndex_, 0);
+    }
+}
+
+// Trigger timing over the last stream tick; periods stay at their last value
+// while no intervals arrive. Port lock held.
+void tpx3servalDriver::publishTrigger(const tpx3TriggerStats &trig)
+{
+    setDoubleParam(trigRateIndex_, trig.rate);
+    if (trig.periodMeanNs > 0.0) {
+        setDoubleParam(trigPeriodMeanIndex_, trig.periodMeanNs / 1e3);
+        setDoubleParam(trigPeriodMinIndex_, trig.periodMinNs / 1e3);
+        setDoubleParam(trigPeriodMaxIndex_, trig.periodMaxNs / 1e3);
+        setDoubleParam(trigJitterIndex_, trig.jitterNs);
+    }
+    if (trig.pulseWidthNs > 0.0) {
+        setDoubleParam(trigPulseWidthIndex_, trig.pulseWidthNs / 1e3);
+    }
+    setDoubleParam(trigEdgesIndex_, (double)trig.edges);
+    setDoubleParam(trigMissingIndex_, (double)trig.missing);
+    setDoubleParam(trigExtraIndex_, (double)trig.extra);
+    setDoubleParam(trigOutOfTolIndex_, (double)trig.outOfTolerance);
+}
+
+// Hits/s per chip over the last stream tick. Port lock held.
+void tpx3servalDriver::publishChipRates(const uint64_t hits[TPX3_MASK_CHIPS], double dt)
+{
+    for (int c = 0; c < TPX3_MASK_CHIPS; c++) {
+        double rate = (hits[c] - prevChipHits_[c]) / dt;
+        chipHitRate_[c] = (epicsInt32)std::min(rate, 2147483647.0);
+        prevChipHits_[c] = hits[c];
+    }
+    doCallbacksInt32Array(&chipHitRate_[0], chipHitRate_.size(), chipHitRateIndex_, 0);
+}
+
+// Flag the noisy pixels of a finished acquisition with no lock held, then publish
+void tpx3servalDriver::finishMaskAcquisition(double now)
+{
+    lock();
+    // MASK_ACQUIRE=0 or a stream stop may have ended it since the tick looked
+    bool acquiring = maskAcquiring_;
+    maskAcquiring_ = false;
+    double seconds = now - maskStart_;
+    double nSigma = maskSigma_;
+    unlock();
+    if (!acquiring) {
+        return;
+    }
+
+    tpx3MaskResult result;
+    mask_.finishAcquisition(seconds, nSigma, &result);
+
+    lock();
+    uint64_t hits = 0;
+    epicsInt32 noisy = 0;
+    for (int c = 0; c < TPX3_MASK_CHIPS; c++) {
+        maskNoisy_[c] = (epicsInt32)result.noisy[c];
+        noisy += maskNoisy_[c];
+        hits += result.hits[c];
+    }
+    setIntegerParam(maskAcquireIndex_, 0);
+    setIntegerParam(maskNoisyTotalIndex_, noisy);
+    setDoubleParam(maskNoisyShareIndex_, hits ? 100.0 * result.noisyHits / hits : 0.0);
+    doCallbacksInt32Array(&maskNoisy_[0], maskNoisy_.size(), maskNoisyIndex_, 0);
+    char msg[MAX_ERROR_LENGTH];
+    snprintf(msg, sizeof(msg), "Noisy-pixel acquisition done: %d pixels above %.1f sigma",
+             (int)noisy, nSigma);
+    setStringParam(errorMsgIndex_, msg);
+    callParamCallbacks();
+    unlock();
+}
+
+// Listen for a centroid output client on CENT_OUTPUT_PORT. Port lock held.
+asynStatus tpx3servalDriver::startCentroidOutput()
+{
+    std::string error;
+    if (!centroid_.startOutput(centOutputPort_, &error)) {
+        setError(error.c_str());
+        setIntegerParam(centOutputEnableIndex_, 0);
+        return asynError;
+    }
+    char msg[MAX_ERROR_LENGTH];
+    snprintf(msg, sizeof(msg), "Centroid output listening on port %d", centOutputPort_);
+    setStringParam(errorMsgIndex_, msg);
+    return asynSuccess;
+}
+
+// Listen for relay subscribers on every RELAYn_PORT above 0. Port lock held.
+asynStatus tpx3servalDriver::startRelay()
+{
+    std::string error;
+    int slots = 0;
+    for (int i = 0; i < TPX3_RELAY_SLOTS; i++) {
+        if (relayPorts_[i] > 0) {
+            slots++;
+        }
+    }
+    if (slots == 0) {
+        setStringParam(errorMsgIndex_, "Stream relay needs at least one RELAYn_PORT");
+        setIntegerParam(relayEnableIndex_, 0);
+        return asynError;
+    }
+    if (!relay_.start(relayPorts_, &error)) {
+        setError(error.c_str());
+        setIntegerParam(relayEnableIndex_, 0);
+        return asynError;
+    }
+    char msg[MAX_ERROR_LENGTH];
+    snprintf(msg, sizeof(msg), "Stream relay listening on %d port%s", slots, slots == 1 ? "" : "s");
+    setStringParam(errorMsgIndex_, msg);
+    return asynSuccess;
+}
+
+// Relay subscriber state and totals since RELAY_ENABLE. Port lock held.
+void tpx3servalDriver::publishRelay()
+{
+    tpx3RelaySlotStats stats[TPX3_RELAY_SLOTS];
+    relay_.getStats(stats);
+    for (int i = 0; i < TPX3_RELAY_SLOTS; i++) {
+        setIntegerParam(relayConnectedIndex_[i], stats[i].connected ? 1 : 0);
+        setDoubleParam(relayLagIndex_[i], stats[i].lagBytes / 1e6);
+        setDoubleParam(relaySentIndex_[i], stats[i].sentBytes / 1e6);
+        setDoubleParam(relayDroppedIndex_[i], stats[i].droppedBytes / 1e6);
+        setDoubleParam(relayDisconnectsIndex_[i], (double)stats[i].disconnects);
+    }
+}
+
+// Create the spool segments and start recording. Port lock held.
+asynStatus tpx3servalDriver::startSpool()
+{
+    std::string error;
+    if (!spool_.start(spoolDir_, spoolSegments_, (size_t)spoolSegmentMB_ << 20, &error)) {
+        setError(error.c_str());
+        setIntegerParam(spoolEnableIndex_, 0);
+        return asynError;
+    }
+    spool_.setRecording(!(streamSource_ == STREAM_SOURCE_SPOOL && stream_.running()));
+    prevSpoolWritten_ = 0;
+    char msg[MAX_ERROR_LENGTH];
+    snprintf(msg, sizeof(msg), "Spool of %d x %d MB in %s started", spoolSegments_, spoolSegmentMB_, spoolDir_.c_str());
+    setStringParam(errorMsgIndex_, msg);
+    return asynSuccess;
+}
+
+// Spool fill, write bandwidth over the last stream tick, and totals since
+// SPOOL_ENABLE. Port lock held.
+void tpx3servalDriver::publishSpool(const tpx3SpoolStats &spool, double dt)
+{
+    if (!spool.running) {
+        return;
+    }
+    // SPOOL_ENABLE may have restarted the spool since the last tick
+    uint64_t written = spool.written >= prevSpoolWritten_ ? spool.written - prevSpoolWritten_ : spool.written;
+    prevSpoolWritten_ = spool.written;
+    setDoubleParam(spoolFillIndex_, spool.capacity ? 100.0 * spool.held / spool.capacity : 0.0);
+    setDoubleParam(spoolWriteRateIndex_, written / dt / 1e6);
+    setDoubleParam(spoolOldestAgeIndex_, spool.oldestAge);
+    setDoubleParam(spoolWrittenIndex_, spool.written / 1e6);
+    setDoubleParam(spoolSkippedIndex_, spool.skipped / 1e6);
+    setDoubleParam(spoolExportedIndex_, spool.exported / 1e6);
+}
+
+// A spool export finished: collect the result and publish it
+void tpx3servalDriver::handleSpoolExportEvent()
+{
+    std::string error;
+    tpx3SpoolStats spool;
+    spool_.getStats(&spool);
+
+    lock();
+    // Under the lock, so SPOOL_EXPORT cannot start the next export meanwhile
+    bool ok = spool_.finishExport(&error);
+    setIntegerParam(spoolExportIndex_, 0);
+    setDoubleParam(spoolExportedIndex_, spool.exported / 1e6);
+    if (ok) {
+        char msg[MAX_ERROR_LENGTH];
+        snprintf(msg, sizeof(msg), "Spool range written to %s (%.1f MB)", spoolExportFile_.c_str(),
+                 spool.exported / 1e6);
+        setStringParam(errorMsgIndex_, msg);
+    } else {
+        setError(error.c_str());
+    }
+    callParamCallbacks();
+    unlock();
+}
+
+// Check the settings and begin a tune; a running Serval is stopped for the
+// first trial. Port lock held.
+asynStatus tpx3servalDriver::startAutotune()
+{
+    std::vector<int> candidates[TPX3_TUNE_PARAMS];
+    std::string problem;
+    if (lifecycleState_ == LIFECYCLE_STOPPING) {
+        problem = "Stop in progress - autotune not started";
+    } else if (switchState_ != SWITCHOVER_IDLE) {
+        problem = "Switchover in progress - autotune not started";
+    } else if (telemetryPeriod_ <= 0.0) {
+        problem = "Autotune needs TELEMETRY_PERIOD above 0";
+    } else if (httpPollPeriod_ <= 0.0) {
+        problem = "Autotune needs HTTP_POLL_PERIOD above 0";
+    } else if (tuneProfileDir_.empty()) {
+        problem = "Autotune profile directory not set";
+    } else {
+        size_t total = 0;
+        for (int p = 0; p < TPX3_TUNE_PARAMS && problem.empty(); p++) {
+            std::string error;
+            if (!tpx3Autotuner::parseCandidates(tuneCandidates_[p], &candidates[p], &error)) {
+                problem = std::string("Invalid autotune candidates for ") + tpx3Autotuner::paramName(p) + ": " + error;
+            }
+            total += candidates[p].size();
+        }
+        if (problem.empty() && total == 0) {
+            problem = "No autotune candidates set";
+        }
+    }
+    if (!problem.empty()) {
+        setError(problem.c_str());
+        setIntegerParam(autotuneIndex_, 0);
+        return asynError;
+    }
+
+    // The search starts from the options as buildArgs() would pass them
+    tpx3TuneProfile start;
+    for (int p = 0; p < TPX3_TUNE_PARAMS; p++) {
+        tuneSavedValues_[p] = *tuneValue(p);
+        tuneSavedEnables_[p] = *tuneEnable(p);
+        start.values[p] = (*tuneEnable(p) && *tuneValue(p) > 0) ? *tuneValue(p) : 0;
+    }
+    tuner_.begin(start, candidates, tunePasses_);
+    tuneAborting_ = false;
+    tuneWasRunning_ = isRunning_;
+    setStringParam(autotuneBestIndex_, "");
+    setDoubleParam(autotuneBestPixelRateIndex_, 0.0);
+    setDoubleParam(autotuneBestDropRateIndex_, 0.0);
+    setDoubleParam(autotuneBestCpuIndex_, 0.0);
+    setDoubleParam(autotuneLastPixelRateIndex_, 0.0);
+    setDoubleParam(autotuneLastDropRateIndex_, 0.0);
+    setDoubleParam(autotuneLastCpuIndex_, 0.0);
+    printf("%s:%s: Autotune of up to %d trials started\n", driverName, __FUNCTION__, tuner_.trialsPlanned());
+
+    if (isRunning_) {
+        tuneState_ = AUTOTUNE_STOPPING;
+        if (stopProcess() != asynSuccess) {
+            finishAutotune("Serval could not be stopped");
+            return asynError;
+        }
+    } else {
+        nextAutotuneTrial();
+        if (tuneState_ == AUTOTUNE_IDLE) {
+            return asynError;
+        }
+    }
+    publishAutotune();
+    return asynSuccess;
+}
+
+// AUTOTUNE=0: end the trial; the settings are put back once Serval has exited.
+// Port lock held.
+void tpx3servalDriver::abortAutotune()
+{
+    tuneAborting_ = true;
+    armAutotuneTimer(0.0);
+    stopAutotuneLoad();
+    if (lifecycleState_ == LIFECYCLE_STARTING || lifecycleState_ == LIFECYCLE_READY) {
+        tuneState_ = AUTOTUNE_STOPPING;
+        if (stopProcess() != asynSuccess) {
+            finishAutotune("Serval could not be stopped");
+        }
+    } else if (!isRunning_) {
+        finishAutotune("");
+    } else {
+        tuneState_ = AUTOTUNE_STOPPING;
+    }
+    publishAutotune();
+    if (tuneState_ != AUTOTUNE_IDLE) {
+        setStringParam(errorMsgIndex_, "Autotune aborting, waiting for Serval to stop");
+    }
+}
+
+// Start Serval with the next candidate profile, or finish. Port lock held.
+void tpx3servalDriver::nextAutotuneTrial()
+{
+    tpx3TuneProfile trial;
+    if (tuneAborting_ || !tuner_.next(&trial)) {
+        finishAutotune("");
+        return;
+    }
+    applyTuneProfile(trial);
+    setStringParam(autotuneCandidateIndex_, tpx3Autotuner::format(trial).c_str());
+    if (startProcess() != asynSuccess) {
+        // Down to the installation rather than the candidate: no point going on
+        char reason[MAX_ERROR_LENGTH];
+        getStringParam(errorMsgIndex_, sizeof(reason), reason);
+        finishAutotune(std::string("Serval could not be started: ") + reason);
+        return;
+    }
+    tuneState_ = AUTOTUNE_STARTING;
+    armAutotuneTimer(readyTimeout_ > 0.0 ? readyTimeout_ : AUTOTUNE_READY_TIMEOUT);
+    publishAutotune();
+}
+
+// Record the trial's score and stop Serval; the next trial starts once it has
+// exited. Port lock held.
+void tpx3servalDriver::endAutotuneTrial(const tpx3TuneScore &score, const std::string &failure)
+{
+    armAutotuneTimer(0.0);
+    stopAutotuneLoad();
+    tuner_.report(score);
+    setDoubleParam(autotuneLastPixelRateIndex_, score.pixelRate);
+    setDoubleParam(autotuneLastDropRateIndex_, score.dropRate);
+    setDoubleParam(autotuneLastCpuIndex_, score.cpuPercent);
+
+    char candidate[MAX_ERROR_LENGTH];
+    getStringParam(autotuneCandidateIndex_, sizeof(candidate), candidate);
+    char msg[MAX_ERROR_LENGTH];
+    if (score.valid) {
+        snprintf(msg, sizeof(msg), "Autotune trial %d: %.0f Hz pixel rate, %.1f Hz drops, %.0f %% CPU",
+                 tuner_.trialsDone(), score.pixelRate, score.dropRate, score.cpuPercent);
+    } else {
+        snprintf(msg, sizeof(msg), "Autotune trial %d failed: %s", tuner_.trialsDone(), failure.c_str());
+    }
+    printf("%s:%s: %s (%s)\n", driverName, __FUNCTION__, msg, candidate);
+
+    tuneState_ = AUTOTUNE_STOPPING;
+    if (lifecycleState_ == LIFECYCLE_STARTING || lifecycleState_ == LIFECYCLE_READY) {
+        if (stopProcess() != asynSuccess) {
+            finishAutotune("Serval could not be stopped");
+            return;
+        }
+    } else if (!isRunning_) {
+        nextAutotuneTrial();
+        return;
+    }
+    setStringParam(errorMsgIndex_, msg);
+}
+
+// Apply and save the best profile, or put the options back after an abort or
+// a failure; then restart Serval if it ran before the tune. Port lock held.
+void tpx3servalDriver::finishAutotune(const std::string &failure)
+{
+    armAutotuneTimer(0.0);
+    stopAutotuneLoad();
+    tuneState_ = AUTOTUNE_IDLE;
+    bool completed = failure.empty() && !tuneAborting_ && tuner_.haveBest();
+    std::string error;
+    std::string path = tuneProfilePath();
+    bool saved = false;
+    if (completed) {
+        applyTuneProfile(tuner_.best());
+        saved = tpx3Autotuner::saveProfile(path, tuner_.best(), tuner_.bestScore(), &error);
+    } else {
+        for (int p = 0; p < TPX3_TUNE_PARAMS; p++) {
+            *tuneValue(p) = tuneSavedValues_[p];
+            *tuneEnable(p) = tuneSavedEnables_[p];
+            setIntegerParam(tuneValueIndex_[p], tuneSavedValues_[p]);
+            setIntegerParam(tuneEnableIndex_[p], tuneSavedEnables_[p] ? 1 : 0);
+        }
+    }
+    setIntegerParam(autotuneIndex_, 0);
+    setStringParam(autotuneCandidateIndex_, "");
+    publishAutotune();
+    if (completed) {
+        setDoubleParam(autotuneProgressIndex_, 100.0);
+    }
+    if (tuneWasRunning_ && !isRunning_ && failure.empty()) {
+        startProcess();
+    }
+
+    char msg[MAX_ERROR_LENGTH];
+    if (!failure.empty()) {
+        snprintf(msg, sizeof(msg), "Autotune stopped: %s", failure.c_str());
+    } else if (tuneAborting_) {
+        snprintf(msg, sizeof(msg), "Autotune aborted after %d trials; options restored", tuner_.trialsDone());
+    } else if (!completed) {
+        snprintf(msg, sizeof(msg), "Autotune found no working profile in %d trials; options restored",
+                 tuner_.trialsDone());
+    } else if (!saved) {
+        snprintf(msg, sizeof(msg), "Autotune done, but the profile was not saved: %s", error.c_str());
+    } else {
+        snprintf(msg, sizeof(msg), "Autotune done after %d trials; profile saved to %s", tuner_.trialsDone(),
+                 path.c_str());
+    }
+    tuneAborting_ = false;
+    if (completed && saved) {
+        setStringParam(errorMsgIndex_, msg);
+        printf("%s:%s: %s\n", driverName, __FUNCTION__, msg);
+    } else {
+        setError(msg);
+    }
+}
+
+// Autotune timer: Serval became ready or a phase of the trial ran out
+void tpx3servalDriver::handleAutotuneEvent()
+{
+    lock();
+    tpx3TuneScore failed = { false, 0.0, 0.0, 0.0 };
+    std::string error;
+    if (tuneState_ == AUTOTUNE_STARTING) {
+        if (lifecycleState_ != LIFECYCLE_READY) {
+            endAutotuneTrial(failed, "Serval did not become ready");
+        } else if (!spawnAutotuneLoad(&error)) {
+            finishAutotune(error);
+        } else {
+            tuneState_ = AUTOTUNE_WARMUP;
+            armAutotuneTimer(tuneWarmup_ > 0.0 ? tuneWarmup_ : 1e-6);
+            setStringParam(errorMsgIndex_, "Autotune trial warming up");
+        }
+    } else if (tuneState_ == AUTOTUNE_WARMUP) {
+        if (!checkAutotuneLoad(&error)) {
+            endAutotuneTrial(failed, error);
+        } else {
+            double drops = 0.0, frames = 0.0;
+            getDoubleParam(udpSocketDropsIndex_, &drops);
+            getDoubleParam(measDroppedFramesIndex_, &frames);
+            tuneDropsStart_ = drops + frames;
+            tuneCpuSum_ = 0.0;
+            tuneCpuSamples_ = 0;
+            tunePixelRateSum_ = 0.0;
+            tunePixelRateSamples_ = 0;
+            tuneMeasureStart_ = monotonicSeconds();
+            tuneState_ = AUTOTUNE_MEASURING;
+            armAutotuneTimer(tuneDuration_);
+            setStringParam(errorMsgIndex_, "Autotune trial measuring");
+        }
+    } else if (tuneState_ == AUTOTUNE_MEASURING) {
+        if (!checkAutotuneLoad(&error)) {
+            endAutotuneTrial(failed, error);
+        } else if (tuneCpuSamples_ == 0 || tunePixelRateSamples_ == 0) {
+            endAutotuneTrial(failed, "no telemetry or Serval status during the trial");
+        } else if (tunePixelRateSum_ <= 0.0) {
+            endAutotuneTrial(failed, "Serval saw no pixel events - is the load running?");
+        } else {
+            double drops = 0.0, frames = 0.0;
+            getDoubleParam(udpSocketDropsIndex_, &drops);
+            getDoubleParam(measDroppedFramesIndex_, &frames);
+            double elapsed = monotonicSeconds() - tuneMeasureStart_;
+            tpx3TuneScore score;
+            score.valid = true;
+            score.pixelRate = tunePixelRateSum_ / tunePixelRateSamples_;
+            // A measurement restarted by the load resets Serval's frame counter
+            score.dropRate = std::max(drops + frames - tuneDropsStart_, 0.0) / elapsed;
+            score.cpuPercent = tuneCpuSum_ / tuneCpuSamples_;
+            endAutotuneTrial(score, "");
+        }
+    }
+    publishAutotune();
+    callParamCallbacks();
+    unlock();
+}
+
+// Serval exited during a tune: the stop between trials completed, or the
+// candidate took it down. Port lock held.
+void tpx3servalDriver::autotuneProcessExited()
+{
+    if (tuneState_ == AUTOTUNE_STOPPING) {
+        nextAutotuneTrial();
+    } else {
+        tpx3TuneScore failed = { false, 0.0, 0.0, 0.0 };
+        endAutotuneTrial(failed, "Serval exited during the trial");
+    }
+    publishAutotune();
+}
+
+// Run AUTOTUNE_LOAD_CMD with /bin/sh in a process group of its own, Serval's
+// HTTP port as $1. Without a command the load is supplied externally.
+bool tpx3servalDriver::spawnAutotuneLoad(std::string *error)
+{
+    if (tuneLoadCmd_.empty()) {
+        return true;
+    }
+    std::string port = std::to_string(httpPortEnable_ ? httpPort_ : SERVAL_DEFAULT_HTTP_PORT);
+    const char *argv[] = { "/bin/sh", "-c", tuneLoadCmd_.c_str(), "tpx3-autotune-load", port.c_str(), NULL };
+    posix_spawnattr_t attr;
+    initChildSpawnAttr(&attr, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attr, 0);
+    pid_t pid = 0;
+    int err = posix_spawn(&pid, argv[0], NULL, &attr, const_cast<char *const *>(argv), environ);
+    posix_spawnattr_destroy(&attr);
+    if (err != 0) {
+        *error = std::string("Cannot run the autotune load command: ") + strerror(err);
+        return false;
+    }
+    tuneLoadPid_ = pid;
+    tuneLoadExited_ = false;
+    return true;
+}
+
+// A load command may exit early, e.g. once it has started a measurement, but
+// not with an error
+bool tpx3servalDriver::checkAutotuneLoad(std::string *error)
+{
+    int status;
+    if (tuneLoadPid_ <= 0 || tuneLoadExited_ || waitpid(tuneLoadPid_, &status, WNOHANG) != tuneLoadPid_) {
+        return true;
+    }
+    tuneLoadExited_ = true;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        return true;
+    }
+    char msg[MAX_ERROR_LENGTH];
+    if (WIFEXITED(status)) {
+        snprintf(msg, sizeof(msg), "load command exited with code %d", WEXITSTATUS(status));
+    } else {
+        snprintf(msg, sizeof(msg), "load command terminated by signal %d", WTERMSIG(status));
+    }
+    *error = msg;
+    return false;
+}
+
+// Kill the load command's whole group, so whatever it left running in the
+// background goes too
+void tpx3servalDriver::stopAutotuneLoad()
+{
+    if (tuneLoadPid_ <= 0) {
+        return;
+    }
+    kill(-tuneLoadPid_, SIGKILL);
+    if (!tuneLoadExited_) {
+        int status;
+        waitpid(tuneLoadPid_, &status, 0);
+    }
+    tuneLoadPid_ = 0;
+    tuneLoadExited_ = false;
+}
+
+// Progress and the best profile so far. Port lock held.
+void tpx3servalDriver::publishAutotune()
+{
+    int planned = tuner_.trialsPlanned();
+    setIntegerParam(autotuneStateIndex_, tuneState_);
+    setIntegerParam(autotuneTrialIndex_, tuner_.trialsDone());
+    setIntegerParam(autotuneTrialsIndex_, planned);
+    setDoubleParam(autotuneProgressIndex_, planned > 0 ? 100.0 * tuner_.trialsDone() / planned : 0.0);
+    if (tuner_.haveBest()) {
+        const tpx3TuneScore &best = tuner_.bestScore();
+        setStringParam(autotuneBestIndex_, tpx3Autotuner::format(tuner_.best()).c_str());
+        setDoubleParam(autotuneBestPixelRateIndex_, best.pixelRate);
+        setDoubleParam(autotuneBestDropRateIndex_, best.dropRate);
+        setDoubleParam(autotuneBestCpuIndex_, best.cpuPercent);
+    }
+}
+
+int *tpx3servalDriver::tuneValue(int param)
+{
+    int *values[TPX3_TUNE_PARAMS] = { &udpReceivers_, &frameAssemblers_, &ringBufferSize_,
+                                      &networkBufferSize_, &correctionHandlers_, &processingHandlers_ };
+    return values[param];
+}
+
+bool *tpx3servalDriver::tuneEnable(int param)
+{
+    bool *enables[TPX3_TUNE_PARAMS] = { &udpReceiversEnable_, &frameAssemblersEnable_, &ringBufferSizeEnable_,
+                                        &networkBufferSizeEnable_, &correctionHandlersEnable_,
+                                        &processingHandlersEnable_ };
+    return enables[param];
+}
+
+// Set the pipeline options and their PVs; 0 disables the option. Port lock held.
+void tpx3servalDriver::applyTuneProfile(const tpx3TuneProfile &profile)
+{
+    for (int p = 0; p < TPX3_TUNE_PARAMS; p++) {
+        *tuneValue(p) = profile.values[p];
+        *tuneEnable(p) = profile.values[p] > 0;
+        setIntegerParam(tuneValueIndex_[p], profile.values[p]);
+        setIntegerParam(tuneEnableIndex_[p], profile.values[p] > 0 ? 1 : 0);
+    }
+}
+
+// One profile per host, so a shared directory serves several
+std::string tpx3servalDriver::tuneProfilePath() const
+{
+    char host[256];
+    if (gethostname(host, sizeof(host)) != 0) {
+        strcpy(host, "localhost");
+    }
+    host[sizeof(host) - 1] = '\0';
+    return tuneProfileDir_ + "/" + host + ".profile";
+}
+
+// SWITCHOVER: start a standby Serval with the current configuration on the
+// other HTTP port; the HTTP thread switches to it once it answers. Port lock held.
+asynStatus tpx3servalDriver::startSwitchover()
+{
+    if (tuneState_ != AUTOTUNE_IDLE) {
+        setStringParam(errorMsgIndex_, "Autotune running - set AUTOTUNE to 0 to abort it first");
+        return asynError;
+    }
+    if (lifecycleState_ != LIFECYCLE_READY) {
+        setStringParam(errorMsgIndex_, "Switchover needs a ready Serval - use START");
+        return asynError;
+    }
+
+    epicsMutexLock(mutex_);
+    // The instances alternate between the two ports
+    int configured = httpPortEnable_ ? httpPort_ : SERVAL_DEFAULT_HTTP_PORT;
+    int port = (activeHttpPort_ == standbyHttpPort_) ? configured : standbyHttpPort_;
+    if (port == activeHttpPort_) {
+        setStringParam(errorMsgIndex_, "STANDBY_HTTP_PORT must differ from HTTP_PORT");
+        epicsMutexUnlock(mutex_);
+        return asynError;
+    }
+    char errMsg[MAX_ERROR_LENGTH];
+    if (!validateJvmOptions(errMsg, sizeof(errMsg))) {
+        setError(errMsg);
+        epicsMutexUnlock(mutex_);
+        return asynError;
+    }
+
+    std::vector<std::string> args;
+    buildArgs(args, port);
+    pid_t pid = 0;
+    double spawnUs = 0.0;
+    if (!spawnServal(args, &pid, &spawnUs, errMsg, sizeof(errMsg))) {
+        setError(errMsg);
+        epicsMutexUnlock(mutex_);
+        return asynError;
+    }
+    standbyPid_ = pid;
+    standbyPort_ = port;
+    standbyCommandLine_ = buildCommandString(port);
+    standbyArgs_ = args;
+    standbyStartTime_ = monotonicSeconds();
+    standbyGeneration_++;
+    watchPid(pid, &standbyPidFd_, MONITOR_TAG_STANDBY);
+    armOneShotTimer(switchTimerFd_, readyTimeout_ > 0.0 ? readyTimeout_ : STANDBY_READY_TIMEOUT);
+    switchState_ = SWITCHOVER_STANDBY;
+    setIntegerParam(switchoverStateIndex_, switchState_);
+    setStringParam(standbyProcessIdIndex_, std::to_string(pid).c_str());
+    setDoubleParam(standbyToReadyIndex_, 0.0);
+    char msg[MAX_ERROR_LENGTH];
+    snprintf(msg, sizeof(msg), "--- Standby Serval %d started on port %d ---", pid, port);
+    servalLog_.mark(msg);
+    snprintf(msg, sizeof(msg), "Standby Serval %d starting on port %d", pid, port);
+    setStringParam(errorMsgIndex_, msg);
+    printf("%s:%s: Started standby process %d in %.0f us with command: %s\n",
+           driverName, __FUNCTION__, pid, spawnUs, standbyCommandLine_.c_str());
+    epicsMutexUnlock(mutex_);
+
+    epicsEventSignal(httpEvent_);
+    return asynSuccess;
+}
+
+// Readiness probe of the standby, on the HTTP thread; the first good
+// /dashboard response switches over
+void tpx3servalDriver::probeStandby(int port, unsigned generation)
+{
+    standbyClient_.setEndpoint("localhost", port);
+
+    tpx3HttpResponse dashboard;
+    std::map<std::string, std::string> json;
+    if (!standbyClient_.get("/dashboard", &dashboard) || dashboard.status != 200 ||
+        !tpx3JsonFlatten(dashboard.body, &json)) {
+        return;
+    }
+    standbyClient_.disconnect();
+
+    lock();
+    epicsMutexLock(mutex_);
+    if (switchState_ == SWITCHOVER_STANDBY && standbyGeneration_ == generation) {
+        switchToStandby();
+    }
+    epicsMutexUnlock(mutex_);
+    callParamCallbacks();
+    unlock();
+}
+
+// Make the ready standby the active instance and start retiring the old one.
+// Port lock and mutex_ held.
+void tpx3servalDriver::switchToStandby()
+{
+    double now = monotonicSeconds();
+    int detector = 0;
+    getIntegerParam(detectorConnectedIndex_, &detector);
+
+    // Swap the roles; each pidfd moves with its process
+    retiringPid_ = processId_;
+    retiringPidFd_ = pidFd_;
+    processId_ = standbyPid_;
+    pidFd_ = standbyPidFd_;
+    processCommandLine_ = standbyCommandLine_;
+    runningArgs_ = standbyArgs_;
+    runningHttpPort_ = standbyPort_;
+    activeHttpPort_ = standbyPort_;
+    standbyPid_ = 0;
+    standbyPidFd_ = -1;
+    standbyCommandLine_.clear();
+    retagInEpoll(epollFd_, retiringPidFd_, MONITOR_TAG_RETIRING);
+    retagInEpoll(epollFd_, pidFd_, MONITOR_TAG_CHILD);
+    telemetryPid_ = processId_;
+    gcLog_.setPid(processId_);
+    startGeneration_++;
+
+    // Serval is as good as down from here until the new instance has the
+    // detector the old one lets go of
+    switchTime_ = now;
+    switchWaitDetector_ = (detector != 0 && httpPollPeriod_ > 0.0);
+    switchDetectorSeen_ = false;
+    if (kill(retiringPid_, SIGTERM) == 0) {
+        printf("%s:%s: Sent SIGTERM to retired process %d\n", driverName, __FUNCTION__, retiringPid_);
+    }
+    retiringStage_ = 1;
+    armOneShotTimer(switchTimerFd_, stopTermTimeout_ > 0.0 ? stopTermTimeout_ : 1e-6);
+    switchState_ = SWITCHOVER_RETIRING;
+    setIntegerParam(switchoverStateIndex_, switchState_);
+
+    setDoubleParam(standbyToReadyIndex_, (now - standbyStartTime_) * 1000.0);
+    setStringParam(standbyProcessIdIndex_, "0");
+    setStringParam(processIdIndex_, std::to_string(processId_).c_str());
+    setStringParam(commandLineIndex_, processCommandLine_.c_str());
+    setIntegerParam(activeHttpPortIndex_, activeHttpPort_);
+    setIntegerParam(udpLossIndex_, 0);
+    updatePlacementRbvs(processId_);
+    updateConfigDirty();
+    char msg[MAX_ERROR_LENGTH];
+    snprintf(msg, sizeof(msg), "Switched to Serval %d on port %d, retiring %d", processId_, activeHttpPort_,
+             retiringPid_);
+    setStringParam(errorMsgIndex_, msg);
+    printf("%s:%s: %s\n", driverName, __FUNCTION__, msg);
+}
+
+// End a switchover; failure is NULL once the new instance has taken over.
+// Port lock and mutex_ held.
+void tpx3servalDriver::finishSwitchover(const char *failure)
+{
+    armOneShotTimer(switchTimerFd_, 0.0);
+    if (failure) {
+        setError(failure);
+    } else {
+        double elapsedMs = (monotonicSeconds() - switchTime_) * 1000.0;
+        char msg[MAX_ERROR_LENGTH];
+        snprintf(msg, sizeof(msg), "Switchover complete in %.0f ms", elapsedMs);
+        setDoubleParam(switchoverTimeIndex_, elapsedMs);
+        setStringParam(errorMsgIndex_, msg);
+        printf("%s:%s: %s\n", driverName, __FUNCTION__, msg);
+    }
+    switchState_ = SWITCHOVER_IDLE;
+    setIntegerParam(switchoverStateIndex_, switchState_);
+    setIntegerParam(switchoverIndex_, 0);
+    setStringParam(standbyProcessIdIndex_, "0");
+}
+
+// Kill a standby or retiring instance at once, e.g. on STOP (mutex_ held)
+void tpx3servalDriver::abortSwitchover()
+{
+    if (switchState_ == SWITCHOVER_IDLE) {
+        return;
+    }
+    pid_t pids[2] = { standbyPid_, retiringPid_ };
+    for (int i = 0; i < 2; i++) {
+        if (pids[i] > 0 && kill(pids[i], SIGKILL) == 0) {
+            int status;
+            waitpid(pids[i], &status, 0);
+            printf("%s:%s: Process %d killed\n", driverName, __FUNCTION__, pids[i]);
+        }
+    }
+    unwatchPid(&standbyPidFd_);
+    unwatchPid(&retiringPidFd_);
+    standbyPid_ = 0;
+    standbyCommandLine_.clear();
+    retiringPid_ = 0;
+    retiringStage_ = 0;
+    armOneShotTimer(switchTimerFd_, 0.0);
+    switchState_ = SWITCHOVER_IDLE;
+    setIntegerParam(switchoverStateIndex_, switchState_);
+    setIntegerParam(switchoverIndex_, 0);
+    setStringParam(standbyProcessIdIndex_, "0");
+}
+
+// The standby exited before it could be switched to
+void tpx3servalDriver::handleStandbyEvent()
+{
+    lock();
+    epicsMutexLock(mutex_);
+    if (standbyPid_ > 0) {
+        int status;
+        pid_t result = waitpid(standbyPid_, &status, WNOHANG);
+        if (result == standbyPid_ || (result == -1 && errno == ECHILD)) {
+            char msg[MAX_ERROR_LENGTH];
+            if (result == standbyPid_ && WIFEXITED(status)) {
+                snprintf(msg, sizeof(msg), "Standby Serval exited with code %d; active instance kept",
+                         WEXITSTATUS(status));
+            } else if (result == standbyPid_ && WIFSIGNALED(status)) {
+                snprintf(msg, sizeof(msg), "Standby Serval terminated by signal %d (%s); active instance kept",
+                         WTERMSIG(status), strsignal(WTERMSIG(status)));
+            } else {
+                snprintf(msg, sizeof(msg), "Standby Serval not found; active instance kept");
+            }
+            unwatchPid(&standbyPidFd_);
+            standbyPid_ = 0;
+            standbyCommandLine_.clear();
+            finishSwitchover(msg);
+        }
+    } else {
+        unwatchPid(&standbyPidFd_);
+    }
+    epicsMutexUnlock(mutex_);
+
+    callParamCallbacks();
+    unlock();
+}
+
+// Reap the retired instance; the switchover is complete once the new one has
+// the detector too
+void tpx3servalDriver::handleRetiringEvent()
+{
+    lock();
+    epicsMutexLock(mutex_);
+    if (retiringPid_ > 0) {
+        int status;
+        pid_t result = waitpid(retiringPid_, &status, WNOHANG);
+        if (result == retiringPid_ || (result == -1 && errno == ECHILD)) {
+            printf("%s:%s: Retired process %d exited\n", driverName, __FUNCTION__, retiringPid_);
+            unwatchPid(&retiringPidFd_);
+            retiringPid_ = 0;
+            retiringStage_ = 0;
+            if (!switchWaitDetector_ || switchDetectorSeen_) {
+                finishSwitchover(NULL);
+            } else {
+                armOneShotTimer(switchTimerFd_, readyTimeout_ > 0.0 ? readyTimeout_ : STANDBY_READY_TIMEOUT);
+                switchState_ = SWITCHOVER_ATTACHING;
+                setIntegerParam(switchoverStateIndex_, switchState_);
+                setStringParam(errorMsgIndex_, "Old instance retired, waiting for the detector");
+            }
+        }
+    } else {
+        unwatchPid(&retiringPidFd_);
+    }
+    epicsMutexUnlock(mutex_);
+
+    callParamCallbacks();
+    unlock();
+}
+
+// Switchover timer: the standby or the detector took too long, or the
+// retired instance needs SIGKILL
+void tpx3servalDriver::handleSwitchoverTimer()
+{
+    lock();
+    epicsMutexLock(mutex_);
+    double timeout = readyTimeout_ > 0.0 ? readyTimeout_ : STANDBY_READY_TIMEOUT;
+    char msg[MAX_ERROR_LENGTH];
+    if (switchState_ == SWITCHOVER_STANDBY) {
+        snprintf(msg, sizeof(msg), "Standby Serval not ready after %.1f s; active instance kept", timeout);
+        abortSwitchover();
+        setError(msg);
+    } else if (switchState_ == SWITCHOVER_RETIRING && retiringPid_ > 0) {
+        if (retiringStage_ == 1) {
+            if (kill(retiringPid_, SIGKILL) == 0) {
+                printf("%s:%s: Sent SIGKILL to retired process %d\n", driverName, __FUNCTION__, retiringPid_);
+            }
+            retiringStage_ = 2;
+            armOneShotTimer(switchTimerFd_, stopKillTimeout_ > 0.0 ? stopKillTimeout_ : 1e-6);
+        } else {
+            snprintf(msg, sizeof(msg), "Retired process %d did not exit after SIGKILL", retiringPid_);
+            setError(msg);
+        }
+    } else if (switchState_ == SWITCHOVER_ATTACHING) {
+        snprintf(msg, sizeof(msg), "Switched, but Serval has no detector after %.1f s", timeout);
+        finishSwitchover(msg);
+    }
+    epicsMutexUnlock(mutex_);
+
+    callParamCallbacks();
+    unlock();
+}
+
+// Validate and apply a histogram setting; the histograms restart. Port lock held.
+asynStatus tpx3servalDriver::setHistConfig(const tpx3HistConfig &config)
+{
+    const int quad = TPX3_PREVIEW_QUAD_PIXELS;
+    const char *problem = NULL;
+    if (config.totBinWidth < 1 || config.totBinWidth > TPX3_HIST_TOT_BINS) {
+        problem = "Histogram ToT bin width must be 1-1024";
+    } else if (config.toaBins < 1 || config.toaBins > TPX3_HIST_TOA_MAX_BINS) {
+        problem = "Histogram ToA bins must be 1-4096";
+    } else if (config.toaBinNs < TPX3_TOA_UNIT_NS) {
+        problem = "Histogram ToA bin width must be at least 1.5625 ns";
+    } else if (config.toaOffsetNs < 0.0) {
+        problem = "Histogram ToA offset cannot be negative";
+    } else if (config.tdcEdge != TPX3_TDC1_RISE && config.tdcEdge != TPX3_TDC1_FALL &&
+               config.tdcEdge != TPX3_TDC2_RISE && config.tdcEdge != TPX3_TDC2_FALL) {
+        problem = "Invalid histogram TDC edge";
+    } else if (config.roiX < 0 || config.roiY < 0 || config.roiWidth < 1 || config.roiHeight < 1 ||
+               config.roiX + config.roiWidth > quad || config.roiY + config.roiHeight > quad) {
+        problem = "Histogram ROI must lie within 512x512";
+    }
+    if (problem) {
+        setStringParam(errorMsgIndex_, problem);
+        return asynError;
+    }
+    histConfig_ = config;
+    histogram_.setConfig(histConfig_);
+    setIntegerParam(histTotNBinsIndex_, tpx3HistTotBins(histConfig_));
+    setStringParam(errorMsgIndex_, "Histogram settings updated - histograms restarted");
+    return asynSuccess;
+}
+
+// Merge the workers' tiles and render the preview into the back buffer with no
+// lock held; only the buffer swap and the callbacks need the lock
+void tpx3servalDriver::publishPreview()
+{
+    lock();
+    int layout = previewLayout_;
+    int chip = previewChip_;
+    int binning = previewBinning_;
+    bool live = (previewMode_ == PREVIEW_MODE_LIVE);
+    int back = (previewFront_ + 1) % PREVIEW_NUM_BUFFERS;
+    unlock();
+
+    preview_.merge();
+    int sizeX, sizeY;
+    uint64_t total;
+    uint32_t maxCount;
+    size_t n = preview_.render(layout, chip, binning, live, (int32_t *)&previewImages_[back][0],
+                               &sizeX, &sizeY, &total, &maxCount);
+
+    lock();
+    previewFront_ = back;
+    previewElements_ = n;
+    setIntegerParam(previewSizeXIndex_, sizeX);
+    setIntegerParam(previewSizeYIndex_, sizeY);
+    setDoubleParam(previewCountsIndex_, (double)total);
+    setIntegerParam(previewMaxCountIndex_, (epicsInt32)std::min(maxCount, (uint32_t)0x7FFFFFFF));
+    doCallbacksInt32Array(&previewImages_[back][0], n, previewImageIndex_, 0);
+    callParamCallbacks();
+    unlock();
+}
+
+// Look up a numeric value in a flattened JSON document
+static bool jsonNumber(const std::map<std::string, std::string> &json, const char *key, double *value)
+{
+    std::map<std::string, std::string>::const_iterator it = json.find(key);
+    if (it == json.end()) {
+        return false;
+    }
+    char *end;
+    double v = strtod(it->second.c_str(), &end);
+    if (end == it->second.c_str()) {
+        return false;
+    }
+    *value = v;
+    return true;
+}
+
+static std::string jsonString(const std::map<std::string, std::string> &json, const char *key)
+{
+    std::map<std::string, std::string>::const_iterator it = json.find(key);
+    return (it == json.end() || it->second == "null") ? std::string() : it->second;
+}
+
+// Serval REST API polling thread. Requests run without any lock held; the
+// results are published under the port lock.
+void tpx3servalDriver::httpPoll()
+{
+    while (!httpExit_) {
+        lock();
+        double period = httpPollPeriod_;
+        bool starting = (lifecycleState_ == LIFECYCLE_STARTING && isRunning_);
+        bool ready = (lifecycleState_ == LIFECYCLE_READY);
+        unsigned generation = startGeneration_;
+        int port = activeHttpPort_;
+        bool standby = (switchState_ == SWITCHOVER_STANDBY);
+        unsigned standbyGeneration = standbyGeneration_;
+        int standbyPort = standbyPort_;
+        unlock();
+
+        if (standby) {
+            probeStandby(standbyPort, standbyGeneration);
+        } else if (standbyClient_.connected()) {
+            standbyClient_.disconnect();
+        }
+
+        // The readiness probe runs even when status polling is disabled
+        if (starting || (ready && period > 0.0)) {
+            pollServal(port, generation);
+        } else if (httpClient_.connected() || httpPolls_ != 0) {
+            httpClient_.disconnect();
+            httpPolls_ = 0;
+            lock();
+            clearServalStatus();
+            callParamCallbacks();
+            unlock();
+        }
+
+        // Woken early by START, a period change or shutdown
+        double wait = period > 0.0 ? period : 1.0;
+        if (starting || standby) {
+            wait = READY_PROBE_INTERVAL;
+        }
+        epicsEventWaitWithTimeout(httpEvent_, wait);
+    }
+    httpClient_.disconnect();
+    standbyClient_.disconnect();
+    epicsEventSignal(httpDoneEvent_);
+}
+
+void tpx3servalDriver::httpThreadC(void *pPvt)
+{
+    tpx3servalDriver *pPvt_ = (tpx3servalDriver*)pPvt;
+    pPvt_->httpPoll();
+}
+
+// One poll of /dashboard, plus /detector/health every HTTP_HEALTH_DIVIDER polls.
+// While Starting this is also the readiness probe for the spawn in generation.
+void tpx3servalDriver::pollServal(int port, unsigned generation)
+{
+    httpClient_.setEndpoint("localhost", port);
+
+    tpx3HttpResponse dashboard;
+    std::map<std::string, std::string> json;
+    bool ok = httpClient_.get("/dashboard", &dashboard);
+    bool parsed = ok && dashboard.status == 200 && tpx3JsonFlatten(dashboard.body, &json);
+    // A connected detector is an object, so it flattens to "Detector.*" keys
+    std::map<std::string, std::string>::const_iterator det = json.lower_bound("Detector.");
+    bool detectorConnected = parsed && det != json.end() && det->first.compare(0, 9, "Detector.") == 0;
+
+    tpx3HttpResponse health;
+    std::map<std::string, std::string> healthJson;
+    bool healthParsed = false;
+    if (detectorConnected && httpPolls_ % HTTP_HEALTH_DIVIDER == 0) {
+        healthParsed = httpClient_.get("/detector/health", &health) && health.status == 200 &&
+                       tpx3JsonFlatten(health.body, &healthJson);
+    }
+    httpPolls_++;
+
+    lock();
+    bool probing = (lifecycleState_ == LIFECYCLE_STARTING && startGeneration_ == generation);
+    if (probing) {
+        double elapsedMs = (monotonicSeconds() - lifecycleStartTime_) * 1000.0;
+        if ((ok || httpClient_.connected()) && !listenSeen_) {
+            listenSeen_ = true;
+            setDoubleParam(startToListenIndex_, elapsedMs);
+        }
+        if (parsed) {
+            char msg[MAX_ERROR_LENGTH];
+            snprintf(msg, sizeof(msg), "Serval ready in %.0f ms", elapsedMs);
+            setDoubleParam(startToReadyIndex_, elapsedMs);
+            setLifecycleState(LIFECYCLE_READY);
+            setStringParam(errorMsgIndex_, msg);
+            // An autotune trial goes on from here on the monitor thread
+            if (tuneState_ == AUTOTUNE_STARTING) {
+                armAutotuneTimer(1e-6);
+            }
+        } else if (readyTimeout_ > 0.0 && elapsedMs > readyTimeout_ * 1000.0 && !readyTimeoutReported_) {
+            char msg[MAX_ERROR_LENGTH];
+            snprintf(msg, sizeof(msg), "Serval not ready after %.1f s: %s", readyTimeout_,
+                     dashboard.error.empty() ? "no valid /dashboard response" : dashboard.error.c_str());
+            readyTimeoutReported_ = true;
+            setError(msg);
+        }
+    }
+
+    int requests = 0, errors = 0;
+    getIntegerParam(httpRequestsIndex_, &requests);
+    getIntegerParam(httpErrorsIndex_, &errors);
+    requests++;
+    // Probes failing while the JVM boots are expected, not errors
+    if (!parsed && !probing) {
+        errors++;
+    }
+    if (ok) {
+        setDoubleParam(httpLatencyIndex_, dashboard.latencyMs);
+        recordHttpLatency(dashboard.latencyMs);
+    }
+    if (healthParsed) {
+        requests++;
+        recordHttpLatency(health.latencyMs);
+    }
+    setIntegerParam(httpRequestsIndex_, requests);
+    setIntegerParam(httpErrorsIndex_, errors);
+    setIntegerParam(httpConnectsIndex_, (int)httpClient_.connects());
+
+    if (!parsed) {
+        char msg[MAX_ERROR_LENGTH];
+        if (!ok) {
+            snprintf(msg, sizeof(msg), "Serval not reachable on port %d: %s", port, dashboard.error.c_str());
+        } else if (dashboard.status != 200) {
+            snprintf(msg, sizeof(msg), "Serval /dashboard returned HTTP %d", dashboard.status);
+        } else {
+            snprintf(msg, sizeof(msg), "Serval /dashboard returned invalid JSON");
+        }
+        setIntegerParam(servalConnectedIndex_, 0);
+        if (!probing) {
+            setStringParam(servalErrorIndex_, msg);
+        }
+    } else {
+        double value;
+        setIntegerParam(servalConnectedIndex_, 1);
+        setStringParam(servalVersionIndex_, jsonString(json, "Server.SoftwareVersion"));
+        setIntegerParam(detectorConnectedIndex_, detectorConnected ? 1 : 0);
+        // After a switchover, the new instance has taken over once it has the detector
+        if ((switchState_ == SWITCHOVER_RETIRING || switchState_ == SWITCHOVER_ATTACHING) &&
+            port == activeHttpPort_ && detectorConnected && !switchDetectorSeen_) {
+            switchDetectorSeen_ = true;
+            if (switchState_ == SWITCHOVER_ATTACHING) {
+                epicsMutexLock(mutex_);
+                finishSwitchover(NULL);
+                epicsMutexUnlock(mutex_);
+            }
+        }
+        setStringParam(detectorTypeIndex_, jsonString(json, "Detector.DetectorType"));
+        setStringParam(measStatusIndex_, jsonString(json, "Measurement.Status"));
+        setDoubleParam(measFrameCountIndex_, jsonNumber(json, "Measurement.FrameCount", &value) ? value : 0.0);
+        setDoubleParam(measDroppedFramesIndex_, jsonNumber(json, "Measurement.DroppedFrames", &value) ? value : 0.0);
+        setDoubleParam(measPixelRateIndex_, jsonNumber(json, "Measurement.PixelEventRate", &value) ? value : 0.0);
+        if (tuneState_ == AUTOTUNE_MEASURING) {
+            tunePixelRateSum_ += jsonNumber(json, "Measurement.PixelEventRate", &value) ? value : 0.0;
+            tunePixelRateSamples_++;
+        }
+        setDoubleParam(measTdc1RateIndex_, jsonNumber(json, "Measurement.Tdc1EventRate", &value) ? value : 0.0);
+        setDoubleParam(measElapsedTimeIndex_, jsonNumber(json, "Measurement.ElapsedTime", &value) ? value : 0.0);
+        setDoubleParam(measTimeLeftIndex_, jsonNumber(json, "Measurement.TimeLeft", &value) ? value : 0.0);
+
+        // The most recent server notification is Serval's own error text
+        std::string notification;
+        for (int i = 0; ; i++) {
+            char key[64];
+            snprintf(key, sizeof(key), "Server.Notifications.%d.Message", i);
+            std::map<std::string, std::string>::const_iterator it = json.find(key);
+            if (it == json.end()) {
+                break;
+            }
+            notification = it->second;
+        }
+        setStringParam(servalErrorIndex_, notification);
+
+        if (healthParsed) {
+            setDoubleParam(detectorTempLocalIndex_, jsonNumber(healthJson, "LocalTemperature", &value) ? value : 0.0);
+            setDoubleParam(detectorTempFpgaIndex_, jsonNumber(healthJson, "FPGATemperature", &value) ? value : 0.0);
+            setDoubleParam(detectorHumidityIndex_, jsonNumber(healthJson, "Humidity", &value) ? value : 0.0);
+        }
+    }
+    callParamCallbacks();
+    unlock();
+}
+
+// Add a request to the latency histogram; the port lock must be held
+void tpx3servalDriver::recordHttpLatency(double latencyMs)
+{
+    int bin = 0;
+    double edge = 0.125;
+    while (bin < HTTP_LATENCY_BINS - 1 && latencyMs >= edge) {
+        bin++;
+        edge *= 2.0;
+    }
+    httpLatencyHist_[bin]++;
+    doCallbacksInt32Array(&httpLatencyHist_[0], httpLatencyHist_.size(), httpLatencyHistIndex_, 0);
+}
+
+// Blank the Serval status PVs while Serval is not running
+void tpx3servalDriver::clearServalStatus()
+{
+    setIntegerParam(servalConnectedIndex_, 0);
+    setStringParam(servalVersionIndex_, "");
+    setStringParam(servalErrorIndex_, "");
+    setIntegerParam(detectorConnectedIndex_, 0);
+    setStringParam(detectorTypeIndex_, "");
+    setDoubleParam(detectorTempLocalIndex_, 0.0);
+    setDoubleParam(detectorTempFpgaIndex_, 0.0);
+    setDoubleParam(detectorHumidityIndex_, 0.0);
+    setStringParam(measStatusIndex_, "");
+    setDoubleParam(measFrameCountIndex_, 0.0);
+    setDoubleParam(measDroppedFramesIndex_, 0.0);
+    setDoubleParam(measPixelRateIndex_, 0.0);
+    setDoubleParam(measTdc1RateIndex_, 0.0);
+    setDoubleParam(measElapsedTimeIndex_, 0.0);
+    setDoubleParam(measTimeLeftIndex_, 0.0);
+}
+
+// Map a STAGE_*_PATTERN parameter to its stage, or -1
+int tpx3servalDriver::stagePatternStage(int function) const
+{
+    for (int stage = 0; stage < TPX3_STAGE_OTHER; stage++) {
+        if (stagePatternIndex_[stage] == function) {
+            return stage;
+        }
+    }
+    return -1;
+}
+
+// Map a LOG_*_PATTERN parameter to its kind of line, or -1
+int tpx3servalDriver::logPatternKind(int function) const
+{
+    for (int kind = 0; kind < TPX3_LOG_KINDS; kind++) {
+        if (logPatternIndex_[kind] == function) {
+            return kind;
+        }
+    }
+    return -1;
+}
+
+// Map a pipeline option's value or _ENABLE parameter to its tuner param, or -1
+int tpx3servalDriver::tuneParam(int function) const
+{
+    for (int p = 0; p < TPX3_TUNE_PARAMS; p++) {
+        if (tuneValueIndex_[p] == function || tuneEnableIndex_[p] == function) {
+            return p;
+        }
+    }
+    return -1;
+}
+
+// Map an AUTOTUNE_<option> parameter to its tuner param, or -1
+int tpx3servalDriver::tuneCandidatesParam(int function) const
+{
+    for (int p = 0; p < TPX3_TUNE_PARAMS; p++) {
+        if (autotuneCandidatesIndex_[p] == function) {
+            return p;
+        }
+    }
+    return -1;
+}
+
+// Map a RELAYn_* parameter of the given kind to its slot, or -1
+int tpx3servalDriver::relaySlot(const int indices[TPX3_RELAY_SLOTS], int function) const
+{
+    for (int i = 0; i < TPX3_RELAY_SLOTS; i++) {
+        if (indices[i] == function) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Zero the telemetry PVs while no process is running
+void tpx3servalDriver::clearTelemetry()
+{
+    setDoubleParam(procCpuPercentIndex_, 0.0);
+    setDoubleParam(procRssIndex_, 0.0);
+    setDoubleParam(procVmHwmIndex_, 0.0);
+    setIntegerParam(procThreadsIndex_, 0);
+    setDoubleParam(procVolCtxRateIndex_, 0.0);
+    setDoubleParam(procInvolCtxRateIndex_, 0.0);
+    setDoubleParam(procReadRateIndex_, 0.0);
+    setDoubleParam(procWriteRateIndex_, 0.0);
+    for (int stage = 0; stage < TPX3_NUM_STAGES; stage++) {
+        setDoubleParam(stageCpuIndex_[stage], 0.0);
+        setDoubleParam(stageMaxCpuIndex_[stage], 0.0);
+        setIntegerParam(stageThreadsIndex_[stage], 0);
+    }
+    setStringParam(bottleneckStageIndex_, "None");
+    setDoubleParam(udpInDatagramRateIndex_, 0.0);
+    setDoubleParam(udpInErrorRateIndex_, 0.0);
+    setDoubleParam(udpRcvbufErrorRateIndex_, 0.0);
+    setIntegerParam(udpSocketsIndex_, 0);
+    setDoubleParam(udpSocketDropRateIndex_, 0.0);
+    setDoubleParam(udpRxQueueIndex_, 0.0);
+    setDoubleParam(udpRxQueueMaxIndex_, 0.0);
+}
+
+// Record a lifecycle transition and the time it started
+void tpx3servalDriver::setLifecycleState(int state)
+{
+    if (state == LIFECYCLE_STARTING || state == LIFECYCLE_STOPPING) {
+        lifecycleStartTime_ = monotonicSeconds();
+    }
+    lifecycleState_ = state;
+    setIntegerParam(lifecycleStateIndex_, state);
+    setIntegerParam(readyIndex_, state == LIFECYCLE_READY ? 1 : 0);
+}
+
+// Read back the placement the kernel applied to the child from /proc
+void tpx3servalDriver::updatePlacementRbvs(pid_t pid)
+{
+    std::string cpusAllowed = readProcStatusField(pid, "Cpus_allowed_list");
+    setStringParam(cpuAffinityRbvIndex_, cpusAllowed.c_str());
+
+    // The first mapping's policy in numa_maps is the task policy, e.g. "bind:1"
+    std::string policy;
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/numa_maps", (int)pid);
+    FILE *fp = fopen(path, "r");
+    if (fp) {
+        char line[256];
+        char addr[32], pol[64];
+        if (fgets(line, sizeof(line), fp) && sscanf(line, "%31s %63s", addr, pol) == 2) {
+            policy = pol;
+        }
+        fclose(fp);
+    }
+    setStringParam(numaPolicyRbvIndex_, policy.c_str());
+
+    // Confirm the requested mask actually took effect
+    if (cpuListEnable_) {
+        cpu_set_t requested, applied;
+        if (!parseCpuList(cpuList_, &requested) || !parseCpuList(cpusAllowed, &applied) ||
+            !CPU_EQUAL(&requested, &applied)) {
+            char mismatchMsg[MAX_ERROR_LENGTH];
+            snprintf(mismatchMsg, sizeof(mismatchMsg), "CPU affinity mismatch: requested %s, applied %s",
+                     cpuList_.c_str(), cpusAllowed.c_str());
+            setError(mismatchMsg);
+        }
+    }
+}
+
+// Register a freshly started child with the monitor loop (mutex_ held)
+void tpx3servalDriver::watchChild(pid_t pid)
+{
+    watchPid(pid, &pidFd_, MONITOR_TAG_CHILD);
+}
+
+// Remove the child's pidfd from the monitor loop (mutex_ held)
+void tpx3servalDriver::unwatchChild()
+{
+    unwatchPid(&pidFd_);
+}
+
+// Open a pidfd for pid into *pidFd and add it to the monitor loop under tag
+void tpx3servalDriver::watchPid(pid_t pid, int *pidFd, uint32_t tag)
+{
+    unwatchPid(pidFd);
+    if (!usePidFd_) {
+        // The child may have exited before we got here; let the loop check
+        wakeMonitor();
+        return;
+    }
+
+    *pidFd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (*pidFd < 0) {
+        printf("%s:%s: pidfd_open(%d) failed: %s\n", driverName, __FUNCTION__, pid, strerror(errno));
+        return;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = tag;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, *pidFd, &ev) != 0) {
+        printf("%s:%s: Failed to watch process %d: %s\n", driverName, __FUNCTION__, pid, strerror(errno));
+        close(*pidFd);
+        *pidFd = -1;
+    }
+}
+
+void tpx3servalDriver::unwatchPid(int *pidFd)
+{
+    if (*pidFd >= 0) {
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, *pidFd, NULL);
+        close(*pidFd);
+        *pidFd = -1;
+    }
+}
+
+// Wake the monitor thread out of epoll_wait
+void tpx3servalDriver::wakeMonitor()
+{
+    if (wakeFd_ >= 0) {
+        uint64_t one = 1;
+        ssize_t n = write(wakeFd_, &one, sizeof(one));
+        (void)n;
+    }
+}
+
+// Read int32 array parameter
+asynStatus tpx3servalDriver::readInt32Array(asynUser *pasynUser, epicsInt32 *value,
+                                            size_t nElements, size_t *nIn)
+{
+    int function = pasynUser->reason;
+
+    if (function == httpLatencyHistIndex_) {
+        size_t n = std::min(nElements, httpLatencyHist_.size());
+        memcpy(value, &httpLatencyHist_[0], n * sizeof(epicsInt32));
+        *nIn = n;
+        return asynSuccess;
+    }
+    if (function == gcPauseHistIndex_) {
+        size_t n = std::min(nElements, gcPauseHist_.size());
+        memcpy(value, &gcPauseHist_[0], n * sizeof(epicsInt32));
+        *nIn = n;
+        return asynSuccess;
+    }
+    if (function == histTotIndex_ || function == histToaIndex_) {
+        const std::vector<epicsInt32> &hist = (function == histTotIndex_) ? histTot_ : histToa_;
+        size_t used = (function == histTotIndex_) ? tpx3HistTotBins(histConfig_) : histConfig_.toaBins;
+        size_t n = std::min(nElements, used);
+        memcpy(value, &hist[0], n * sizeof(epicsInt32));
+        *nIn = n;
+        return asynSuccess;
+    }
+    if (function == centSizeHistIndex_) {
+        size_t n = std::min(nElements, centSizeHist_.size());
+        memcpy(value, &centSizeHist_[0], n * sizeof(epicsInt32));
+        *nIn = n;
+        return asynSuccess;
+    }
+    if (function == chipHitRateIndex_ || function == maskNoisyIndex_) {
+        const std::vector<epicsInt32> &array = (function == chipHitRateIndex_) ? chipHitRate_ : maskNoisy_;
+        size_t n = std::min(nElements, array.size());
+        memcpy(value, &array[0], n * sizeof(epicsInt32));
+        *nIn = n;
+        return asynSuccess;
+    }
+    if (function == previewImageIndex_) {
+        size_t n = std::min(nElements, previewElements_);
+        memcpy(value, &previewImages_[previewFront_][0], n * sizeof(epicsInt32));
+        *nIn = n;
+        return asynSuccess;
+    }
+    return asynPortDriver::readInt32Array(pasynUser, value, nElements, nIn);
+}
+
+// Monitor thread C function
+void tpx3servalDriver::monitorThreadC(void *pPvt)
+{
+    tpx3servalDriver *pPvt_ = (tpx3servalDriver*)pPvt;
+    pPvt_->monitorProcess();
+}
+
+// Set error message
+void tpx3servalDriver::setError(const char *errorMsg)
+{
+    setStringParam(errorMsgIndex_, errorMsg);
+    printf("%s:%s: Error: %s\n", driverName, __FUNCTION__, errorMsg);
+}
+
+// Update file path RBV parameter with combined path and filename
+void tpx3servalDriver::updateFileRbvs()
+{
+    // Helper function to combine path and filename
+    auto combinePathAndFile = [](const std::string& path, const std::string& filename) -> std::string {
+        std::string fullPath = path;
+        if (!fullPath.empty() && fullPath.back() != '/' && fullPath.back() != '\\') {
+            fullPath += "/";
+        }
+        fullPath += filename;
+        return fullPath;
+    };
+    
+    // Update JarFile_RBV
+    std::string fullJarPath = combinePathAndFile(jarFilePath_, jarFileName_);
+    setStringParam(jarFileRbvIndex_, fullJarPath.c_str());
+    
+    // Trigger callbacks to update PVs
+    callParamCallbacks();
+}
+
+// Driver instances, one per detector, for lookup and cleanup during IOC shutdown
+static std::vector<tpx3servalDriver*> g_drivers;
+static bool g_cleanup_done = false;
+
+// Export driver
+extern "C" {
+    int tpx3servalConfigure(const char *portName, int maxAddr)
+    {
+        // Each detector gets its own port, PV prefix and Serval child
+        if (getTpx3servalDriver(portName)) {
+            printf("%s:%s: port %s already configured\n", driverName, __FUNCTION__, portName);
+            return asynError;
+        }
+        g_drivers.push_back(new tpx3servalDriver(portName, maxAddr));
+        return asynSuccess;
+    }
+    
+    // Function to get a driver instance by port name; NULL gives the first
+    tpx3servalDriver* getTpx3servalDriver(const char *portName)
+    {
+        for (size_t i = 0; i < g_drivers.size(); i++) {
+            if (!portName || strcmp(g_drivers[i]->portName, portName) == 0) {
+                return g_drivers[i];
+            }
+        }
+        return NULL;
     }
     
     // Function to perform cleanup (prevents double cleanup)
@@ -883,12 +4768,12 @@ extern "C" {
             return;
         }
         
-        if (g_driver) {
-            printf("Performing TPX3 serval driver cleanup...\n");
-            g_driver->cleanupAllProcesses();
-            delete g_driver;
-            g_driver = NULL;
+        for (size_t i = 0; i < g_drivers.size(); i++) {
+            printf("Performing TPX3 serval driver cleanup for %s...\n", g_drivers[i]->portName);
+            g_drivers[i]->cleanupAllProcesses();
+            delete g_drivers[i];
         }
+        g_drivers.clear();
         
         g_cleanup_done = true;
     }
@@ -6,10 +6,81 @@
 #include <epicsEvent.h>
 #include <epicsThread.h>
 #include <string>
+#include <vector>
+#include <atomic>
+
+#include "tpx3ProcStats.h"
+#include "tpx3UdpStats.h"
+#include "tpx3HttpClient.h"
+#include "tpx3Stream.h"
+#include "tpx3Preview.h"
+#include "tpx3Histogram.h"
+#include "tpx3Centroid.h"
+#include "tpx3Trigger.h"
+#include "tpx3PixelMask.h"
+#include "tpx3Relay.h"
+#include "tpx3Spool.h"
+#include "tpx3Autotune.h"
+#include "tpx3ServalLog.h"
+#include "tpx3GcLog.h"
 
-#define MAX_COMMAND_LENGTH 2048
 #define MAX_ERROR_LENGTH 256
-#define NUM_PARAMS 75
+#define NUM_PARAMS 480
+
+// Serval process lifecycle states (LIFECYCLE_STATE PV)
+#define LIFECYCLE_STOPPED  0
+#define LIFECYCLE_STARTING 1
+#define LIFECYCLE_READY    2
+#define LIFECYCLE_STOPPING 3
+
+// JVM garbage collector choices (JVM_GC PV)
+#define JVM_GC_G1         0
+#define JVM_GC_PARALLEL   1
+#define JVM_GC_Z          2
+#define JVM_GC_SHENANDOAH 3
+#define JVM_GC_SERIAL     4
+
+// NUMA memory policy choices (NUMA_POLICY PV)
+#define NUMA_POLICY_PREFERRED  0
+#define NUMA_POLICY_BIND       1
+#define NUMA_POLICY_INTERLEAVE 2
+
+// Hot-standby switchover phases (SWITCHOVER_STATE PV)
+#define SWITCHOVER_IDLE      0
+#define SWITCHOVER_STANDBY   1  // standby instance starting
+#define SWITCHOVER_RETIRING  2  // switched; old instance stopping
+#define SWITCHOVER_ATTACHING 3  // old instance gone; waiting for the detector
+
+// How APPLY brings a stale Serval up to date (APPLY_MODE PV)
+#define APPLY_MODE_RESTART    0
+#define APPLY_MODE_SWITCHOVER 1
+
+// Serval's own default when --httpPort is not given
+#define SERVAL_DEFAULT_HTTP_PORT 8080
+
+// Raw stream sources (STREAM_SOURCE PV)
+#define STREAM_SOURCE_TCP   0
+#define STREAM_SOURCE_FILE  1
+#define STREAM_SOURCE_SPOOL 2
+
+// Preview image (PREVIEW_MODE PV) and its buffer pool
+#define PREVIEW_MODE_ACCUMULATE 0
+#define PREVIEW_MODE_LIVE       1
+#define PREVIEW_NUM_BUFFERS     2
+
+// Histogram accumulation (HIST_MODE PV)
+#define HIST_MODE_ACCUMULATE 0
+#define HIST_MODE_LIVE       1
+
+// Pipeline autotuner phases (AUTOTUNE_STATE PV)
+#define AUTOTUNE_IDLE      0
+#define AUTOTUNE_STARTING  1
+#define AUTOTUNE_WARMUP    2
+#define AUTOTUNE_MEASURING 3
+#define AUTOTUNE_STOPPING  4
+
+// HTTP_LATENCY_HIST: bin 0 is < 0.125 ms, each further bin doubles, the last is open-ended
+#define HTTP_LATENCY_BINS 16
 
 class tpx3servalDriver : public asynPortDriver {
 public:
@@ -18,7 +89,9 @@ public:
 
     // asynPortDriver methods
     virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
+    virtual asynStatus writeFloat64(asynUser *pasynUser, epicsFloat64 value);
     virtual asynStatus writeOctet(asynUser *pasynUser, const char *value, size_t maxChars, size_t *nActual);
+    virtual asynStatus readInt32Array(asynUser *pasynUser, epicsInt32 *value, size_t nElements, size_t *nIn);
 
     // Public cleanup method for external access
     void cleanupAllProcesses();
@@ -73,16 +146,445 @@ private:
     int processIdIndex_;
     int commandLineIndex_;
     int errorMsgIndex_;
+    int lifecycleStateIndex_;
+    int startDurationIndex_;
+    int stopDurationIndex_;
+    int stopTermTimeoutIndex_;
+    int stopKillTimeoutIndex_;
+    int spawnLatencyIndex_;
+    int cpuListIndex_;
+    int cpuListEnableIndex_;
+    int numaNodeIndex_;
+    int numaPolicyIndex_;
+    int numaEnableIndex_;
+    int cpuAffinityRbvIndex_;
+    int numaPolicyRbvIndex_;
+    int jvmXmsIndex_;
+    int jvmXmsEnableIndex_;
+    int jvmXmxIndex_;
+    int jvmXmxEnableIndex_;
+    int jvmMaxDirectMemoryIndex_;
+    int jvmMaxDirectMemoryEnableIndex_;
+    int jvmGcIndex_;
+    int jvmGcEnableIndex_;
+    int jvmLargePagesIndex_;
+    int jvmPreTouchIndex_;
+    int jvmGcLogIndex_;
+    int telemetryPeriodIndex_;
+    int procCpuPercentIndex_;
+    int procRssIndex_;
+    int procVmHwmIndex_;
+    int procThreadsIndex_;
+    int procVolCtxRateIndex_;
+    int procInvolCtxRateIndex_;
+    int procReadRateIndex_;
+    int procWriteRateIndex_;
+    int stageCpuIndex_[TPX3_NUM_STAGES];
+    int stageMaxCpuIndex_[TPX3_NUM_STAGES];
+    int stageThreadsIndex_[TPX3_NUM_STAGES];
+    int stagePatternIndex_[TPX3_NUM_STAGES];
+    int bottleneckStageIndex_;
+    int udpInDatagramRateIndex_;
+    int udpInErrorsIndex_;
+    int udpInErrorRateIndex_;
+    int udpRcvbufErrorsIndex_;
+    int udpRcvbufErrorRateIndex_;
+    int udpSocketsIndex_;
+    int udpSocketDropsIndex_;
+    int udpSocketDropRateIndex_;
+    int udpRxQueueIndex_;
+    int udpRxQueueMaxIndex_;
+    int udpLossIndex_;
+    int udpLossResetIndex_;
+    int httpPollPeriodIndex_;
+    int servalConnectedIndex_;
+    int servalVersionIndex_;
+    int servalErrorIndex_;
+    int detectorConnectedIndex_;
+    int detectorTypeIndex_;
+    int detectorTempLocalIndex_;
+    int detectorTempFpgaIndex_;
+    int detectorHumidityIndex_;
+    int measStatusIndex_;
+    int measFrameCountIndex_;
+    int measDroppedFramesIndex_;
+    int measPixelRateIndex_;
+    int measTdc1RateIndex_;
+    int measElapsedTimeIndex_;
+    int measTimeLeftIndex_;
+    int httpLatencyIndex_;
+    int httpLatencyHistIndex_;
+    int httpLatencyHistResetIndex_;
+    int httpRequestsIndex_;
+    int httpErrorsIndex_;
+    int httpConnectsIndex_;
+    int readyIndex_;
+    int startToListenIndex_;
+    int startToReadyIndex_;
+    int readyTimeoutIndex_;
+    int streamEnableIndex_;
+    int streamSourceIndex_;
+    int streamPortIndex_;
+    int streamFileIndex_;
+    int streamReplayLoopIndex_;
+    int streamReplayRateIndex_;
+    int streamWorkersIndex_;
+    int streamPublishPeriodIndex_;
+    int streamRunningIndex_;
+    int streamConnectedIndex_;
+    int streamSourceDoneIndex_;
+    int streamRateIndex_;
+    int streamChunkRateIndex_;
+    int streamHitRateIndex_;
+    int streamTdcRateIndex_;
+    int streamGlobalTimeRateIndex_;
+    int streamControlRateIndex_;
+    int streamOtherRateIndex_;
+    int streamBytesIndex_;
+    int streamHitsIndex_;
+    int streamTdcsIndex_;
+    int streamFramingErrorsIndex_;
+    int streamStallsIndex_;
+    int streamFreeBlocksIndex_;
+    int streamMinFreeBlocksIndex_;
+    int previewEnableIndex_;
+    int previewImageIndex_;
+    int previewSizeXIndex_;
+    int previewSizeYIndex_;
+    int previewLayoutIndex_;
+    int previewChipIndex_;
+    int previewBinningIndex_;
+    int previewDecimationIndex_;
+    int previewModeIndex_;
+    int previewPeriodIndex_;
+    int previewResetIndex_;
+    int previewCountsIndex_;
+    int previewMaxCountIndex_;
+    int histEnableIndex_;
+    int histTotIndex_;
+    int histTotBinWidthIndex_;
+    int histTotNBinsIndex_;
+    int histToaIndex_;
+    int histToaBinNsIndex_;
+    int histToaOffsetNsIndex_;
+    int histToaBinsIndex_;
+    int histTdcEdgeIndex_;
+    int histRoiXIndex_;
+    int histRoiYIndex_;
+    int histRoiWidthIndex_;
+    int histRoiHeightIndex_;
+    int histModeIndex_;
+    int histPeriodIndex_;
+    int histResetIndex_;
+    int histTotCountsIndex_;
+    int histToaCountsIndex_;
+    int histNoTdcIndex_;
+    int centEnableIndex_;
+    int centTimeWindowIndex_;
+    int centSpaceWindowIndex_;
+    int centEventRateIndex_;
+    int centEventsIndex_;
+    int centMeanSizeIndex_;
+    int centSizeHistIndex_;
+    int centResetIndex_;
+    int centOutputEnableIndex_;
+    int centOutputPortIndex_;
+    int centOutputConnectedIndex_;
+    int centOutputSentIndex_;
+    int centOutputDroppedIndex_;
+    int trigEdgeIndex_;
+    int trigExpectedPeriodIndex_;
+    int trigToleranceIndex_;
+    int trigRateIndex_;
+    int trigPeriodMeanIndex_;
+    int trigPeriodMinIndex_;
+    int trigPeriodMaxIndex_;
+    int trigJitterIndex_;
+    int trigPulseWidthIndex_;
+    int trigEdgesIndex_;
+    int trigMissingIndex_;
+    int trigExtraIndex_;
+    int trigOutOfTolIndex_;
+    int trigResetIndex_;
+    int chipHitRateIndex_;
+    int maskAcquireIndex_;
+    int maskAcquireTimeIndex_;
+    int maskSigmaIndex_;
+    int maskNoisyIndex_;
+    int maskNoisyTotalIndex_;
+    int maskNoisyShareIndex_;
+    int maskFileIndex_;
+    int maskBpcBaseIndex_;
+    int maskExportIndex_;
+    int relayEnableIndex_;
+    int relayMaxLagIndex_;
+    int relayPortIndex_[TPX3_RELAY_SLOTS];
+    int relayPolicyIndex_[TPX3_RELAY_SLOTS];
+    int relayConnectedIndex_[TPX3_RELAY_SLOTS];
+    int relayLagIndex_[TPX3_RELAY_SLOTS];
+    int relaySentIndex_[TPX3_RELAY_SLOTS];
+    int relayDroppedIndex_[TPX3_RELAY_SLOTS];
+    int relayDisconnectsIndex_[TPX3_RELAY_SLOTS];
+    int spoolEnableIndex_;
+    int spoolDirIndex_;
+    int spoolSegmentsIndex_;
+    int spoolSegmentMBIndex_;
+    int spoolFillIndex_;
+    int spoolWriteRateIndex_;
+    int spoolOldestAgeIndex_;
+    int spoolWrittenIndex_;
+    int spoolSkippedIndex_;
+    int spoolRangeFromIndex_;
+    int spoolRangeToIndex_;
+    int spoolExportFileIndex_;
+    int spoolExportIndex_;
+    int spoolExportedIndex_;
+    int autotuneIndex_;
+    int autotuneStateIndex_;
+    int autotuneTrialIndex_;
+    int autotuneTrialsIndex_;
+    int autotuneProgressIndex_;
+    int autotuneCandidateIndex_;
+    int autotuneBestIndex_;
+    int autotuneBestPixelRateIndex_;
+    int autotuneBestDropRateIndex_;
+    int autotuneBestCpuIndex_;
+    int autotuneLastPixelRateIndex_;
+    int autotuneLastDropRateIndex_;
+    int autotuneLastCpuIndex_;
+    int autotuneWarmupIndex_;
+    int autotuneDurationIndex_;
+    int autotunePassesIndex_;
+    int autotuneLoadCmdIndex_;
+    int autotuneProfileDirIndex_;
+    int autotuneLoadProfileIndex_;
+    int autotuneCandidatesIndex_[TPX3_TUNE_PARAMS];
+    // The pipeline options' own value and _ENABLE parameters, by tuner param
+    int tuneValueIndex_[TPX3_TUNE_PARAMS];
+    int tuneEnableIndex_[TPX3_TUNE_PARAMS];
+    int switchoverIndex_;
+    int switchoverStateIndex_;
+    int switchoverTimeIndex_;
+    int standbyHttpPortIndex_;
+    int standbyProcessIdIndex_;
+    int standbyToReadyIndex_;
+    int activeHttpPortIndex_;
+    int applyIndex_;
+    int applyModeIndex_;
+    int configDirtyIndex_;
+    int configDiffIndex_;
+    int logCaptureIndex_;
+    int logTailLinesIndex_;
+    int logTailIndex_;
+    int logLinesIndex_;
+    int logLineRateIndex_;
+    int logCountIndex_[TPX3_LOG_KINDS];
+    int logRateIndex_[TPX3_LOG_KINDS];
+    int logLastIndex_[TPX3_LOG_KINDS];
+    int logPatternIndex_[TPX3_LOG_KINDS];
+    int logFileIndex_;
+    int logFileMaxIndex_;
+    int logResetIndex_;
+    int gcPausesIndex_;
+    int gcLastPauseIndex_;
+    int gcMaxPauseIndex_;
+    int gcPausePercentIndex_;
+    int gcPauseHistIndex_;
+    int gcHeapAfterIndex_;
+    int gcHeapSizeIndex_;
+    int gcDropOverlapIndex_;
+    int gcDropOverlapsIndex_;
+    int gcResetIndex_;
 
     // Process management
     pid_t processId_;
     bool isRunning_;
     std::string lastError_;
     std::string processCommandLine_;  // Store the exact command line for precise cleanup
+    std::vector<std::string> runningArgs_;  // argv of the running process, for CONFIG_DIRTY
+    int runningHttpPort_;    // buildArgs() port override it was spawned with
+    int applyMode_;
+    bool applyRestart_;      // APPLY stopped Serval; start it again once it has exited
     epicsMutexId mutex_;
     epicsEventId stopEvent_;
+    epicsEventId monitorDoneEvent_;
     epicsThreadId monitorThreadId_;
 
+    // Event-driven supervision: the monitor thread sleeps in epoll_wait on a
+    // pidfd for the child (or the SIGCHLD eventfd fallback) and a wake eventfd
+    int epollFd_;
+    int wakeFd_;
+    int pidFd_;
+    bool usePidFd_;
+    bool sigchldWatched_;  // wakeFd_ is written on SIGCHLD
+    int timerFd_;
+
+    // Asynchronous start/stop state machine
+    int lifecycleState_;
+    double lifecycleStartTime_;  // CLOCK_MONOTONIC time of the START/STOP request
+    int stopStage_;              // 0 = none, 1 = SIGTERM sent, 2 = SIGKILL sent
+    double stopTermTimeout_;     // seconds from SIGTERM to SIGKILL
+    double stopKillTimeout_;     // seconds from SIGKILL to giving up
+
+    // /proc telemetry, sampled by the monitor thread without mutex_
+    tpx3ProcStats procStats_;
+    tpx3UdpStats udpStats_;
+    int telemetryFd_;
+    double telemetryPeriod_;
+    std::atomic<int> telemetryPid_;
+
+    // Serval's stdout and stderr, drained and parsed by the monitor thread
+    tpx3ServalLog servalLog_;
+    bool logCapture_;       // takes effect on the next spawn
+    int logTailLines_;
+    std::string logFile_;
+    int logFileMaxMB_;
+    std::string logFileError_;  // last one reported in ERROR_MSG
+
+    // Unified GC log of the JVM, read from a FIFO by the monitor thread
+    tpx3GcLog gcLog_;
+    std::vector<epicsInt32> gcPauseHist_;  // guarded by the port lock
+    int gcDropOverlaps_;
+
+    // Serval REST API polling on its own thread; the client is only used there
+    tpx3HttpClient httpClient_;
+    epicsThreadId httpThreadId_;
+    epicsEventId httpEvent_;
+    epicsEventId httpDoneEvent_;
+    std::atomic<bool> httpExit_;
+    double httpPollPeriod_;
+    unsigned long httpPolls_;
+    std::vector<epicsInt32> httpLatencyHist_;  // guarded by the port lock
+
+    // Raw TPX3 stream ingest; rates are computed on the monitor thread's publish tick
+    tpx3StreamEngine stream_;
+    int streamTimerFd_;
+    int streamSource_;
+    int streamPort_;
+    std::string streamFile_;
+    bool streamReplayLoop_;
+    double streamReplayRate_;
+    int streamWorkers_;
+    double streamPublishPeriod_;
+    tpx3StreamStats prevStreamStats_;
+    double prevStreamTime_;
+
+    // Preview image: rendered without the lock into the back buffer of a
+    // fixed pool, then swapped to the front and published under the lock
+    tpx3Preview preview_;
+    std::vector<epicsInt32> previewImages_[PREVIEW_NUM_BUFFERS];
+    int previewFront_;         // guarded by the port lock
+    size_t previewElements_;   // guarded by the port lock
+    bool previewEnabled_;
+    int previewLayout_;
+    int previewChip_;
+    int previewBinning_;
+    int previewMode_;
+    double previewPeriod_;
+    double previewLastPublish_;  // monitor thread only
+
+    // ToT and ToA-TDC histograms; the published arrays are guarded by the port lock
+    tpx3Histogram histogram_;
+    tpx3HistConfig histConfig_;
+    std::vector<epicsInt32> histTot_;
+    std::vector<epicsInt32> histToa_;
+    bool histEnabled_;
+    int histMode_;
+    double histPeriod_;
+    double histLastPublish_;  // monitor thread only
+
+    // Centroiding: counters are published with the stream rates
+    tpx3Centroid centroid_;
+    tpx3CentroidConfig centConfig_;
+    std::vector<epicsInt32> centSizeHist_;  // guarded by the port lock
+    bool centEnabled_;
+    int centOutputPort_;
+    tpx3CentroidStats prevCentStats_;       // monitor thread only
+
+    // Trigger timing: always on, analyzed and published with the stream rates
+    tpx3TriggerMonitor trigger_;
+    tpx3TriggerConfig trigConfig_;
+
+    // Per-chip hit rates and noisy-pixel acquisitions; the arrays and the
+    // acquisition state are guarded by the port lock
+    tpx3PixelMask mask_;
+    std::vector<epicsInt32> chipHitRate_;
+    std::vector<epicsInt32> maskNoisy_;
+    uint64_t prevChipHits_[TPX3_MASK_CHIPS];
+    bool maskAcquiring_;
+    double maskStart_;
+    double maskAcquireTime_;
+    double maskSigma_;
+    std::string maskFile_;
+    std::string maskBpcBase_;
+
+    // Raw stream fan-out; a tap on stream_, so declared after it
+    tpx3StreamRelay relay_;
+    int relayPorts_[TPX3_RELAY_SLOTS];
+    double relayMaxLag_;  // MB
+
+    // On-disk spool of the raw stream, also a tap on stream_; replayed as STREAM_SOURCE=Spool
+    tpx3StreamSpool spool_;
+    std::string spoolDir_;
+    int spoolSegments_;
+    int spoolSegmentMB_;
+    double spoolRangeFrom_;  // s ago, 0 for the oldest
+    double spoolRangeTo_;    // s ago
+    std::string spoolExportFile_;
+    uint64_t prevSpoolWritten_;  // monitor thread only
+
+    // Pipeline autotuner: a trial per candidate profile, driven by the monitor
+    // thread; all of it guarded by the port lock
+    tpx3Autotuner tuner_;
+    int tuneTimerFd_;
+    int tuneState_;
+    bool tuneAborting_;
+    bool tuneWasRunning_;
+    int tuneSavedValues_[TPX3_TUNE_PARAMS];  // restored when a tune is aborted
+    bool tuneSavedEnables_[TPX3_TUNE_PARAMS];
+    std::string tuneCandidates_[TPX3_TUNE_PARAMS];
+    std::string tuneLoadCmd_;
+    std::string tuneProfileDir_;
+    double tuneWarmup_;
+    double tuneDuration_;
+    int tunePasses_;
+    pid_t tuneLoadPid_;      // also its process group
+    bool tuneLoadExited_;    // reaped, but its group may live on
+    double tuneMeasureStart_;
+    double tuneDropsStart_;  // UDP socket drops plus Serval's dropped frames
+    double tuneCpuSum_;
+    int tuneCpuSamples_;
+    double tunePixelRateSum_;
+    int tunePixelRateSamples_;
+
+    // Hot standby: a second Serval is started on the other HTTP port and, once
+    // ready, takes over from the active one, which is then retired. Guarded by
+    // the port lock and mutex_, like the active process.
+    int switchState_;
+    int switchTimerFd_;
+    int standbyHttpPort_;
+    int activeHttpPort_;        // the port the active instance listens on
+    pid_t standbyPid_;
+    int standbyPidFd_;
+    int standbyPort_;
+    std::string standbyCommandLine_;
+    std::vector<std::string> standbyArgs_;
+    unsigned standbyGeneration_;  // bumped on every standby spawn so stale probes are ignored
+    double standbyStartTime_;
+    pid_t retiringPid_;
+    int retiringPidFd_;
+    int retiringStage_;         // as stopStage_
+    double switchTime_;         // CLOCK_MONOTONIC time of the switch
+    bool switchWaitDetector_;   // the old instance had the detector
+    bool switchDetectorSeen_;
+    tpx3HttpClient standbyClient_;  // HTTP thread only
+
+    // Readiness probe: Starting becomes Ready on the first good /dashboard response
+    unsigned startGeneration_;   // bumped on every spawn so stale probes are ignored
+    bool listenSeen_;
+    bool readyTimeoutReported_;
+    double readyTimeout_;
+
     // Configuration
     std::string httpLog_;
     bool httpLogEnable_;
@@ -124,21 +626,114 @@ private:
     std::string jarFilePath_;
     bool jarFileEnable_;
 
+    // CPU/NUMA placement of the Serval JVM
+    std::string cpuList_;
+    bool cpuListEnable_;
+    int numaNode_;
+    int numaPolicy_;
+    bool numaEnable_;
+
+    // JVM performance options (sizes in MB), placed before -jar
+    int jvmXms_;
+    bool jvmXmsEnable_;
+    int jvmXmx_;
+    bool jvmXmxEnable_;
+    int jvmMaxDirectMemory_;
+    bool jvmMaxDirectMemoryEnable_;
+    int jvmGc_;
+    bool jvmGcEnable_;
+    bool jvmLargePages_;
+    bool jvmPreTouch_;
+    bool jvmGcLog_;
+
     // Methods
-    void buildCommandString(char *command, size_t maxLen);
+    void buildArgs(std::vector<std::string> &args, int httpPort = 0);
+    void buildJvmArgs(std::vector<std::string> &args);
+    bool validateJvmOptions(char *errMsg, size_t errLen);
+    std::string buildCommandString(int httpPort = 0);
+    bool spawnServal(const std::vector<std::string> &args, pid_t *pid, double *spawnUs, char *errMsg, size_t errLen);
     asynStatus startProcess();
+    asynStatus applyConfig();
+    void updateConfigDirty();
     asynStatus stopProcess();
     void forceKillAllProcesses();
-    void killAllJavaProcesses();
+    void killOwnProcesses();
     void monitorProcess();
     static void monitorThreadC(void *pPvt);
+    void watchChild(pid_t pid);
+    void unwatchChild();
+    void wakeMonitor();
+    void handleChildEvent();
+    void handleTimerEvent();
+    void armStopTimer(double seconds);
+    void armTelemetryTimer(double period);
+    void handleTelemetryEvent();
+    void clearTelemetry();
+    void publishUdpSample(const tpx3UdpSample &udp);
+    void publishLog();
+    void publishGc(const tpx3UdpSample *udp);
+    void httpPoll();
+    static void httpThreadC(void *pPvt);
+    void pollServal(int port, unsigned generation);
+    void recordHttpLatency(double latencyMs);
+    void clearServalStatus();
+    asynStatus startStream();
+    void stopStream();
+    void armStreamTimer(double period);
+    void handleStreamEvent();
+    void publishPreview();
+    void publishHistograms();
+    asynStatus setHistConfig(const tpx3HistConfig &config);
+    void publishCentroids(const tpx3CentroidStats &cent, double dt);
+    void publishTrigger(const tpx3TriggerStats &trig);
+    void publishChipRates(const uint64_t hits[TPX3_MASK_CHIPS], double dt);
+    void finishMaskAcquisition(double now);
+    asynStatus startCentroidOutput();
+    asynStatus startRelay();
+    void publishRelay();
+    asynStatus startSpool();
+    void publishSpool(const tpx3SpoolStats &spool, double dt);
+    void handleSpoolExportEvent();
+    asynStatus startAutotune();
+    void abortAutotune();
+    void nextAutotuneTrial();
+    void endAutotuneTrial(const tpx3TuneScore &score, const std::string &failure);
+    void finishAutotune(const std::string &failure);
+    void handleAutotuneEvent();
+    void autotuneProcessExited();
+    asynStatus startSwitchover();
+    void probeStandby(int port, unsigned generation);
+    void switchToStandby();
+    void finishSwitchover(const char *failure);
+    void abortSwitchover();
+    void handleStandbyEvent();
+    void handleRetiringEvent();
+    void handleSwitchoverTimer();
+    void watchPid(pid_t pid, int *pidFd, uint32_t tag);
+    void unwatchPid(int *pidFd);
+    void armAutotuneTimer(double seconds);
+    bool spawnAutotuneLoad(std::string *error);
+    bool checkAutotuneLoad(std::string *error);
+    void stopAutotuneLoad();
+    void publishAutotune();
+    int *tuneValue(int param);
+    bool *tuneEnable(int param);
+    void applyTuneProfile(const tpx3TuneProfile &profile);
+    std::string tuneProfilePath() const;
+    int tuneParam(int function) const;
+    int tuneCandidatesParam(int function) const;
+    int relaySlot(const int indices[TPX3_RELAY_SLOTS], int function) const;
+    int stagePatternStage(int function) const;
+    int logPatternKind(int function) const;
+    void setLifecycleState(int state);
+    void updatePlacementRbvs(pid_t pid);
     void updateStatus();
     void setError(const char *errorMsg);
     void updateFileRbvs();
 };
 
-// Function to get driver instance for cleanup
-extern "C" tpx3servalDriver* getTpx3servalDriver();
+// Function to get a driver instance by port name; NULL gives the first
+extern "C" tpx3servalDriver* getTpx3servalDriver(const char *portName);
 
 // Function to perform cleanup (prevents double cleanup)
 extern "C" void performTpx3servalCleanup();